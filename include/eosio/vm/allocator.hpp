@@ -3,6 +3,7 @@
 #include <eosio/vm/constants.hpp>
 #include <eosio/vm/exceptions.hpp>
 
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
@@ -287,34 +288,83 @@ namespace eosio { namespace vm {
          _offset = align_to_page(_offset);
          return _base + _offset;
       }
+      // data_size is the size of read-only data at the start of
+      // the code.  It must be a multiple of the page size.
+      // reserved_size bytes of jit code space are left after the code
+      // for functions that are added later with update_code.
       template<bool IsJit>
-      void end_code(void * code_base) {
+      void end_code(void * code_base, std::size_t data_size = 0, std::size_t reserved_size = 0) {
          assert((char*)code_base >= _base);
          assert((char*)code_base <= (_base+_offset));
+         assert(data_size == align_to_page(data_size));
          _offset = align_to_page(_offset);
          _code_base = (char*)code_base;
          _code_size = _offset - ((char*)code_base - _base);
+         _code_data_size = data_size;
          if constexpr (IsJit) {
             auto & jit_alloc = jit_allocator::instance();
-            void * executable_code = jit_alloc.alloc(_code_size);
+            void * executable_code = jit_alloc.alloc(_code_size + reserved_size);
             int err = mprotect(executable_code, _code_size, PROT_READ | PROT_WRITE);
             EOS_VM_ASSERT(err == 0, wasm_bad_alloc, "mprotect failed");
             std::memcpy(executable_code, _code_base, _code_size);
             is_jit = true;
             _code_base = (char*)executable_code;
+            _code_size = align_to_page(_code_size + reserved_size);
             _offset = (char*)code_base - _base;
          }
          enable_code(IsJit);
       }
 
+      // Installs jit code that was produced earlier, instead of code built
+      // with start_code/end_code.  relocate is called with the new code
+      // while it is still writable.
+      template<typename F>
+      void load_code(const void* code, std::size_t size, std::size_t data_size, F&& relocate) {
+         assert(size == align_to_page(size) && data_size == align_to_page(data_size));
+         auto & jit_alloc = jit_allocator::instance();
+         void * executable_code = jit_alloc.alloc(size);
+         is_jit = true;
+         _code_base = (char*)executable_code;
+         _code_size = size;
+         _code_data_size = data_size;
+         int err = mprotect(executable_code, size, PROT_READ | PROT_WRITE);
+         EOS_VM_ASSERT(err == 0, wasm_bad_alloc, "mprotect failed");
+         std::memcpy(executable_code, code, size);
+         relocate(_code_base);
+         enable_code(true);
+      }
+
       // Sets protection on code pages to allow them to be executed.
       void enable_code(bool is_jit) {
-         mprotect(_code_base, _code_size, is_jit?PROT_EXEC:(PROT_READ|PROT_WRITE));
+         std::lock_guard l{_code_mutex};
+         _code_disabled = false;
+         if (is_jit) {
+            mprotect(_code_base, _code_data_size, PROT_READ);
+            mprotect(_code_base + _code_data_size, _code_size - _code_data_size, PROT_EXEC);
+         } else {
+            mprotect(_code_base, _code_size, PROT_READ|PROT_WRITE);
+         }
       }
       // Make code pages unexecutable
       void disable_code() {
+         std::lock_guard l{_code_mutex};
+         _code_disabled = true;
          mprotect(_code_base, _code_size, PROT_NONE);
       }
+      // Makes the jit code writable while f runs.  This is used to add or
+      // patch code after end_code.  If disable_code is called in the meantime,
+      // it takes effect after f returns.
+      template<typename F>
+      void update_code(F&& f) {
+         std::lock_guard l{_code_mutex};
+         assert(is_jit);
+         int err = mprotect(_code_base + _code_data_size, _code_size - _code_data_size, PROT_READ | PROT_WRITE);
+         EOS_VM_ASSERT(err == 0, wasm_bad_alloc, "mprotect failed");
+         auto restore = scope_guard{[&]() {
+            mprotect(_code_base + _code_data_size, _code_size - _code_data_size, _code_disabled ? PROT_NONE : PROT_EXEC);
+         }};
+         f();
+      }
 
       /* different semantics than free,
        * the memory must be at the end of the most recently allocated block.
@@ -348,7 +398,11 @@ namespace eosio { namespace vm {
       char*  _base;
       char*  _code_base = nullptr;
       size_t _code_size = 0;
+      size_t _code_data_size = 0;
       bool is_jit = false;
+      // Serializes disable_code with update_code
+      std::mutex _code_mutex;
+      bool _code_disabled = false;
    };
 
    template <typename T>
@@ -371,9 +425,75 @@ namespace eosio { namespace vm {
    };
 
    class wasm_allocator {
+    public:
+      // How reset zeroes the linear memory of the previous instance.
+      enum reset_policy_t {
+         // memset every committed page
+         zero_all,
+         // Drop every committed page with madvise.  The kernel zeroes them
+         // again when they are touched, so the cost follows the working set
+         // of each instance, paid as page faults.
+         decommit,
+         // memset the pages that are resident and drop the rest, so that a
+         // small working set stays mapped without faulting again.  Pages
+         // stay resident until more than zero_resident_limit bytes are,
+         // when every page is dropped as with decommit.
+         zero_resident
+      };
+      static constexpr std::size_t zero_resident_limit = 256 * 1024;
+
     private:
       char*   raw       = nullptr;
       int32_t page      = 0;
+      reset_policy_t reset_policy = decommit;
+      std::vector<unsigned char> residency;
+
+      // Zeroes [ptr, ptr + size), which must be writable and page aligned.
+      // Every page above the committed pages is kept zero, so only pages
+      // that have been committed ever need zeroing.
+      void zero_pages(char* ptr, std::size_t size) {
+         if (size == 0) return;
+#ifdef __linux__
+         if (reset_policy == zero_resident) {
+            std::size_t syspagesize = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+            std::size_t n = size / syspagesize;
+            residency.resize(n);
+            if (mincore(ptr, size, residency.data()) == 0) {
+               std::size_t resident_pages = std::count_if(residency.begin(), residency.end(),
+                                                          [](unsigned char r) { return r & 1; });
+               if (resident_pages * syspagesize > zero_resident_limit) {
+                  decommit_pages(ptr, size);
+                  return;
+               }
+               for (std::size_t i = 0; i < n;) {
+                  bool resident = residency[i] & 1;
+                  std::size_t j = i + 1;
+                  while (j < n && (residency[j] & 1) == resident) ++j;
+                  // Pages that are not resident may have been swapped out
+                  if (resident)
+                     memset(ptr + i * syspagesize, 0, (j - i) * syspagesize);
+                  else
+                     decommit_pages(ptr + i * syspagesize, (j - i) * syspagesize);
+                  i = j;
+               }
+               return;
+            }
+         } else if (reset_policy == decommit) {
+            decommit_pages(ptr, size);
+            return;
+         }
+#endif
+         memset(ptr, 0, size);
+      }
+
+      static void decommit_pages(char* ptr, std::size_t size) {
+#ifdef __linux__
+         // Private anonymous pages read as zero after MADV_DONTNEED
+         if (madvise(ptr, size, MADV_DONTNEED) == 0)
+            return;
+#endif
+         memset(ptr, 0, size);
+      }
 
     public:
       template <typename T>
@@ -381,10 +501,9 @@ namespace eosio { namespace vm {
          if (size == 0) return;
          EOS_VM_ASSERT(page != -1, wasm_bad_alloc, "require memory to allocate");
          EOS_VM_ASSERT(size <= max_pages - page, wasm_bad_alloc, "exceeded max number of pages");
+         // The pages are already zero
          int err = mprotect(raw + (page_size * page), (page_size * size), PROT_READ | PROT_WRITE);
          EOS_VM_ASSERT(err == 0, wasm_bad_alloc, "mprotect failed");
-         T* ptr    = (T*)(raw + (page_size * page));
-         memset(ptr, 0, page_size * size);
          page += size;
       }
       template <typename T>
@@ -393,6 +512,7 @@ namespace eosio { namespace vm {
          EOS_VM_ASSERT(page != -1, wasm_bad_alloc, "require memory to deallocate");
          EOS_VM_ASSERT(size <= page, wasm_bad_alloc, "freed too many pages");
          page -= size;
+         zero_pages(raw + (page_size * page), page_size * size);
          int err = mprotect(raw + (page_size * page), (page_size * size), PROT_NONE);
          EOS_VM_ASSERT(err == 0, wasm_bad_alloc, "mprotect failed");
       }
@@ -400,7 +520,7 @@ namespace eosio { namespace vm {
          std::size_t syspagesize = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
          munmap(raw - syspagesize, max_memory + 2*syspagesize);
       }
-      wasm_allocator() {
+      explicit wasm_allocator(reset_policy_t policy = decommit) : reset_policy(policy) {
          std::size_t syspagesize = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
          raw  = (char*)mmap(NULL, max_memory + 2*syspagesize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
          EOS_VM_ASSERT( raw != MAP_FAILED, wasm_bad_alloc, "mmap failed to alloca pages" );
@@ -411,7 +531,7 @@ namespace eosio { namespace vm {
       }
       void reset(uint32_t new_pages) {
          if (page != -1) {
-            memset(raw, '\0', page_size * page); // zero the memory
+            zero_pages(raw, page_size * page); // zero the memory
          } else {
             std::size_t syspagesize = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
             int err = mprotect(raw - syspagesize, syspagesize, PROT_READ);
@@ -428,12 +548,14 @@ namespace eosio { namespace vm {
       void reset() {
          if (page != -1) {
             std::size_t syspagesize = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
-            memset(raw, '\0', page_size * page); // zero the memory
+            zero_pages(raw, page_size * page); // zero the memory
             int err = mprotect(raw - syspagesize, page_size * page + syspagesize, PROT_NONE);
             EOS_VM_ASSERT(err == 0, wasm_bad_alloc, "mprotect failed");
          }
          page = -1;
       }
+      void set_reset_policy(reset_policy_t policy) { reset_policy = policy; }
+      reset_policy_t get_reset_policy() const { return reset_policy; }
       template <typename T>
       inline T* get_base_ptr() const {
          return reinterpret_cast<T*>(raw);
@@ -6,7 +6,11 @@
 #include <eosio/vm/debug_visitor.hpp>
 #include <eosio/vm/execution_context.hpp>
 #include <eosio/vm/interpret_visitor.hpp>
+#include <eosio/vm/mapped_file.hpp>
 #include <eosio/vm/parser.hpp>
+#include <eosio/vm/register_bitcode_writer.hpp>
+#include <eosio/vm/register_execution_context.hpp>
+#include <eosio/vm/tiered_execution_context.hpp>
 #include <eosio/vm/types.hpp>
 #include <eosio/vm/x86_64.hpp>
 
@@ -14,9 +18,11 @@
 #include <exception>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <optional>
 #include <string_view>
 #include <system_error>
+#include <type_traits>
 #include <vector>
 
 namespace eosio { namespace vm {
@@ -27,6 +33,7 @@ namespace eosio { namespace vm {
       template<typename Host>
       using parser = binary_parser<machine_code_writer<jit_execution_context<Host>>>;
       static constexpr bool is_jit = true;
+      static constexpr bool is_tiered = false;
    };
 
    struct interpreter {
@@ -35,6 +42,28 @@ namespace eosio { namespace vm {
       template<typename Host>
       using parser = binary_parser<bitcode_writer>;
       static constexpr bool is_jit = false;
+      static constexpr bool is_tiered = false;
+   };
+
+   // Interprets register bitcode, which needs fewer instructions than the
+   // stack bitcode of the interpreter
+   struct register_interpreter {
+      template<typename Host>
+      using context = register_execution_context<Host>;
+      template<typename Host>
+      using parser = binary_parser<register_bitcode_writer>;
+      static constexpr bool is_jit = false;
+      static constexpr bool is_tiered = false;
+   };
+
+   // Starts in the interpreter and switches to the jit once the module is hot
+   struct tiered {
+      template<typename Host>
+      using context = tiered_execution_context<Host>;
+      template<typename Host>
+      using parser = binary_parser<bitcode_writer>;
+      static constexpr bool is_jit = false;
+      static constexpr bool is_tiered = true;
    };
 
    template <typename Host, typename Impl = interpreter>
@@ -43,18 +72,51 @@ namespace eosio { namespace vm {
       using host_t = Host;
 
       template <typename HostFunctions = nullptr_t>
-      backend(wasm_code& code, HostFunctions = nullptr) : _ctx(typename Impl::template parser<Host>{ _mod.allocator }.parse_module(code, _mod)) {
+      backend(wasm_code& code, HostFunctions = nullptr, const compile_options& options = {})
+         : _ctx(typename Impl::template parser<Host>{ _mod.allocator, options }.parse_module(code, _mod)) {
+         if constexpr (Impl::is_tiered)
+            _ctx.set_source(code.data(), code.size(), options);
 	 if constexpr (!std::is_same_v<HostFunctions, nullptr_t>)
             HostFunctions::resolve(_mod);
 	 _mod.finalize();
       }
       template <typename HostFunctions = nullptr_t>
-      backend(wasm_code_ptr& ptr, size_t sz, HostFunctions = nullptr) : _ctx(typename Impl::template parser<Host>{ _mod.allocator }.parse_module2(ptr, sz, _mod)) {
+      backend(wasm_code_ptr& ptr, size_t sz, HostFunctions = nullptr, const compile_options& options = {})
+         : _ctx(typename Impl::template parser<Host>{ _mod.allocator, options }.parse_module2(ptr, sz, _mod)) {
+         // The parser leaves ptr at the end of the module
+         if constexpr (Impl::is_tiered)
+            _ctx.set_source(ptr.raw() - sz, sz, options);
 	 if constexpr (!std::is_same_v<HostFunctions, nullptr_t>)
             HostFunctions::resolve(_mod);
 	 _mod.finalize();
       }
 
+      // Loads a module mapped by map_wasm.  Data segments refer to the
+      // mapping instead of being copied, and the module keeps it alive.  See
+      // mapped_file for what must not happen to the file meanwhile.
+      template <typename HostFunctions = nullptr_t>
+      backend(std::shared_ptr<const mapped_file> file, HostFunctions = nullptr, const compile_options& options = {})
+         : _ctx(parse_mapped(file, options)) {
+         if constexpr (Impl::is_tiered)
+            _ctx.set_source(file->data(), file->size(), options);
+         if constexpr (!std::is_same_v<HostFunctions, nullptr_t>)
+            HostFunctions::resolve(_mod);
+         _mod.finalize();
+      }
+
+      // Compiles the module while it is being read.  read(buffer, size) stores
+      // up to size bytes of the module in buffer and returns how many it
+      // stored, or 0 at the end of the module.
+      template <typename Read, typename HostFunctions = nullptr_t,
+                typename = std::enable_if_t<std::is_invocable_r_v<std::size_t, Read&, uint8_t*, std::size_t>>>
+      backend(Read&& read, HostFunctions = nullptr, const compile_options& options = {})
+         : _ctx(parse_stream(read, options)) {
+         static_assert(!Impl::is_tiered, "the tiered backend needs the whole module to compile it again later");
+         if constexpr (!std::is_same_v<HostFunctions, nullptr_t>)
+            HostFunctions::resolve(_mod);
+         _mod.finalize();
+      }
+
       template <typename... Args>
       inline bool operator()(Host* host, const std::string_view& mod, const std::string_view& func, Args... args) {
          return call(host, mod, func, args...);
@@ -155,12 +217,16 @@ namespace eosio { namespace vm {
          auto reenable_code = scope_guard{[&](){
             if (_timed_out) {
                _mod.allocator.enable_code(Impl::is_jit);
+               if constexpr (Impl::is_tiered)
+                  _ctx.enable_jit_code();
             }
          }};
          try {
             auto wd_guard = wd.scoped_run([this,&_timed_out]() {
                _timed_out = true;
                _mod.allocator.disable_code();
+               if constexpr (Impl::is_tiered)
+                  _ctx.disable_jit_code();
             });
             static_cast<F&&>(f)();
          } catch(wasm_memory_exception&) {
@@ -214,7 +280,33 @@ namespace eosio { namespace vm {
          return wasm;
       }
 
+      static std::shared_ptr<const mapped_file> map_wasm(const std::string& fname) {
+         return std::make_shared<const mapped_file>(fname);
+      }
+
     private:
+      module& parse_mapped(const std::shared_ptr<const mapped_file>& file, compile_options options) {
+         _mod.source = file;
+         options.reference_source = true;
+         // The parser only reads through the pointer
+         wasm_code_ptr code(const_cast<uint8_t*>(file->data()), file->size());
+         module*       result = nullptr;
+         read_mapped_file([&]() {
+            result = &typename Impl::template parser<Host>{ _mod.allocator, options }.parse_module2(code, file->size(), _mod);
+         });
+         return *result;
+      }
+
+      template <typename Read>
+      module& parse_stream(Read& read, const compile_options& options) {
+         typename Impl::template parser<Host> parser{ _mod.allocator, options };
+         parser.begin_stream(_mod);
+         std::vector<uint8_t> buffer(64 * 1024);
+         while (std::size_t n = read(buffer.data(), buffer.size()))
+            parser.parse_chunk(buffer.data(), n);
+         return parser.end_stream();
+      }
+
       wasm_allocator*         _walloc = nullptr; // non owning pointer
       module                  _mod;
       typename Impl::template context<Host> _ctx;
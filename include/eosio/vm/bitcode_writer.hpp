@@ -2,20 +2,64 @@
 
 #include <eosio/vm/allocator.hpp>
 #include <eosio/vm/opcodes.hpp>
+#include <eosio/vm/superinstructions.hpp>
 #include <eosio/vm/types.hpp>
 #include <eosio/vm/vector.hpp>
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <memory>
 #include <type_traits>
+#include <vector>
 
 namespace eosio { namespace vm {
 
+   // Writes the interpreter's bitcode: each instruction is its opcode byte
+   // followed by only the immediates that it uses.  Branch targets are byte
+   // offsets from the start of the first function.
+   //
+   // Common sequences of instructions are replaced by superinstructions.
+   // When an instruction completes a sequence, the instructions already
+   // written for the start of it are overwritten.
    class bitcode_writer {
 
+      // Returns the location of the instruction's immediates
       template<class I>
-      decltype(auto) append_instr(I&& instr) {
-         return (fb[op_index++] = instr).template get<std::decay_t<I>>();
+      uint8_t* append_instr(const I& instr) {
+         EOS_VM_ASSERT(op_index + 1 + sizeof(I) <= fb.size(), wasm_parse_exception, "bitcode buffer overflow");
+         uint8_t* pos = fb.raw() + op_index;
+         *pos = I::opcode;
+         push_recent(op_index, I::opcode);
+         op_index = instr.pack(pos + 1) - fb.raw();
+         return pos + 1;
+      }
+
+      // True if superinstruction I may be used and the last instructions
+      // written were ops, oldest first.
+      template<class I, typename... Ops>
+      bool can_fuse(Ops... ops) const {
+         constexpr uint32_t n = sizeof...(Ops);
+         if (!_superinstructions.contains(I::opcode) || _num_recent < n)
+            return false;
+         const uint8_t expected[] = { static_cast<uint8_t>(ops)... };
+         return std::equal(expected, expected + n, _recent + _num_recent - n,
+                           [](uint8_t op, const recent_instr& instr) { return op == instr.opcode; });
+      }
+      // Decodes the ith most recent instruction, starting from 0
+      template<class I>
+      I recent(uint32_t i) {
+         I result;
+         result.unpack(fb.raw() + _recent[_num_recent - 1 - i].pos + 1);
+         return result;
+      }
+      // Overwrites the last n instructions with instr
+      template<class I>
+      uint8_t* replace_recent(uint32_t n, const I& instr) {
+         _num_recent -= n;
+         op_index = _recent[_num_recent].pos;
+         return append_instr(instr);
       }
 
     public:
@@ -24,33 +68,92 @@ namespace eosio { namespace vm {
          _code_segment_base(alloc.start_code()),
          fb(alloc, source_bytes),
          _mod(&mod) {}
-      ~bitcode_writer() { _allocator.end_code<false>(_code_segment_base); }
-      void emit_unreachable() { fb[op_index++] = unreachable_t{}; };
-      void emit_nop() { fb[op_index++] = nop_t{}; }
-      uint32_t emit_end() { return op_index; }
-      uint32_t* emit_return(uint32_t depth_change) {
+      ~bitcode_writer() {
+         if (!_worker_allocator)
+            _allocator.end_code<false>(_code_segment_base);
+      }
+
+      // Parallel compilation: a worker compiles one function at a time into
+      // its own allocator with branch targets relative to the function.
+      // link_function copies it into the code segment and rebases the targets.
+      struct compiled_function {
+         std::vector<uint8_t> code;
+         std::vector<std::size_t> branches; // byte offsets of branch targets
+      };
+      bitcode_writer make_worker() const { return bitcode_writer(*this, worker_tag{}); }
+      // Every function is always compiled up front
+      static constexpr bool supports_lazy_compile = false;
+      // The bitcode refers to the module's own memory and cannot be cached
+      static constexpr bool supports_code_cache = false;
+      static constexpr bool supports_superinstructions = true;
+      static constexpr bool tracks_operand_depth = false;
+      void set_superinstructions(const superinstruction_set& ops) { _superinstructions = ops; }
+      // Called on a worker after emit_epilogue instead of finalize.
+      compiled_function release_function() {
+         _compiled.code.assign(fb.raw(), fb.raw() + op_index);
+         return std::move(_compiled);
+      }
+      // Functions must be linked in order.
+      void link_function(compiled_function& func, function_body& body, uint32_t /*idx*/) {
+         uint8_t* dest = _allocator.alloc<uint8_t>(func.code.size());
+         std::copy_n(func.code.data(), func.code.size(), dest);
+         for (std::size_t offset : func.branches) {
+            uint32_t target;
+            std::memcpy(&target, dest + offset, sizeof(target));
+            target += _base_offset;
+            std::memcpy(dest + offset, &target, sizeof(target));
+         }
+         body.code = dest;
+         body.size = func.code.size();
+         _base_offset += body.size;
+      }
+
+      void emit_unreachable() { append_instr(unreachable_t{}); };
+      void emit_nop() { append_instr(nop_t{}); }
+      uint32_t emit_end() {
+         clear_recent();
+         return op_index;
+      }
+      uint8_t* emit_return(uint32_t depth_change) {
          return emit_br(depth_change);
       }
       void emit_block() {}
-      uint32_t emit_loop() { return op_index; }
-      uint32_t* emit_if() { 
-         if_t& instr = append_instr(if_t{});
-         return &instr.pc;
-      }
-      uint32_t * emit_else(uint32_t * if_loc) {
-         auto& else_ = append_instr(else_t{});
-         *if_loc = _base_offset + op_index;
-         return &else_.pc;
+      uint32_t emit_loop() {
+         clear_recent();
+         return op_index;
       }
-      uint32_t * emit_br(uint32_t depth_change) {
-         auto& instr = append_instr(br_t{});
-         instr.data = depth_change;
-         return &instr.pc;
+      uint8_t* emit_if() { return append_instr(if_t{}); }
+      uint8_t* emit_else(uint8_t* if_loc) {
+         uint8_t* result = append_instr(else_t{});
+         fix_branch(if_loc, op_index);
+         clear_recent();
+         return result;
       }
-      uint32_t * emit_br_if(uint32_t depth_change) {
-         auto& instr = append_instr(br_if_t{});
-         instr.data = depth_change;
-         return &instr.pc;
+      // The target follows the depth change
+      uint8_t* emit_br(uint32_t depth_change) { return append_instr(br_t{ depth_change }) + sizeof(uint32_t); }
+      uint8_t* emit_br_if(uint32_t depth_change) {
+         if (can_fuse<local_local_i32_lt_u_br_if_t>(get_local_get_local_t::opcode, i32_lt_u_t::opcode)) {
+            auto locals = recent<get_local_get_local_t>(1);
+            return replace_recent(2, local_local_i32_lt_u_br_if_t{ locals.index, locals.index2, depth_change, 0 }) +
+                   3 * sizeof(uint32_t);
+         }
+         if (can_fuse<local_local_i32_lt_u_br_if_t>(get_local_t::opcode, get_local_t::opcode, i32_lt_u_t::opcode)) {
+            uint32_t lhs = recent<get_local_t>(2).index;
+            uint32_t rhs = recent<get_local_t>(1).index;
+            return replace_recent(3, local_local_i32_lt_u_br_if_t{ lhs, rhs, depth_change, 0 }) + 3 * sizeof(uint32_t);
+         }
+         uint8_t* result;
+         if (fuse_compare_br_if<i32_eqz_t, i32_eqz_br_if_t>(depth_change, result) ||
+             fuse_compare_br_if<i32_eq_t, i32_eq_br_if_t>(depth_change, result) ||
+             fuse_compare_br_if<i32_ne_t, i32_ne_br_if_t>(depth_change, result) ||
+             fuse_compare_br_if<i32_lt_s_t, i32_lt_s_br_if_t>(depth_change, result) ||
+             fuse_compare_br_if<i32_lt_u_t, i32_lt_u_br_if_t>(depth_change, result) ||
+             fuse_compare_br_if<i32_gt_u_t, i32_gt_u_br_if_t>(depth_change, result) ||
+             fuse_compare_br_if<i32_ge_u_t, i32_ge_u_br_if_t>(depth_change, result) ||
+             fuse_compare_br_if<i64_eq_t, i64_eq_br_if_t>(depth_change, result) ||
+             fuse_compare_br_if<i64_ne_t, i64_ne_br_if_t>(depth_change, result))
+            return result;
+         return append_instr(br_if_t{ depth_change }) + sizeof(uint32_t);
       }
 
       struct br_table_parser;
@@ -59,54 +162,91 @@ namespace eosio { namespace vm {
          br_table_parser(bitcode_writer& base, uint32_t table_size) :
             _this{ &base },
             _i{ 0 } {
-            br_table_t& bt = _this->append_instr(br_table_t{});
-            bt.offset = static_cast<uint32_t>(((table_size * sizeof(br_table_t::elem_t))/sizeof(opcode))+2);
-
-            // point the branch table data to after the br_table instruction
-            _br_tab = bt.table = reinterpret_cast<br_table_t::elem_t*>(&_this->fb[_this->op_index]);
-
-            _this->op_index += bt.offset;
-
-            // canary to throw if we have overbounded our allocated memory
-            _this->fb[_this->op_index] = error_t{};
-            bt.size           = table_size;
+            br_table_t bt;
+            bt.size = table_size;
+            // the entries follow the size
+            _br_tab = _this->append_instr(bt) + sizeof(uint32_t);
+            std::size_t table_bytes = (std::size_t{ table_size } + 1) * sizeof(br_table_t::elem_t);
+            EOS_VM_ASSERT(table_bytes <= _this->fb.size() - _this->op_index, wasm_parse_exception,
+                          "bitcode buffer overflow");
+            _this->op_index += table_bytes;
          }
-         uint32_t * emit_case(uint32_t depth_change) {
-            auto& elem = _br_tab[_i++];
-            elem.stack_pop = depth_change;
-            return &elem.pc;
+         uint8_t* emit_case(uint32_t depth_change) {
+            uint8_t* elem = _br_tab + (_i++) * sizeof(br_table_t::elem_t);
+            std::memcpy(elem + offsetof(br_table_t::elem_t, stack_pop), &depth_change, sizeof(depth_change));
+            return elem + offsetof(br_table_t::elem_t, pc);
          }
          // Must be called after all cases
-         uint32_t* emit_default(uint32_t depth_change) {
-            auto result = emit_case(depth_change);
-            EOS_VM_ASSERT(_this->fb[_this->op_index].is_a<error_t>(), wasm_parse_exception, "overwrote br_table data");
-            return result;
-         }
-         br_table_t::elem_t* _br_tab;
+         uint8_t* emit_default(uint32_t depth_change) { return emit_case(depth_change); }
+         uint8_t* _br_tab;
          bitcode_writer * _this;
          std::size_t _i;
          br_table_parser(const br_table_parser&) = delete;
          br_table_parser& operator=(const br_table_parser&) = delete;
       };
       auto emit_br_table(uint32_t table_size) { return br_table_parser{ *this, table_size }; }
-      void emit_call(const func_type& ft, uint32_t funcnum) { fb[op_index++] = call_t{ funcnum }; }
-      void emit_call_indirect(const func_type& ft, uint32_t functypeidx) { fb[op_index++] = call_indirect_t{ functypeidx }; }
+      void emit_call(const func_type& ft, uint32_t funcnum) {
+         if (can_fuse<i32_const_call_t>(i32_const_t::opcode))
+            replace_recent(1, i32_const_call_t{ recent<i32_const_t>(0).data.ui, funcnum });
+         else
+            append_instr(call_t{ funcnum });
+      }
+      void emit_call_indirect(const func_type& ft, uint32_t functypeidx) { append_instr(call_indirect_t{ functypeidx }); }
 
 
-      void emit_drop() { fb[op_index++] = drop_t{}; }
-      void emit_select() { fb[op_index++] = select_t{}; }
-      void emit_get_local(uint32_t localidx) { fb[op_index++] = get_local_t{localidx}; }
-      void emit_set_local(uint32_t localidx) { fb[op_index++] = set_local_t{localidx}; }
-      void emit_tee_local(uint32_t localidx) { fb[op_index++] = tee_local_t{localidx}; }
-      void emit_get_global(uint32_t localidx) { fb[op_index++] = get_global_t{localidx}; }
-      void emit_set_global(uint32_t localidx) { fb[op_index++] = set_global_t{localidx}; }
+      void emit_drop() { append_instr(drop_t{}); }
+      void emit_select() { append_instr(select_t{}); }
+      void emit_get_local(uint32_t localidx) {
+         if (can_fuse<set_local_get_local_t>(set_local_t::opcode))
+            replace_recent(1, set_local_get_local_t{ recent<set_local_t>(0).index, localidx });
+         else if (can_fuse<get_local_get_local_t>(get_local_t::opcode))
+            replace_recent(1, get_local_get_local_t{ recent<get_local_t>(0).index, localidx });
+         else
+            append_instr(get_local_t{localidx});
+      }
+      void emit_set_local(uint32_t localidx) { append_instr(set_local_t{localidx}); }
+      void emit_tee_local(uint32_t localidx) { append_instr(tee_local_t{localidx}); }
+      // Immutable globals can only be initialized by a constant, so reads of them
+      // become constants.  Other globals are accessed through the address of their
+      // value, with the width decided here instead of on every access.
+      void emit_get_global(uint32_t globalidx) {
+         global_variable& gl = _mod->globals[globalidx];
+         if (!gl.type.mutability) {
+            switch (gl.type.content_type) {
+               case types::i32: emit_i32_const(gl.init.value.i32); return;
+               case types::i64: emit_i64_const(gl.init.value.i64); return;
+               case types::f32: append_instr(f32_const_t{ gl.init.value.f32 }); return;
+               case types::f64: append_instr(f64_const_t{ gl.init.value.f64 }); return;
+            }
+         }
+         if (gl.type.content_type == types::i64 || gl.type.content_type == types::f64)
+            append_instr(get_global_i64_t{ &gl.current.value });
+         else
+            append_instr(get_global_i32_t{ &gl.current.value });
+      }
+      void emit_set_global(uint32_t globalidx) {
+         global_variable& gl = _mod->globals[globalidx];
+         if (gl.type.content_type == types::i64 || gl.type.content_type == types::f64)
+            append_instr(set_global_i64_t{ &gl.current.value });
+         else
+            append_instr(set_global_i32_t{ &gl.current.value });
+      }
 
 #define MEM_OP(op_name) \
-      void emit_ ## op_name(uint32_t offset, uint32_t alignment) { fb[op_index++] = op_name ## _t{ offset, alignment }; }
+      void emit_ ## op_name(uint32_t offset, uint32_t alignment) { append_instr(op_name ## _t{ offset, alignment }); }
+// A get_local of the address or stored value becomes part of the instruction
+#define LOCAL_MEM_OP(op_name)                                                                                          \
+      void emit_ ## op_name(uint32_t offset, uint32_t alignment) {                                                     \
+         op_name ## _t op{ offset, alignment };                                                                        \
+         if (can_fuse<local_ ## op_name ## _t>(get_local_t::opcode))                                                   \
+            replace_recent(1, local_ ## op_name ## _t{ recent<get_local_t>(0).index, op.flags_align, op.offset });     \
+         else                                                                                                          \
+            append_instr(op);                                                                                          \
+      }
 #define LOAD_OP MEM_OP
 #define STORE_OP MEM_OP
-      LOAD_OP(i32_load)
-      LOAD_OP(i64_load)
+      LOCAL_MEM_OP(i32_load)
+      LOCAL_MEM_OP(i64_load)
       LOAD_OP(f32_load)
       LOAD_OP(f64_load)
       LOAD_OP(i32_load8_s)
@@ -119,8 +259,8 @@ namespace eosio { namespace vm {
       LOAD_OP(i64_load8_u)
       LOAD_OP(i64_load16_u)
       LOAD_OP(i64_load32_u)
-      STORE_OP(i32_store)
-      STORE_OP(i64_store)
+      LOCAL_MEM_OP(i32_store)
+      LOCAL_MEM_OP(i64_store)
       STORE_OP(f32_store)
       STORE_OP(f64_store)
       STORE_OP(i32_store8)
@@ -130,18 +270,24 @@ namespace eosio { namespace vm {
       STORE_OP(i64_store32)
 #undef LOAD_OP
 #undef STORE_OP
+#undef LOCAL_MEM_OP
 #undef MEM_OP
 
-      void emit_current_memory() { fb[op_index++] = current_memory_t{}; }
-      void emit_grow_memory() { fb[op_index++] = grow_memory_t{}; }
+      void emit_current_memory() { append_instr(current_memory_t{}); }
+      void emit_grow_memory() { append_instr(grow_memory_t{}); }
 
-      void emit_i32_const(uint32_t value) { fb[op_index++] = i32_const_t{ value }; }
-      void emit_i64_const(uint64_t value) { fb[op_index++] = i64_const_t{ value }; }
-      void emit_f32_const(float value) { fb[op_index++] = f32_const_t{ value }; }
-      void emit_f64_const(double value) { fb[op_index++] = f64_const_t{ value }; }
+      void emit_i32_const(uint32_t value) {
+         if (can_fuse<get_local_i32_const_t>(get_local_t::opcode))
+            replace_recent(1, get_local_i32_const_t{ recent<get_local_t>(0).index, value });
+         else
+            append_instr(i32_const_t{ value });
+      }
+      void emit_i64_const(uint64_t value) { append_instr(i64_const_t{ value }); }
+      void emit_f32_const(float value) { append_instr(f32_const_t{ value }); }
+      void emit_f64_const(double value) { append_instr(f64_const_t{ value }); }
 
 #define OP(opname) \
-      void emit_ ## opname() { fb[op_index++] = opname ## _t{}; }
+      void emit_ ## opname() { append_instr(opname ## _t{}); }
 #define UNOP OP
 #define BINOP OP
 
@@ -184,14 +330,25 @@ namespace eosio { namespace vm {
       UNOP(i32_clz)
       UNOP(i32_ctz)
       UNOP(i32_popcnt)
-      BINOP(i32_add)
-      BINOP(i32_sub)
+      void emit_i32_add() {
+         if (!fuse_i32_add_const(false))
+            append_instr(i32_add_t{});
+      }
+      void emit_i32_sub() {
+         if (!fuse_i32_add_const(true))
+            append_instr(i32_sub_t{});
+      }
       BINOP(i32_mul)
       BINOP(i32_div_s)
       BINOP(i32_div_u)
       BINOP(i32_rem_s)
       BINOP(i32_rem_u)
-      BINOP(i32_and)
+      void emit_i32_and() {
+         if (can_fuse<i32_and_const_t>(i32_const_t::opcode))
+            replace_recent(1, i32_and_const_t{ recent<i32_const_t>(0).data.ui });
+         else
+            append_instr(i32_and_t{});
+      }
       BINOP(i32_or)
       BINOP(i32_xor)
       BINOP(i32_shl)
@@ -277,37 +434,113 @@ namespace eosio { namespace vm {
 #undef UNOP
 #undef OP
 
-      void emit_error() { fb[op_index++] = error_t{}; }
+      void emit_error() { append_instr(error_t{}); }
       
-      void fix_branch(uint32_t* branch, uint32_t target) { if(branch) *branch = _base_offset + target; }
+      void fix_branch(uint8_t* branch, uint32_t target) {
+         if(branch) {
+            uint32_t pc = _base_offset + target;
+            std::memcpy(branch, &pc, sizeof(pc));
+            record_branch(branch);
+         }
+      }
       void emit_prologue(const func_type& ft, const guarded_vector<local_entry>&, uint32_t idx) {
          op_index = 0;
+         clear_recent();
+         if (_worker_allocator) {
+            _worker_allocator->reset();
+            _compiled = {};
+         }
          // pre-allocate for the function body code, so we have a big blob of memory to work with during function code parsing
-         fb = guarded_vector<opcode>{_allocator, _mod->code[idx].size };
+         fb = guarded_vector<uint8_t>{_allocator, (_mod->code[idx].size + 2) * max_bytes_per_source_byte };
       }
      void emit_epilogue(const func_type& ft, const guarded_vector<local_entry>& locals, uint32_t idx) {
-         fb.resize(op_index + 1);
          uint32_t locals_count = 0;
          for(uint32_t i = 0; i < locals.size(); ++i) {
             locals_count += locals[i].count;
          }
-         fb[fb.size() - 1] = return_t{ static_cast<uint32_t>(locals_count + ft.param_types.size()), ft.return_count, 0, 0 };
+         append_instr(return_t{ static_cast<uint32_t>(locals_count + ft.param_types.size()), ft.return_count, 0, 0 });
       }
 
       void finalize(function_body& body) {
-         fb.resize(op_index + 1);
+         fb.resize(op_index);
          body.code = fb.raw();
-         body.size = op_index + 1;
+         body.size = op_index;
          _base_offset += body.size;
       }
     private:
+      struct worker_tag {};
+      bitcode_writer(const bitcode_writer& parent, worker_tag) :
+         _worker_allocator(std::make_unique<growable_allocator>(0)),
+         _allocator(*_worker_allocator),
+         _code_segment_base(nullptr),
+         fb(*_worker_allocator),
+         _mod(parent._mod),
+         _superinstructions(parent._superinstructions) {}
+
+      // Adding or subtracting a constant becomes one instruction that adds
+      // the constant or its negation.
+      bool fuse_i32_add_const(bool negate) {
+         auto addend = [&](uint32_t value) { return negate ? 0u - value : value; };
+         if (can_fuse<local_i32_add_const_t>(get_local_i32_const_t::opcode)) {
+            auto prev = recent<get_local_i32_const_t>(0);
+            replace_recent(1, local_i32_add_const_t{ prev.index, addend(prev.value) });
+         } else if (can_fuse<local_i32_add_const_t>(get_local_t::opcode, i32_const_t::opcode)) {
+            uint32_t index = recent<get_local_t>(1).index;
+            replace_recent(2, local_i32_add_const_t{ index, addend(recent<i32_const_t>(0).data.ui) });
+         } else if (can_fuse<i32_add_const_t>(i32_const_t::opcode)) {
+            replace_recent(1, i32_add_const_t{ addend(recent<i32_const_t>(0).data.ui) });
+         } else {
+            return false;
+         }
+         return true;
+      }
+
+      // Replaces a comparison followed by br_if.  The target follows the depth change.
+      template<class Compare, class I>
+      bool fuse_compare_br_if(uint32_t depth_change, uint8_t*& target) {
+         if (!can_fuse<I>(Compare::opcode))
+            return false;
+         target = replace_recent(1, I{ depth_change, 0 }) + sizeof(uint32_t);
+         return true;
+      }
+
+      // The instructions written since the last branch target, oldest
+      // first.  Only these can become part of a superinstruction.
+      struct recent_instr {
+         std::size_t pos;
+         uint8_t     opcode;
+      };
+      static constexpr uint32_t max_recent = 3;
+      void push_recent(std::size_t pos, uint8_t opcode) {
+         if (_num_recent == max_recent) {
+            std::copy(_recent + 1, _recent + max_recent, _recent);
+            --_num_recent;
+         }
+         _recent[_num_recent++] = { pos, opcode };
+      }
+      void clear_recent() { _num_recent = 0; }
+
+      void record_branch(uint8_t* branch) {
+         if (_worker_allocator)
+            _compiled.branches.push_back(branch - fb.raw());
+      }
+
+      // A one byte return becomes a br with two four byte immediates, which
+      // is the most that any byte of the function body can expand to.
+      static constexpr std::size_t max_bytes_per_source_byte = 9;
 
+      // Only set for writers created by make_worker
+      std::unique_ptr<growable_allocator> _worker_allocator;
+      compiled_function _compiled;
       growable_allocator& _allocator;
       void * _code_segment_base;
       std::size_t op_index = 0;
-      guarded_vector<opcode> fb;
+      guarded_vector<uint8_t> fb;
       module* _mod;
       std::size_t _base_offset = 0;
+      superinstruction_set _superinstructions = superinstruction_set::all();
+      recent_instr _recent[max_recent];
+      uint32_t _num_recent = 0;
    };
 
 }}
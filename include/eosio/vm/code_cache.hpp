@@ -0,0 +1,278 @@
+#pragma once
+
+#include <eosio/vm/allocator.hpp>
+#include <eosio/vm/exceptions.hpp>
+#include <eosio/vm/types.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace eosio { namespace vm {
+
+   // Stores the jit output for a module in a directory, so that a later
+   // process can load it instead of compiling the module again.
+   //
+   // An entry is found by a hash of the wasm and is only used if it holds
+   // exactly the same wasm and was written by the same build of the
+   // program.  The code refers to functions in the program and to the
+   // module's globals by absolute address, so these are recorded as
+   // relocations and patched when the entry is loaded.
+   //
+   // Failures to read or write entries are not errors.  The module is
+   // compiled as if there were no cache.
+   class code_cache {
+    public:
+      struct relocation {
+         enum kind_t : uint32_t {
+            function, // value is the address of a function in the program
+            global    // value is the byte offset of a global's value from the start of module::globals
+         };
+         uint32_t offset; // of the 8 byte address from the start of the code segment
+         kind_t   kind;
+         uint64_t value;
+      };
+
+      // A complete module in the format written to disk
+      struct entry {
+         const unsigned char* code      = nullptr;
+         std::size_t          code_size = 0;
+         // The read-only data at the start of the code
+         std::size_t          data_size     = 0;
+         uint64_t             maximum_stack = 0;
+         const uint64_t*      jit_code_offsets = nullptr;
+         uint32_t             num_functions    = 0;
+         const relocation*    relocations      = nullptr;
+         uint32_t             num_relocations  = 0;
+      };
+
+      // anchor is the address of any function in the code generator.  All
+      // function relocations must be in the same executable or shared
+      // library as anchor.  variant distinguishes code generators that
+      // produce different code for the same wasm.
+      code_cache(std::string dir, const void* anchor, std::string_view variant) : _dir(std::move(dir)) {
+         Dl_info info;
+         struct stat st;
+         if (!dladdr(anchor, &info) || !info.dli_fname || ::stat(info.dli_fname, &st) != 0)
+            return;
+         _object_base        = info.dli_fbase;
+         _build.object_size  = st.st_size;
+         _build.object_mtime = st.st_mtime;
+         _build.object_inode = st.st_ino;
+         _build.variant_hash = hash(variant.data(), variant.size());
+         _enabled            = !_dir.empty();
+      }
+      ~code_cache() {
+         if (_mapping)
+            ::munmap(_mapping, _mapping_size);
+      }
+      code_cache(const code_cache&) = delete;
+      code_cache& operator=(const code_cache&) = delete;
+
+      bool enabled() const { return _enabled; }
+
+      // Looks up the entry for a wasm module.  The entry stays valid until
+      // the code_cache is destroyed.
+      const entry* find(const void* wasm, std::size_t wasm_size) {
+         if (!_enabled)
+            return nullptr;
+         int fd = ::open(path_for(wasm, wasm_size).c_str(), O_RDONLY | O_CLOEXEC);
+         if (fd < 0)
+            return nullptr;
+         struct stat st;
+         if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            _mapping_size = st.st_size;
+            _mapping      = ::mmap(nullptr, _mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (_mapping == MAP_FAILED)
+               _mapping = nullptr;
+         }
+         ::close(fd);
+         if (!_mapping || !parse(wasm, wasm_size))
+            return nullptr;
+         return &_entry;
+      }
+
+      // Writes an entry for a wasm module, replacing any existing one.
+      void store(const void* wasm, std::size_t wasm_size, const entry& e) {
+         if (!_enabled)
+            return;
+         std::vector<relocation> relocations(e.relocations, e.relocations + e.num_relocations);
+         for (relocation& r : relocations) {
+            if (r.kind == relocation::function) {
+               Dl_info info;
+               if (!dladdr(reinterpret_cast<const void*>(r.value), &info) || info.dli_fbase != _object_base)
+                  return;
+               r.value -= reinterpret_cast<uint64_t>(_object_base);
+            }
+         }
+         header h{};
+         std::memcpy(h.magic, magic, sizeof(h.magic));
+         h.version         = format_version;
+         h.build           = _build;
+         h.wasm_size       = wasm_size;
+         h.code_size       = e.code_size;
+         h.data_size       = e.data_size;
+         h.maximum_stack   = e.maximum_stack;
+         h.num_functions   = e.num_functions;
+         h.num_relocations = e.num_relocations;
+
+         h.checksum        = hash(e.code, e.code_size,
+                                  hash(relocations.data(), relocations.size() * sizeof(relocation),
+                                       hash(e.jit_code_offsets, e.num_functions * sizeof(uint64_t))));
+
+         // The temporary file is unique to this call, so concurrent stores
+         // of the same module, even from one process, do not share it.
+         std::string path = path_for(wasm, wasm_size);
+         std::string tmp  = path + ".XXXXXX";
+         int         fd   = ::mkstemp(tmp.data());
+         if (fd < 0)
+            return;
+         std::FILE* f = ::fdopen(fd, "wb");
+         if (!f) {
+            ::close(fd);
+            std::remove(tmp.c_str());
+            return;
+         }
+         const uint64_t zero = 0;
+         bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1 && std::fwrite(wasm, 1, wasm_size, f) == wasm_size &&
+                   std::fwrite(&zero, 1, padding(wasm_size), f) == padding(wasm_size) &&
+                   std::fwrite(e.jit_code_offsets, sizeof(uint64_t), e.num_functions, f) == e.num_functions &&
+                   std::fwrite(relocations.data(), sizeof(relocation), relocations.size(), f) == relocations.size() &&
+                   std::fwrite(e.code, 1, e.code_size, f) == e.code_size;
+         ok = ok && std::fflush(f) == 0 && ::fsync(fd) == 0;
+         ok = (std::fclose(f) == 0) && ok;
+         // Readers never see a partial file
+         if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0)
+            std::remove(tmp.c_str());
+      }
+
+      // Copies the code of an entry into executable memory for a module
+      // that has been parsed from the same wasm, up to the code section.
+      void install(const entry& e, module& mod) const {
+         EOS_VM_ASSERT(e.num_functions == mod.code.size(), wasm_parse_exception, "code cache does not match the module");
+         mod.allocator.load_code(e.code, e.code_size, e.data_size, [&](char* base) {
+            for (uint32_t i = 0; i < e.num_relocations; ++i) {
+               const relocation& r = e.relocations[i];
+               uint64_t value = r.value;
+               if (r.kind == relocation::function)
+                  value += reinterpret_cast<uint64_t>(_object_base);
+               else
+                  value += reinterpret_cast<uint64_t>(mod.globals.raw());
+               std::memcpy(base + r.offset, &value, sizeof(value));
+            }
+         });
+         for (uint32_t i = 0; i < e.num_functions; ++i)
+            mod.code[i].jit_code_offset = e.jit_code_offsets[i];
+         mod.maximum_stack = e.maximum_stack;
+      }
+
+    private:
+      static constexpr char     magic[8]       = { 'e', 'o', 's', 'v', 'm', 'j', 'i', 't' };
+      static constexpr uint32_t format_version = 2;
+
+      struct build_id {
+         uint64_t object_size  = 0;
+         uint64_t object_mtime = 0;
+         uint64_t object_inode = 0;
+         uint64_t variant_hash = 0;
+         bool     operator==(const build_id& other) const {
+            return object_size == other.object_size && object_mtime == other.object_mtime &&
+                   object_inode == other.object_inode && variant_hash == other.variant_hash;
+         }
+      };
+
+      // Followed by the wasm padded to 8 bytes, the function offsets, the relocations and the code
+      struct header {
+         char     magic[8];
+         uint32_t version;
+         build_id build;
+         uint64_t wasm_size;
+         uint64_t code_size;
+         uint64_t data_size;
+         uint64_t maximum_stack;
+         uint32_t num_functions;
+         uint32_t num_relocations;
+         // Of the function offsets, the relocations and the code
+         uint64_t checksum;
+      };
+
+      // FNV-1a.  It spreads out the file names and detects damaged
+      // entries.  Entries are still checked against the whole wasm.
+      static uint64_t hash(const void* data, std::size_t size, uint64_t h = 14695981039346656037ull) {
+         auto* p = static_cast<const unsigned char*>(data);
+         for (std::size_t i = 0; i < size; ++i)
+            h = (h ^ p[i]) * 1099511628211ull;
+         return h;
+      }
+
+      static std::size_t padding(std::size_t size) { return (8 - size % 8) % 8; }
+
+      std::string path_for(const void* wasm, std::size_t wasm_size) const {
+         char name[24];
+         std::snprintf(name, sizeof(name), "%016llx.jit",
+                       static_cast<unsigned long long>(hash(wasm, wasm_size, _build.variant_hash)));
+         return _dir + "/" + name;
+      }
+
+      bool parse(const void* wasm, std::size_t wasm_size) {
+         auto*       data = static_cast<const unsigned char*>(_mapping);
+         std::size_t size = _mapping_size;
+         header      h;
+         if (size < sizeof(h))
+            return false;
+         std::memcpy(&h, data, sizeof(h));
+         if (std::memcmp(h.magic, magic, sizeof(magic)) != 0 || h.version != format_version || !(h.build == _build))
+            return false;
+         if (h.wasm_size != wasm_size || growable_allocator::align_to_page(h.code_size) != h.code_size ||
+             growable_allocator::align_to_page(h.data_size) != h.data_size || h.data_size > h.code_size)
+            return false;
+         std::size_t expected = sizeof(h) + wasm_size + padding(wasm_size) + h.num_functions * sizeof(uint64_t) +
+                                h.num_relocations * sizeof(relocation) + h.code_size;
+         if (expected != size || std::memcmp(data + sizeof(h), wasm, wasm_size) != 0)
+            return false;
+
+         const unsigned char* pos = data + sizeof(h) + wasm_size + padding(wasm_size);
+         // The code is run as it is, so anything that the header does not
+         // describe must be detected here.
+         if (hash(pos, data + size - pos) != h.checksum)
+            return false;
+         _entry.jit_code_offsets  = reinterpret_cast<const uint64_t*>(pos);
+         _entry.num_functions     = h.num_functions;
+         pos += h.num_functions * sizeof(uint64_t);
+         _entry.relocations     = reinterpret_cast<const relocation*>(pos);
+         _entry.num_relocations = h.num_relocations;
+         pos += h.num_relocations * sizeof(relocation);
+         _entry.code          = pos;
+         _entry.code_size     = h.code_size;
+         _entry.data_size     = h.data_size;
+         _entry.maximum_stack = h.maximum_stack;
+
+         for (uint32_t i = 0; i < h.num_functions; ++i)
+            if (_entry.jit_code_offsets[i] >= h.code_size)
+               return false;
+         for (uint32_t i = 0; i < h.num_relocations; ++i)
+            if (_entry.relocations[i].offset + sizeof(uint64_t) > h.code_size)
+               return false;
+         return true;
+      }
+
+      std::string _dir;
+      bool        _enabled     = false;
+      const void* _object_base = nullptr;
+      build_id    _build;
+      void*       _mapping      = nullptr;
+      std::size_t _mapping_size = 0;
+      entry       _entry;
+   };
+}} // namespace eosio::vm
@@ -2,14 +2,17 @@
 
 #include <eosio/vm/interpret_visitor.hpp>
 #include <eosio/vm/opcodes.hpp>
+#include <eosio/vm/superinstructions.hpp>
 
 #include <iostream>
 
 #define DBG_VISIT(name, code)                                                                                          \
    void operator()(EOS_VM_OPCODE_T(name)& op) {                                                                        \
-      std::cout << "Found " << #name << " at " << get_context().get_pc() << "\n";                                      \
-      interpret_visitor<ExecutionCTX>::operator()(op);                                                                 \
+      std::cout << "Found " << #name << "\n";                                                                          \
+      /* The stack before the instruction runs.  Only then is the context's copy up to date. */                        \
+      this->store_state();                                                                                             \
       get_context().print_stack();                                                                                     \
+      interpret_visitor<ExecutionCTX>::operator()(op);                                                                 \
    }
 
 #define DBG2_VISIT(name, code)                                                                                         \
@@ -38,6 +41,9 @@ struct debug_visitor : public interpret_visitor<ExecutionCTX> {
    EOS_VM_NUMERIC_OPS(DBG_VISIT)
    EOS_VM_CONVERSION_OPS(DBG_VISIT)
    EOS_VM_EXIT_OP(DBG_VISIT)
+   EOS_VM_FUSED_OPS(DBG_VISIT)
+   EOS_VM_FUSED_BRANCH_OPS(DBG_VISIT)
+   EOS_VM_TYPED_GLOBAL_OPS(DBG_VISIT)
    EOS_VM_ERROR_OPS(DBG_VISIT)
 };
 
@@ -58,12 +64,31 @@ struct debug_visitor2 {
    EOS_VM_NUMERIC_OPS(DBG2_VISIT)
    EOS_VM_CONVERSION_OPS(DBG2_VISIT)
    EOS_VM_EXIT_OP(DBG2_VISIT)
+   EOS_VM_FUSED_OPS(DBG2_VISIT)
+   EOS_VM_FUSED_BRANCH_OPS(DBG2_VISIT)
+   EOS_VM_TYPED_GLOBAL_OPS(DBG2_VISIT)
    EOS_VM_ERROR_OPS(DBG2_VISIT)
 };
 #undef DBG_VISIT
 #undef DBG2_VISIT
 
-#undef DBG_VISIT
-#undef DBG2_VISIT
+// Records every pair of instructions that run one after the other.  The
+// module should be compiled with superinstruction_set::none(), so that the
+// profile sees the original instructions.
+template <typename ExecutionCTX>
+struct profile_visitor : public interpret_visitor<ExecutionCTX> {
+   profile_visitor(ExecutionCTX& ctx, opcode_pair_profile& p) : interpret_visitor<ExecutionCTX>(ctx), profile(&p) {}
+   template <typename Op>
+   void operator()(Op& op) {
+      if (has_previous)
+         profile->add(previous, Op::opcode);
+      previous     = Op::opcode;
+      has_previous = true;
+      interpret_visitor<ExecutionCTX>::operator()(op);
+   }
+   opcode_pair_profile* profile;
+   uint8_t              previous     = 0;
+   bool                 has_previous = false;
+};
 
 }} // ns eosio::wasm_backend
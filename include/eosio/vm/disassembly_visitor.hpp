@@ -1,10 +1,13 @@
 #pragma once
 
-#include <eosio/wasm_backend/opcodes.hpp>
+#include <eosio/vm/opcodes.hpp>
+
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
-#include <variant>
+#include <string>
 
-namespace eosio { namespace wasm_backend {
+namespace eosio { namespace vm {
 struct disassembly_visitor {
    void print(const std::string& s) {
       //std::string tb(tab_width, '\t');
@@ -20,7 +23,7 @@ struct disassembly_visitor {
       print("end");
       tab_width--;
    }
-   void operator()(return__t) {
+   void operator()(return_t) {
       print("return");
    }
    void operator()(block_t) {
@@ -31,11 +34,11 @@ struct disassembly_visitor {
       print("loop");
       tab_width++;
    }
-   void operator()(if__t) {
+   void operator()(if_t) {
       print("if");
       tab_width++;
    }
-   void operator()(else__t) {
+   void operator()(else_t) {
       print("else");
    }
    void operator()(br_t b) {
@@ -45,7 +48,10 @@ struct disassembly_visitor {
       print("br.if : "+std::to_string(b.data));
    }
    void operator()(br_table_t b) {
-      print("br.table : "); //+std::to_string(b.data);
+      std::string targets;
+      for (uint32_t i = 0; i <= b.size; i++)
+         targets += (i ? ", " : "") + std::to_string(b.at(i).pc);
+      print("br.table : [ " + targets + " ]");
    }
    void operator()(call_t b) {
       print("call : "+std::to_string(b.index));
@@ -150,16 +156,16 @@ struct disassembly_visitor {
       print("grow_memory ");
    }
    void operator()(i32_const_t b) {
-      print("i32.const : "+std::to_string(b.data));
+      print("i32.const : "+std::to_string(b.data.i));
    }
    void operator()(i64_const_t b) {
-      print("i64.const : "+std::to_string(b.data));
+      print("i64.const : "+std::to_string(b.data.i));
    }
    void operator()(f32_const_t b) {
-      print("f32.const : "+std::to_string(*((float*)&b.data)));
+      print("f32.const : "+std::to_string(b.data.f));
    }
    void operator()(f64_const_t b) {
-      print("f64.const : "+std::to_string(*((double*)&b.data)));
+      print("f64.const : "+std::to_string(b.data.f));
    }
    void operator()(i32_eqz_t b) {
       print("i32.eqz");
@@ -533,8 +539,25 @@ struct disassembly_visitor {
    void operator()(error_t) {
       print("error");
    }
+#define EOS_VM_DISASSEMBLE_FUSED(name, code) \
+   void operator()(name##_t) { print(#name); }
+   EOS_VM_FUSED_OPS(EOS_VM_DISASSEMBLE_FUSED)
+   EOS_VM_FUSED_BRANCH_OPS(EOS_VM_DISASSEMBLE_FUSED)
+   EOS_VM_TYPED_GLOBAL_OPS(EOS_VM_DISASSEMBLE_FUSED)
+#undef EOS_VM_DISASSEMBLE_FUSED
+   template <typename T>
+   void operator()(T) {
+      print("invalid opcode");
+   }
 
-   uint32_t tab_width;
+   uint32_t tab_width = 0;
 };
 
-}} // ns eosio::wasm_backend
+// Prints the interpreter's bitcode for a function
+inline void disassemble(const uint8_t* code, std::size_t size) {
+   disassembly_visitor v;
+   for (const uint8_t* pos = code; pos < code + size;)
+      pos = visit_instruction(v, pos);
+}
+
+}} // ns eosio::vm
@@ -4,6 +4,7 @@
 #include <eosio/vm/constants.hpp>
 #include <eosio/vm/exceptions.hpp>
 #include <eosio/vm/host_function.hpp>
+#include <eosio/vm/mapped_file.hpp>
 #include <eosio/vm/opcodes.hpp>
 #include <eosio/vm/signals.hpp>
 #include <eosio/vm/types.hpp>
@@ -11,17 +12,21 @@
 #include <eosio/vm/wasm_stack.hpp>
 
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <signal.h>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <functional>
 #include <iostream>
 #include <limits>
 #include <optional>
 #include <string_view>
 #include <system_error>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 namespace eosio { namespace vm {
 
@@ -59,6 +64,57 @@ namespace eosio { namespace vm {
       inline char*          linear_memory() { return _linear_memory; }
 
       inline std::error_code get_error_code() const { return _error_code; }
+      inline void           set_linear_memory(char* mem) { _linear_memory = mem; }
+
+      inline operand_stack_slot  get_global(uint32_t index) {
+         EOS_VM_ASSERT(index < _mod.globals.size(), wasm_interpreter_exception, "global index out of range");
+         const auto& gl = _mod.globals[index];
+         switch (gl.type.content_type) {
+            case types::i32: return i32_const_t{ *(uint32_t*)&gl.current.value.i32 };
+            case types::i64: return i64_const_t{ *(uint64_t*)&gl.current.value.i64 };
+            case types::f32: return f32_const_t{ gl.current.value.f32 };
+            case types::f64: return f64_const_t{ gl.current.value.f64 };
+            default: throw wasm_interpreter_exception{ "invalid global type" };
+         }
+      }
+
+      inline void set_global(uint32_t index, const operand_stack_slot& el) {
+         EOS_VM_ASSERT(index < _mod.globals.size(), wasm_interpreter_exception, "global index out of range");
+         auto& gl = _mod.globals[index];
+         EOS_VM_ASSERT(gl.type.mutability, wasm_interpreter_exception, "global is not mutable");
+         switch (gl.type.content_type) {
+            case types::i32: gl.current.value.i32 = el.to_ui32(); break;
+            case types::i64: gl.current.value.i64 = el.to_ui64(); break;
+            case types::f32: gl.current.value.f32 = el.to_fui32(); break;
+            case types::f64: gl.current.value.f64 = el.to_fui64(); break;
+            default: throw wasm_interpreter_exception{ "invalid global type" };
+         }
+      }
+
+      // The operand stack does not record types, so arguments from the host
+      // are checked against the function's signature before they are pushed.
+      template <typename... Args>
+      inline void type_check_args(const func_type& ft) {
+         EOS_VM_ASSERT(sizeof...(Args) == ft.param_types.size(), wasm_interpreter_exception,
+                       "function param count mismatch");
+         constexpr std::array<value_type, sizeof...(Args)> arg_types = {
+            arg_type<decltype(detail::resolve_result(std::declval<Args>(), _wasm_alloc))>()...
+         };
+         for (uint32_t i = 0; i < arg_types.size(); i++)
+            EOS_VM_ASSERT(ft.param_types[i] == arg_types[i], wasm_interpreter_exception, "function param type mismatch");
+      }
+
+      template <typename T>
+      static constexpr value_type arg_type() {
+         if constexpr (std::is_same_v<T, i32_const_t>)
+            return types::i32;
+         else if constexpr (std::is_same_v<T, i64_const_t>)
+            return types::i64;
+         else if constexpr (std::is_same_v<T, f32_const_t>)
+            return types::f32;
+         else
+            return types::f64;
+      }
 
       inline void reset() {
          _linear_memory = _wasm_alloc->get_base_ptr<char>();
@@ -69,15 +125,22 @@ namespace eosio { namespace vm {
             EOS_VM_ASSERT(err != -1, wasm_bad_alloc, "Cannot allocate initial linear memory.");
          }
 
-         for (uint32_t i = 0; i < _mod.data.size(); i++) {
-            const auto& data_seg = _mod.data[i];
-            uint32_t offset = data_seg.offset.value.i32; // force to unsigned
-            auto available_memory =  _mod.memories[0].limits.initial * static_cast<uint64_t>(page_size);
-            auto required_memory = static_cast<uint64_t>(offset) + data_seg.data.size();
-            EOS_VM_ASSERT(required_memory <= available_memory, wasm_memory_exception, "data out of range");
-            auto addr = _linear_memory + offset;
-            memcpy((char*)(addr), data_seg.data.raw(), data_seg.data.size());
-         }
+         auto init_data = [&]() {
+            for (uint32_t i = 0; i < _mod.data.size(); i++) {
+               const auto& data_seg = _mod.data[i];
+               uint32_t offset = data_seg.offset.value.i32; // force to unsigned
+               auto available_memory =  _mod.memories[0].limits.initial * static_cast<uint64_t>(page_size);
+               auto required_memory = static_cast<uint64_t>(offset) + data_seg.data.size();
+               EOS_VM_ASSERT(required_memory <= available_memory, wasm_memory_exception, "data out of range");
+               auto addr = _linear_memory + offset;
+               memcpy((char*)(addr), data_seg.data.raw(), data_seg.data.size());
+            }
+         };
+         // The data segments may be in a mapped file
+         if (_mod.source)
+            read_mapped_file(init_data);
+         else
+            init_data();
 
          // reset the mutable globals
          for (uint32_t i = 0; i < _mod.globals.size(); i++) {
@@ -157,7 +220,7 @@ namespace eosio { namespace vm {
          // guarantee that the junk bits are zero, to avoid problems.
          auto set_result = [&result](auto val) { std::memcpy(&result, &val, sizeof(val)); };
          if(ft.return_count) {
-            operand_stack_elem el = _os.pop();
+            operand_stack_slot el = _os.pop();
             switch(ft.return_type) {
              case i32: set_result(el.to_ui32()); break;
              case i64: set_result(el.to_ui64()); break;
@@ -200,6 +263,9 @@ namespace eosio { namespace vm {
                std::unique_ptr<native_value[]> alt_stack;
                if (maximum_stack_usage > stack_cutoff/sizeof(native_value)) {
                   maximum_stack_usage += SIGSTKSZ/sizeof(native_value);
+                  // Functions compiled on their first call run the parser on this stack
+                  if (_mod.lazy_compiler)
+                     maximum_stack_usage += stack_cutoff/sizeof(native_value);
                   alt_stack.reset(new native_value[maximum_stack_usage + 3]);
                   stack = alt_stack.get() + maximum_stack_usage;
                }
@@ -293,7 +359,7 @@ namespace eosio { namespace vm {
 
       // This is only needed because the host function api uses operand stack
       bounded_allocator _base_allocator = {
-         constants::max_stack_size * sizeof(operand_stack_elem)
+         constants::max_stack_size * sizeof(operand_stack_slot)
       };
       operand_stack _os;
    };
@@ -307,60 +373,52 @@ namespace eosio { namespace vm {
       using base_type::_linear_memory;
       using base_type::_error_code;
       using base_type::handle_signal;
-      execution_context(module& m) : base_type(m), _halt(exit_t{}) {}
+      execution_context(module& m) : base_type(m) {}
 
 
       inline void call(uint32_t index) {
-         // TODO validate index is valid
-         if (index < _mod.get_imported_functions_size()) {
-            // TODO validate only importing functions
-            const auto& ft = _mod.types[_mod.imports[index].type.func_t];
-            type_check(ft);
-            inc_pc();
+         const function_frame& frame = _mod.function_frames[index];
+         if (!frame.pc) {
             push_call( activation_frame{ nullptr, 0 } );
             _rhf(_state.host, *this, _mod.import_functions[index]);
             pop_call();
          } else {
-            // const auto& ft = _mod.types[_mod.functions[index - _mod.get_imported_functions_size()]];
-            // type_check(ft);
-            push_call(index);
-            setup_locals(index);
-            set_pc( _mod.get_function_pc(index) );
+            if (!_profile.empty())
+               profile_function(frame.code_index);
+            // The pc has already moved past the call
+            push_call(_state.pc, frame);
+            set_pc(frame.pc);
          }
       }
 
       void print_stack() {
          std::cout << "STACK { ";
          for (int i = 0; i < _os.size(); i++) {
-            std::cout << "(" << i << ")";
-            visit(overloaded { [&](i32_const_t el) { std::cout << "i32:" << el.data.ui << ", "; },
-                               [&](i64_const_t el) { std::cout << "i64:" << el.data.ui << ", "; },
-                               [&](f32_const_t el) { std::cout << "f32:" << el.data.f << ", "; },
-                               [&](f64_const_t el) { std::cout << "f64:" << el.data.f << ", "; },
-                               [&](auto el) { std::cout << "(INDEX " << el.index() << "), "; } }, _os.get(i));
+            std::cout << "(" << i << ")" << std::hex << _os.get(i).to_ui64() << std::dec << ", ";
          }
          std::cout << " }\n";
       }
 
       inline operand_stack& get_operand_stack() { return _os; }
       inline uint32_t       table_elem(uint32_t i) { return _mod.tables[0].table[i]; }
-      inline void           push_operand(operand_stack_elem el) { _os.push(std::move(el)); }
-      inline operand_stack_elem get_operand(uint16_t index) const { return _os.get(_last_op_index + index); }
+      inline void           push_operand(operand_stack_slot el) { _os.push(std::move(el)); }
+      inline operand_stack_slot get_operand(uint16_t index) const { return _os.get(_last_op_index + index); }
       inline void           eat_operands(uint16_t index) { _os.eat(index); }
       inline void           compact_operand(uint16_t index) { _os.compact(index); }
-      inline void           set_operand(uint16_t index, const operand_stack_elem& el) { _os.set(_last_op_index + index, el); }
+      inline void           set_operand(uint16_t index, const operand_stack_slot& el) { _os.set(_last_op_index + index, el); }
       inline uint16_t       current_operands_index() const { return _os.current_index(); }
+      inline uint16_t       get_frame_index() const { return _last_op_index; }
       inline void           push_call(activation_frame&& el) { _as.push(std::move(el)); }
       inline activation_frame pop_call() { return _as.pop(); }
       inline uint32_t       call_depth()const { return _as.size(); }
-      template <bool Should_Exit=false>
-      inline void           push_call(uint32_t index) {
-         opcode* return_pc = static_cast<opcode*>(&_halt);
-         if constexpr (!Should_Exit)
-            return_pc = _state.pc + 1;
-
+      // Starts the frame of a function whose arguments are on top of the
+      // operand stack.  Its locals are zeroed in one block.
+      inline void           push_call(const uint8_t* return_pc, const function_frame& frame) {
          _as.push( activation_frame{ return_pc, _last_op_index } );
-         _last_op_index = _os.size() - _mod.get_function_type(index).param_types.size();
+         _last_op_index = _os.size() - frame.num_params;
+         _os.reserve(_mod.maximum_stack);
+         std::memset(_os.data() + _os.size(), 0, frame.num_locals * sizeof(operand_stack_slot));
+         _os.eat(_os.size() + frame.num_locals);
       }
 
       inline void apply_pop_call(uint32_t num_locals, uint16_t return_count) {
@@ -372,86 +430,15 @@ namespace eosio { namespace vm {
          else
             eat_operands(_os.size() - num_locals);
       }
-      inline operand_stack_elem  pop_operand() { return _os.pop(); }
-      inline operand_stack_elem& peek_operand(size_t i = 0) { return _os.peek(i); }
-      inline operand_stack_elem  get_global(uint32_t index) {
-         EOS_VM_ASSERT(index < _mod.globals.size(), wasm_interpreter_exception, "global index out of range");
-         const auto& gl = _mod.globals[index];
-         switch (gl.type.content_type) {
-            case types::i32: return i32_const_t{ *(uint32_t*)&gl.current.value.i32 };
-            case types::i64: return i64_const_t{ *(uint64_t*)&gl.current.value.i64 };
-            case types::f32: return f32_const_t{ gl.current.value.f32 };
-            case types::f64: return f64_const_t{ gl.current.value.f64 };
-            default: throw wasm_interpreter_exception{ "invalid global type" };
-         }
-      }
+      inline operand_stack_slot  pop_operand() { return _os.pop(); }
+      inline operand_stack_slot& peek_operand(size_t i = 0) { return _os.peek(i); }
+      inline bool is_true(const operand_stack_slot& el) { return el.to_ui32() != 0; }
 
-      inline void set_global(uint32_t index, const operand_stack_elem& el) {
-         EOS_VM_ASSERT(index < _mod.globals.size(), wasm_interpreter_exception, "global index out of range");
-         auto& gl = _mod.globals[index];
-         EOS_VM_ASSERT(gl.type.mutability, wasm_interpreter_exception, "global is not mutable");
-         visit(overloaded{ [&](const i32_const_t& i) {
-                                  EOS_VM_ASSERT(gl.type.content_type == types::i32, wasm_interpreter_exception,
-                                                "expected i32 global type");
-                                  gl.current.value.i32 = i.data.ui;
-                               },
-                                [&](const i64_const_t& i) {
-                                   EOS_VM_ASSERT(gl.type.content_type == types::i64, wasm_interpreter_exception,
-                                                 "expected i64 global type");
-                                   gl.current.value.i64 = i.data.ui;
-                                },
-                                [&](const f32_const_t& f) {
-                                   EOS_VM_ASSERT(gl.type.content_type == types::f32, wasm_interpreter_exception,
-                                                 "expected f32 global type");
-                                   gl.current.value.f32 = f.data.ui;
-                                },
-                                [&](const f64_const_t& f) {
-                                   EOS_VM_ASSERT(gl.type.content_type == types::f64, wasm_interpreter_exception,
-                                                 "expected f64 global type");
-                                   gl.current.value.f64 = f.data.ui;
-                                },
-                                [](auto) { throw wasm_interpreter_exception{ "invalid global type" }; } },
-                    el);
-      }
-
-      inline bool is_true(const operand_stack_elem& el) {
-         bool ret_val = false;
-         visit(overloaded{ [&](const i32_const_t& i32) { ret_val = i32.data.ui; },
-                           [&](auto) { throw wasm_invalid_element{ "should be an i32 type" }; } },
-                    el);
-         return ret_val;
-      }
-
-      inline void type_check(const func_type& ft) {
-         for (uint32_t i = 0; i < ft.param_types.size(); i++) {
-            const auto& op = peek_operand((ft.param_types.size() - 1) - i);
-            visit(overloaded{ [&](const i32_const_t&) {
-                                     EOS_VM_ASSERT(ft.param_types[i] == types::i32, wasm_interpreter_exception,
-                                                   "function param type mismatch");
-                                  },
-                                   [&](const f32_const_t&) {
-                                      EOS_VM_ASSERT(ft.param_types[i] == types::f32, wasm_interpreter_exception,
-                                                    "function param type mismatch");
-                                   },
-                                   [&](const i64_const_t&) {
-                                      EOS_VM_ASSERT(ft.param_types[i] == types::i64, wasm_interpreter_exception,
-                                                    "function param type mismatch");
-                                   },
-                                   [&](const f64_const_t&) {
-                                      EOS_VM_ASSERT(ft.param_types[i] == types::f64, wasm_interpreter_exception,
-                                                    "function param type mismatch");
-                                   },
-                                   [&](auto) { throw wasm_interpreter_exception{ "function param invalid type" }; } },
-                       op);
-         }
-      }
-
-      inline opcode*  get_pc() const { return _state.pc; }
+      inline const uint8_t* get_pc() const { return _state.pc; }
       inline void     set_relative_pc(uint32_t pc_offset) { 
          _state.pc = _mod.code[0].code + pc_offset;
       }
-      inline void     set_pc(opcode* pc) { _state.pc = pc; }
-      inline void     inc_pc(uint32_t offset=1) { _state.pc += offset; }
+      inline void     set_pc(const uint8_t* pc) { _state.pc = pc; }
       inline void     exit(std::error_code err = std::error_code()) {
          _error_code = err;
          _state.pc = &_halt;
@@ -506,28 +493,33 @@ namespace eosio { namespace vm {
             _last_op_index = last_last_op_index;
          });
 
+         this->template type_check_args<Args...>(_mod.get_function_type(func_index));
          push_args(args...);
-         push_call<true>(func_index);
-         type_check(_mod.get_function_type(func_index));
+         const function_frame& frame = _mod.function_frames[func_index];
+         push_call(&_halt, frame);
 
-         if (func_index < _mod.get_imported_functions_size()) {
+         if (!frame.pc) {
             _rhf(_state.host, *this, _mod.import_functions[func_index]);
          } else {
-            _state.pc = _mod.get_function_pc(func_index);
-            setup_locals(func_index);
+            if (!_profile.empty())
+               profile_function(frame.code_index);
+            _state.pc = frame.pc;
             vm::invoke_with_signal_handler([&]() {
                execute(visitor);
             }, &handle_signal);
          }
 
-         if (_mod.get_function_type(func_index).return_count && !_state.exiting) {
-            return pop_operand();
+         const func_type& ft = _mod.get_function_type(func_index);
+         if (ft.return_count && !_state.exiting) {
+            return pop_operand().to_operand_stack_elem(ft.return_type);
          } else {
             return {};
          }
       }
 
       inline void jump(uint32_t pop_info, uint32_t new_pc) {
+         if (!_profile.empty() && _mod.code[0].code + new_pc < _state.pc)
+            profile_back_edge(new_pc);
          set_relative_pc(new_pc);
          if ((pop_info & 0x80000000u)) {
             const auto& op = pop_operand();
@@ -538,32 +530,61 @@ namespace eosio { namespace vm {
          }
       }
 
+      // Counts the calls and loop back-edges of each function.  The first time
+      // a count reaches threshold, profiling stops and on_hot is called.
+      void enable_profiling(uint32_t threshold, std::function<void()> on_hot) {
+         _profile.assign(_mod.code.size(), 0);
+         _profile_threshold = threshold;
+         _on_hot            = std::move(on_hot);
+      }
+
     private:
 
+      void profile_function(uint32_t code_index) {
+         if (++_profile[code_index] >= _profile_threshold) {
+            _profile.clear();
+            _on_hot();
+         }
+      }
+
+      void profile_back_edge(uint32_t new_pc) {
+         // The function bodies are laid out in order, so find the last one starting at or before new_pc
+         const function_body* first = _mod.code.raw();
+         const function_body* pos = std::upper_bound(first + 1, first + _mod.code.size(), new_pc,
+                                                     [&](uint32_t pc, const function_body& fb) {
+                                                        return pc < static_cast<uint32_t>(fb.code - first->code);
+                                                     });
+         profile_function(pos - first - 1);
+      }
+
       template <typename... Args>
       void push_args(Args&&... args) {
          (... , push_operand(detail::resolve_result(std::move(args), this->_wasm_alloc)));
       }
 
-      inline void setup_locals(uint32_t index) {
-         const auto& fn = _mod.code[index - _mod.get_imported_functions_size()];
-         for (uint32_t i = 0; i < fn.locals.size(); i++) {
-            for (uint32_t j = 0; j < fn.locals[i].count; j++)
-               switch (fn.locals[i].type) {
-                  case types::i32: push_operand(i32_const_t{ (uint32_t)0 }); break;
-                  case types::i64: push_operand(i64_const_t{ (uint64_t)0 }); break;
-                  case types::f32: push_operand(f32_const_t{ (uint32_t)0 }); break;
-                  case types::f64: push_operand(f64_const_t{ (uint64_t)0 }); break;
-                  default: throw wasm_interpreter_exception{ "invalid function param type" };
-               }
-         }
-      }
-
 #define CREATE_TABLE_ENTRY(NAME, CODE) &&ev_label_##NAME,
+// The pc is kept in a local, which the compiler can leave in a register.
+// Instructions that do not branch or call never see _state.pc.
 #define CREATE_LABEL(NAME, CODE)                                                                                  \
-      ev_label_##NAME : visitor(ev_variant->template get<eosio::vm::EOS_VM_OPCODE_T(NAME)>());                    \
-      ev_variant = _state.pc; \
-      goto* dispatch_table[ev_variant->index()];
+      ev_label_##NAME : {                                                                                         \
+         eosio::vm::EOS_VM_OPCODE_T(NAME) ev_op;                                                                  \
+         ev_pc = ev_op.unpack(ev_pc + 1);                                                                         \
+         ev_visitor(ev_op);                                                                                       \
+      }                                                                                                           \
+      goto* dispatch_table[*ev_pc];
+// Branches, calls and returns work on _state.pc and the operand stack, so
+// these are written back before they run and reloaded after.  The pc has
+// already moved past the instruction when it runs.
+#define CREATE_BRANCH_LABEL(NAME, CODE)                                                                           \
+      ev_label_##NAME : {                                                                                         \
+         eosio::vm::EOS_VM_OPCODE_T(NAME) ev_op;                                                                  \
+         _state.pc = ev_op.unpack(ev_pc + 1);                                                                     \
+         ev_visitor.store_state();                                                                                \
+         ev_visitor(ev_op);                                                                                       \
+         ev_visitor.load_state();                                                                                 \
+         ev_pc = _state.pc;                                                                                       \
+      }                                                                                                           \
+      goto* dispatch_table[*ev_pc];
 #define CREATE_EXIT_LABEL(NAME, CODE) ev_label_##NAME : \
       return;
 #define CREATE_EMPTY_LABEL(NAME, CODE) ev_label_##NAME :  \
@@ -588,18 +609,24 @@ namespace eosio { namespace vm {
             EOS_VM_NUMERIC_OPS(CREATE_TABLE_ENTRY)
             EOS_VM_CONVERSION_OPS(CREATE_TABLE_ENTRY)
             EOS_VM_EXIT_OP(CREATE_TABLE_ENTRY)
+            EOS_VM_FUSED_OPS(CREATE_TABLE_ENTRY)
+            EOS_VM_FUSED_BRANCH_OPS(CREATE_TABLE_ENTRY)
+            EOS_VM_TYPED_GLOBAL_OPS(CREATE_TABLE_ENTRY)
             EOS_VM_EMPTY_OPS(CREATE_TABLE_ENTRY)
             EOS_VM_ERROR_OPS(CREATE_TABLE_ENTRY)
             &&__ev_last
          };
-         auto* ev_variant = _state.pc;
-         goto *dispatch_table[ev_variant->index()];
+         // A local copy, so that the compiler can keep its state in registers
+         std::decay_t<Visitor> ev_visitor = visitor;
+         ev_visitor.load_state();
+         const uint8_t* ev_pc = _state.pc;
+         goto *dispatch_table[*ev_pc];
          while (1) {
-             EOS_VM_CONTROL_FLOW_OPS(CREATE_LABEL);
-             EOS_VM_BR_TABLE_OP(CREATE_LABEL);
-             EOS_VM_RETURN_OP(CREATE_LABEL);
-             EOS_VM_CALL_OPS(CREATE_LABEL);
-             EOS_VM_CALL_IMM_OPS(CREATE_LABEL);
+             EOS_VM_CONTROL_FLOW_OPS(CREATE_BRANCH_LABEL);
+             EOS_VM_BR_TABLE_OP(CREATE_BRANCH_LABEL);
+             EOS_VM_RETURN_OP(CREATE_BRANCH_LABEL);
+             EOS_VM_CALL_OPS(CREATE_BRANCH_LABEL);
+             EOS_VM_CALL_IMM_OPS(CREATE_BRANCH_LABEL);
              EOS_VM_PARAMETRIC_OPS(CREATE_LABEL);
              EOS_VM_VARIABLE_ACCESS_OPS(CREATE_LABEL);
              EOS_VM_MEMORY_OPS(CREATE_LABEL);
@@ -611,6 +638,9 @@ namespace eosio { namespace vm {
              EOS_VM_NUMERIC_OPS(CREATE_LABEL);
              EOS_VM_CONVERSION_OPS(CREATE_LABEL);
              EOS_VM_EXIT_OP(CREATE_EXIT_LABEL);
+             EOS_VM_FUSED_OPS(CREATE_LABEL);
+             EOS_VM_FUSED_BRANCH_OPS(CREATE_BRANCH_LABEL);
+             EOS_VM_TYPED_GLOBAL_OPS(CREATE_LABEL);
              EOS_VM_EMPTY_OPS(CREATE_EMPTY_LABEL);
              EOS_VM_ERROR_OPS(CREATE_LABEL);
              __ev_last:
@@ -619,6 +649,7 @@ namespace eosio { namespace vm {
       }
 
 #undef CREATE_EMPTY_LABEL
+#undef CREATE_BRANCH_LABEL
 #undef CREATE_LABEL
 #undef CREATE_TABLE_ENTRY
 
@@ -626,17 +657,20 @@ namespace eosio { namespace vm {
          Host* host                = nullptr;
          uint32_t as_index         = 0;
          uint32_t os_index         = 0;
-         opcode*  pc               = nullptr;
+         const uint8_t* pc         = nullptr;
          bool     exiting          = false;
       };
 
       bounded_allocator _base_allocator = {
-         (constants::max_stack_size + constants::max_call_depth + 1) * (std::max(sizeof(operand_stack_elem), sizeof(activation_frame)))
+         (constants::max_stack_size + constants::max_call_depth + 1) * (std::max(sizeof(operand_stack_slot), sizeof(activation_frame)))
       };
       execution_state _state;
       uint16_t                        _last_op_index    = 0;
       call_stack                      _as = { _base_allocator };
       operand_stack                   _os;
-      opcode                          _halt;
+      uint8_t                         _halt = exit_t::opcode;
+      std::vector<uint32_t>           _profile;
+      uint32_t                        _profile_threshold = 0;
+      std::function<void()>           _on_hot;
    };
 }} // namespace eosio::vm
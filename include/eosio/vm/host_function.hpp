@@ -369,15 +369,15 @@ namespace eosio { namespace vm {
       template<typename S, typename T, typename WAlloc, typename Cons>
       constexpr decltype(auto) get_value(WAlloc* alloc, T&& val, Cons& tail) {
          if constexpr (std::is_integral_v<S> && sizeof(S) == 4)
-            return as_value(val.template get<i32_const_t>().data.ui);
+            return as_value(val.to_ui32());
          else if constexpr (std::is_integral_v<S> && sizeof(S) == 8)
-            return as_value(val.template get<i64_const_t>().data.ui);
+            return as_value(val.to_ui64());
          else if constexpr (std::is_floating_point_v<S> && sizeof(S) == 4)
-            return as_value(val.template get<f32_const_t>().data.f);
+            return as_value(val.to_f32());
          else if constexpr (std::is_floating_point_v<S> && sizeof(S) == 8)
-            return as_value(val.template get<f64_const_t>().data.f);
+            return as_value(val.to_f64());
          else if constexpr (std::is_void_v<std::decay_t<std::remove_pointer_t<S>>>)
-            return reinterpret_cast<S>(alloc->template get_base_ptr<char>() + val.template get<i32_const_t>().data.ui);
+            return reinterpret_cast<S>(alloc->template get_base_ptr<char>() + val.to_ui32());
          else {
             return detail::make_value_getter<S, Cons>().template apply<S>(alloc, static_cast<T&&>(val), tail);
          }
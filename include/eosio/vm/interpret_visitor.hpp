@@ -24,6 +24,27 @@ namespace eosio { namespace vm {
 
       ExecutionContext& get_context() { return context; }
 
+      // While the interpreter runs, the operand stack pointers live in the
+      // visitor, which it keeps in registers.  Branches and calls work on the
+      // context's stack, so execute stores them before each of those
+      // instructions and loads them after.
+      operand_stack_slot* sp     = nullptr; // one past the top of the operand stack
+      operand_stack_slot* fp     = nullptr; // the first local of the current function
+      char*               memory = nullptr;
+
+      void load_state() {
+         auto& os = context.get_operand_stack();
+         sp       = os.data() + os.size();
+         fp       = os.data() + context.get_frame_index();
+         memory   = context.linear_memory();
+      }
+      void store_state() { context.get_operand_stack().eat(sp - context.get_operand_stack().data()); }
+
+      // Functions reserve their whole frame when they are entered, so these never need to grow the stack.
+      [[gnu::always_inline]] inline operand_stack_slot  pop_operand() { return *--sp; }
+      [[gnu::always_inline]] inline operand_stack_slot& peek_operand(size_t i = 0) { return sp[-1 - static_cast<std::ptrdiff_t>(i)]; }
+      [[gnu::always_inline]] inline void push_operand(const operand_stack_slot& el) { *sp++ = el; }
+
       static inline constexpr void* align_address(void* addr, size_t align_amt) {
          if constexpr (should_align_memory_ops) {
             addr = (void*)(((uintptr_t)addr + (1 << align_amt) - 1) & ~((1 << align_amt) - 1));
@@ -44,18 +65,16 @@ namespace eosio { namespace vm {
       }
 
       [[gnu::always_inline]] inline void operator()(const unreachable_t& op) {
-         context.inc_pc();
          throw wasm_interpreter_exception{ "unreachable" };
       }
 
-      [[gnu::always_inline]] inline void operator()(const nop_t& op) { context.inc_pc(); }
+      [[gnu::always_inline]] inline void operator()(const nop_t& op) {}
 
-      [[gnu::always_inline]] inline void operator()(const end_t& op) { context.inc_pc(); }
+      [[gnu::always_inline]] inline void operator()(const end_t& op) {}
       [[gnu::always_inline]] inline void operator()(const return_t& op) { context.apply_pop_call(op.data, op.pc); }
-      [[gnu::always_inline]] inline void operator()(block_t& op) { context.inc_pc(); }
-      [[gnu::always_inline]] inline void operator()(loop_t& op) { context.inc_pc(); }
+      [[gnu::always_inline]] inline void operator()(block_t& op) {}
+      [[gnu::always_inline]] inline void operator()(loop_t& op) {}
       [[gnu::always_inline]] inline void operator()(if_t& op) {
-         context.inc_pc();
          const auto& oper = context.pop_operand();
          if (!oper.to_ui32()) {
             context.set_relative_pc(op.pc);
@@ -67,17 +86,13 @@ namespace eosio { namespace vm {
          const auto& val = context.pop_operand();
          if (context.is_true(val)) {
             context.jump(op.data, op.pc);
-         } else {
-            context.inc_pc();
          }
       }
 
-      [[gnu::always_inline]] inline void operator()(const br_table_data_t& op) {
-         context.inc_pc(op.index);
-      }
+      [[gnu::always_inline]] inline void operator()(const br_table_data_t& op) {}
       [[gnu::always_inline]] inline void operator()(const br_table_t& op) {
          const auto& in = context.pop_operand().to_ui32();
-         const auto& entry = op.table[std::min(in, op.size)]; 
+         const auto& entry = op.at(std::min(in, op.size));
          context.jump(entry.stack_pop, entry.pc);
       }
       [[gnu::always_inline]] inline void operator()(const call_t& op) {
@@ -86,495 +101,427 @@ namespace eosio { namespace vm {
       [[gnu::always_inline]] inline void operator()(const call_indirect_t& op) {
          const auto& index = context.pop_operand().to_ui32();
          uint32_t fn = context.table_elem(index);
-         const auto& expected_type = context.get_module().types.at(op.index);
-         const auto& actual_type = context.get_module().get_function_type(fn);
-         EOS_VM_ASSERT(actual_type == expected_type, wasm_interpreter_exception, "bad call_indirect type");
+         const module& mod = context.get_module();
+         EOS_VM_ASSERT(mod.function_frames[fn].type_id == mod.type_aliases[op.index], wasm_interpreter_exception,
+                       "bad call_indirect type");
          context.call(fn);
       }
       [[gnu::always_inline]] inline void operator()(const drop_t& op) {
-         context.pop_operand();
-         context.inc_pc();
+         pop_operand();
       }
       [[gnu::always_inline]] inline void operator()(const select_t& op) {
-         const auto& c  = context.pop_operand();
-         const auto& v2 = context.pop_operand();
+         const auto& c  = pop_operand();
+         const auto& v2 = pop_operand();
          if (c.to_ui32() == 0) {
-            context.peek_operand() = v2;
+            peek_operand() = v2;
          }
-         context.inc_pc();
       }
       [[gnu::always_inline]] inline void operator()(const get_local_t& op) {
-         context.inc_pc();
-         context.push_operand(context.get_operand(op.index));
+         push_operand(fp[op.index]);
       }
       [[gnu::always_inline]] inline void operator()(const set_local_t& op) {
-         context.inc_pc();
-         context.set_operand(op.index, context.pop_operand());
+         fp[op.index] = pop_operand();
       }
       [[gnu::always_inline]] inline void operator()(const tee_local_t& op) {
-         context.inc_pc();
-         const auto& oper = context.pop_operand();
-         context.set_operand(op.index, oper);
-         context.push_operand(oper);
+         fp[op.index] = peek_operand();
       }
       [[gnu::always_inline]] inline void operator()(const get_global_t& op) {
-         context.inc_pc();
          const auto& gl = context.get_global(op.index);
-         context.push_operand(gl);
+         push_operand(gl);
       }
       [[gnu::always_inline]] inline void operator()(const set_global_t& op) {
-         context.inc_pc();
-         const auto& oper = context.pop_operand();
+         const auto& oper = pop_operand();
          context.set_global(op.index, oper);
       }
+      [[gnu::always_inline]] inline void operator()(const get_global_i32_t& op) {
+         push_operand(i32_const_t{ read_unaligned<uint32_t>(op.ptr) });
+      }
+      [[gnu::always_inline]] inline void operator()(const get_global_i64_t& op) {
+         push_operand(i64_const_t{ read_unaligned<uint64_t>(op.ptr) });
+      }
+      [[gnu::always_inline]] inline void operator()(const set_global_i32_t& op) {
+         write_unaligned(op.ptr, pop_operand().to_ui32());
+      }
+      [[gnu::always_inline]] inline void operator()(const set_global_i64_t& op) {
+         write_unaligned(op.ptr, pop_operand().to_ui64());
+      }
       template<typename Op>
       inline void * pop_memop_addr(const Op& op) {
-         const auto& ptr  = context.pop_operand();
-         return align_address((context.linear_memory() + op.offset + ptr.to_ui32()), op.flags_align);
+         const auto& ptr  = pop_operand();
+         return align_address((memory + op.offset + ptr.to_ui32()), op.flags_align);
       }
       [[gnu::always_inline]] inline void operator()(const i32_load_t& op) {
-         context.inc_pc();
          void* _ptr = pop_memop_addr(op);
-         context.push_operand(i32_const_t{ read_unaligned<uint32_t>(_ptr) });
+         push_operand(i32_const_t{ read_unaligned<uint32_t>(_ptr) });
       }
       [[gnu::always_inline]] inline void operator()(const i32_load8_s_t& op) {
-         context.inc_pc();
          void* _ptr = pop_memop_addr(op);
-         context.push_operand(i32_const_t{ static_cast<int32_t>(read_unaligned<int8_t>(_ptr) ) });
+         push_operand(i32_const_t{ static_cast<int32_t>(read_unaligned<int8_t>(_ptr) ) });
       }
       [[gnu::always_inline]] inline void operator()(const i32_load16_s_t& op) {
-         context.inc_pc();
          void* _ptr = pop_memop_addr(op);
-         context.push_operand(i32_const_t{ static_cast<int32_t>( read_unaligned<int16_t>(_ptr) ) });
+         push_operand(i32_const_t{ static_cast<int32_t>( read_unaligned<int16_t>(_ptr) ) });
       }
       [[gnu::always_inline]] inline void operator()(const i32_load8_u_t& op) {
-         context.inc_pc();
          void* _ptr = pop_memop_addr(op);
-         context.push_operand(i32_const_t{ static_cast<uint32_t>( read_unaligned<uint8_t>(_ptr) ) });
+         push_operand(i32_const_t{ static_cast<uint32_t>( read_unaligned<uint8_t>(_ptr) ) });
       }
       [[gnu::always_inline]] inline void operator()(const i32_load16_u_t& op) {
-         context.inc_pc();
          void* _ptr = pop_memop_addr(op);
-         context.push_operand(i32_const_t{ static_cast<uint32_t>( read_unaligned<uint16_t>(_ptr) ) });
+         push_operand(i32_const_t{ static_cast<uint32_t>( read_unaligned<uint16_t>(_ptr) ) });
       }
       [[gnu::always_inline]] inline void operator()(const i64_load_t& op) {
-         context.inc_pc();
          void* _ptr = pop_memop_addr(op);
-         context.push_operand(i64_const_t{ static_cast<uint64_t>( read_unaligned<uint64_t>(_ptr) ) });
+         push_operand(i64_const_t{ static_cast<uint64_t>( read_unaligned<uint64_t>(_ptr) ) });
       }
       [[gnu::always_inline]] inline void operator()(const i64_load8_s_t& op) {
-         context.inc_pc();
          void* _ptr = pop_memop_addr(op);
-         context.push_operand(i64_const_t{ static_cast<int64_t>( read_unaligned<int8_t>(_ptr) ) });
+         push_operand(i64_const_t{ static_cast<int64_t>( read_unaligned<int8_t>(_ptr) ) });
       }
       [[gnu::always_inline]] inline void operator()(const i64_load16_s_t& op) {
-         context.inc_pc();
          void* _ptr = pop_memop_addr(op);
-         context.push_operand(i64_const_t{ static_cast<int64_t>( read_unaligned<int16_t>(_ptr) ) });
+         push_operand(i64_const_t{ static_cast<int64_t>( read_unaligned<int16_t>(_ptr) ) });
       }
       [[gnu::always_inline]] inline void operator()(const i64_load32_s_t& op) {
-         context.inc_pc();
          void* _ptr = pop_memop_addr(op);
-         context.push_operand(i64_const_t{ static_cast<int64_t>( read_unaligned<int32_t>(_ptr) ) });
+         push_operand(i64_const_t{ static_cast<int64_t>( read_unaligned<int32_t>(_ptr) ) });
       }
       [[gnu::always_inline]] inline void operator()(const i64_load8_u_t& op) {
-         context.inc_pc();
          void* _ptr = pop_memop_addr(op);
-         context.push_operand(i64_const_t{ static_cast<uint64_t>( read_unaligned<uint8_t>(_ptr) ) });
+         push_operand(i64_const_t{ static_cast<uint64_t>( read_unaligned<uint8_t>(_ptr) ) });
       }
       [[gnu::always_inline]] inline void operator()(const i64_load16_u_t& op) {
-         context.inc_pc();
          void* _ptr = pop_memop_addr(op);
-         context.push_operand(i64_const_t{ static_cast<uint64_t>( read_unaligned<uint16_t>(_ptr) ) });
+         push_operand(i64_const_t{ static_cast<uint64_t>( read_unaligned<uint16_t>(_ptr) ) });
       }
       [[gnu::always_inline]] inline void operator()(const i64_load32_u_t& op) {
-         context.inc_pc();
          void* _ptr = pop_memop_addr(op);
-         context.push_operand(i64_const_t{ static_cast<uint64_t>( read_unaligned<uint32_t>(_ptr) ) });
+         push_operand(i64_const_t{ static_cast<uint64_t>( read_unaligned<uint32_t>(_ptr) ) });
       }
       [[gnu::always_inline]] inline void operator()(const f32_load_t& op) {
-         context.inc_pc();
          void* _ptr = pop_memop_addr(op);
-         context.push_operand(f32_const_t{ read_unaligned<uint32_t>(_ptr) });
+         push_operand(f32_const_t{ read_unaligned<uint32_t>(_ptr) });
       }
       [[gnu::always_inline]] inline void operator()(const f64_load_t& op) {
-         context.inc_pc();
          void* _ptr = pop_memop_addr(op);
-         context.push_operand(f64_const_t{ read_unaligned<uint64_t>(_ptr) });
+         push_operand(f64_const_t{ read_unaligned<uint64_t>(_ptr) });
       }
       [[gnu::always_inline]] inline void operator()(const i32_store_t& op) {
-         context.inc_pc();
-         const auto& val     = context.pop_operand();
+         const auto& val     = pop_operand();
          void* store_loc     = pop_memop_addr(op);
          write_unaligned(store_loc, val.to_ui32());
       }
       [[gnu::always_inline]] inline void operator()(const i32_store8_t& op) {
-         context.inc_pc();
-         const auto& val = context.pop_operand();
+         const auto& val = pop_operand();
          void* store_loc = pop_memop_addr(op);
          write_unaligned(store_loc, static_cast<uint8_t>(val.to_ui32()));
       }
       [[gnu::always_inline]] inline void operator()(const i32_store16_t& op) {
-         context.inc_pc();
-         const auto& val     = context.pop_operand();
+         const auto& val     = pop_operand();
          void* store_loc     = pop_memop_addr(op);
          write_unaligned(store_loc, static_cast<uint16_t>(val.to_ui32()));
       }
       [[gnu::always_inline]] inline void operator()(const i64_store_t& op) {
-         context.inc_pc();
-         const auto& val     = context.pop_operand();
+         const auto& val     = pop_operand();
          void* store_loc     = pop_memop_addr(op);
          write_unaligned(store_loc, static_cast<uint64_t>(val.to_ui64()));
       }
       [[gnu::always_inline]] inline void operator()(const i64_store8_t& op) {
-         context.inc_pc();
-         const auto& val = context.pop_operand();
+         const auto& val = pop_operand();
          void* store_loc = pop_memop_addr(op);
          write_unaligned(store_loc, static_cast<uint8_t>(val.to_ui64()));
       }
       [[gnu::always_inline]] inline void operator()(const i64_store16_t& op) {
-         context.inc_pc();
-         const auto& val     = context.pop_operand();
+         const auto& val     = pop_operand();
          void* store_loc     = pop_memop_addr(op);
          write_unaligned(store_loc, static_cast<uint16_t>(val.to_ui64()));
       }
       [[gnu::always_inline]] inline void operator()(const i64_store32_t& op) {
-         context.inc_pc();
-         const auto& val     = context.pop_operand();
+         const auto& val     = pop_operand();
          void* store_loc     = pop_memop_addr(op);
          write_unaligned(store_loc, static_cast<uint32_t>(val.to_ui64()));
       }
       [[gnu::always_inline]] inline void operator()(const f32_store_t& op) {
-         context.inc_pc();
-         const auto& val     = context.pop_operand();
+         const auto& val     = pop_operand();
          void* store_loc     = pop_memop_addr(op);
          write_unaligned(store_loc, static_cast<uint32_t>(val.to_fui32()));
       }
       [[gnu::always_inline]] inline void operator()(const f64_store_t& op) {
-         context.inc_pc();
-         const auto& val     = context.pop_operand();
+         const auto& val     = pop_operand();
          void* store_loc     = pop_memop_addr(op);
          write_unaligned(store_loc, static_cast<uint64_t>(val.to_fui64()));
       }
       [[gnu::always_inline]] inline void operator()(const current_memory_t& op) {
-         context.inc_pc();
-         context.push_operand(i32_const_t{ context.current_linear_memory() });
+         push_operand(i32_const_t{ context.current_linear_memory() });
       }
       [[gnu::always_inline]] inline void operator()(const grow_memory_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand().to_ui32();
+         auto& oper = peek_operand().to_ui32();
          oper       = context.grow_linear_memory(oper);
+         memory     = context.linear_memory();
       }
       [[gnu::always_inline]] inline void operator()(const i32_const_t& op) {
-         context.inc_pc();
-         context.push_operand(op);
+         push_operand(op);
       }
       [[gnu::always_inline]] inline void operator()(const i64_const_t& op) {
-         context.inc_pc();
-         context.push_operand(op);
+         push_operand(op);
       }
       [[gnu::always_inline]] inline void operator()(const f32_const_t& op) {
-         context.inc_pc();
-         context.push_operand(op);
+         push_operand(op);
       }
       [[gnu::always_inline]] inline void operator()(const f64_const_t& op) {
-         context.inc_pc();
-         context.push_operand(op);
+         push_operand(op);
       }
       [[gnu::always_inline]] inline void operator()(const i32_eqz_t& op) {
-         context.inc_pc();
-         auto& t = context.peek_operand().to_ui32();
+         auto& t = peek_operand().to_ui32();
          t       = t == 0;
       }
       [[gnu::always_inline]] inline void operator()(const i32_eq_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui32();
-         auto&       lhs = context.peek_operand().to_ui32();
+         const auto& rhs = pop_operand().to_ui32();
+         auto&       lhs = peek_operand().to_ui32();
          lhs             = lhs == rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i32_ne_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui32();
-         auto&       lhs = context.peek_operand().to_ui32();
+         const auto& rhs = pop_operand().to_ui32();
+         auto&       lhs = peek_operand().to_ui32();
          lhs             = lhs != rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i32_lt_s_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_i32();
-         auto&       lhs = context.peek_operand().to_i32();
+         const auto& rhs = pop_operand().to_i32();
+         auto&       lhs = peek_operand().to_i32();
          lhs             = lhs < rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i32_lt_u_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui32();
-         auto&       lhs = context.peek_operand().to_ui32();
+         const auto& rhs = pop_operand().to_ui32();
+         auto&       lhs = peek_operand().to_ui32();
          lhs             = lhs < rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i32_le_s_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_i32();
-         auto&       lhs = context.peek_operand().to_i32();
+         const auto& rhs = pop_operand().to_i32();
+         auto&       lhs = peek_operand().to_i32();
          lhs             = lhs <= rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i32_le_u_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui32();
-         auto&       lhs = context.peek_operand().to_ui32();
+         const auto& rhs = pop_operand().to_ui32();
+         auto&       lhs = peek_operand().to_ui32();
          lhs             = lhs <= rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i32_gt_s_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_i32();
-         auto&       lhs = context.peek_operand().to_i32();
+         const auto& rhs = pop_operand().to_i32();
+         auto&       lhs = peek_operand().to_i32();
          lhs             = lhs > rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i32_gt_u_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui32();
-         auto&       lhs = context.peek_operand().to_ui32();
+         const auto& rhs = pop_operand().to_ui32();
+         auto&       lhs = peek_operand().to_ui32();
          lhs             = lhs > rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i32_ge_s_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_i32();
-         auto&       lhs = context.peek_operand().to_i32();
+         const auto& rhs = pop_operand().to_i32();
+         auto&       lhs = peek_operand().to_i32();
          lhs             = lhs >= rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i32_ge_u_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui32();
-         auto&       lhs = context.peek_operand().to_ui32();
+         const auto& rhs = pop_operand().to_ui32();
+         auto&       lhs = peek_operand().to_ui32();
          lhs             = lhs >= rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i64_eqz_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          oper       = i32_const_t{ oper.to_ui64() == 0 };
       }
       [[gnu::always_inline]] inline void operator()(const i64_eq_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui64();
-         auto&       lhs = context.peek_operand();
+         const auto& rhs = pop_operand().to_ui64();
+         auto&       lhs = peek_operand();
          lhs             = i32_const_t{ lhs.to_ui64() == rhs };
       }
       [[gnu::always_inline]] inline void operator()(const i64_ne_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui64();
-         auto&       lhs = context.peek_operand();
+         const auto& rhs = pop_operand().to_ui64();
+         auto&       lhs = peek_operand();
          lhs             = i32_const_t{ lhs.to_ui64() != rhs };
       }
       [[gnu::always_inline]] inline void operator()(const i64_lt_s_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_i64();
-         auto&       lhs = context.peek_operand();
+         const auto& rhs = pop_operand().to_i64();
+         auto&       lhs = peek_operand();
          lhs             = i32_const_t{ lhs.to_i64() < rhs };
       }
       [[gnu::always_inline]] inline void operator()(const i64_lt_u_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui64();
-         auto&       lhs = context.peek_operand();
+         const auto& rhs = pop_operand().to_ui64();
+         auto&       lhs = peek_operand();
          lhs             = i32_const_t{ lhs.to_ui64() < rhs };
       }
       [[gnu::always_inline]] inline void operator()(const i64_le_s_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_i64();
-         auto&       lhs = context.peek_operand();
+         const auto& rhs = pop_operand().to_i64();
+         auto&       lhs = peek_operand();
          lhs             = i32_const_t{ lhs.to_i64() <= rhs };
       }
       [[gnu::always_inline]] inline void operator()(const i64_le_u_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui64();
-         auto&       lhs = context.peek_operand();
+         const auto& rhs = pop_operand().to_ui64();
+         auto&       lhs = peek_operand();
          lhs             = i32_const_t{ lhs.to_ui64() <= rhs };
       }
       [[gnu::always_inline]] inline void operator()(const i64_gt_s_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_i64();
-         auto&       lhs = context.peek_operand();
+         const auto& rhs = pop_operand().to_i64();
+         auto&       lhs = peek_operand();
          lhs             = i32_const_t{ lhs.to_i64() > rhs };
       }
       [[gnu::always_inline]] inline void operator()(const i64_gt_u_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui64();
-         auto&       lhs = context.peek_operand();
+         const auto& rhs = pop_operand().to_ui64();
+         auto&       lhs = peek_operand();
          lhs             = i32_const_t{ lhs.to_ui64() > rhs };
       }
       [[gnu::always_inline]] inline void operator()(const i64_ge_s_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_i64();
-         auto&       lhs = context.peek_operand();
+         const auto& rhs = pop_operand().to_i64();
+         auto&       lhs = peek_operand();
          lhs             = i32_const_t{ lhs.to_i64() >= rhs };
       }
       [[gnu::always_inline]] inline void operator()(const i64_ge_u_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui64();
-         auto&       lhs = context.peek_operand();
+         const auto& rhs = pop_operand().to_ui64();
+         auto&       lhs = peek_operand();
          lhs             = i32_const_t{ lhs.to_ui64() >= rhs };
       }
       [[gnu::always_inline]] inline void operator()(const f32_eq_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_f32();
-         auto&       lhs = context.peek_operand();
+         const auto& rhs = pop_operand().to_f32();
+         auto&       lhs = peek_operand();
          if constexpr (use_softfloat)
             lhs = i32_const_t{ (uint32_t)_eosio_f32_eq(lhs.to_f32(), rhs) };
          else
             lhs = i32_const_t{ (uint32_t)(lhs.to_f32() == rhs) };
       }
       [[gnu::always_inline]] inline void operator()(const f32_ne_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_f32();
-         auto&       lhs = context.peek_operand();
+         const auto& rhs = pop_operand().to_f32();
+         auto&       lhs = peek_operand();
          if constexpr (use_softfloat)
             lhs = i32_const_t{ (uint32_t)_eosio_f32_ne(lhs.to_f32(), rhs) };
          else
             lhs = i32_const_t{ (uint32_t)(lhs.to_f32() != rhs) };
       }
       [[gnu::always_inline]] inline void operator()(const f32_lt_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_f32();
-         auto&       lhs = context.peek_operand();
+         const auto& rhs = pop_operand().to_f32();
+         auto&       lhs = peek_operand();
          if constexpr (use_softfloat)
             lhs = i32_const_t{ (uint32_t)_eosio_f32_lt(lhs.to_f32(), rhs) };
          else
             lhs = i32_const_t{ (uint32_t)(lhs.to_f32() < rhs) };
       }
       [[gnu::always_inline]] inline void operator()(const f32_gt_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_f32();
-         auto&       lhs = context.peek_operand();
+         const auto& rhs = pop_operand().to_f32();
+         auto&       lhs = peek_operand();
          if constexpr (use_softfloat)
             lhs = i32_const_t{ (uint32_t)_eosio_f32_gt(lhs.to_f32(), rhs) };
          else
             lhs = i32_const_t{ (uint32_t)(lhs.to_f32() > rhs) };
       }
       [[gnu::always_inline]] inline void operator()(const f32_le_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_f32();
-         auto&       lhs = context.peek_operand();
+         const auto& rhs = pop_operand().to_f32();
+         auto&       lhs = peek_operand();
          if constexpr (use_softfloat)
             lhs = i32_const_t{ (uint32_t)_eosio_f32_le(lhs.to_f32(), rhs) };
          else
             lhs = i32_const_t{ (uint32_t)(lhs.to_f32() <= rhs) };
       }
       [[gnu::always_inline]] inline void operator()(const f32_ge_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_f32();
-         auto&       lhs = context.peek_operand();
+         const auto& rhs = pop_operand().to_f32();
+         auto&       lhs = peek_operand();
          if constexpr (use_softfloat)
             lhs = i32_const_t{ (uint32_t)_eosio_f32_ge(lhs.to_f32(), rhs) };
          else
             lhs = i32_const_t{ (uint32_t)(lhs.to_f32() >= rhs) };
       }
       [[gnu::always_inline]] inline void operator()(const f64_eq_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_f64();
-         auto&       lhs = context.peek_operand();
+         const auto& rhs = pop_operand().to_f64();
+         auto&       lhs = peek_operand();
          if constexpr (use_softfloat)
             lhs = i32_const_t{ (uint32_t)_eosio_f64_eq(lhs.to_f64(), rhs) };
          else
             lhs = i32_const_t{ (uint32_t)(lhs.to_f64() == rhs) };
       }
       [[gnu::always_inline]] inline void operator()(const f64_ne_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_f64();
-         auto&       lhs = context.peek_operand();
+         const auto& rhs = pop_operand().to_f64();
+         auto&       lhs = peek_operand();
          if constexpr (use_softfloat)
             lhs = i32_const_t{ (uint32_t)_eosio_f64_ne(lhs.to_f64(), rhs) };
          else
             lhs = i32_const_t{ (uint32_t)(lhs.to_f64() != rhs) };
       }
       [[gnu::always_inline]] inline void operator()(const f64_lt_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_f64();
-         auto&       lhs = context.peek_operand();
+         const auto& rhs = pop_operand().to_f64();
+         auto&       lhs = peek_operand();
          if constexpr (use_softfloat)
             lhs = i32_const_t{ (uint32_t)_eosio_f64_lt(lhs.to_f64(), rhs) };
          else
             lhs = i32_const_t{ (uint32_t)(lhs.to_f64() < rhs) };
       }
       [[gnu::always_inline]] inline void operator()(const f64_gt_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_f64();
-         auto&       lhs = context.peek_operand();
+         const auto& rhs = pop_operand().to_f64();
+         auto&       lhs = peek_operand();
          if constexpr (use_softfloat)
             lhs = i32_const_t{ (uint32_t)_eosio_f64_gt(lhs.to_f64(), rhs) };
          else
             lhs = i32_const_t{ (uint32_t)(lhs.to_f64() > rhs) };
       }
       [[gnu::always_inline]] inline void operator()(const f64_le_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_f64();
-         auto&       lhs = context.peek_operand();
+         const auto& rhs = pop_operand().to_f64();
+         auto&       lhs = peek_operand();
          if constexpr (use_softfloat)
             lhs = i32_const_t{ (uint32_t)_eosio_f64_le(lhs.to_f64(), rhs) };
          else
             lhs = i32_const_t{ (uint32_t)(lhs.to_f64() <= rhs) };
       }
       [[gnu::always_inline]] inline void operator()(const f64_ge_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_f64();
-         auto&       lhs = context.peek_operand();
+         const auto& rhs = pop_operand().to_f64();
+         auto&       lhs = peek_operand();
          if constexpr (use_softfloat)
             lhs = i32_const_t{ (uint32_t)_eosio_f64_ge(lhs.to_f64(), rhs) };
          else
             lhs = i32_const_t{ (uint32_t)(lhs.to_f64() >= rhs) };
       }
       [[gnu::always_inline]] inline void operator()(const i32_clz_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand().to_ui32();
+         auto& oper = peek_operand().to_ui32();
          // __builtin_clz(0) is undefined
          oper = oper == 0 ? 32 : __builtin_clz(oper);
       }
       [[gnu::always_inline]] inline void operator()(const i32_ctz_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand().to_ui32();
+         auto& oper = peek_operand().to_ui32();
 
          // __builtin_ctz(0) is undefined
          oper = oper == 0 ? 32 : __builtin_ctz(oper);
       }
       [[gnu::always_inline]] inline void operator()(const i32_popcnt_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand().to_ui32();
+         auto& oper = peek_operand().to_ui32();
          oper       = __builtin_popcount(oper);
       }
       [[gnu::always_inline]] inline void operator()(const i32_add_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui32();
-         auto&       lhs = context.peek_operand().to_ui32();
+         const auto& rhs = pop_operand().to_ui32();
+         auto&       lhs = peek_operand().to_ui32();
          lhs += rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i32_sub_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui32();
-         auto&       lhs = context.peek_operand().to_ui32();
+         const auto& rhs = pop_operand().to_ui32();
+         auto&       lhs = peek_operand().to_ui32();
          lhs -= rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i32_mul_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui32();
-         auto&       lhs = context.peek_operand().to_ui32();
+         const auto& rhs = pop_operand().to_ui32();
+         auto&       lhs = peek_operand().to_ui32();
          lhs *= rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i32_div_s_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_i32();
-         auto&       lhs = context.peek_operand().to_i32();
+         const auto& rhs = pop_operand().to_i32();
+         auto&       lhs = peek_operand().to_i32();
          EOS_VM_ASSERT(rhs != 0, wasm_interpreter_exception, "i32.div_s divide by zero");
          EOS_VM_ASSERT(!(lhs == std::numeric_limits<int32_t>::min() && rhs == -1), wasm_interpreter_exception,
                        "i32.div_s traps when I32_MAX/-1");
          lhs /= rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i32_div_u_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui32();
-         auto&       lhs = context.peek_operand().to_ui32();
+         const auto& rhs = pop_operand().to_ui32();
+         auto&       lhs = peek_operand().to_ui32();
          EOS_VM_ASSERT(rhs != 0, wasm_interpreter_exception, "i32.div_u divide by zero");
          lhs /= rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i32_rem_s_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_i32();
-         auto&       lhs = context.peek_operand().to_i32();
+         const auto& rhs = pop_operand().to_i32();
+         auto&       lhs = peek_operand().to_i32();
          EOS_VM_ASSERT(rhs != 0, wasm_interpreter_exception, "i32.rem_s divide by zero");
          if (UNLIKELY(lhs == std::numeric_limits<int32_t>::min() && rhs == -1))
             lhs = 0;
@@ -582,125 +529,107 @@ namespace eosio { namespace vm {
             lhs %= rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i32_rem_u_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui32();
-         auto&       lhs = context.peek_operand().to_ui32();
+         const auto& rhs = pop_operand().to_ui32();
+         auto&       lhs = peek_operand().to_ui32();
          EOS_VM_ASSERT(rhs != 0, wasm_interpreter_exception, "i32.rem_u divide by zero");
          lhs %= rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i32_and_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui32();
-         auto&       lhs = context.peek_operand().to_ui32();
+         const auto& rhs = pop_operand().to_ui32();
+         auto&       lhs = peek_operand().to_ui32();
          lhs &= rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i32_or_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui32();
-         auto&       lhs = context.peek_operand().to_ui32();
+         const auto& rhs = pop_operand().to_ui32();
+         auto&       lhs = peek_operand().to_ui32();
          lhs |= rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i32_xor_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui32();
-         auto&       lhs = context.peek_operand().to_ui32();
+         const auto& rhs = pop_operand().to_ui32();
+         auto&       lhs = peek_operand().to_ui32();
          lhs ^= rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i32_shl_t& op) {
-         context.inc_pc();
          static constexpr uint32_t mask = (8 * sizeof(uint32_t) - 1);
-         const auto& rhs = context.pop_operand().to_ui32();
-         auto&       lhs = context.peek_operand().to_ui32();
+         const auto& rhs = pop_operand().to_ui32();
+         auto&       lhs = peek_operand().to_ui32();
          lhs <<= (rhs & mask);
       }
       [[gnu::always_inline]] inline void operator()(const i32_shr_s_t& op) {
-         context.inc_pc();
          static constexpr uint32_t mask = (8 * sizeof(uint32_t) - 1);
-         const auto& rhs = context.pop_operand().to_ui32();
-         auto&       lhs = context.peek_operand().to_i32();
+         const auto& rhs = pop_operand().to_ui32();
+         auto&       lhs = peek_operand().to_i32();
          lhs >>= (rhs & mask);
       }
       [[gnu::always_inline]] inline void operator()(const i32_shr_u_t& op) {
-         context.inc_pc();
          static constexpr uint32_t mask = (8 * sizeof(uint32_t) - 1);
-         const auto& rhs = context.pop_operand().to_ui32();
-         auto&       lhs = context.peek_operand().to_ui32();
+         const auto& rhs = pop_operand().to_ui32();
+         auto&       lhs = peek_operand().to_ui32();
          lhs >>= (rhs & mask);
       }
       [[gnu::always_inline]] inline void operator()(const i32_rotl_t& op) {
 
-         context.inc_pc();
          static constexpr uint32_t mask = (8 * sizeof(uint32_t) - 1);
-         const auto&               rhs  = context.pop_operand().to_ui32();
-         auto&                     lhs  = context.peek_operand().to_ui32();
+         const auto&               rhs  = pop_operand().to_ui32();
+         auto&                     lhs  = peek_operand().to_ui32();
          uint32_t                  c    = rhs;
          c &= mask;
          lhs = (lhs << c) | (lhs >> ((-c) & mask));
       }
       [[gnu::always_inline]] inline void operator()(const i32_rotr_t& op) {
-         context.inc_pc();
          static constexpr uint32_t mask = (8 * sizeof(uint32_t) - 1);
-         const auto&               rhs  = context.pop_operand().to_ui32();
-         auto&                     lhs  = context.peek_operand().to_ui32();
+         const auto&               rhs  = pop_operand().to_ui32();
+         auto&                     lhs  = peek_operand().to_ui32();
          uint32_t                  c    = rhs;
          c &= mask;
          lhs = (lhs >> c) | (lhs << ((-c) & mask));
       }
       [[gnu::always_inline]] inline void operator()(const i64_clz_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand().to_ui64();
+         auto& oper = peek_operand().to_ui64();
          // __builtin_clzll(0) is undefined
          oper = oper == 0 ? 64 : __builtin_clzll(oper);
       }
       [[gnu::always_inline]] inline void operator()(const i64_ctz_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand().to_ui64();
+         auto& oper = peek_operand().to_ui64();
          // __builtin_clzll(0) is undefined
          oper = oper == 0 ? 64 : __builtin_ctzll(oper);
       }
       [[gnu::always_inline]] inline void operator()(const i64_popcnt_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand().to_ui64();
+         auto& oper = peek_operand().to_ui64();
          oper       = __builtin_popcountll(oper);
       }
       [[gnu::always_inline]] inline void operator()(const i64_add_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui64();
-         auto&       lhs = context.peek_operand().to_ui64();
+         const auto& rhs = pop_operand().to_ui64();
+         auto&       lhs = peek_operand().to_ui64();
          lhs += rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i64_sub_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui64();
-         auto&       lhs = context.peek_operand().to_ui64();
+         const auto& rhs = pop_operand().to_ui64();
+         auto&       lhs = peek_operand().to_ui64();
          lhs -= rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i64_mul_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui64();
-         auto&       lhs = context.peek_operand().to_ui64();
+         const auto& rhs = pop_operand().to_ui64();
+         auto&       lhs = peek_operand().to_ui64();
          lhs *= rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i64_div_s_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_i64();
-         auto&       lhs = context.peek_operand().to_i64();
+         const auto& rhs = pop_operand().to_i64();
+         auto&       lhs = peek_operand().to_i64();
          EOS_VM_ASSERT(rhs != 0, wasm_interpreter_exception, "i64.div_s divide by zero");
          EOS_VM_ASSERT(!(lhs == std::numeric_limits<int64_t>::min() && rhs == -1), wasm_interpreter_exception,
                        "i64.div_s traps when I64_MAX/-1");
          lhs /= rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i64_div_u_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui64();
-         auto&       lhs = context.peek_operand().to_ui64();
+         const auto& rhs = pop_operand().to_ui64();
+         auto&       lhs = peek_operand().to_ui64();
          EOS_VM_ASSERT(rhs != 0, wasm_interpreter_exception, "i64.div_u divide by zero");
          lhs /= rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i64_rem_s_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_i64();
-         auto&       lhs = context.peek_operand().to_i64();
+         const auto& rhs = pop_operand().to_i64();
+         auto&       lhs = peek_operand().to_i64();
          EOS_VM_ASSERT(rhs != 0, wasm_interpreter_exception, "i64.rem_s divide by zero");
          if (UNLIKELY(lhs == std::numeric_limits<int64_t>::min() && rhs == -1))
             lhs = 0;
@@ -708,199 +637,174 @@ namespace eosio { namespace vm {
             lhs %= rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i64_rem_u_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui64();
-         auto&       lhs = context.peek_operand().to_ui64();
+         const auto& rhs = pop_operand().to_ui64();
+         auto&       lhs = peek_operand().to_ui64();
          EOS_VM_ASSERT(rhs != 0, wasm_interpreter_exception, "i64.rem_s divide by zero");
          lhs %= rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i64_and_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui64();
-         auto&       lhs = context.peek_operand().to_ui64();
+         const auto& rhs = pop_operand().to_ui64();
+         auto&       lhs = peek_operand().to_ui64();
          lhs &= rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i64_or_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui64();
-         auto&       lhs = context.peek_operand().to_ui64();
+         const auto& rhs = pop_operand().to_ui64();
+         auto&       lhs = peek_operand().to_ui64();
          lhs |= rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i64_xor_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand().to_ui64();
-         auto&       lhs = context.peek_operand().to_ui64();
+         const auto& rhs = pop_operand().to_ui64();
+         auto&       lhs = peek_operand().to_ui64();
          lhs ^= rhs;
       }
       [[gnu::always_inline]] inline void operator()(const i64_shl_t& op) {
-         context.inc_pc();
          static constexpr uint64_t mask = (8 * sizeof(uint64_t) - 1);
-         const auto& rhs = context.pop_operand().to_ui64();
-         auto&       lhs = context.peek_operand().to_ui64();
+         const auto& rhs = pop_operand().to_ui64();
+         auto&       lhs = peek_operand().to_ui64();
          lhs <<= (rhs & mask);
       }
       [[gnu::always_inline]] inline void operator()(const i64_shr_s_t& op) {
-         context.inc_pc();
          static constexpr uint64_t mask = (8 * sizeof(uint64_t) - 1);
-         const auto& rhs = context.pop_operand().to_ui64();
-         auto&       lhs = context.peek_operand().to_i64();
+         const auto& rhs = pop_operand().to_ui64();
+         auto&       lhs = peek_operand().to_i64();
          lhs >>= (rhs & mask);
       }
       [[gnu::always_inline]] inline void operator()(const i64_shr_u_t& op) {
-         context.inc_pc();
          static constexpr uint64_t mask = (8 * sizeof(uint64_t) - 1);
-         const auto& rhs = context.pop_operand().to_ui64();
-         auto&       lhs = context.peek_operand().to_ui64();
+         const auto& rhs = pop_operand().to_ui64();
+         auto&       lhs = peek_operand().to_ui64();
          lhs >>= (rhs & mask);
       }
       [[gnu::always_inline]] inline void operator()(const i64_rotl_t& op) {
-         context.inc_pc();
          static constexpr uint64_t mask = (8 * sizeof(uint64_t) - 1);
-         const auto&               rhs  = context.pop_operand().to_ui64();
-         auto&                     lhs  = context.peek_operand().to_ui64();
+         const auto&               rhs  = pop_operand().to_ui64();
+         auto&                     lhs  = peek_operand().to_ui64();
          uint32_t                  c    = rhs;
          c &= mask;
          lhs = (lhs << c) | (lhs >> (-c & mask));
       }
       [[gnu::always_inline]] inline void operator()(const i64_rotr_t& op) {
-         context.inc_pc();
          static constexpr uint64_t mask = (8 * sizeof(uint64_t) - 1);
-         const auto&               rhs  = context.pop_operand().to_ui64();
-         auto&                     lhs  = context.peek_operand().to_ui64();
+         const auto&               rhs  = pop_operand().to_ui64();
+         auto&                     lhs  = peek_operand().to_ui64();
          uint32_t                  c    = rhs;
          c &= mask;
          lhs = (lhs >> c) | (lhs << (-c & mask));
       }
       [[gnu::always_inline]] inline void operator()(const f32_abs_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand().to_f32();
+         auto& oper = peek_operand().to_f32();
          if constexpr (use_softfloat)
             oper = _eosio_f32_abs(oper);
          else
             oper = __builtin_fabsf(oper);
       }
       [[gnu::always_inline]] inline void operator()(const f32_neg_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand().to_f32();
+         auto& oper = peek_operand().to_f32();
          if constexpr (use_softfloat)
             oper = _eosio_f32_neg(oper);
          else
             oper = -oper;
       }
       [[gnu::always_inline]] inline void operator()(const f32_ceil_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand().to_f32();
+         auto& oper = peek_operand().to_f32();
          if constexpr (use_softfloat)
             oper = _eosio_f32_ceil(oper);
          else
             oper = __builtin_ceilf(oper);
       }
       [[gnu::always_inline]] inline void operator()(const f32_floor_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand().to_f32();
+         auto& oper = peek_operand().to_f32();
          if constexpr (use_softfloat)
             oper = _eosio_f32_floor(oper);
          else
             oper = __builtin_floorf(oper);
       }
       [[gnu::always_inline]] inline void operator()(const f32_trunc_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand().to_f32();
+         auto& oper = peek_operand().to_f32();
          if constexpr (use_softfloat)
             oper = _eosio_f32_trunc(oper);
          else
             oper = __builtin_trunc(oper);
       }
       [[gnu::always_inline]] inline void operator()(const f32_nearest_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand().to_f32();
+         auto& oper = peek_operand().to_f32();
          if constexpr (use_softfloat)
             oper = _eosio_f32_nearest(oper);
          else
             oper = __builtin_nearbyintf(oper);
       }
       [[gnu::always_inline]] inline void operator()(const f32_sqrt_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand().to_f32();
+         auto& oper = peek_operand().to_f32();
          if constexpr (use_softfloat)
             oper = _eosio_f32_sqrt(oper);
          else
             oper = __builtin_sqrtf(oper);
       }
       [[gnu::always_inline]] inline void operator()(const f32_add_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand();
-         auto&       lhs = context.peek_operand().to_f32();
+         const auto& rhs = pop_operand();
+         auto&       lhs = peek_operand().to_f32();
          if constexpr (use_softfloat)
             lhs = _eosio_f32_add(lhs, rhs.to_f32());
          else
             lhs += rhs.to_f32();
       }
       [[gnu::always_inline]] inline void operator()(const f32_sub_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand();
-         auto&       lhs = context.peek_operand().to_f32();
+         const auto& rhs = pop_operand();
+         auto&       lhs = peek_operand().to_f32();
          if constexpr (use_softfloat)
             lhs = _eosio_f32_sub(lhs, rhs.to_f32());
          else
             lhs -= rhs.to_f32();
       }
       [[gnu::always_inline]] inline void operator()(const f32_mul_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand();
-         auto&       lhs = context.peek_operand().to_f32();
+         const auto& rhs = pop_operand();
+         auto&       lhs = peek_operand().to_f32();
          if constexpr (use_softfloat) {
             lhs = _eosio_f32_mul(lhs, rhs.to_f32());
          } else
             lhs *= rhs.to_f32();
       }
       [[gnu::always_inline]] inline void operator()(const f32_div_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand();
-         auto&       lhs = context.peek_operand().to_f32();
+         const auto& rhs = pop_operand();
+         auto&       lhs = peek_operand().to_f32();
          if constexpr (use_softfloat)
             lhs = _eosio_f32_div(lhs, rhs.to_f32());
          else
             lhs /= rhs.to_f32();
       }
       [[gnu::always_inline]] inline void operator()(const f32_min_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand();
-         auto&       lhs = context.peek_operand().to_f32();
+         const auto& rhs = pop_operand();
+         auto&       lhs = peek_operand().to_f32();
          if constexpr (use_softfloat)
             lhs = _eosio_f32_min(lhs, rhs.to_f32());
          else
             lhs = __builtin_fminf(lhs, rhs.to_f32());
       }
       [[gnu::always_inline]] inline void operator()(const f32_max_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand();
-         auto&       lhs = context.peek_operand().to_f32();
+         const auto& rhs = pop_operand();
+         auto&       lhs = peek_operand().to_f32();
          if constexpr (use_softfloat)
             lhs = _eosio_f32_max(lhs, rhs.to_f32());
          else
             lhs = __builtin_fmaxf(lhs, rhs.to_f32());
       }
       [[gnu::always_inline]] inline void operator()(const f32_copysign_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand();
-         auto&       lhs = context.peek_operand().to_f32();
+         const auto& rhs = pop_operand();
+         auto&       lhs = peek_operand().to_f32();
          if constexpr (use_softfloat)
             lhs = _eosio_f32_copysign(lhs, rhs.to_f32());
          else
             lhs = __builtin_copysignf(lhs, rhs.to_f32());
       }
       [[gnu::always_inline]] inline void operator()(const f64_abs_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand().to_f64();
+         auto& oper = peek_operand().to_f64();
          if constexpr (use_softfloat)
             oper = _eosio_f64_abs(oper);
          else
             oper = __builtin_fabs(oper);
       }
       [[gnu::always_inline]] inline void operator()(const f64_neg_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand().to_f64();
+         auto& oper = peek_operand().to_f64();
          if constexpr (use_softfloat)
             oper = _eosio_f64_neg(oper);
          else
@@ -908,116 +812,102 @@ namespace eosio { namespace vm {
       }
       [[gnu::always_inline]] inline void operator()(const f64_ceil_t& op) {
 
-         context.inc_pc();
-         auto& oper = context.peek_operand().to_f64();
+         auto& oper = peek_operand().to_f64();
          if constexpr (use_softfloat)
             oper = _eosio_f64_ceil(oper);
          else
             oper = __builtin_ceil(oper);
       }
       [[gnu::always_inline]] inline void operator()(const f64_floor_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand().to_f64();
+         auto& oper = peek_operand().to_f64();
          if constexpr (use_softfloat)
             oper = _eosio_f64_floor(oper);
          else
             oper = __builtin_floor(oper);
       }
       [[gnu::always_inline]] inline void operator()(const f64_trunc_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand().to_f64();
+         auto& oper = peek_operand().to_f64();
          if constexpr (use_softfloat)
             oper = _eosio_f64_trunc(oper);
          else
             oper = __builtin_trunc(oper);
       }
       [[gnu::always_inline]] inline void operator()(const f64_nearest_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand().to_f64();
+         auto& oper = peek_operand().to_f64();
          if constexpr (use_softfloat)
             oper = _eosio_f64_nearest(oper);
          else
             oper = __builtin_nearbyint(oper);
       }
       [[gnu::always_inline]] inline void operator()(const f64_sqrt_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand().to_f64();
+         auto& oper = peek_operand().to_f64();
          if constexpr (use_softfloat)
             oper = _eosio_f64_sqrt(oper);
          else
             oper = __builtin_sqrt(oper);
       }
       [[gnu::always_inline]] inline void operator()(const f64_add_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand();
-         auto&       lhs = context.peek_operand().to_f64();
+         const auto& rhs = pop_operand();
+         auto&       lhs = peek_operand().to_f64();
          if constexpr (use_softfloat)
             lhs = _eosio_f64_add(lhs, rhs.to_f64());
          else
             lhs += rhs.to_f64();
       }
       [[gnu::always_inline]] inline void operator()(const f64_sub_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand();
-         auto&       lhs = context.peek_operand().to_f64();
+         const auto& rhs = pop_operand();
+         auto&       lhs = peek_operand().to_f64();
          if constexpr (use_softfloat)
             lhs = _eosio_f64_sub(lhs, rhs.to_f64());
          else
             lhs -= rhs.to_f64();
       }
       [[gnu::always_inline]] inline void operator()(const f64_mul_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand();
-         auto&       lhs = context.peek_operand().to_f64();
+         const auto& rhs = pop_operand();
+         auto&       lhs = peek_operand().to_f64();
          if constexpr (use_softfloat)
             lhs = _eosio_f64_mul(lhs, rhs.to_f64());
          else
             lhs *= rhs.to_f64();
       }
       [[gnu::always_inline]] inline void operator()(const f64_div_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand();
-         auto&       lhs = context.peek_operand().to_f64();
+         const auto& rhs = pop_operand();
+         auto&       lhs = peek_operand().to_f64();
          if constexpr (use_softfloat)
             lhs = _eosio_f64_div(lhs, rhs.to_f64());
          else
             lhs /= rhs.to_f64();
       }
       [[gnu::always_inline]] inline void operator()(const f64_min_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand();
-         auto&       lhs = context.peek_operand().to_f64();
+         const auto& rhs = pop_operand();
+         auto&       lhs = peek_operand().to_f64();
          if constexpr (use_softfloat)
             lhs = _eosio_f64_min(lhs, rhs.to_f64());
          else
             lhs = __builtin_fmin(lhs, rhs.to_f64());
       }
       [[gnu::always_inline]] inline void operator()(const f64_max_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand();
-         auto&       lhs = context.peek_operand().to_f64();
+         const auto& rhs = pop_operand();
+         auto&       lhs = peek_operand().to_f64();
          if constexpr (use_softfloat)
             lhs = _eosio_f64_max(lhs, rhs.to_f64());
          else
             lhs = __builtin_fmax(lhs, rhs.to_f64());
       }
       [[gnu::always_inline]] inline void operator()(const f64_copysign_t& op) {
-         context.inc_pc();
-         const auto& rhs = context.pop_operand();
-         auto&       lhs = context.peek_operand().to_f64();
+         const auto& rhs = pop_operand();
+         auto&       lhs = peek_operand().to_f64();
          if constexpr (use_softfloat)
             lhs = _eosio_f64_copysign(lhs, rhs.to_f64());
          else
             lhs = __builtin_copysign(lhs, rhs.to_f64());
       }
       [[gnu::always_inline]] inline void operator()(const i32_wrap_i64_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          oper       = i32_const_t{ static_cast<int32_t>(oper.to_i64()) };
       }
       [[gnu::always_inline]] inline void operator()(const i32_trunc_s_f32_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          if constexpr (use_softfloat) {
             oper = i32_const_t{ _eosio_f32_trunc_i32s(oper.to_f32()) };
          } else {
@@ -1028,8 +918,7 @@ namespace eosio { namespace vm {
          }
       }
       [[gnu::always_inline]] inline void operator()(const i32_trunc_u_f32_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          if constexpr (use_softfloat) {
             oper = i32_const_t{ _eosio_f32_trunc_i32u(oper.to_f32()) };
          } else {
@@ -1040,8 +929,7 @@ namespace eosio { namespace vm {
          }
       }
       [[gnu::always_inline]] inline void operator()(const i32_trunc_s_f64_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          if constexpr (use_softfloat) {
             oper = i32_const_t{ _eosio_f64_trunc_i32s(oper.to_f64()) };
          } else {
@@ -1052,8 +940,7 @@ namespace eosio { namespace vm {
          }
       }
       [[gnu::always_inline]] inline void operator()(const i32_trunc_u_f64_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          if constexpr (use_softfloat) {
             oper = i32_const_t{ _eosio_f64_trunc_i32u(oper.to_f64()) };
          } else {
@@ -1064,18 +951,15 @@ namespace eosio { namespace vm {
          }
       }
       [[gnu::always_inline]] inline void operator()(const i64_extend_s_i32_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          oper       = i64_const_t{ static_cast<int64_t>(oper.to_i32()) };
       }
       [[gnu::always_inline]] inline void operator()(const i64_extend_u_i32_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          oper       = i64_const_t{ static_cast<uint64_t>(oper.to_ui32()) };
       }
       [[gnu::always_inline]] inline void operator()(const i64_trunc_s_f32_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          if constexpr (use_softfloat) {
             oper = i64_const_t{ _eosio_f32_trunc_i64s(oper.to_f32()) };
          } else {
@@ -1086,8 +970,7 @@ namespace eosio { namespace vm {
          }
       }
       [[gnu::always_inline]] inline void operator()(const i64_trunc_u_f32_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          if constexpr (use_softfloat) {
             oper = i64_const_t{ _eosio_f32_trunc_i64u(oper.to_f32()) };
          } else {
@@ -1098,8 +981,7 @@ namespace eosio { namespace vm {
          }
       }
       [[gnu::always_inline]] inline void operator()(const i64_trunc_s_f64_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          if constexpr (use_softfloat) {
             oper = i64_const_t{ _eosio_f64_trunc_i64s(oper.to_f64()) };
          } else {
@@ -1110,8 +992,7 @@ namespace eosio { namespace vm {
          }
       }
       [[gnu::always_inline]] inline void operator()(const i64_trunc_u_f64_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          if constexpr (use_softfloat) {
             oper = i64_const_t{ _eosio_f64_trunc_i64u(oper.to_f64()) };
          } else {
@@ -1122,8 +1003,7 @@ namespace eosio { namespace vm {
          }
       }
       [[gnu::always_inline]] inline void operator()(const f32_convert_s_i32_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          if constexpr (use_softfloat) {
             oper = f32_const_t{ _eosio_i32_to_f32(oper.to_i32()) };
          } else {
@@ -1131,8 +1011,7 @@ namespace eosio { namespace vm {
          }
       }
       [[gnu::always_inline]] inline void operator()(const f32_convert_u_i32_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          if constexpr (use_softfloat) {
             oper = f32_const_t{ _eosio_ui32_to_f32(oper.to_ui32()) };
          } else {
@@ -1140,8 +1019,7 @@ namespace eosio { namespace vm {
          }
       }
       [[gnu::always_inline]] inline void operator()(const f32_convert_s_i64_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          if constexpr (use_softfloat) {
             oper = f32_const_t{ _eosio_i64_to_f32(oper.to_i64()) };
          } else {
@@ -1149,8 +1027,7 @@ namespace eosio { namespace vm {
          }
       }
       [[gnu::always_inline]] inline void operator()(const f32_convert_u_i64_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          if constexpr (use_softfloat) {
             oper = f32_const_t{ _eosio_ui64_to_f32(oper.to_ui64()) };
          } else {
@@ -1158,8 +1035,7 @@ namespace eosio { namespace vm {
          }
       }
       [[gnu::always_inline]] inline void operator()(const f32_demote_f64_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          if constexpr (use_softfloat) {
             oper = f32_const_t{ _eosio_f64_demote(oper.to_f64()) };
          } else {
@@ -1167,8 +1043,7 @@ namespace eosio { namespace vm {
          }
       }
       [[gnu::always_inline]] inline void operator()(const f64_convert_s_i32_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          if constexpr (use_softfloat) {
             oper = f64_const_t{ _eosio_i32_to_f64(oper.to_i32()) };
          } else {
@@ -1176,8 +1051,7 @@ namespace eosio { namespace vm {
          }
       }
       [[gnu::always_inline]] inline void operator()(const f64_convert_u_i32_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          if constexpr (use_softfloat) {
             oper = f64_const_t{ _eosio_ui32_to_f64(oper.to_ui32()) };
          } else {
@@ -1185,8 +1059,7 @@ namespace eosio { namespace vm {
          }
       }
       [[gnu::always_inline]] inline void operator()(const f64_convert_s_i64_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          if constexpr (use_softfloat) {
             oper = f64_const_t{ _eosio_i64_to_f64(oper.to_i64()) };
          } else {
@@ -1194,8 +1067,7 @@ namespace eosio { namespace vm {
          }
       }
       [[gnu::always_inline]] inline void operator()(const f64_convert_u_i64_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          if constexpr (use_softfloat) {
             oper = f64_const_t{ _eosio_ui64_to_f64(oper.to_ui64()) };
          } else {
@@ -1203,8 +1075,7 @@ namespace eosio { namespace vm {
          }
       }
       [[gnu::always_inline]] inline void operator()(const f64_promote_f32_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          if constexpr (use_softfloat) {
             oper = f64_const_t{ _eosio_f32_promote(oper.to_f32()) };
          } else {
@@ -1212,25 +1083,125 @@ namespace eosio { namespace vm {
          }
       }
       [[gnu::always_inline]] inline void operator()(const i32_reinterpret_f32_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          oper       = i32_const_t{ oper.to_fui32() };
       }
       [[gnu::always_inline]] inline void operator()(const i64_reinterpret_f64_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          oper       = i64_const_t{ oper.to_fui64() };
       }
       [[gnu::always_inline]] inline void operator()(const f32_reinterpret_i32_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          oper       = f32_const_t{ oper.to_ui32() };
       }
       [[gnu::always_inline]] inline void operator()(const f64_reinterpret_i64_t& op) {
-         context.inc_pc();
-         auto& oper = context.peek_operand();
+         auto& oper = peek_operand();
          oper       = f64_const_t{ oper.to_ui64() };
       }
+
+      // Superinstructions
+      [[gnu::always_inline]] inline void operator()(const get_local_get_local_t& op) {
+         push_operand(fp[op.index]);
+         push_operand(fp[op.index2]);
+      }
+      [[gnu::always_inline]] inline void operator()(const set_local_get_local_t& op) {
+         fp[op.index] = pop_operand();
+         push_operand(fp[op.index2]);
+      }
+      [[gnu::always_inline]] inline void operator()(const get_local_i32_const_t& op) {
+         push_operand(fp[op.index]);
+         push_operand(i32_const_t{ op.value });
+      }
+      [[gnu::always_inline]] inline void operator()(const local_i32_add_const_t& op) {
+         push_operand(i32_const_t{ fp[op.index].to_ui32() + op.value });
+      }
+      [[gnu::always_inline]] inline void operator()(const i32_add_const_t& op) {
+         peek_operand().to_ui32() += op.value;
+      }
+      [[gnu::always_inline]] inline void operator()(const i32_and_const_t& op) {
+         peek_operand().to_ui32() &= op.value;
+      }
+      template<typename Op>
+      inline void * local_memop_addr(const Op& op) {
+         return align_address((memory + op.offset + fp[op.index].to_ui32()), op.flags_align);
+      }
+      [[gnu::always_inline]] inline void operator()(const local_i32_load_t& op) {
+         void* _ptr = local_memop_addr(op);
+         push_operand(i32_const_t{ read_unaligned<uint32_t>(_ptr) });
+      }
+      [[gnu::always_inline]] inline void operator()(const local_i64_load_t& op) {
+         void* _ptr = local_memop_addr(op);
+         push_operand(i64_const_t{ read_unaligned<uint64_t>(_ptr) });
+      }
+      // The local is the stored value, not the address
+      [[gnu::always_inline]] inline void operator()(const local_i32_store_t& op) {
+         void* store_loc = pop_memop_addr(op);
+         write_unaligned(store_loc, fp[op.index].to_ui32());
+      }
+      [[gnu::always_inline]] inline void operator()(const local_i64_store_t& op) {
+         void* store_loc = pop_memop_addr(op);
+         write_unaligned(store_loc, fp[op.index].to_ui64());
+      }
+      [[gnu::always_inline]] inline void operator()(const i32_const_call_t& op) {
+         context.push_operand(i32_const_t{ op.value });
+         context.call(op.index);
+      }
+      [[gnu::always_inline]] inline void operator()(const i32_eqz_br_if_t& op) {
+         if (context.pop_operand().to_ui32() == 0)
+            context.jump(op.data, op.pc);
+      }
+      [[gnu::always_inline]] inline void operator()(const i32_eq_br_if_t& op) {
+         const auto rhs = context.pop_operand().to_ui32();
+         const auto lhs = context.pop_operand().to_ui32();
+         if (lhs == rhs)
+            context.jump(op.data, op.pc);
+      }
+      [[gnu::always_inline]] inline void operator()(const i32_ne_br_if_t& op) {
+         const auto rhs = context.pop_operand().to_ui32();
+         const auto lhs = context.pop_operand().to_ui32();
+         if (lhs != rhs)
+            context.jump(op.data, op.pc);
+      }
+      [[gnu::always_inline]] inline void operator()(const i32_lt_s_br_if_t& op) {
+         const auto rhs = context.pop_operand().to_i32();
+         const auto lhs = context.pop_operand().to_i32();
+         if (lhs < rhs)
+            context.jump(op.data, op.pc);
+      }
+      [[gnu::always_inline]] inline void operator()(const i32_lt_u_br_if_t& op) {
+         const auto rhs = context.pop_operand().to_ui32();
+         const auto lhs = context.pop_operand().to_ui32();
+         if (lhs < rhs)
+            context.jump(op.data, op.pc);
+      }
+      [[gnu::always_inline]] inline void operator()(const i32_gt_u_br_if_t& op) {
+         const auto rhs = context.pop_operand().to_ui32();
+         const auto lhs = context.pop_operand().to_ui32();
+         if (lhs > rhs)
+            context.jump(op.data, op.pc);
+      }
+      [[gnu::always_inline]] inline void operator()(const i32_ge_u_br_if_t& op) {
+         const auto rhs = context.pop_operand().to_ui32();
+         const auto lhs = context.pop_operand().to_ui32();
+         if (lhs >= rhs)
+            context.jump(op.data, op.pc);
+      }
+      [[gnu::always_inline]] inline void operator()(const i64_eq_br_if_t& op) {
+         const auto rhs = context.pop_operand().to_ui64();
+         const auto lhs = context.pop_operand().to_ui64();
+         if (lhs == rhs)
+            context.jump(op.data, op.pc);
+      }
+      [[gnu::always_inline]] inline void operator()(const i64_ne_br_if_t& op) {
+         const auto rhs = context.pop_operand().to_ui64();
+         const auto lhs = context.pop_operand().to_ui64();
+         if (lhs != rhs)
+            context.jump(op.data, op.pc);
+      }
+      [[gnu::always_inline]] inline void operator()(const local_local_i32_lt_u_br_if_t& op) {
+         if (fp[op.index].to_ui32() < fp[op.index2].to_ui32())
+            context.jump(op.data, op.pc);
+      }
    };
 
 }} // namespace eosio::vm
@@ -6,9 +6,14 @@
 #include <array>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <type_traits>
 
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
 namespace eosio { namespace vm {
    template <size_t N>
    inline size_t constexpr bytes_needed() {
@@ -200,4 +205,79 @@ namespace eosio { namespace vm {
          uint8_t bytes_used = bytes_needed<N>(); 
    };
 
+   namespace detail {
+      // Packs the low 7 bits of each byte together, the first byte lowest
+      inline uint64_t pack_leb128_groups(uint64_t word) {
+#ifdef __BMI2__
+         return _pext_u64(word, 0x7f7f7f7f7f7f7f7full);
+#else
+         word &= 0x7f7f7f7f7f7f7f7full;
+         word = ((word & 0x7f007f007f007f00ull) >> 1) | (word & 0x007f007f007f007full);
+         word = ((word & 0x3fff00003fff0000ull) >> 2) | (word & 0x00003fff00003fffull);
+         word = ((word & 0x0fffffff00000000ull) >> 4) | (word & 0x000000000fffffffull);
+         return word;
+#endif
+      }
+
+      // Decodes a leb128 that ends in the next 8 bytes with a single load.
+      // Returns its length and stores its bits in value, or returns 0 if
+      // fewer than 8 bytes remain or the encoding is longer.
+      inline uint32_t read_leb128_bits(const guarded_ptr<uint8_t>& code, uint64_t& value) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+         if (code.bnds - code.raw_ptr < 8)
+            return 0;
+         uint64_t word;
+         std::memcpy(&word, code.raw_ptr, sizeof(word));
+         // The last byte is the first without the continuation bit
+         uint64_t last = ~word & 0x8080808080808080ull;
+         if (last == 0)
+            return 0;
+         uint32_t len = (__builtin_ctzll(last) >> 3) + 1;
+         value = pack_leb128_groups(word & (~0ull >> (64 - 8 * len)));
+         return len;
+#else
+         return 0;
+#endif
+      }
+
+      inline int64_t sign_extend_leb128(uint64_t value, uint32_t len) {
+         uint32_t unused = 64 - 7 * len;
+         return static_cast<int64_t>(value << unused) >> unused;
+      }
+   } // namespace detail
+
+   // These decode the same values as varuint<32> and varint<N>.  Encodings
+   // that end in the next 8 bytes are decoded without a loop.  Longer ones,
+   // those near the end of the buffer and invalid ones are left to the
+   // careful decoders, which report any errors.
+   inline uint32_t read_varuint32(guarded_ptr<uint8_t>& code) {
+      uint64_t value;
+      uint32_t len = detail::read_leb128_bits(code, value);
+      if (len == 0 || len > bytes_needed<32>() || (value >> 32) != 0)
+         return varuint<32>(code).to();
+      code.raw_ptr += len;
+      return static_cast<uint32_t>(value);
+   }
+
+   inline int32_t read_varint32(guarded_ptr<uint8_t>& code) {
+      uint64_t value;
+      uint32_t len = detail::read_leb128_bits(code, value);
+      if (len == 0 || len > bytes_needed<32>())
+         return varint<32>(code).to();
+      int64_t result = detail::sign_extend_leb128(value, len);
+      if (result != static_cast<int32_t>(result))
+         return varint<32>(code).to();
+      code.raw_ptr += len;
+      return static_cast<int32_t>(result);
+   }
+
+   inline int64_t read_varint64(guarded_ptr<uint8_t>& code) {
+      uint64_t value;
+      uint32_t len = detail::read_leb128_bits(code, value);
+      if (len == 0)
+         return varint<64>(code).to();
+      code.raw_ptr += len;
+      return detail::sign_extend_leb128(value, len);
+   }
+
 }} // ns eosio::vm
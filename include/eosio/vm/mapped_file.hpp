@@ -0,0 +1,83 @@
+#pragma once
+
+#include <eosio/vm/exceptions.hpp>
+#include <eosio/vm/signals.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace eosio { namespace vm {
+
+   // A read-only mapping of a whole file.  Pages are read from the page
+   // cache when they are first touched.
+   //
+   // The file must not be modified or truncated while it is mapped.  A
+   // module loaded from it reads its data segments from the mapping on
+   // every reset, so changes would make instances differ, and reading a
+   // page past the end of a truncated file raises SIGBUS.  To update the
+   // file, write a new one and rename it over the old one: the mapping
+   // keeps the old contents.  A shared flock is held while the file is
+   // mapped, so writers that take an exclusive lock wait until it is
+   // unmapped.  Reads from the mapping go through read_mapped_file, so
+   // that a truncated file is an error instead of a crash.
+   class mapped_file {
+    public:
+      explicit mapped_file(const std::string& fname) {
+         int fd = ::open(fname.c_str(), O_RDONLY | O_CLOEXEC);
+         if (fd < 0)
+            throw std::runtime_error("wasm file not found");
+         struct stat st;
+         if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("cannot read the size of the wasm file");
+         }
+         // Advisory, so failing to take it is not an error
+         ::flock(fd, LOCK_SH);
+         _size = st.st_size;
+         if (_size != 0) {
+            void* data = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+               ::close(fd);
+               throw std::runtime_error("cannot map the wasm file");
+            }
+            _data = static_cast<uint8_t*>(data);
+         }
+         // Kept open to hold the lock
+         _fd = fd;
+      }
+      ~mapped_file() {
+         if (_data)
+            ::munmap(_data, _size);
+         ::close(_fd);
+      }
+      mapped_file(const mapped_file&) = delete;
+      mapped_file& operator=(const mapped_file&) = delete;
+
+      const uint8_t* data() const { return _data; }
+      std::size_t    size() const { return _size; }
+
+    private:
+      uint8_t*    _data = nullptr;
+      std::size_t _size = 0;
+      int         _fd   = -1;
+   };
+
+   // Runs f, which reads from a mapped_file, and turns the SIGBUS raised by
+   // reading past the end of a truncated file into a wasm_parse_exception.
+   // Objects that f creates are leaked if that happens.
+   template <typename F>
+   void read_mapped_file(F&& f) {
+      invoke_with_signal_handler(static_cast<F&&>(f), [](int) {
+         throw wasm_parse_exception{ "the wasm file was changed while it was mapped" };
+      });
+   }
+
+}} // namespace eosio::vm
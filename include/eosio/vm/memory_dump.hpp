@@ -1,11 +1,10 @@
 #pragma once
 
 #include <eosio/vm/opcodes.hpp>
-#include <eosio/vm/variant.hpp>
 
 #include <cstddef>
 #include <cstdint>
-#include <utility>
+#include <type_traits>
 
 namespace eosio { namespace vm {
 
@@ -16,20 +15,19 @@ namespace eosio { namespace vm {
 
 #define MEMORY_DUMP_CONTROL_FLOW_VISIT(name, code) \
    void operator()(const EOS_VM_OPCODE_T(name)& op) { \
-      stream << #name << " : { " << op.data << ", " << op.pc << ", " << op.index << ", " << op.op_index << " }\n"; \
+      stream << #name << " : { " << op.data << ", " << op.pc << " }\n"; \
    }
 
 #define MEMORY_DUMP_BR_TABLE_VISIT(name, code) \
    void operator()(const EOS_VM_OPCODE_T(name)& op) { \
       stream << #name << " : { [ "; \
-      for (uint32_t i=0; i < op.size; i++) { \
-         stream << op.table[i].pc; \
-         if (i < op.size-1) { \
+      for (uint32_t i=0; i <= op.size; i++) { \
+         stream << op.at(i).pc; \
+         if (i < op.size) { \
             stream << ", "; \
          } \
       } \
       stream << " ] }\n"; \
-      index += op.offset; \
    }
 
 #define MEMORY_DUMP_CALL_VISIT(name, code) \
@@ -51,10 +49,26 @@ namespace eosio { namespace vm {
    void operator()(const name##_t& op) { \
       stream << #name << " : { " << op.data.ui << " }\n"; \
    }
-   
+
+// Every immediate of a superinstruction is a uint32_t
+#define MEMORY_DUMP_FUSED_VISIT(name, code) \
+   void operator()(const name##_t& op) { \
+      stream << #name << " : {"; \
+      uint32_t immediates[4]; \
+      auto end = op.pack(reinterpret_cast<uint8_t*>(immediates)); \
+      for (auto* p = immediates; reinterpret_cast<uint8_t*>(p) < end; ++p) \
+         stream << (p == immediates ? " " : ", ") << *p; \
+      stream << " }\n"; \
+   }
+
+#define MEMORY_DUMP_TYPED_GLOBAL_VISIT(name, code) \
+   void operator()(const name##_t& op) { \
+      stream << #name << " : { " << op.ptr << " }\n"; \
+   }
+
    template <typename Stream>
    struct memory_dump_visitor {
-      memory_dump_visitor(Stream&& stream, size_t& i) : stream(stream), index(i) {}
+      memory_dump_visitor(Stream& stream) : stream(stream) {}
       EOS_VM_CONTROL_FLOW_OPS(MEMORY_DUMP_CONTROL_FLOW_VISIT)
       EOS_VM_BR_TABLE_OP(MEMORY_DUMP_BR_TABLE_VISIT)
       EOS_VM_RETURN_OP(MEMORY_DUMP_OP_VISIT)
@@ -62,6 +76,7 @@ namespace eosio { namespace vm {
       EOS_VM_CALL_IMM_OPS(MEMORY_DUMP_CALL_VISIT)
       EOS_VM_PARAMETRIC_OPS(MEMORY_DUMP_OP_VISIT)
       EOS_VM_VARIABLE_ACCESS_OPS(MEMORY_DUMP_VARIABLE_ACCESS_VISIT)
+      EOS_VM_MEMORY_OPS(MEMORY_DUMP_MEMORY_VISIT)
       EOS_VM_I32_CONSTANT_OPS(MEMORY_DUMP_CONST_VISIT)
       EOS_VM_I64_CONSTANT_OPS(MEMORY_DUMP_CONST_VISIT)
       EOS_VM_F32_CONSTANT_OPS(MEMORY_DUMP_CONST_VISIT)
@@ -70,29 +85,30 @@ namespace eosio { namespace vm {
       EOS_VM_NUMERIC_OPS(MEMORY_DUMP_OP_VISIT)
       EOS_VM_CONVERSION_OPS(MEMORY_DUMP_OP_VISIT)
       EOS_VM_EXIT_OP(MEMORY_DUMP_OP_VISIT)
+      EOS_VM_FUSED_OPS(MEMORY_DUMP_FUSED_VISIT)
+      EOS_VM_FUSED_BRANCH_OPS(MEMORY_DUMP_FUSED_VISIT)
+      EOS_VM_TYPED_GLOBAL_OPS(MEMORY_DUMP_TYPED_GLOBAL_VISIT)
       EOS_VM_EMPTY_OPS(MEMORY_DUMP_OP_VISIT)
       EOS_VM_ERROR_OPS(MEMORY_DUMP_OP_VISIT)
       template <typename T>
       inline void operator()(T) { stream << "invalid opcode\n"; }
       Stream& stream;
-      size_t& index;
    };
 
-   template <typename Opcode>
+   // Prints the interpreter's bitcode, one instruction per line
    class memory_dump {
       public:
-         memory_dump(Opcode* opcodes, size_t size) : _opcodes(opcodes), _size(size) {}
+         memory_dump(const uint8_t* code, size_t size) : _code(code), _size(size) {}
 
          template <typename Stream>
          void write(Stream&& stream) {
-            size_t index=0;
-            memory_dump_visitor<Stream> md(std::forward<Stream>(stream), index);
-            for (; index < _size; index++) {
-               eosio::vm::visit(std::move(md), std::move(_opcodes[index]));
+            memory_dump_visitor<std::remove_reference_t<Stream>> md(stream);
+            for (const uint8_t* pos = _code; pos < _code + _size;) {
+               pos = visit_instruction(md, pos);
             }
          }
       private:
-         Opcode* _opcodes = nullptr;
-         size_t  _size    = 0;
+         const uint8_t* _code = nullptr;
+         size_t         _size = 0;
    };
 }} // ns eosio::vm
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <eosio/vm/allocator.hpp>
+#include <eosio/vm/opcodes.hpp>
+#include <eosio/vm/parser.hpp>
+#include <eosio/vm/types.hpp>
+#include <eosio/vm/vector.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace eosio { namespace vm {
+
+   // A writer that emits nothing.  Parsing a module with it runs every
+   // validation check on the function bodies without allocating any code.
+   class null_writer {
+    public:
+      explicit null_writer(growable_allocator&, std::size_t /*source_bytes*/, module&) {}
+
+      struct compiled_function {};
+      null_writer make_worker() const { return {}; }
+      static constexpr bool supports_lazy_compile = false;
+      static constexpr bool supports_code_cache = false;
+      static constexpr bool supports_superinstructions = false;
+      static constexpr bool tracks_operand_depth = false;
+      compiled_function release_function() { return {}; }
+      void link_function(compiled_function&, function_body&, uint32_t) {}
+
+      void emit_unreachable() {}
+      void emit_nop() {}
+      uint32_t emit_end() { return 0; }
+      uint8_t* emit_return(uint32_t) { return nullptr; }
+      void emit_block() {}
+      uint32_t emit_loop() { return 0; }
+      uint8_t* emit_if() { return nullptr; }
+      uint8_t* emit_else(uint8_t*) { return nullptr; }
+      uint8_t* emit_br(uint32_t) { return nullptr; }
+      uint8_t* emit_br_if(uint32_t) { return nullptr; }
+
+      struct br_table_parser {
+         uint8_t* emit_case(uint32_t) { return nullptr; }
+         uint8_t* emit_default(uint32_t) { return nullptr; }
+      };
+      br_table_parser emit_br_table(uint32_t) { return {}; }
+
+      void emit_call(const func_type&, uint32_t) {}
+      void emit_call_indirect(const func_type&, uint32_t) {}
+
+      void emit_drop() {}
+      void emit_select() {}
+      void emit_get_local(uint32_t) {}
+      void emit_set_local(uint32_t) {}
+      void emit_tee_local(uint32_t) {}
+      void emit_get_global(uint32_t) {}
+      void emit_set_global(uint32_t) {}
+
+#define MEM_OP(op_name) \
+      void emit_ ## op_name(uint32_t, uint32_t) {}
+      MEM_OP(i32_load)
+      MEM_OP(i64_load)
+      MEM_OP(f32_load)
+      MEM_OP(f64_load)
+      MEM_OP(i32_load8_s)
+      MEM_OP(i32_load16_s)
+      MEM_OP(i32_load8_u)
+      MEM_OP(i32_load16_u)
+      MEM_OP(i64_load8_s)
+      MEM_OP(i64_load16_s)
+      MEM_OP(i64_load32_s)
+      MEM_OP(i64_load8_u)
+      MEM_OP(i64_load16_u)
+      MEM_OP(i64_load32_u)
+      MEM_OP(i32_store)
+      MEM_OP(i64_store)
+      MEM_OP(f32_store)
+      MEM_OP(f64_store)
+      MEM_OP(i32_store8)
+      MEM_OP(i32_store16)
+      MEM_OP(i64_store8)
+      MEM_OP(i64_store16)
+      MEM_OP(i64_store32)
+#undef MEM_OP
+
+      void emit_current_memory() {}
+      void emit_grow_memory() {}
+
+      void emit_i32_const(uint32_t) {}
+      void emit_i64_const(uint64_t) {}
+      void emit_f32_const(float) {}
+      void emit_f64_const(double) {}
+
+#define OP(opname, code) \
+      void emit_ ## opname() {}
+      EOS_VM_COMPARISON_OPS(OP)
+      EOS_VM_NUMERIC_OPS(OP)
+      EOS_VM_CONVERSION_OPS(OP)
+#undef OP
+
+      void emit_error() {}
+
+      void fix_branch(uint8_t*, uint32_t) {}
+      void emit_prologue(const func_type&, const guarded_vector<local_entry>&, uint32_t) {}
+      void emit_epilogue(const func_type&, const guarded_vector<local_entry>&, uint32_t) {}
+      void finalize(function_body&) {}
+
+    private:
+      null_writer() = default;
+   };
+
+   // Checks that data/size is a valid module, throwing the same exceptions as
+   // loading it would.  The declarations are parsed into a temporary module
+   // that is released on return; no code is generated.
+   inline void validate_module(const uint8_t* data, std::size_t size, const compile_options& options = {}) {
+      module mod;
+      // The parser only reads through the pointer
+      wasm_code_ptr code(const_cast<uint8_t*>(data), size);
+      binary_parser<null_writer>{ mod.allocator, options }.parse_module(code, size, mod);
+   }
+
+   inline void validate_module(const wasm_code& code, const compile_options& options = {}) {
+      validate_module(code.data(), code.size(), options);
+   }
+
+}} // namespace eosio::vm
@@ -2,6 +2,8 @@
 #include <eosio/vm/opcodes_def.hpp>
 #include <eosio/vm/variant.hpp>
 
+#include <cstdint>
+#include <cstring>
 #include <map>
 
 namespace eosio { namespace vm {
@@ -22,6 +24,9 @@ namespace eosio { namespace vm {
       EOS_VM_NUMERIC_OPS(EOS_VM_CREATE_ENUM)
       EOS_VM_CONVERSION_OPS(EOS_VM_CREATE_ENUM)
       EOS_VM_EXIT_OP(EOS_VM_CREATE_ENUM)
+      EOS_VM_FUSED_OPS(EOS_VM_CREATE_ENUM)
+      EOS_VM_FUSED_BRANCH_OPS(EOS_VM_CREATE_ENUM)
+      EOS_VM_TYPED_GLOBAL_OPS(EOS_VM_CREATE_ENUM)
       EOS_VM_EMPTY_OPS(EOS_VM_CREATE_ENUM)
       EOS_VM_ERROR_OPS(EOS_VM_CREATE_ENUM)
    };
@@ -44,11 +49,28 @@ namespace eosio { namespace vm {
          EOS_VM_NUMERIC_OPS(EOS_VM_CREATE_MAP)
          EOS_VM_CONVERSION_OPS(EOS_VM_CREATE_MAP)
          EOS_VM_EXIT_OP(EOS_VM_CREATE_MAP)
+         EOS_VM_FUSED_OPS(EOS_VM_CREATE_MAP)
+         EOS_VM_FUSED_BRANCH_OPS(EOS_VM_CREATE_MAP)
+         EOS_VM_TYPED_GLOBAL_OPS(EOS_VM_CREATE_MAP)
          EOS_VM_EMPTY_OPS(EOS_VM_CREATE_MAP)
          EOS_VM_ERROR_OPS(EOS_VM_CREATE_MAP)
       };
    }; 
 
+   namespace detail {
+      // Immediates are stored unaligned, directly after the opcode byte
+      template <typename T>
+      inline const uint8_t* unpack_immediate(const uint8_t* p, T& value) {
+         std::memcpy(&value, p, sizeof(T));
+         return p + sizeof(T);
+      }
+      template <typename T>
+      inline uint8_t* pack_immediate(uint8_t* p, const T& value) {
+         std::memcpy(p, &value, sizeof(T));
+         return p + sizeof(T);
+      }
+   } // namespace detail
+
    enum imm_types {
       none,
       block_imm,
@@ -73,6 +95,14 @@ namespace eosio { namespace vm {
    EOS_VM_NUMERIC_OPS(EOS_VM_CREATE_TYPES)
    EOS_VM_CONVERSION_OPS(EOS_VM_CREATE_TYPES)
    EOS_VM_EXIT_OP(EOS_VM_CREATE_EXIT_TYPE)
+   EOS_VM_FUSED_LOCAL_PAIR_OPS(EOS_VM_CREATE_FUSED_LOCAL_PAIR_TYPES)
+   EOS_VM_FUSED_LOCAL_CONSTANT_OPS(EOS_VM_CREATE_FUSED_LOCAL_CONSTANT_TYPES)
+   EOS_VM_FUSED_CONSTANT_OPS(EOS_VM_CREATE_FUSED_CONSTANT_TYPES)
+   EOS_VM_FUSED_LOCAL_MEMORY_OPS(EOS_VM_CREATE_FUSED_LOCAL_MEMORY_TYPES)
+   EOS_VM_FUSED_CALL_OPS(EOS_VM_CREATE_FUSED_CALL_TYPES)
+   EOS_VM_FUSED_BR_IF_OPS(EOS_VM_CREATE_FUSED_BR_IF_TYPES)
+   EOS_VM_FUSED_LOCAL_BR_IF_OPS(EOS_VM_CREATE_FUSED_LOCAL_BR_IF_TYPES)
+   EOS_VM_TYPED_GLOBAL_OPS(EOS_VM_CREATE_TYPED_GLOBAL_TYPES)
    EOS_VM_EMPTY_OPS(EOS_VM_CREATE_TYPES)
    EOS_VM_ERROR_OPS(EOS_VM_CREATE_TYPES)
 
@@ -93,7 +123,50 @@ namespace eosio { namespace vm {
       EOS_VM_NUMERIC_OPS(EOS_VM_IDENTITY)
       EOS_VM_CONVERSION_OPS(EOS_VM_IDENTITY)
       EOS_VM_EXIT_OP(EOS_VM_IDENTITY)
+      EOS_VM_FUSED_OPS(EOS_VM_IDENTITY)
+      EOS_VM_FUSED_BRANCH_OPS(EOS_VM_IDENTITY)
+      EOS_VM_TYPED_GLOBAL_OPS(EOS_VM_IDENTITY)
       EOS_VM_EMPTY_OPS(EOS_VM_IDENTITY)
       EOS_VM_ERROR_OPS(EOS_VM_IDENTITY_END)
       >;
+
+#define EOS_VM_VISIT_INSTRUCTION_CASE(name, code)                                                                      \
+   case code: {                                                                                                        \
+      EOS_VM_OPCODE_T(name) op;                                                                                        \
+      const uint8_t* next = op.unpack(p + 1);                                                                          \
+      visitor(op);                                                                                                     \
+      return next;                                                                                                     \
+   }
+
+   // Decodes the instruction at p from the interpreter's bitcode and passes it
+   // to visitor.  Returns the start of the next instruction.
+   template <typename Visitor>
+   inline const uint8_t* visit_instruction(Visitor&& visitor, const uint8_t* p) {
+      switch (*p) {
+         EOS_VM_CONTROL_FLOW_OPS(EOS_VM_VISIT_INSTRUCTION_CASE)
+         EOS_VM_BR_TABLE_OP(EOS_VM_VISIT_INSTRUCTION_CASE)
+         EOS_VM_RETURN_OP(EOS_VM_VISIT_INSTRUCTION_CASE)
+         EOS_VM_CALL_OPS(EOS_VM_VISIT_INSTRUCTION_CASE)
+         EOS_VM_CALL_IMM_OPS(EOS_VM_VISIT_INSTRUCTION_CASE)
+         EOS_VM_PARAMETRIC_OPS(EOS_VM_VISIT_INSTRUCTION_CASE)
+         EOS_VM_VARIABLE_ACCESS_OPS(EOS_VM_VISIT_INSTRUCTION_CASE)
+         EOS_VM_MEMORY_OPS(EOS_VM_VISIT_INSTRUCTION_CASE)
+         EOS_VM_I32_CONSTANT_OPS(EOS_VM_VISIT_INSTRUCTION_CASE)
+         EOS_VM_I64_CONSTANT_OPS(EOS_VM_VISIT_INSTRUCTION_CASE)
+         EOS_VM_F32_CONSTANT_OPS(EOS_VM_VISIT_INSTRUCTION_CASE)
+         EOS_VM_F64_CONSTANT_OPS(EOS_VM_VISIT_INSTRUCTION_CASE)
+         EOS_VM_COMPARISON_OPS(EOS_VM_VISIT_INSTRUCTION_CASE)
+         EOS_VM_NUMERIC_OPS(EOS_VM_VISIT_INSTRUCTION_CASE)
+         EOS_VM_CONVERSION_OPS(EOS_VM_VISIT_INSTRUCTION_CASE)
+         EOS_VM_EXIT_OP(EOS_VM_VISIT_INSTRUCTION_CASE)
+         EOS_VM_FUSED_OPS(EOS_VM_VISIT_INSTRUCTION_CASE)
+         EOS_VM_FUSED_BRANCH_OPS(EOS_VM_VISIT_INSTRUCTION_CASE)
+         EOS_VM_TYPED_GLOBAL_OPS(EOS_VM_VISIT_INSTRUCTION_CASE)
+         EOS_VM_EMPTY_OPS(EOS_VM_VISIT_INSTRUCTION_CASE)
+         EOS_VM_ERROR_OPS(EOS_VM_VISIT_INSTRUCTION_CASE)
+      }
+      __builtin_unreachable();
+   }
+
+#undef EOS_VM_VISIT_INSTRUCTION_CASE
 }} // namespace eosio::vm
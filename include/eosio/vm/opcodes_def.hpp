@@ -212,32 +212,57 @@
    opcode_macro(f64_reinterpret_i64, 0xBF)
 #define EOS_VM_EXIT_OP(opcode_macro)            \
    opcode_macro(exit, 0xC0)
+// Superinstructions.  bitcode_writer replaces common sequences of wasm
+// instructions with these, so that the interpreter dispatches once for the
+// whole sequence.  They never appear in wasm.
+#define EOS_VM_FUSED_LOCAL_PAIR_OPS(opcode_macro)       \
+   opcode_macro(get_local_get_local, 0xC1)              \
+   opcode_macro(set_local_get_local, 0xC2)
+#define EOS_VM_FUSED_LOCAL_CONSTANT_OPS(opcode_macro)   \
+   opcode_macro(get_local_i32_const, 0xC3)              \
+   opcode_macro(local_i32_add_const, 0xC4)
+#define EOS_VM_FUSED_CONSTANT_OPS(opcode_macro)         \
+   opcode_macro(i32_add_const, 0xC5)                    \
+   opcode_macro(i32_and_const, 0xC6)
+#define EOS_VM_FUSED_LOCAL_MEMORY_OPS(opcode_macro)     \
+   opcode_macro(local_i32_load, 0xC7)                   \
+   opcode_macro(local_i64_load, 0xC8)                   \
+   opcode_macro(local_i32_store, 0xC9)                  \
+   opcode_macro(local_i64_store, 0xCA)
+#define EOS_VM_FUSED_CALL_OPS(opcode_macro)             \
+   opcode_macro(i32_const_call, 0xCB)
+#define EOS_VM_FUSED_BR_IF_OPS(opcode_macro)            \
+   opcode_macro(i32_eqz_br_if, 0xCC)                    \
+   opcode_macro(i32_eq_br_if, 0xCD)                     \
+   opcode_macro(i32_ne_br_if, 0xCE)                     \
+   opcode_macro(i32_lt_s_br_if, 0xCF)                   \
+   opcode_macro(i32_lt_u_br_if, 0xD0)                   \
+   opcode_macro(i32_gt_u_br_if, 0xD1)                   \
+   opcode_macro(i32_ge_u_br_if, 0xD2)                   \
+   opcode_macro(i64_eq_br_if, 0xD3)                     \
+   opcode_macro(i64_ne_br_if, 0xD4)
+#define EOS_VM_FUSED_LOCAL_BR_IF_OPS(opcode_macro)      \
+   opcode_macro(local_local_i32_lt_u_br_if, 0xD5)
+// The superinstructions that neither branch nor call
+#define EOS_VM_FUSED_OPS(opcode_macro)                  \
+   EOS_VM_FUSED_LOCAL_PAIR_OPS(opcode_macro)            \
+   EOS_VM_FUSED_LOCAL_CONSTANT_OPS(opcode_macro)        \
+   EOS_VM_FUSED_CONSTANT_OPS(opcode_macro)              \
+   EOS_VM_FUSED_LOCAL_MEMORY_OPS(opcode_macro)
+#define EOS_VM_FUSED_BRANCH_OPS(opcode_macro)           \
+   EOS_VM_FUSED_CALL_OPS(opcode_macro)                  \
+   EOS_VM_FUSED_BR_IF_OPS(opcode_macro)                 \
+   EOS_VM_FUSED_LOCAL_BR_IF_OPS(opcode_macro)
+// get_global and set_global, with the global's type resolved when the
+// bitcode is written.  The immediate points at the global's value in the
+// module.  Operands are untagged, so f32 and f64 globals use the i32 and i64
+// forms.  Immutable globals become constants instead.
+#define EOS_VM_TYPED_GLOBAL_OPS(opcode_macro)           \
+   opcode_macro(get_global_i32, 0xD6)                   \
+   opcode_macro(get_global_i64, 0xD7)                   \
+   opcode_macro(set_global_i32, 0xD8)                   \
+   opcode_macro(set_global_i64, 0xD9)
 #define EOS_VM_EMPTY_OPS(opcode_macro)          \
-   opcode_macro(empty0xC1, 0xC1)                \
-   opcode_macro(empty0xC2, 0xC2)                \
-   opcode_macro(empty0xC3, 0xC3)                \
-   opcode_macro(empty0xC4, 0xC4)                \
-   opcode_macro(empty0xC5, 0xC5)                \
-   opcode_macro(empty0xC6, 0xC6)                \
-   opcode_macro(empty0xC7, 0xC7)                \
-   opcode_macro(empty0xC8, 0xC8)                \
-   opcode_macro(empty0xC9, 0xC9)                \
-   opcode_macro(empty0xCA, 0xCA)                \
-   opcode_macro(empty0xCB, 0xCB)                \
-   opcode_macro(empty0xCC, 0xCC)                \
-   opcode_macro(empty0xCD, 0xCD)                \
-   opcode_macro(empty0xCE, 0xCE)                \
-   opcode_macro(empty0xCF, 0xCF)                \
-   opcode_macro(empty0xD0, 0xD0)                \
-   opcode_macro(empty0xD1, 0xD1)                \
-   opcode_macro(empty0xD2, 0xD2)                \
-   opcode_macro(empty0xD3, 0xD3)                \
-   opcode_macro(empty0xD4, 0xD4)                \
-   opcode_macro(empty0xD5, 0xD5)                \
-   opcode_macro(empty0xD6, 0xD6)                \
-   opcode_macro(empty0xD7, 0xD7)                \
-   opcode_macro(empty0xD8, 0xD8)                \
-   opcode_macro(empty0xD9, 0xD9)                \
    opcode_macro(empty0xDA, 0xDA)                \
    opcode_macro(empty0xDB, 0xDB)                \
    opcode_macro(empty0xDC, 0xDC)                \
@@ -310,6 +335,8 @@
    struct EOS_VM_OPCODE_T(name) {                                                                                      \
       EOS_VM_OPCODE_T(name)() = default;                                                                               \
       uint32_t pc;                                                                                                     \
+      const uint8_t* unpack(const uint8_t* p) { return p; }                                                            \
+      uint8_t* pack(uint8_t* p) const { return p; }                                                                    \
       static constexpr uint8_t opcode = code;                                                                          \
    };
 
@@ -323,6 +350,19 @@
       uint32_t pc       = 0;                                                                                           \
       uint16_t index    = 0;                                                                                           \
       uint16_t op_index = 0;                                                                                           \
+      /* only br, br_if and return use data, and they and if and else use pc */                                        \
+      static constexpr bool has_data = code == 0x0C || code == 0x0D || code == 0x0F;                                   \
+      static constexpr bool has_pc   = has_data || code == 0x04 || code == 0x05;                                       \
+      const uint8_t* unpack(const uint8_t* p) {                                                                        \
+         if constexpr (has_data) p = detail::unpack_immediate(p, data);                                                \
+         if constexpr (has_pc) p = detail::unpack_immediate(p, pc);                                                    \
+         return p;                                                                                                     \
+      }                                                                                                                \
+      uint8_t* pack(uint8_t* p) const {                                                                                \
+         if constexpr (has_data) p = detail::pack_immediate(p, data);                                                  \
+         if constexpr (has_pc) p = detail::pack_immediate(p, pc);                                                      \
+         return p;                                                                                                     \
+      }                                                                                                                \
       static constexpr uint8_t opcode = code;                                                                          \
    };
 
@@ -330,15 +370,29 @@
    struct EOS_VM_OPCODE_T(name) {                                                                                      \
       EOS_VM_OPCODE_T(name)() = default;                                                                               \
       struct elem_t { uint32_t pc; uint32_t stack_pop; };                                                              \
-      elem_t* table;                                                                                                   \
+      /* size + 1 unaligned elem_ts follow size in the bytecode.  The last one is the default. */                      \
+      const uint8_t* table;                                                                                            \
       uint32_t  size;                                                                                                  \
-      uint32_t  offset;                                                                                                \
+      elem_t at(uint32_t i) const {                                                                                    \
+         elem_t result;                                                                                                \
+         detail::unpack_immediate(table + i * sizeof(elem_t), result);                                                 \
+         return result;                                                                                                \
+      }                                                                                                                \
+      const uint8_t* unpack(const uint8_t* p) {                                                                        \
+         p     = detail::unpack_immediate(p, size);                                                                    \
+         table = p;                                                                                                    \
+         return p + (size + 1) * sizeof(elem_t);                                                                       \
+      }                                                                                                                \
+      /* The writer fills in the entries after size */                                                                 \
+      uint8_t* pack(uint8_t* p) const { return detail::pack_immediate(p, size); }                                      \
       static constexpr uint8_t opcode = code;                                                                          \
    };
 
 #define EOS_VM_CREATE_TYPES(name, code)                                                                                \
    struct EOS_VM_OPCODE_T(name) {                                                                                      \
       EOS_VM_OPCODE_T(name)() = default;                                                                               \
+      const uint8_t* unpack(const uint8_t* p) { return p; }                                                            \
+      uint8_t* pack(uint8_t* p) const { return p; }                                                                    \
       static constexpr uint8_t opcode = code;                                                                          \
    };
 
@@ -346,6 +400,8 @@
    struct EOS_VM_OPCODE_T(name) {                                                                                      \
       EOS_VM_OPCODE_T(name)() = default;                                                                               \
       uint32_t index;                                                                                                  \
+      const uint8_t* unpack(const uint8_t* p) { p = detail::unpack_immediate(p, index); return p; }                    \
+      uint8_t* pack(uint8_t* p) const { p = detail::pack_immediate(p, index); return p; }                              \
       static constexpr uint8_t opcode = code;                                                                          \
    };
 
@@ -355,6 +411,18 @@
       uint32_t index;                                                                                                  \
       uint16_t locals;                                                                                                 \
       uint16_t return_type;                                                                                            \
+      const uint8_t* unpack(const uint8_t* p) {                                                                        \
+         p = detail::unpack_immediate(p, index);                                                                       \
+         p = detail::unpack_immediate(p, locals);                                                                      \
+         p = detail::unpack_immediate(p, return_type);                                                                 \
+         return p;                                                                                                     \
+      }                                                                                                                \
+      uint8_t* pack(uint8_t* p) const {                                                                                \
+         p = detail::pack_immediate(p, index);                                                                         \
+         p = detail::pack_immediate(p, locals);                                                                        \
+         p = detail::pack_immediate(p, return_type);                                                                   \
+         return p;                                                                                                     \
+      }                                                                                                                \
       static constexpr uint8_t opcode = code;                                                                          \
    };
 
@@ -362,6 +430,8 @@
    struct EOS_VM_OPCODE_T(name) {                                                                                      \
       EOS_VM_OPCODE_T(name)() = default;                                                                               \
       uint32_t index;                                                                                                  \
+      const uint8_t* unpack(const uint8_t* p) { p = detail::unpack_immediate(p, index); return p; }                    \
+      uint8_t* pack(uint8_t* p) const { p = detail::pack_immediate(p, index); return p; }                              \
       static constexpr uint8_t opcode = code;                                                                          \
    };
 
@@ -370,6 +440,16 @@
       EOS_VM_OPCODE_T(name)() = default;                                                                               \
       uint32_t flags_align;                                                                                            \
       uint32_t offset;                                                                                                 \
+      const uint8_t* unpack(const uint8_t* p) {                                                                        \
+         p = detail::unpack_immediate(p, flags_align);                                                                 \
+         p = detail::unpack_immediate(p, offset);                                                                      \
+         return p;                                                                                                     \
+      }                                                                                                                \
+      uint8_t* pack(uint8_t* p) const {                                                                                \
+         p = detail::pack_immediate(p, flags_align);                                                                   \
+         p = detail::pack_immediate(p, offset);                                                                        \
+         return p;                                                                                                     \
+      }                                                                                                                \
       static constexpr uint8_t opcode = code;                                                                          \
    };
 
@@ -382,6 +462,8 @@
          uint32_t ui;                                                                                                  \
          int32_t  i;                                                                                                   \
       } data;                                                                                                          \
+      const uint8_t* unpack(const uint8_t* p) { p = detail::unpack_immediate(p, data); return p; }                     \
+      uint8_t* pack(uint8_t* p) const { p = detail::pack_immediate(p, data); return p; }                               \
       static constexpr uint8_t opcode = code;                                                                          \
    };
 
@@ -394,6 +476,8 @@
          uint64_t ui;                                                                                                  \
          int64_t  i;                                                                                                   \
       } data;                                                                                                          \
+      const uint8_t* unpack(const uint8_t* p) { p = detail::unpack_immediate(p, data); return p; }                     \
+      uint8_t* pack(uint8_t* p) const { p = detail::pack_immediate(p, data); return p; }                               \
       static constexpr uint8_t opcode = code;                                                                          \
    };
 
@@ -406,6 +490,8 @@
          uint32_t ui;                                                                                                  \
          float    f;                                                                                                   \
       } data;                                                                                                          \
+      const uint8_t* unpack(const uint8_t* p) { p = detail::unpack_immediate(p, data); return p; }                     \
+      uint8_t* pack(uint8_t* p) const { p = detail::pack_immediate(p, data); return p; }                               \
       static constexpr uint8_t opcode = code;                                                                          \
    };
 
@@ -418,6 +504,159 @@
          uint64_t ui;                                                                                                  \
          double   f;                                                                                                   \
       } data;                                                                                                          \
+      const uint8_t* unpack(const uint8_t* p) { p = detail::unpack_immediate(p, data); return p; }                     \
+      uint8_t* pack(uint8_t* p) const { p = detail::pack_immediate(p, data); return p; }                               \
+      static constexpr uint8_t opcode = code;                                                                          \
+   };
+
+#define EOS_VM_CREATE_FUSED_LOCAL_PAIR_TYPES(name, code)                                                               \
+   struct EOS_VM_OPCODE_T(name) {                                                                                      \
+      EOS_VM_OPCODE_T(name)() = default;                                                                               \
+      EOS_VM_OPCODE_T(name)(uint32_t index, uint32_t index2) : index(index), index2(index2) {}                         \
+      /* the locals of the first and second instructions */                                                            \
+      uint32_t index;                                                                                                  \
+      uint32_t index2;                                                                                                 \
+      const uint8_t* unpack(const uint8_t* p) {                                                                        \
+         p = detail::unpack_immediate(p, index);                                                                       \
+         p = detail::unpack_immediate(p, index2);                                                                      \
+         return p;                                                                                                     \
+      }                                                                                                                \
+      uint8_t* pack(uint8_t* p) const {                                                                                \
+         p = detail::pack_immediate(p, index);                                                                         \
+         p = detail::pack_immediate(p, index2);                                                                        \
+         return p;                                                                                                     \
+      }                                                                                                                \
+      static constexpr uint8_t opcode = code;                                                                          \
+   };
+
+#define EOS_VM_CREATE_FUSED_LOCAL_CONSTANT_TYPES(name, code)                                                           \
+   struct EOS_VM_OPCODE_T(name) {                                                                                      \
+      EOS_VM_OPCODE_T(name)() = default;                                                                               \
+      EOS_VM_OPCODE_T(name)(uint32_t index, uint32_t value) : index(index), value(value) {}                            \
+      uint32_t index;                                                                                                  \
+      uint32_t value;                                                                                                  \
+      const uint8_t* unpack(const uint8_t* p) {                                                                        \
+         p = detail::unpack_immediate(p, index);                                                                       \
+         p = detail::unpack_immediate(p, value);                                                                       \
+         return p;                                                                                                     \
+      }                                                                                                                \
+      uint8_t* pack(uint8_t* p) const {                                                                                \
+         p = detail::pack_immediate(p, index);                                                                         \
+         p = detail::pack_immediate(p, value);                                                                         \
+         return p;                                                                                                     \
+      }                                                                                                                \
+      static constexpr uint8_t opcode = code;                                                                          \
+   };
+
+#define EOS_VM_CREATE_FUSED_CONSTANT_TYPES(name, code)                                                                 \
+   struct EOS_VM_OPCODE_T(name) {                                                                                      \
+      EOS_VM_OPCODE_T(name)() = default;                                                                               \
+      EOS_VM_OPCODE_T(name)(uint32_t value) : value(value) {}                                                          \
+      uint32_t value;                                                                                                  \
+      const uint8_t* unpack(const uint8_t* p) {                                                                        \
+         p = detail::unpack_immediate(p, value);                                                                       \
+         return p;                                                                                                     \
+      }                                                                                                                \
+      uint8_t* pack(uint8_t* p) const {                                                                                \
+         p = detail::pack_immediate(p, value);                                                                         \
+         return p;                                                                                                     \
+      }                                                                                                                \
+      static constexpr uint8_t opcode = code;                                                                          \
+   };
+
+#define EOS_VM_CREATE_FUSED_LOCAL_MEMORY_TYPES(name, code)                                                             \
+   struct EOS_VM_OPCODE_T(name) {                                                                                      \
+      EOS_VM_OPCODE_T(name)() = default;                                                                               \
+      EOS_VM_OPCODE_T(name)(uint32_t index, uint32_t flags_align, uint32_t offset) : index(index), flags_align(flags_align), offset(offset) {}\
+      uint32_t index;                                                                                                  \
+      uint32_t flags_align;                                                                                            \
+      uint32_t offset;                                                                                                 \
+      const uint8_t* unpack(const uint8_t* p) {                                                                        \
+         p = detail::unpack_immediate(p, index);                                                                       \
+         p = detail::unpack_immediate(p, flags_align);                                                                 \
+         p = detail::unpack_immediate(p, offset);                                                                      \
+         return p;                                                                                                     \
+      }                                                                                                                \
+      uint8_t* pack(uint8_t* p) const {                                                                                \
+         p = detail::pack_immediate(p, index);                                                                         \
+         p = detail::pack_immediate(p, flags_align);                                                                   \
+         p = detail::pack_immediate(p, offset);                                                                        \
+         return p;                                                                                                     \
+      }                                                                                                                \
+      static constexpr uint8_t opcode = code;                                                                          \
+   };
+
+#define EOS_VM_CREATE_FUSED_CALL_TYPES(name, code)                                                                     \
+   struct EOS_VM_OPCODE_T(name) {                                                                                      \
+      EOS_VM_OPCODE_T(name)() = default;                                                                               \
+      EOS_VM_OPCODE_T(name)(uint32_t value, uint32_t index) : value(value), index(index) {}                            \
+      uint32_t value;                                                                                                  \
+      uint32_t index;                                                                                                  \
+      const uint8_t* unpack(const uint8_t* p) {                                                                        \
+         p = detail::unpack_immediate(p, value);                                                                       \
+         p = detail::unpack_immediate(p, index);                                                                       \
+         return p;                                                                                                     \
+      }                                                                                                                \
+      uint8_t* pack(uint8_t* p) const {                                                                                \
+         p = detail::pack_immediate(p, value);                                                                         \
+         p = detail::pack_immediate(p, index);                                                                         \
+         return p;                                                                                                     \
+      }                                                                                                                \
+      static constexpr uint8_t opcode = code;                                                                          \
+   };
+
+#define EOS_VM_CREATE_FUSED_BR_IF_TYPES(name, code)                                                                    \
+   struct EOS_VM_OPCODE_T(name) {                                                                                      \
+      EOS_VM_OPCODE_T(name)() = default;                                                                               \
+      EOS_VM_OPCODE_T(name)(uint32_t data, uint32_t pc) : data(data), pc(pc) {}                                        \
+      /* the same as br_if */                                                                                          \
+      uint32_t data;                                                                                                   \
+      uint32_t pc;                                                                                                     \
+      const uint8_t* unpack(const uint8_t* p) {                                                                        \
+         p = detail::unpack_immediate(p, data);                                                                        \
+         p = detail::unpack_immediate(p, pc);                                                                          \
+         return p;                                                                                                     \
+      }                                                                                                                \
+      uint8_t* pack(uint8_t* p) const {                                                                                \
+         p = detail::pack_immediate(p, data);                                                                          \
+         p = detail::pack_immediate(p, pc);                                                                            \
+         return p;                                                                                                     \
+      }                                                                                                                \
+      static constexpr uint8_t opcode = code;                                                                          \
+   };
+
+#define EOS_VM_CREATE_FUSED_LOCAL_BR_IF_TYPES(name, code)                                                              \
+   struct EOS_VM_OPCODE_T(name) {                                                                                      \
+      EOS_VM_OPCODE_T(name)() = default;                                                                               \
+      EOS_VM_OPCODE_T(name)(uint32_t index, uint32_t index2, uint32_t data, uint32_t pc) : index(index), index2(index2), data(data), pc(pc) {}\
+      uint32_t index;                                                                                                  \
+      uint32_t index2;                                                                                                 \
+      uint32_t data;                                                                                                   \
+      uint32_t pc;                                                                                                     \
+      const uint8_t* unpack(const uint8_t* p) {                                                                        \
+         p = detail::unpack_immediate(p, index);                                                                       \
+         p = detail::unpack_immediate(p, index2);                                                                      \
+         p = detail::unpack_immediate(p, data);                                                                        \
+         p = detail::unpack_immediate(p, pc);                                                                          \
+         return p;                                                                                                     \
+      }                                                                                                                \
+      uint8_t* pack(uint8_t* p) const {                                                                                \
+         p = detail::pack_immediate(p, index);                                                                         \
+         p = detail::pack_immediate(p, index2);                                                                        \
+         p = detail::pack_immediate(p, data);                                                                          \
+         p = detail::pack_immediate(p, pc);                                                                            \
+         return p;                                                                                                     \
+      }                                                                                                                \
+      static constexpr uint8_t opcode = code;                                                                          \
+   };
+
+#define EOS_VM_CREATE_TYPED_GLOBAL_TYPES(name, code)                                                                  \
+   struct EOS_VM_OPCODE_T(name) {                                                                                      \
+      EOS_VM_OPCODE_T(name)() = default;                                                                               \
+      explicit EOS_VM_OPCODE_T(name)(void* ptr) : ptr(ptr) {}                                                          \
+      void* ptr;                                                                                                       \
+      const uint8_t* unpack(const uint8_t* p) { p = detail::unpack_immediate(p, ptr); return p; }                      \
+      uint8_t* pack(uint8_t* p) const { p = detail::pack_immediate(p, ptr); return p; }                                \
       static constexpr uint8_t opcode = code;                                                                          \
    };
 
@@ -1,27 +1,64 @@
 #pragma once
 
 #include <eosio/vm/allocator.hpp>
+#include <eosio/vm/code_cache.hpp>
 #include <eosio/vm/constants.hpp>
 #include <eosio/vm/exceptions.hpp>
 #include <eosio/vm/leb128.hpp>
 #include <eosio/vm/sections.hpp>
+#include <eosio/vm/superinstructions.hpp>
 #include <eosio/vm/types.hpp>
+#include <eosio/vm/utf8.hpp>
 #include <eosio/vm/utils.hpp>
 #include <eosio/vm/vector.hpp>
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <typeinfo>
 #include <utility>
 #include <variant>
 #include <vector>
 
 namespace eosio { namespace vm {
 
+   struct compile_options {
+      // The number of threads used to validate and compile function
+      // bodies.  0 or 1 compiles everything on the calling thread.
+      uint32_t threads = 1;
+      // Validate and compile each function when it is first called
+      // instead of when the module is loaded.  Only the jit supports
+      // this, other backends ignore it.
+      bool lazy = false;
+      // A directory where compiled code is saved and loaded from, so that
+      // a module is only compiled once.  Empty disables the cache.  Only
+      // the jit supports this, and lazy compilation takes precedence.
+      std::string code_cache_dir;
+      // The superinstructions that the interpreter may use.  A smaller set
+      // can be chosen with select_superinstructions from a profile of
+      // the workload.  Other backends ignore this.
+      superinstruction_set superinstructions = superinstruction_set::all();
+      // Data segments refer to the bytes of the module instead of copying
+      // them, so the bytes must outlive the module.  Names are still copied,
+      // so that looking up exports does not read the bytes.  Streaming
+      // always copies.
+      bool reference_source = false;
+      // The largest section that is accepted.  A streamed section is
+      // buffered before it is parsed, so this bounds the memory that a
+      // stream can make the parser allocate before it sees any of it.
+      uint32_t max_section_size = 64 * 1024 * 1024;
+   };
+
    template <typename Writer>
    class binary_parser {
     public:
-      binary_parser(growable_allocator& alloc) : _allocator(alloc) {}
+      binary_parser(growable_allocator& alloc, const compile_options& options = {}) : _allocator(alloc), _options(options) {}
 
       template <typename T>
       using vec = guarded_vector<T>;
@@ -30,13 +67,13 @@ namespace eosio { namespace vm {
 
       static inline uint8_t parse_varuint7(wasm_code_ptr& code) { return varuint<7>(code).to(); }
 
-      static inline uint32_t parse_varuint32(wasm_code_ptr& code) { return varuint<32>(code).to(); }
+      static inline uint32_t parse_varuint32(wasm_code_ptr& code) { return read_varuint32(code); }
 
       static inline int8_t parse_varint7(wasm_code_ptr& code) { return varint<7>(code).to(); }
 
-      static inline int32_t parse_varint32(wasm_code_ptr& code) { return varint<32>(code).to(); }
+      static inline int32_t parse_varint32(wasm_code_ptr& code) { return read_varint32(code); }
 
-      static inline int64_t parse_varint64(wasm_code_ptr& code) { return varint<64>(code).to(); }
+      static inline int64_t parse_varint64(wasm_code_ptr& code) { return read_varint64(code); }
 
       int validate_utf8_code_point(wasm_code_ptr& code) {
          unsigned char ch = *code++;
@@ -84,6 +121,11 @@ namespace eosio { namespace vm {
       }
 
       void validate_utf8_string(wasm_code_ptr& code, uint32_t bytes) {
+         if (bytes <= static_cast<std::size_t>(code.bnds - code.raw_ptr) && is_valid_utf8(code.raw(), bytes)) {
+            code += bytes;
+            return;
+         }
+         // Find the error one code point at a time
          while(bytes != 0) {
             bytes -= validate_utf8_code_point(code);
          }
@@ -121,6 +163,14 @@ namespace eosio { namespace vm {
 
       void parse_module(wasm_code_ptr& code_ptr, size_t sz, module& mod) {
          _mod = &mod;
+         const uint8_t* wasm = code_ptr.raw();
+         if constexpr (Writer::supports_code_cache) {
+            if (!_options.code_cache_dir.empty() && !_options.lazy) {
+               _code_cache = std::make_shared<code_cache>(_options.code_cache_dir, Writer::code_cache_anchor(),
+                                                          typeid(Writer).name());
+               _cached_code = _code_cache->find(wasm, sz);
+            }
+         }
          EOS_VM_ASSERT(parse_magic(code_ptr) == constants::magic, wasm_parse_exception, "magic number did not match");
          EOS_VM_ASSERT(parse_version(code_ptr) == constants::version, wasm_parse_exception,
                        "version number did not match");
@@ -135,31 +185,80 @@ namespace eosio { namespace vm {
             highest_section_id = std::max(highest_section_id, id);
 
             auto section_guard = code_ptr.scoped_consume_items(len);
-
-            switch (id) {
-               case section_id::custom_section: parse_custom(code_ptr); break;
-               case section_id::type_section: parse_section<section_id::type_section>(code_ptr, mod.types); break;
-               case section_id::import_section: parse_section<section_id::import_section>(code_ptr, mod.imports); break;
-               case section_id::function_section:
-                  parse_section<section_id::function_section>(code_ptr, mod.functions);
-                  mod.normalize_types();
-                  break;
-               case section_id::table_section: parse_section<section_id::table_section>(code_ptr, mod.tables); break;
-               case section_id::memory_section:
-                  parse_section<section_id::memory_section>(code_ptr, mod.memories);
-                  break;
-               case section_id::global_section: parse_section<section_id::global_section>(code_ptr, mod.globals); break;
-               case section_id::export_section: parse_section<section_id::export_section>(code_ptr, mod.exports); break;
-               case section_id::start_section: parse_section<section_id::start_section>(code_ptr, mod.start); break;
-               case section_id::element_section:
-                  parse_section<section_id::element_section>(code_ptr, mod.elements);
-                  break;
-               case section_id::code_section: parse_section<section_id::code_section>(code_ptr, mod.code); break;
-               case section_id::data_section: parse_section<section_id::data_section>(code_ptr, mod.data); break;
-               default: EOS_VM_ASSERT(false, wasm_parse_exception, "error invalid section id");
-            }
+            parse_section_payload(code_ptr, id);
          }
          EOS_VM_ASSERT(_mod->code.size() == _mod->functions.size(), wasm_parse_exception, "code section must have the same size as the function section" );
+         // Only modules that loaded successfully are saved
+         if (_code_cache && !_cached_code && !_new_cache_code.empty()) {
+            std::vector<uint64_t> offsets;
+            for (uint32_t i = 0; i < mod.code.size(); ++i)
+               offsets.push_back(mod.code[i].jit_code_offset);
+            code_cache::entry e;
+            e.code             = _new_cache_code.data();
+            e.code_size        = _new_cache_code.size();
+            e.data_size        = _new_cache_data_size;
+            e.maximum_stack    = mod.maximum_stack;
+            e.jit_code_offsets = offsets.data();
+            e.num_functions    = offsets.size();
+            e.relocations      = _new_cache_relocations.data();
+            e.num_relocations  = _new_cache_relocations.size();
+            _code_cache->store(wasm, sz, e);
+         }
+      }
+
+      // Parses a module whose bytes arrive in pieces: begin_stream, then
+      // parse_chunk for each piece in order, then end_stream, which returns
+      // the same module as parse_module.  Each section is parsed once all of
+      // its bytes have arrived, and each function body is compiled as soon as
+      // it is complete.  Lazy and parallel compilation need the whole code
+      // section, so with those options it is compiled once it has arrived.
+      // The code cache is not used.
+      void begin_stream(module& mod) {
+         _mod = &mod;
+         _stream = std::make_shared<stream_state>();
+      }
+
+      void parse_chunk(const uint8_t* data, std::size_t size) {
+         stream_state& s = *_stream;
+         s.buffer.insert(s.buffer.end(), data, data + size);
+         while (parse_stream_item(s)) {}
+         s.buffer.erase(s.buffer.begin(), s.buffer.begin() + s.pos);
+         s.pos = 0;
+      }
+
+      module& end_stream() {
+         stream_state& s = *_stream;
+         EOS_VM_ASSERT(s.state == stream_state::section_start && s.pos == s.buffer.size(), wasm_parse_exception,
+                       "unexpected end of module");
+         EOS_VM_ASSERT(_mod->code.size() == _mod->functions.size(), wasm_parse_exception, "code section must have the same size as the function section" );
+         _stream.reset();
+         return *_mod;
+      }
+
+      void parse_section_payload(wasm_code_ptr& code_ptr, uint8_t id) {
+         module& mod = *_mod;
+         switch (id) {
+            case section_id::custom_section: parse_custom(code_ptr); break;
+            case section_id::type_section: parse_section<section_id::type_section>(code_ptr, mod.types); break;
+            case section_id::import_section: parse_section<section_id::import_section>(code_ptr, mod.imports); break;
+            case section_id::function_section:
+               parse_section<section_id::function_section>(code_ptr, mod.functions);
+               mod.normalize_types();
+               break;
+            case section_id::table_section: parse_section<section_id::table_section>(code_ptr, mod.tables); break;
+            case section_id::memory_section:
+               parse_section<section_id::memory_section>(code_ptr, mod.memories);
+               break;
+            case section_id::global_section: parse_section<section_id::global_section>(code_ptr, mod.globals); break;
+            case section_id::export_section: parse_section<section_id::export_section>(code_ptr, mod.exports); break;
+            case section_id::start_section: parse_section<section_id::start_section>(code_ptr, mod.start); break;
+            case section_id::element_section:
+               parse_section<section_id::element_section>(code_ptr, mod.elements);
+               break;
+            case section_id::code_section: parse_section<section_id::code_section>(code_ptr, mod.code); break;
+            case section_id::data_section: parse_section<section_id::data_section>(code_ptr, mod.data); break;
+            default: EOS_VM_ASSERT(false, wasm_parse_exception, "error invalid section id");
+         }
       }
 
       inline uint32_t parse_magic(wasm_code_ptr& code) {
@@ -170,7 +269,9 @@ namespace eosio { namespace vm {
       }
       inline uint8_t  parse_section_id(wasm_code_ptr& code) { return *code++; }
       inline uint32_t parse_section_payload_len(wasm_code_ptr& code) {
-         return parse_varuint32(code);
+         uint32_t len = parse_varuint32(code);
+         EOS_VM_ASSERT(len <= _options.max_section_size, wasm_section_length_exception, "section is too large");
+         return len;
       }
 
       inline void parse_custom(wasm_code_ptr& code) {
@@ -312,11 +413,16 @@ namespace eosio { namespace vm {
       }
 
       void parse_function_body(wasm_code_ptr& code, function_body& fb, std::size_t idx) {
+         parse_function_body(code, fb, idx, _allocator);
+      }
+
+      // The locals are allocated from locals_alloc
+      void parse_function_body(wasm_code_ptr& code, function_body& fb, std::size_t idx, growable_allocator& locals_alloc) {
          fb.size   = parse_varuint32(code);
          const auto&         before    = code.offset();
          const auto&         local_cnt = parse_varuint32(code);
          _current_function_index++;
-         decltype(fb.locals) locals    = { _allocator, local_cnt };
+         decltype(fb.locals) locals    = { locals_alloc, local_cnt };
          // parse the local entries
          for (size_t i = 0; i < local_cnt; i++) {
             locals.at(i).count = parse_varuint32(code);
@@ -453,7 +559,8 @@ namespace eosio { namespace vm {
          std::vector<uint32_t> _boundaries;
       };
 
-      void parse_function_body_code(wasm_code_ptr& code, size_t bounds, Writer& code_writer, const func_type& ft, const local_types_t& local_types) {
+      // Returns the maximum stack usage of the function
+      uint64_t parse_function_body_code(wasm_code_ptr& code, size_t bounds, Writer& code_writer, const func_type& ft, const local_types_t& local_types) {
          // Initialize the control stack with the current function as the sole element
          operand_stack_type_tracker op_stack;
          std::vector<pc_element_t> pc_stack{{
@@ -508,6 +615,8 @@ namespace eosio { namespace vm {
             }
             op_stack.pop_scope(pc_stack.back().expected_result);
             pc_stack.pop_back();
+            if constexpr (Writer::tracks_operand_depth)
+               code_writer.set_operand_depth(op_stack.depth());
          };
 
          while (code.offset() < bounds) {
@@ -905,7 +1014,140 @@ namespace eosio { namespace vm {
             }
          }
          EOS_VM_ASSERT( pc_stack.empty(), wasm_parse_exception, "function body too long" );
-         _mod->maximum_stack = std::max(_mod->maximum_stack, static_cast<uint64_t>(op_stack.maximum_operand_depth) + local_types.locals_count());
+         return static_cast<uint64_t>(op_stack.maximum_operand_depth) + local_types.locals_count();
+      }
+
+      void compile_function(Writer& code_writer, std::size_t i) {
+         function_body& fb = _mod->code[i];
+         func_type& ft = _mod->types.at(_mod->functions.at(i));
+         local_types_t local_types(ft, fb.locals);
+         code_writer.emit_prologue(ft, fb.locals, i);
+         _mod->maximum_stack = std::max(_mod->maximum_stack, parse_function_body_code(_function_bodies[i], fb.size, code_writer, ft, local_types));
+         code_writer.emit_epilogue(ft, fb.locals, i);
+         code_writer.finalize(fb);
+      }
+
+      // Defers validation and compilation of each function to its first
+      // call.  The function bodies are copied, because the caller's code
+      // does not need to outlive the module.
+      void parse_function_bodies_lazy(Writer& code_writer) {
+         std::size_t total_size = 0;
+         for (size_t i = 0; i < _function_bodies.size(); i++) {
+            total_size += _mod->code[i].size;
+         }
+         auto source = std::make_shared<std::vector<uint8_t>>(total_size);
+         auto parser = std::make_shared<binary_parser>(*this);
+         parser->_function_bodies.clear();
+         std::size_t offset = 0;
+         for (size_t i = 0; i < _function_bodies.size(); i++) {
+            function_body& fb = _mod->code[i];
+            func_type& ft = _mod->types.at(_mod->functions.at(i));
+            local_types_t local_types(ft, fb.locals);
+            // The operand stack cannot be deeper than the number of instructions.
+            // This has to be an upper bound, because it sizes the stack before
+            // the functions are compiled.
+            _mod->maximum_stack = std::max(_mod->maximum_stack, fb.size + local_types.locals_count());
+            std::copy_n(_function_bodies[i].raw(), fb.size, source->data() + offset);
+            parser->_function_bodies.emplace_back(source->data() + offset, fb.size);
+            offset += fb.size;
+         }
+         code_writer.emit_lazy_functions([parser, source](Writer& worker, uint32_t i) {
+            function_body& fb = parser->_mod->code[i];
+            func_type& ft = parser->_mod->types.at(parser->_mod->functions.at(i));
+            local_types_t local_types(ft, fb.locals);
+            wasm_code_ptr body = parser->_function_bodies[i];
+            worker.emit_prologue(ft, fb.locals, i);
+            parser->parse_function_body_code(body, fb.size, worker, ft, local_types);
+            worker.emit_epilogue(ft, fb.locals, i);
+         });
+      }
+
+      // Validates and compiles the function bodies on a pool of threads,
+      // each with its own writer.  The functions are linked into code_writer
+      // in order afterwards.  If any function fails, the error from the
+      // first one is rethrown, which matches the serial behavior.
+      void parse_function_bodies_parallel(Writer& code_writer) {
+         const std::size_t count = _function_bodies.size();
+         // A mapped file is only read under a signal handler, which the
+         // workers do not have, so they get a copy of its function bodies.
+         std::vector<uint8_t>       bodies_copy;
+         std::vector<wasm_code_ptr> copied_bodies;
+         if (references_source()) {
+            std::size_t total_size = 0;
+            for (std::size_t i = 0; i < count; i++)
+               total_size += _mod->code[i].size;
+            bodies_copy.resize(total_size);
+            std::size_t offset = 0;
+            for (std::size_t i = 0; i < count; i++) {
+               std::copy_n(_function_bodies[i].raw(), _mod->code[i].size, bodies_copy.data() + offset);
+               copied_bodies.emplace_back(bodies_copy.data() + offset, _mod->code[i].size);
+               offset += _mod->code[i].size;
+            }
+         }
+         std::vector<wasm_code_ptr>& bodies = references_source() ? copied_bodies : _function_bodies;
+         std::vector<typename Writer::compiled_function> results(count);
+         std::vector<uint64_t> stack_usage(count);
+         std::vector<std::exception_ptr> errors(count);
+         std::atomic<std::size_t> next_function{0};
+         std::atomic<std::size_t> first_error{count};
+
+         auto record_error = [&](std::size_t i) {
+            errors[i] = std::current_exception();
+            std::size_t prev = first_error.load();
+            while (i < prev && !first_error.compare_exchange_weak(prev, i)) {}
+         };
+         auto work = [&]() {
+            std::size_t i = next_function++;
+            try {
+               Writer worker = code_writer.make_worker();
+               // Functions after a failure will never be linked
+               for (; i < count && i < first_error.load(); i = next_function++) {
+                  try {
+                     function_body& fb = _mod->code[i];
+                     func_type& ft = _mod->types.at(_mod->functions.at(i));
+                     local_types_t local_types(ft, fb.locals);
+                     worker.emit_prologue(ft, fb.locals, i);
+                     stack_usage[i] = parse_function_body_code(bodies[i], fb.size, worker, ft, local_types);
+                     worker.emit_epilogue(ft, fb.locals, i);
+                     results[i] = worker.release_function();
+                  } catch (...) {
+                     record_error(i);
+                  }
+               }
+            } catch (...) {
+               // make_worker failed
+               if (i < count) record_error(i);
+            }
+         };
+
+         {
+            std::vector<std::thread> threads;
+            // The threads that did start must be joined even if starting
+            // another one throws
+            auto join_threads = scope_guard{ [&]() {
+               for (auto& t : threads) t.join();
+            } };
+            const std::size_t num_threads = std::min<std::size_t>(_options.threads, count);
+            threads.reserve(num_threads);
+            for (std::size_t i = 1; i < num_threads; ++i) {
+               try {
+                  threads.emplace_back(work);
+               } catch (std::system_error&) {
+                  // Functions are handed out as threads ask for them, so
+                  // fewer threads, or only this one, still compile all of them
+                  break;
+               }
+            }
+            work();
+         }
+
+         if (first_error.load() < count)
+            std::rethrow_exception(errors[first_error.load()]);
+
+         for (std::size_t i = 0; i < count; i++) {
+            _mod->maximum_stack = std::max(_mod->maximum_stack, stack_usage[i]);
+            code_writer.link_function(results[i], _mod->code[i], i);
+         }
       }
 
       void parse_data_segment(wasm_code_ptr& code, data_segment& ds) {
@@ -914,8 +1156,11 @@ namespace eosio { namespace vm {
          parse_init_expr(code, ds.offset, types::i32);
          auto len =  parse_varuint32(code);
          auto guard = code.scoped_shrink_bounds(len);
-         ds.data = decltype(ds.data){ _allocator, len};
-         ds.data.copy(code.raw(), len);
+         ds.data = decltype(ds.data){ _allocator, 0 };
+         if (references_source())
+            ds.data.set(code.raw(), len);
+         else
+            ds.data.copy(code.raw(), len);
          code += len;
       }
 
@@ -983,15 +1228,35 @@ namespace eosio { namespace vm {
          parse_section_impl(code, elems,
                             [&](wasm_code_ptr& code, function_body& fb, std::size_t idx) { parse_function_body(code, fb, idx); });
          EOS_VM_ASSERT( elems.size() == _mod->functions.size(), wasm_parse_exception, "code section must have the same size as the function section" );
+         if constexpr (Writer::supports_code_cache) {
+            // The function bodies were validated when the entry was saved
+            if (_cached_code) {
+               _code_cache->install(*_cached_code, *_mod);
+               return;
+            }
+         }
          Writer code_writer(_allocator, code.bounds() - code.offset(), *_mod);
-         for (size_t i = 0; i < _function_bodies.size(); i++) {
-            function_body& fb = _mod->code[i];
-            func_type& ft = _mod->types.at(_mod->functions.at(i));
-            local_types_t local_types(ft, fb.locals);
-            code_writer.emit_prologue(ft, fb.locals, i);
-            parse_function_body_code(_function_bodies[i], fb.size, code_writer, ft, local_types);
-            code_writer.emit_epilogue(ft, fb.locals, i);
-            code_writer.finalize(fb);
+         if constexpr (Writer::supports_superinstructions)
+            code_writer.set_superinstructions(_options.superinstructions);
+         if constexpr (Writer::supports_lazy_compile) {
+            if (_options.lazy) {
+               parse_function_bodies_lazy(code_writer);
+               return;
+            }
+         }
+         if (_options.threads > 1 && _function_bodies.size() > 1) {
+            parse_function_bodies_parallel(code_writer);
+         } else {
+            for (size_t i = 0; i < _function_bodies.size(); i++) {
+               compile_function(code_writer, i);
+            }
+         }
+         if constexpr (Writer::supports_code_cache) {
+            if (_code_cache) {
+               _new_cache_code        = code_writer.get_code_segment();
+               _new_cache_data_size   = code_writer.get_data_size();
+               _new_cache_relocations = code_writer.get_relocations();
+            }
          }
       }
       template <uint8_t id>
@@ -1015,10 +1280,155 @@ namespace eosio { namespace vm {
       }
 
     private:
+      // The bytes of a streamed module that have arrived but not been parsed
+      struct stream_state {
+         enum { header, section_start, section_payload, function_count, function, } state = header;
+         std::vector<uint8_t> buffer;
+         std::size_t          pos = 0; // the bytes before pos have been parsed
+         uint8_t              section_id = 0;
+         uint8_t              highest_section_id = 0;
+         uint32_t             section_remaining = 0;
+         uint32_t             next_function = 0;
+         // Only used while the code section is compiled a function at a time.
+         // The locals are kept out of the module's allocator until the code
+         // is complete, so that they do not end up between the functions.
+         std::unique_ptr<Writer> writer;
+         growable_allocator      locals_allocator{ 0 };
+      };
+
+      bool references_source() const { return _options.reference_source && !_stream; }
+
+      // True if the code section is compiled as each function arrives
+      bool streams_functions() const {
+         if constexpr (Writer::supports_lazy_compile) {
+            if (_options.lazy)
+               return false;
+         }
+         return _options.threads <= 1;
+      }
+
+      // True if a varuint32 starts at pos and has arrived.  One that is too
+      // long counts as arrived, so that parsing it reports the error.
+      static bool has_varuint32(const stream_state& s, std::size_t pos, std::size_t end) {
+         for (std::size_t i = pos; i < end && i < pos + 5; ++i)
+            if (!(s.buffer[i] & 0x80))
+               return true;
+         return end >= pos + 5;
+      }
+
+      // Parses the next part of the stream if it has arrived.  Returns false
+      // if more bytes are needed.
+      bool parse_stream_item(stream_state& s) {
+         uint8_t*    next      = s.buffer.data() + s.pos;
+         std::size_t available = s.buffer.size() - s.pos;
+         switch (s.state) {
+            case stream_state::header: {
+               if (available < 8)
+                  return false;
+               wasm_code_ptr code(next, 8);
+               EOS_VM_ASSERT(parse_magic(code) == constants::magic, wasm_parse_exception, "magic number did not match");
+               EOS_VM_ASSERT(parse_version(code) == constants::version, wasm_parse_exception,
+                             "version number did not match");
+               s.pos += 8;
+               s.state = stream_state::section_start;
+               return true;
+            }
+            case stream_state::section_start: {
+               if (available == 0 || !has_varuint32(s, s.pos + 1, s.buffer.size()))
+                  return false;
+               wasm_code_ptr code(next, available);
+               s.section_id = parse_section_id(code);
+               s.section_remaining = parse_section_payload_len(code);
+               EOS_VM_ASSERT(s.section_id == 0 || s.section_id > s.highest_section_id, wasm_parse_exception, "section out of order");
+               s.highest_section_id = std::max(s.highest_section_id, s.section_id);
+               s.pos += code.offset();
+               if (s.section_id == section_id::code_section && streams_functions())
+                  s.state = stream_state::function_count;
+               else
+                  s.state = stream_state::section_payload;
+               return true;
+            }
+            case stream_state::section_payload: {
+               if (available < s.section_remaining)
+                  return false;
+               wasm_code_ptr code(next, s.section_remaining);
+               {
+                  auto section_guard = code.scoped_consume_items(s.section_remaining);
+                  parse_section_payload(code, s.section_id);
+               }
+               s.pos += s.section_remaining;
+               s.state = stream_state::section_start;
+               return true;
+            }
+            case stream_state::function_count: {
+               std::size_t end = std::min<std::size_t>(available, s.section_remaining);
+               if (!has_varuint32(s, s.pos, s.pos + end) && end < s.section_remaining)
+                  return false;
+               wasm_code_ptr code(next, end);
+               auto count = parse_varuint32(code);
+               _mod->code = vec<function_body>{ _allocator, count };
+               EOS_VM_ASSERT(count == _mod->functions.size(), wasm_parse_exception, "code section must have the same size as the function section" );
+               s.pos += code.offset();
+               s.section_remaining -= code.offset();
+               s.writer = std::make_unique<Writer>(_allocator, s.section_remaining, *_mod);
+               if constexpr (Writer::supports_superinstructions)
+                  s.writer->set_superinstructions(_options.superinstructions);
+               s.next_function = 0;
+               s.state = stream_state::function;
+               if (count == 0)
+                  end_stream_code_section(s);
+               return true;
+            }
+            case stream_state::function: {
+               std::size_t end = std::min<std::size_t>(available, s.section_remaining);
+               if (!has_varuint32(s, s.pos, s.pos + end) && end < s.section_remaining)
+                  return false;
+               if (has_varuint32(s, s.pos, s.pos + end)) {
+                  // Bodies that run past the section are left for parse_function_body to reject
+                  wasm_code_ptr size_ptr(next, end);
+                  std::size_t body_size = parse_varuint32(size_ptr);
+                  std::size_t body_end = size_ptr.offset() + body_size;
+                  if (body_end > end && body_end <= s.section_remaining)
+                     return false;
+               }
+               wasm_code_ptr code(next, end);
+               parse_function_body(code, _mod->code[s.next_function], s.next_function, s.locals_allocator);
+               compile_function(*s.writer, s.next_function);
+               s.pos += code.offset();
+               s.section_remaining -= code.offset();
+               if (++s.next_function == _mod->code.size())
+                  end_stream_code_section(s);
+               return true;
+            }
+         }
+         return false;
+      }
+
+      void end_stream_code_section(stream_state& s) {
+         EOS_VM_ASSERT(s.section_remaining == 0, wasm_parse_exception, "code section has bytes after the last function");
+         s.writer.reset();
+         for (uint32_t i = 0; i < _mod->code.size(); ++i) {
+            function_body& fb = _mod->code[i];
+            decltype(fb.locals) locals = { _allocator, fb.locals.size() };
+            std::copy_n(fb.locals.raw(), fb.locals.size(), locals.raw());
+            fb.locals = std::move(locals);
+         }
+         s.locals_allocator.reset();
+         s.state = stream_state::section_start;
+      }
+
       growable_allocator& _allocator;
+      compile_options     _options;
       module*             _mod; // non-owning weak pointer
       int64_t             _current_function_index = -1;
       uint64_t            _maximum_function_stack_usage = 0; // non-parameter locals + stack
       std::vector<wasm_code_ptr>  _function_bodies;
+      std::shared_ptr<code_cache> _code_cache;
+      const code_cache::entry*    _cached_code = nullptr;
+      // The code of a module that is not in the cache yet
+      std::vector<unsigned char>          _new_cache_code;
+      std::size_t                         _new_cache_data_size = 0;
+      std::vector<code_cache::relocation> _new_cache_relocations;
+      std::shared_ptr<stream_state>       _stream;
    };
 }} // namespace eosio::vm
@@ -0,0 +1,813 @@
+#pragma once
+
+#include <eosio/vm/allocator.hpp>
+#include <eosio/vm/opcodes.hpp>
+#include <eosio/vm/register_opcodes.hpp>
+#include <eosio/vm/types.hpp>
+#include <eosio/vm/vector.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace eosio { namespace vm {
+
+   // Translates wasm into the register bitcode in a single pass.  The value
+   // at depth h of the operand stack lives in register num_locals + h.
+   //
+   // get_local and i32.const do not write anything.  Their values stay on a
+   // virtual operand stack and the instruction that consumes them reads the
+   // local or uses the constant directly.  A set_local of the result of the
+   // previous instruction changes that instruction to write the local.  All
+   // values are moved to their registers at block boundaries, so that every
+   // path into a label leaves the operands in the same place.
+   class register_bitcode_writer {
+      using reg_opcodes = register_ops::opcodes;
+
+      struct operand {
+         enum kind_t : uint8_t { stack, local, i32_const };
+         kind_t   kind  = stack;
+         uint32_t value = 0; // the local or the constant
+      };
+      struct block {
+         uint32_t height;
+         bool     reachable;
+      };
+      // A condition that may still be part of the branch that consumes it
+      struct condition {
+         uint8_t  compare; // the comparison's wasm opcode, or 0 if the condition is in lhs
+         uint32_t lhs;
+         uint32_t rhs;
+      };
+
+      template <class I>
+      uint8_t* append_instr(uint8_t opcode, const I& instr) {
+         EOS_VM_ASSERT(op_index + 1 + sizeof(I) <= fb.size(), wasm_parse_exception, "bitcode buffer overflow");
+         uint8_t* pos = fb.raw() + op_index;
+         *pos = opcode;
+         op_index = instr.pack(pos + 1) - fb.raw();
+         return pos + 1;
+      }
+      // For instructions whose first immediate is the register that they write
+      template <class I>
+      void append_result(uint8_t opcode, const I& instr) {
+         _last_instr = op_index;
+         append_instr(opcode, instr);
+         _last_end = op_index;
+      }
+      // True if the value at pos was written by the last instruction
+      bool is_last_result(uint32_t pos) const {
+         if (_last_end != op_index || _operands[pos].kind != operand::stack)
+            return false;
+         uint32_t dst;
+         std::memcpy(&dst, fb.raw() + _last_instr + 1, sizeof(dst));
+         return dst == home(pos);
+      }
+      void clear_last() { _last_end = ~std::size_t{0}; }
+      // Drops the operands of the current block, which the code after a
+      // branch cannot use.  Some may still be pending and would otherwise be
+      // written over the branch's result when the block ends.
+      void set_unreachable() {
+         _operands.resize(_blocks.back().height);
+         _reachable = false;
+      }
+
+      uint32_t home(uint32_t pos) const { return _num_locals + pos; }
+      void push(operand value) {
+         _operands.push_back(value);
+         _max_height = std::max(_max_height, static_cast<uint32_t>(_operands.size()));
+      }
+      uint32_t push_result() {
+         push({});
+         return home(_operands.size() - 1);
+      }
+      // Writes the value at pos to dst, without changing the operand
+      void move_to(uint32_t pos, uint32_t dst) {
+         const operand& value = _operands[pos];
+         if (value.kind == operand::i32_const)
+            append_instr(vm::opcodes::i32_const, register_ops::const_t<uint32_t>{ dst, value.value });
+         else if (uint32_t src = value.kind == operand::local ? value.value : home(pos); src != dst)
+            append_instr(reg_opcodes::copy, register_ops::unary_t{ dst, src });
+      }
+      void materialize(uint32_t pos) {
+         if (_operands[pos].kind != operand::stack) {
+            move_to(pos, home(pos));
+            _operands[pos] = {};
+         }
+      }
+      void materialize_all() {
+         for (uint32_t pos = 0; pos < _operands.size(); ++pos)
+            materialize(pos);
+      }
+      // Returns a register holding the top operand and pops it
+      uint32_t pop_reg() {
+         uint32_t pos = _operands.size() - 1;
+         if (_operands[pos].kind == operand::i32_const)
+            materialize(pos);
+         uint32_t result = _operands[pos].kind == operand::local ? _operands[pos].value : home(pos);
+         _operands.pop_back();
+         return result;
+      }
+      uint32_t top_reg() {
+         uint32_t pos = _operands.size() - 1;
+         if (_operands[pos].kind == operand::i32_const)
+            materialize(pos);
+         return _operands[pos].kind == operand::local ? _operands[pos].value : home(pos);
+      }
+
+      static constexpr bool is_fusable_compare(uint8_t op) {
+         return (op >= vm::opcodes::i32_eqz && op <= vm::opcodes::i32_ge_u) ||
+                (op >= vm::opcodes::i64_eqz && op <= vm::opcodes::i64_ge_u);
+      }
+      static constexpr uint8_t negate_compare(uint8_t op) {
+         switch (op) {
+            case vm::opcodes::i32_eq: return vm::opcodes::i32_ne;
+            case vm::opcodes::i32_ne: return vm::opcodes::i32_eq;
+            case vm::opcodes::i32_lt_s: return vm::opcodes::i32_ge_s;
+            case vm::opcodes::i32_lt_u: return vm::opcodes::i32_ge_u;
+            case vm::opcodes::i32_gt_s: return vm::opcodes::i32_le_s;
+            case vm::opcodes::i32_gt_u: return vm::opcodes::i32_le_u;
+            case vm::opcodes::i32_le_s: return vm::opcodes::i32_gt_s;
+            case vm::opcodes::i32_le_u: return vm::opcodes::i32_gt_u;
+            case vm::opcodes::i32_ge_s: return vm::opcodes::i32_lt_s;
+            case vm::opcodes::i32_ge_u: return vm::opcodes::i32_lt_u;
+            case vm::opcodes::i64_eq: return vm::opcodes::i64_ne;
+            case vm::opcodes::i64_ne: return vm::opcodes::i64_eq;
+            case vm::opcodes::i64_lt_s: return vm::opcodes::i64_ge_s;
+            case vm::opcodes::i64_lt_u: return vm::opcodes::i64_ge_u;
+            case vm::opcodes::i64_gt_s: return vm::opcodes::i64_le_s;
+            case vm::opcodes::i64_gt_u: return vm::opcodes::i64_le_u;
+            case vm::opcodes::i64_le_s: return vm::opcodes::i64_gt_s;
+            case vm::opcodes::i64_le_u: return vm::opcodes::i64_gt_u;
+            case vm::opcodes::i64_ge_s: return vm::opcodes::i64_lt_s;
+            case vm::opcodes::i64_ge_u: return vm::opcodes::i64_lt_u;
+            default: return op;
+         }
+      }
+      static constexpr uint8_t compare_branch_opcode(uint8_t op) {
+         if (op >= vm::opcodes::i64_eq)
+            return reg_opcodes::br_if_i64_eq + (op - vm::opcodes::i64_eq);
+         else
+            return reg_opcodes::br_if_i32_eq + (op - vm::opcodes::i32_eq);
+      }
+
+      // Pops the condition of a branch.  If it is the result of a comparison
+      // that was the last instruction written, the comparison is removed so
+      // that the branch can do it.  The instructions written before the
+      // branch only write registers below the condition, so they cannot
+      // change the operands of the comparison.
+      condition pop_condition() {
+         uint32_t pos = _operands.size() - 1;
+         if (is_last_result(pos) && is_fusable_compare(fb.raw()[_last_instr])) {
+            uint8_t compare = fb.raw()[_last_instr];
+            condition result{ compare, 0, 0 };
+            if (register_ops::is_unary(compare)) {
+               register_ops::unary_t instr;
+               instr.unpack(fb.raw() + _last_instr + 1);
+               result.lhs = instr.src;
+            } else {
+               register_ops::binary_t instr;
+               instr.unpack(fb.raw() + _last_instr + 1);
+               result.lhs = instr.lhs;
+               result.rhs = instr.rhs;
+            }
+            op_index = _last_instr;
+            clear_last();
+            _operands.pop_back();
+            return result;
+         }
+         return { 0, pop_reg(), 0 };
+      }
+      // Returns the location of the branch target
+      uint8_t* emit_cond_branch(condition cond, bool negate) {
+         if (cond.compare == vm::opcodes::i32_eqz) {
+            cond.compare = 0;
+            negate       = !negate;
+         }
+         if (cond.compare == 0) {
+            return append_instr(negate ? reg_opcodes::br_unless : reg_opcodes::br_if,
+                                register_ops::cond_branch_t{ cond.lhs, 0 }) + sizeof(uint32_t);
+         } else if (cond.compare == vm::opcodes::i64_eqz) {
+            return append_instr(negate ? reg_opcodes::br_unless_i64_eqz : reg_opcodes::br_if_i64_eqz,
+                                register_ops::cond_branch_t{ cond.lhs, 0 }) + sizeof(uint32_t);
+         } else {
+            uint8_t compare = negate ? negate_compare(cond.compare) : cond.compare;
+            return append_instr(compare_branch_opcode(compare),
+                                register_ops::compare_branch_t{ cond.lhs, cond.rhs, 0 }) + 2 * sizeof(uint32_t);
+         }
+      }
+
+      void emit_unop(uint8_t opcode) {
+         if (!_reachable)
+            return;
+         uint32_t src = pop_reg();
+         uint32_t dst = push_result();
+         append_result(opcode, register_ops::unary_t{ dst, src });
+      }
+      void emit_binop(uint8_t opcode) {
+         if (!_reachable)
+            return;
+         uint32_t rhs = pop_reg();
+         uint32_t lhs = pop_reg();
+         uint32_t dst = push_result();
+         append_result(opcode, register_ops::binary_t{ dst, lhs, rhs });
+      }
+      void emit_load(uint8_t opcode, uint32_t alignment, uint32_t offset) {
+         if (!_reachable)
+            return;
+         uint32_t addr = pop_reg();
+         uint32_t dst  = push_result();
+         append_result(opcode, register_ops::load_t{ dst, addr, alignment, offset });
+      }
+      void emit_store(uint8_t opcode, uint32_t alignment, uint32_t offset) {
+         if (!_reachable)
+            return;
+         uint32_t src  = pop_reg();
+         uint32_t addr = pop_reg();
+         append_instr(opcode, register_ops::store_t{ addr, src, alignment, offset });
+      }
+      // Adding or subtracting a constant becomes one instruction
+      void emit_i32_add_imm(uint8_t opcode, bool negate) {
+         if (!_reachable)
+            return;
+         uint32_t top = _operands.size() - 1;
+         uint32_t value, lhs;
+         if (_operands[top].kind == operand::i32_const) {
+            value = _operands[top].value;
+            _operands.pop_back();
+            lhs = pop_reg();
+         } else if (!negate && _operands[top - 1].kind == operand::i32_const) {
+            // Addition commutes.  The other operand stays where it is.
+            value = _operands[top - 1].value;
+            lhs   = pop_reg();
+            _operands.pop_back();
+         } else {
+            return emit_binop(opcode);
+         }
+         uint32_t dst = push_result();
+         append_result(reg_opcodes::i32_add_imm, register_ops::binary_imm_t{ dst, lhs, negate ? 0u - value : value });
+      }
+      void call_base(uint32_t num_params, uint32_t return_count, uint32_t& base) {
+         uint32_t base_pos = _operands.size() - num_params;
+         for (uint32_t pos = base_pos; pos < _operands.size(); ++pos)
+            materialize(pos);
+         _operands.resize(base_pos);
+         base = home(base_pos);
+         if (return_count)
+            push_result();
+         clear_last();
+      }
+
+    public:
+      explicit register_bitcode_writer(growable_allocator& alloc, std::size_t source_bytes, module& mod) :
+         _allocator(alloc),
+         _code_segment_base(alloc.start_code()),
+         fb(alloc, source_bytes),
+         _mod(&mod) {}
+      ~register_bitcode_writer() {
+         if (!_worker_allocator)
+            _allocator.end_code<false>(_code_segment_base);
+      }
+
+      // Parallel compilation works the same as for bitcode_writer
+      struct compiled_function {
+         std::vector<uint8_t> code;
+         std::vector<std::size_t> branches; // byte offsets of branch targets
+      };
+      register_bitcode_writer make_worker() const { return register_bitcode_writer(*this, worker_tag{}); }
+      static constexpr bool supports_lazy_compile = false;
+      static constexpr bool supports_code_cache = false;
+      static constexpr bool supports_superinstructions = false;
+      // The parser reports the depth of the operand stack after each end
+      static constexpr bool tracks_operand_depth = true;
+      compiled_function release_function() {
+         _compiled.code.assign(fb.raw(), fb.raw() + op_index);
+         return std::move(_compiled);
+      }
+      void link_function(compiled_function& func, function_body& body, uint32_t /*idx*/) {
+         uint8_t* dest = _allocator.alloc<uint8_t>(func.code.size());
+         std::copy_n(func.code.data(), func.code.size(), dest);
+         for (std::size_t offset : func.branches) {
+            uint32_t target;
+            std::memcpy(&target, dest + offset, sizeof(target));
+            target += _base_offset;
+            std::memcpy(dest + offset, &target, sizeof(target));
+         }
+         body.code = dest;
+         body.size = func.code.size();
+         _base_offset += body.size;
+      }
+
+      void emit_unreachable() {
+         if (!_reachable)
+            return;
+         append_instr(reg_opcodes::unreachable, register_ops::none_t{});
+         set_unreachable();
+      }
+      void emit_nop() {}
+      uint32_t emit_end() {
+         if (_reachable)
+            materialize_all();
+         _reachable = _blocks.back().reachable;
+         _blocks.pop_back();
+         clear_last();
+         return op_index;
+      }
+      // The operands above the block's height are the block's results, which
+      // every path into the end left in their registers
+      void set_operand_depth(uint32_t depth) {
+         if (_reachable) {
+            _operands.resize(depth);
+            _max_height = std::max(_max_height, depth);
+         }
+      }
+      uint8_t* emit_return(uint32_t depth_change) {
+         if (!_reachable)
+            return nullptr;
+         if (depth_change & 0x80000000u)
+            append_instr(reg_opcodes::return_value, register_ops::return_value_t{ pop_reg() });
+         else
+            append_instr(reg_opcodes::return_, register_ops::none_t{});
+         set_unreachable();
+         return nullptr;
+      }
+      void emit_block() {
+         if (_reachable)
+            materialize_all();
+         _blocks.push_back({ static_cast<uint32_t>(_operands.size()), _reachable });
+      }
+      uint32_t emit_loop() {
+         emit_block();
+         clear_last();
+         return op_index;
+      }
+      uint8_t* emit_if() {
+         uint8_t* result = nullptr;
+         if (_reachable) {
+            condition cond = pop_condition();
+            materialize_all();
+            result = emit_cond_branch(cond, true);
+         }
+         _blocks.push_back({ static_cast<uint32_t>(_operands.size()), _reachable });
+         return result;
+      }
+      uint8_t* emit_else(uint8_t* if_loc) {
+         uint8_t* result = nullptr;
+         if (_reachable) {
+            materialize_all();
+            result = append_instr(reg_opcodes::br, register_ops::branch_t{ 0 });
+         }
+         fix_branch(if_loc, op_index);
+         _operands.resize(_blocks.back().height);
+         _reachable = _blocks.back().reachable;
+         clear_last();
+         return result;
+      }
+      // Values below the target's depth are already in their registers,
+      // because they were written before the target's block was entered.
+      uint8_t* emit_br(uint32_t depth_change) {
+         if (!_reachable)
+            return nullptr;
+         if (depth_change & 0x80000000u)
+            move_to(_operands.size() - 1, home(_operands.size() - (depth_change & 0x7FFFFFFFu)));
+         set_unreachable();
+         return append_instr(reg_opcodes::br, register_ops::branch_t{ 0 });
+      }
+      uint8_t* emit_br_if(uint32_t depth_change) {
+         if (!_reachable)
+            return nullptr;
+         condition cond = pop_condition();
+         if (!(depth_change & 0x80000000u))
+            return emit_cond_branch(cond, false);
+         uint32_t top = _operands.size() - 1;
+         uint32_t dst = home(_operands.size() - (depth_change & 0x7FFFFFFFu));
+         if (dst == home(top)) {
+            materialize(top);
+            return emit_cond_branch(cond, false);
+         }
+         // The result must only be copied when the branch is taken
+         uint8_t* skip = emit_cond_branch(cond, true);
+         move_to(top, dst);
+         uint8_t* result = append_instr(reg_opcodes::br, register_ops::branch_t{ 0 });
+         fix_branch(skip, op_index);
+         clear_last();
+         return result;
+      }
+
+      struct br_table_parser;
+      friend struct br_table_parser;
+      struct br_table_parser {
+         br_table_parser(register_bitcode_writer& base, uint32_t table_size) : _this{ &base } {
+            if (!_this->_reachable)
+               return;
+            uint32_t index = _this->pop_reg();
+            // The result, if the labels have one, is on top of the stack
+            _src = _this->_operands.size() > _this->_blocks.back().height ? _this->top_reg() : index;
+            _br_tab = _this->append_instr(reg_opcodes::br_table, register_ops::br_table_t{ index, _src, table_size });
+            _br_tab += 3 * sizeof(uint32_t);
+            std::size_t table_bytes = (std::size_t{ table_size } + 1) * sizeof(register_ops::br_table_t::elem_t);
+            EOS_VM_ASSERT(table_bytes <= _this->fb.size() - _this->op_index, wasm_parse_exception,
+                          "bitcode buffer overflow");
+            _this->op_index += table_bytes;
+         }
+         uint8_t* emit_case(uint32_t depth_change) {
+            if (!_br_tab)
+               return nullptr;
+            uint8_t* elem = _br_tab + (_i++) * sizeof(register_ops::br_table_t::elem_t);
+            uint32_t dst = _src;
+            if (depth_change & 0x80000000u)
+               dst = _this->home(_this->_operands.size() - (depth_change & 0x7FFFFFFFu));
+            std::memcpy(elem + offsetof(register_ops::br_table_t::elem_t, dst), &dst, sizeof(dst));
+            return elem + offsetof(register_ops::br_table_t::elem_t, target);
+         }
+         // Must be called after all cases
+         uint8_t* emit_default(uint32_t depth_change) {
+            uint8_t* result = emit_case(depth_change);
+            if (_br_tab)
+               _this->set_unreachable();
+            return result;
+         }
+         register_bitcode_writer* _this;
+         uint8_t*                 _br_tab = nullptr;
+         uint32_t                 _src    = 0;
+         std::size_t              _i      = 0;
+         br_table_parser(const br_table_parser&) = delete;
+         br_table_parser& operator=(const br_table_parser&) = delete;
+      };
+      auto emit_br_table(uint32_t table_size) { return br_table_parser{ *this, table_size }; }
+      void emit_call(const func_type& ft, uint32_t funcnum) {
+         if (!_reachable)
+            return;
+         uint32_t base;
+         call_base(ft.param_types.size(), ft.return_count, base);
+         append_instr(reg_opcodes::call, register_ops::call_t{ funcnum, base });
+      }
+      void emit_call_indirect(const func_type& ft, uint32_t functypeidx) {
+         if (!_reachable)
+            return;
+         uint32_t elem = pop_reg();
+         uint32_t base;
+         call_base(ft.param_types.size(), ft.return_count, base);
+         append_instr(reg_opcodes::call_indirect, register_ops::call_indirect_t{ functypeidx, elem, base });
+      }
+
+      void emit_drop() {
+         if (_reachable)
+            _operands.pop_back();
+      }
+      void emit_select() {
+         if (!_reachable)
+            return;
+         uint32_t cond = pop_reg();
+         uint32_t rhs  = pop_reg();
+         uint32_t lhs  = pop_reg();
+         uint32_t dst  = push_result();
+         append_result(reg_opcodes::select, register_ops::select_t{ dst, lhs, rhs, cond });
+      }
+      void emit_get_local(uint32_t localidx) {
+         if (_reachable)
+            push({ operand::local, localidx });
+      }
+      void emit_set_local(uint32_t localidx) {
+         if (!_reachable)
+            return;
+         uint32_t top = _operands.size() - 1;
+         // Earlier reads of the local must see its old value
+         for (uint32_t pos = 0; pos < top; ++pos)
+            if (_operands[pos].kind == operand::local && _operands[pos].value == localidx)
+               materialize(pos);
+         if (is_last_result(top))
+            std::memcpy(fb.raw() + _last_instr + 1, &localidx, sizeof(localidx));
+         else
+            move_to(top, localidx);
+         _operands.pop_back();
+         clear_last();
+      }
+      void emit_tee_local(uint32_t localidx) {
+         if (!_reachable)
+            return;
+         operand value = _operands.back();
+         emit_set_local(localidx);
+         push(value.kind == operand::stack ? operand{ operand::local, localidx } : value);
+      }
+      void emit_get_global(uint32_t globalidx) {
+         if (!_reachable)
+            return;
+         const global_variable& gl = _mod->globals[globalidx];
+         if (!gl.type.mutability) {
+            switch (gl.type.content_type) {
+               case types::i32: emit_i32_const(gl.init.value.i32); return;
+               case types::i64: emit_i64_const(gl.init.value.i64); return;
+               case types::f32: {
+                  uint32_t dst = push_result();
+                  append_result(vm::opcodes::f32_const, register_ops::const_t<uint32_t>{ dst, gl.init.value.f32 });
+                  return;
+               }
+               case types::f64: {
+                  uint32_t dst = push_result();
+                  append_result(vm::opcodes::f64_const, register_ops::const_t<uint64_t>{ dst, gl.init.value.f64 });
+                  return;
+               }
+            }
+         }
+         uint32_t dst = push_result();
+         append_result(reg_opcodes::get_global, register_ops::get_global_t{ dst, globalidx });
+      }
+      void emit_set_global(uint32_t globalidx) {
+         if (_reachable)
+            append_instr(reg_opcodes::set_global, register_ops::set_global_t{ globalidx, pop_reg() });
+      }
+
+#define LOAD_OP(op_name) \
+      void emit_ ## op_name(uint32_t alignment, uint32_t offset) { emit_load(vm::opcodes::op_name, alignment, offset); }
+#define STORE_OP(op_name) \
+      void emit_ ## op_name(uint32_t alignment, uint32_t offset) { emit_store(vm::opcodes::op_name, alignment, offset); }
+      LOAD_OP(i32_load)
+      LOAD_OP(i64_load)
+      LOAD_OP(f32_load)
+      LOAD_OP(f64_load)
+      LOAD_OP(i32_load8_s)
+      LOAD_OP(i32_load16_s)
+      LOAD_OP(i32_load8_u)
+      LOAD_OP(i32_load16_u)
+      LOAD_OP(i64_load8_s)
+      LOAD_OP(i64_load16_s)
+      LOAD_OP(i64_load32_s)
+      LOAD_OP(i64_load8_u)
+      LOAD_OP(i64_load16_u)
+      LOAD_OP(i64_load32_u)
+      STORE_OP(i32_store)
+      STORE_OP(i64_store)
+      STORE_OP(f32_store)
+      STORE_OP(f64_store)
+      STORE_OP(i32_store8)
+      STORE_OP(i32_store16)
+      STORE_OP(i64_store8)
+      STORE_OP(i64_store16)
+      STORE_OP(i64_store32)
+#undef LOAD_OP
+#undef STORE_OP
+
+      void emit_current_memory() {
+         if (!_reachable)
+            return;
+         uint32_t dst = push_result();
+         append_result(vm::opcodes::current_memory, register_ops::nullary_t{ dst });
+      }
+      void emit_grow_memory() { emit_unop(vm::opcodes::grow_memory); }
+
+      void emit_i32_const(uint32_t value) {
+         if (_reachable)
+            push({ operand::i32_const, value });
+      }
+      void emit_i64_const(uint64_t value) {
+         if (!_reachable)
+            return;
+         uint32_t dst = push_result();
+         append_result(vm::opcodes::i64_const, register_ops::const_t<uint64_t>{ dst, value });
+      }
+      void emit_f32_const(float value) {
+         if (!_reachable)
+            return;
+         uint32_t bits;
+         std::memcpy(&bits, &value, sizeof(bits));
+         uint32_t dst = push_result();
+         append_result(vm::opcodes::f32_const, register_ops::const_t<uint32_t>{ dst, bits });
+      }
+      void emit_f64_const(double value) {
+         if (!_reachable)
+            return;
+         uint64_t bits;
+         std::memcpy(&bits, &value, sizeof(bits));
+         uint32_t dst = push_result();
+         append_result(vm::opcodes::f64_const, register_ops::const_t<uint64_t>{ dst, bits });
+      }
+
+#define UNOP(opname) \
+      void emit_ ## opname() { emit_unop(vm::opcodes::opname); }
+#define BINOP(opname) \
+      void emit_ ## opname() { emit_binop(vm::opcodes::opname); }
+
+      UNOP(i32_eqz)
+      BINOP(i32_eq)
+      BINOP(i32_ne)
+      BINOP(i32_lt_s)
+      BINOP(i32_lt_u)
+      BINOP(i32_gt_s)
+      BINOP(i32_gt_u)
+      BINOP(i32_le_s)
+      BINOP(i32_le_u)
+      BINOP(i32_ge_s)
+      BINOP(i32_ge_u)
+      UNOP(i64_eqz)
+      BINOP(i64_eq)
+      BINOP(i64_ne)
+      BINOP(i64_lt_s)
+      BINOP(i64_lt_u)
+      BINOP(i64_gt_s)
+      BINOP(i64_gt_u)
+      BINOP(i64_le_s)
+      BINOP(i64_le_u)
+      BINOP(i64_ge_s)
+      BINOP(i64_ge_u)
+      BINOP(f32_eq)
+      BINOP(f32_ne)
+      BINOP(f32_lt)
+      BINOP(f32_gt)
+      BINOP(f32_le)
+      BINOP(f32_ge)
+      BINOP(f64_eq)
+      BINOP(f64_ne)
+      BINOP(f64_lt)
+      BINOP(f64_gt)
+      BINOP(f64_le)
+      BINOP(f64_ge)
+
+      UNOP(i32_clz)
+      UNOP(i32_ctz)
+      UNOP(i32_popcnt)
+      void emit_i32_add() { emit_i32_add_imm(vm::opcodes::i32_add, false); }
+      void emit_i32_sub() { emit_i32_add_imm(vm::opcodes::i32_sub, true); }
+      BINOP(i32_mul)
+      BINOP(i32_div_s)
+      BINOP(i32_div_u)
+      BINOP(i32_rem_s)
+      BINOP(i32_rem_u)
+      BINOP(i32_and)
+      BINOP(i32_or)
+      BINOP(i32_xor)
+      BINOP(i32_shl)
+      BINOP(i32_shr_s)
+      BINOP(i32_shr_u)
+      BINOP(i32_rotl)
+      BINOP(i32_rotr)
+      UNOP(i64_clz)
+      UNOP(i64_ctz)
+      UNOP(i64_popcnt)
+      BINOP(i64_add)
+      BINOP(i64_sub)
+      BINOP(i64_mul)
+      BINOP(i64_div_s)
+      BINOP(i64_div_u)
+      BINOP(i64_rem_s)
+      BINOP(i64_rem_u)
+      BINOP(i64_and)
+      BINOP(i64_or)
+      BINOP(i64_xor)
+      BINOP(i64_shl)
+      BINOP(i64_shr_s)
+      BINOP(i64_shr_u)
+      BINOP(i64_rotl)
+      BINOP(i64_rotr)
+
+      UNOP(f32_abs)
+      UNOP(f32_neg)
+      UNOP(f32_ceil)
+      UNOP(f32_floor)
+      UNOP(f32_trunc)
+      UNOP(f32_nearest)
+      UNOP(f32_sqrt)
+      BINOP(f32_add)
+      BINOP(f32_sub)
+      BINOP(f32_mul)
+      BINOP(f32_div)
+      BINOP(f32_min)
+      BINOP(f32_max)
+      BINOP(f32_copysign)
+      UNOP(f64_abs)
+      UNOP(f64_neg)
+      UNOP(f64_ceil)
+      UNOP(f64_floor)
+      UNOP(f64_trunc)
+      UNOP(f64_nearest)
+      UNOP(f64_sqrt)
+      BINOP(f64_add)
+      BINOP(f64_sub)
+      BINOP(f64_mul)
+      BINOP(f64_div)
+      BINOP(f64_min)
+      BINOP(f64_max)
+      BINOP(f64_copysign)
+
+      UNOP(i32_wrap_i64)
+      UNOP(i32_trunc_s_f32)
+      UNOP(i32_trunc_u_f32)
+      UNOP(i32_trunc_s_f64)
+      UNOP(i32_trunc_u_f64)
+      UNOP(i64_extend_s_i32)
+      UNOP(i64_extend_u_i32)
+      UNOP(i64_trunc_s_f32)
+      UNOP(i64_trunc_u_f32)
+      UNOP(i64_trunc_s_f64)
+      UNOP(i64_trunc_u_f64)
+      UNOP(f32_convert_s_i32)
+      UNOP(f32_convert_u_i32)
+      UNOP(f32_convert_s_i64)
+      UNOP(f32_convert_u_i64)
+      UNOP(f32_demote_f64)
+      UNOP(f64_convert_s_i32)
+      UNOP(f64_convert_u_i32)
+      UNOP(f64_convert_s_i64)
+      UNOP(f64_convert_u_i64)
+      UNOP(f64_promote_f32)
+      UNOP(i32_reinterpret_f32)
+      UNOP(i64_reinterpret_f64)
+      UNOP(f32_reinterpret_i32)
+      UNOP(f64_reinterpret_i64)
+
+#undef BINOP
+#undef UNOP
+
+      void emit_error() {
+         if (_reachable)
+            append_instr(reg_opcodes::error, register_ops::none_t{});
+      }
+
+      void fix_branch(uint8_t* branch, uint32_t target) {
+         if (branch) {
+            uint32_t pc = _base_offset + target;
+            std::memcpy(branch, &pc, sizeof(pc));
+            record_branch(branch);
+         }
+      }
+      void emit_prologue(const func_type& ft, const guarded_vector<local_entry>& locals, uint32_t idx) {
+         op_index = 0;
+         if (_worker_allocator) {
+            _worker_allocator->reset();
+            _compiled = {};
+         }
+         fb = guarded_vector<uint8_t>{ _allocator, (_mod->code[idx].size + 2) * max_bytes_per_source_byte };
+         uint32_t num_params = ft.param_types.size();
+         uint64_t locals_count = 0;
+         for (uint32_t i = 0; i < locals.size(); ++i)
+            locals_count += locals[i].count;
+         EOS_VM_ASSERT(num_params + locals_count <= constants::max_stack_size, wasm_parse_exception, "too many locals");
+         _num_locals = num_params + locals_count;
+         _operands.clear();
+         _blocks.assign(1, block{ 0, true });
+         _reachable  = true;
+         _max_height = 0;
+         clear_last();
+         _enter = append_instr(reg_opcodes::enter, register_ops::enter_t{ num_params, _num_locals - num_params, 0 });
+      }
+      void emit_epilogue(const func_type& ft, const guarded_vector<local_entry>& locals, uint32_t idx) {
+         // The end of the function is always treated as reachable
+         if (ft.return_count)
+            append_instr(reg_opcodes::return_value, register_ops::return_value_t{ home(0) });
+         else
+            append_instr(reg_opcodes::return_, register_ops::none_t{});
+         // return_value reads a register even if the function never pushes anything
+         uint32_t frame_size = _num_locals + std::max(_max_height, 1u);
+         std::memcpy(_enter + offsetof(register_ops::enter_t, frame_size), &frame_size, sizeof(frame_size));
+      }
+
+      void finalize(function_body& body) {
+         fb.resize(op_index);
+         body.code = fb.raw();
+         body.size = op_index;
+         _base_offset += body.size;
+      }
+
+    private:
+      struct worker_tag {};
+      register_bitcode_writer(const register_bitcode_writer& parent, worker_tag) :
+         _worker_allocator(std::make_unique<growable_allocator>(0)),
+         _allocator(*_worker_allocator),
+         _code_segment_base(nullptr),
+         fb(*_worker_allocator),
+         _mod(parent._mod) {}
+
+      void record_branch(uint8_t* branch) {
+         if (_worker_allocator)
+            _compiled.branches.push_back(branch - fb.raw());
+      }
+
+      // A one byte select becomes an opcode and four registers, which is
+      // the most that any byte of the function body can expand to.
+      static constexpr std::size_t max_bytes_per_source_byte = 17;
+
+      // Only set for writers created by make_worker
+      std::unique_ptr<growable_allocator> _worker_allocator;
+      compiled_function _compiled;
+      growable_allocator& _allocator;
+      void * _code_segment_base;
+      std::size_t op_index = 0;
+      guarded_vector<uint8_t> fb;
+      module* _mod;
+      std::size_t _base_offset = 0;
+
+      uint32_t             _num_locals = 0;
+      uint32_t             _max_height = 0;
+      std::vector<operand> _operands;
+      std::vector<block>   _blocks;
+      bool                 _reachable = true;
+      uint8_t*             _enter     = nullptr;
+      // The last instruction written by append_result and the end of it
+      std::size_t          _last_instr = 0;
+      std::size_t          _last_end   = ~std::size_t{0};
+   };
+
+}} // namespace eosio::vm
@@ -0,0 +1,425 @@
+#pragma once
+
+#include <eosio/vm/constants.hpp>
+#include <eosio/vm/exceptions.hpp>
+#include <eosio/vm/execution_context.hpp>
+#include <eosio/vm/host_function.hpp>
+#include <eosio/vm/interpret_visitor.hpp>
+#include <eosio/vm/opcodes.hpp>
+#include <eosio/vm/register_opcodes.hpp>
+#include <eosio/vm/signals.hpp>
+#include <eosio/vm/types.hpp>
+#include <eosio/vm/utils.hpp>
+#include <eosio/vm/wasm_stack.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+
+namespace eosio { namespace vm {
+
+   // Runs the bitcode written by register_bitcode_writer.  The registers of
+   // every active function are kept in the operand stack, which host
+   // functions also use for their arguments.  A call's arguments are already
+   // in the first registers of the callee's frame.
+   template <typename Host>
+   class register_execution_context : public execution_context_base<register_execution_context<Host>, Host> {
+      using base_type = execution_context_base<register_execution_context<Host>, Host>;
+    public:
+      using base_type::execute;
+      using base_type::_mod;
+      using base_type::_rhf;
+      using base_type::_linear_memory;
+      using base_type::_error_code;
+      using base_type::handle_signal;
+      register_execution_context(module& m) : base_type(m) {}
+
+      inline operand_stack& get_operand_stack() { return _os; }
+      inline uint32_t       table_elem(uint32_t i) { return _mod.tables[0].table[i]; }
+      inline uint32_t       call_depth() const { return _frames.size(); }
+
+      inline void reset() {
+         base_type::reset();
+         _os.eat(0);
+         _frames.eat(0);
+      }
+
+      template <typename Visitor, typename... Args>
+      inline std::optional<operand_stack_elem> execute_func_table(Host* host, Visitor&& visitor, uint32_t table_index,
+                                                                  Args... args) {
+         return execute(host, std::forward<Visitor>(visitor), table_elem(table_index), std::forward<Args>(args)...);
+      }
+
+      // The visitor is unused.  The register bitcode has its own dispatch loop.
+      template <typename Visitor, typename... Args>
+      inline std::optional<operand_stack_elem> execute(Host* host, Visitor&&, uint32_t func_index, Args... args) {
+         EOS_VM_ASSERT(func_index < std::numeric_limits<uint32_t>::max(), wasm_interpreter_exception,
+                       "cannot execute function, function not found");
+         auto saved_host        = _host;
+         auto saved_os_size     = _os.size();
+         auto saved_frames_size = _frames.size();
+         auto g = scope_guard([&]() {
+            _host = saved_host;
+            _os.eat(saved_os_size);
+            _frames.eat(saved_frames_size);
+         });
+
+         _host = host;
+
+         const func_type& ft = _mod.get_function_type(func_index);
+         this->template type_check_args<Args...>(ft);
+         (..., _os.push(detail::resolve_result(std::move(args), this->_wasm_alloc)));
+
+         try {
+            const function_frame& callee = _mod.function_frames[func_index];
+            if (!callee.pc) {
+               call_host_function(func_index, saved_os_size);
+            } else {
+               _frames.push(frame{ &_halt, 0 });
+               vm::invoke_with_signal_handler([&]() {
+                  run(saved_os_size, callee.pc);
+               }, &handle_signal);
+            }
+         } catch (wasm_exit_exception&) {
+            return {};
+         }
+
+         if (!ft.return_count)
+            return {};
+         return _os.data()[saved_os_size].to_operand_stack_elem(ft.return_type);
+      }
+
+    private:
+      struct frame {
+         const uint8_t* pc;
+         uint32_t       fp; // the index of the caller's first register
+      };
+
+      // Host functions count towards the call depth, as in the interpreter
+      void call_host_function(uint32_t index, uint32_t base) {
+         _frames.push(frame{ nullptr, 0 });
+         _os.eat(base + _mod.function_frames[index].num_params);
+         _rhf(_host, *this, _mod.import_functions[index]);
+         _frames.pop();
+      }
+
+      // Runs one of the numeric or memory instructions of interpret_visitor
+      // on registers instead of the operand stack.  Returns the first element
+      // of args, where the instruction leaves its result.
+      template <typename Op, std::size_t N>
+      [[gnu::always_inline]] inline operand_stack_slot apply(const Op& op, operand_stack_slot (&args)[N], char* memory) {
+         interpret_visitor<register_execution_context> visitor(*this);
+         visitor.sp     = args + N;
+         visitor.memory = memory;
+         visitor(op);
+         return args[0];
+      }
+
+      // Loads and stores take the address and value from registers.  The
+      // memory base is reloaded after grow_memory.
+      template <typename Op>
+      [[gnu::always_inline]] inline const uint8_t* memory_op(const uint8_t* pc, operand_stack_slot* fp, char*& memory) {
+         if constexpr (Op::opcode <= vm::opcodes::i64_load32_u) {
+            register_ops::load_t instr;
+            pc = instr.unpack(pc + 1);
+            Op op;
+            op.flags_align                = instr.flags_align;
+            op.offset                     = instr.offset;
+            operand_stack_slot args[]     = { fp[instr.addr] };
+            fp[instr.dst]                 = apply(op, args, memory);
+         } else if constexpr (Op::opcode <= vm::opcodes::i64_store32) {
+            register_ops::store_t instr;
+            pc = instr.unpack(pc + 1);
+            Op op;
+            op.flags_align                = instr.flags_align;
+            op.offset                     = instr.offset;
+            operand_stack_slot args[]     = { fp[instr.addr], fp[instr.src] };
+            apply(op, args, memory);
+         } else if constexpr (Op::opcode == vm::opcodes::current_memory) {
+            register_ops::nullary_t instr;
+            pc = instr.unpack(pc + 1);
+            fp[instr.dst] = i32_const_t{ static_cast<uint32_t>(this->current_linear_memory()) };
+         } else {
+            register_ops::unary_t instr;
+            pc = instr.unpack(pc + 1);
+            fp[instr.dst] = i32_const_t{ static_cast<uint32_t>(this->grow_linear_memory(fp[instr.src].to_i32())) };
+            memory        = _linear_memory;
+         }
+         return pc;
+      }
+
+      template <uint8_t Opcode>
+      static bool compare(const operand_stack_slot& lhs, const operand_stack_slot& rhs) {
+         switch (Opcode) {
+            case register_ops::br_if_i32_eq: return lhs.to_ui32() == rhs.to_ui32();
+            case register_ops::br_if_i32_ne: return lhs.to_ui32() != rhs.to_ui32();
+            case register_ops::br_if_i32_lt_s: return lhs.to_i32() < rhs.to_i32();
+            case register_ops::br_if_i32_lt_u: return lhs.to_ui32() < rhs.to_ui32();
+            case register_ops::br_if_i32_gt_s: return lhs.to_i32() > rhs.to_i32();
+            case register_ops::br_if_i32_gt_u: return lhs.to_ui32() > rhs.to_ui32();
+            case register_ops::br_if_i32_le_s: return lhs.to_i32() <= rhs.to_i32();
+            case register_ops::br_if_i32_le_u: return lhs.to_ui32() <= rhs.to_ui32();
+            case register_ops::br_if_i32_ge_s: return lhs.to_i32() >= rhs.to_i32();
+            case register_ops::br_if_i32_ge_u: return lhs.to_ui32() >= rhs.to_ui32();
+            case register_ops::br_if_i64_eq: return lhs.to_ui64() == rhs.to_ui64();
+            case register_ops::br_if_i64_ne: return lhs.to_ui64() != rhs.to_ui64();
+            case register_ops::br_if_i64_lt_s: return lhs.to_i64() < rhs.to_i64();
+            case register_ops::br_if_i64_lt_u: return lhs.to_ui64() < rhs.to_ui64();
+            case register_ops::br_if_i64_gt_s: return lhs.to_i64() > rhs.to_i64();
+            case register_ops::br_if_i64_gt_u: return lhs.to_ui64() > rhs.to_ui64();
+            case register_ops::br_if_i64_le_s: return lhs.to_i64() <= rhs.to_i64();
+            case register_ops::br_if_i64_le_u: return lhs.to_ui64() <= rhs.to_ui64();
+            case register_ops::br_if_i64_ge_s: return lhs.to_i64() >= rhs.to_i64();
+            case register_ops::br_if_i64_ge_u: return lhs.to_ui64() >= rhs.to_ui64();
+         }
+         __builtin_unreachable();
+      }
+
+#define REGISTER_TABLE_ENTRY(NAME, CODE) &&ev_label_##NAME,
+#define REGISTER_INVALID_ENTRY(NAME, CODE) &&ev_invalid,
+#define REGISTER_DISPATCH() goto* dispatch_table[*pc]
+#define REGISTER_MEMORY_LABEL(NAME, CODE)                                                                         \
+      ev_label_##NAME :                                                                                           \
+         pc = memory_op<eosio::vm::EOS_VM_OPCODE_T(NAME)>(pc, fp, memory);                                        \
+         REGISTER_DISPATCH();
+#define REGISTER_NUMERIC_LABEL(NAME, CODE)                                                                        \
+      ev_label_##NAME : {                                                                                         \
+         if constexpr (register_ops::is_unary(CODE)) {                                                            \
+            register_ops::unary_t ev_instr;                                                                       \
+            pc                           = ev_instr.unpack(pc + 1);                                               \
+            operand_stack_slot ev_args[] = { fp[ev_instr.src] };                                                  \
+            fp[ev_instr.dst]             = apply(eosio::vm::EOS_VM_OPCODE_T(NAME){}, ev_args, memory);            \
+         } else {                                                                                                 \
+            register_ops::binary_t ev_instr;                                                                      \
+            pc                           = ev_instr.unpack(pc + 1);                                               \
+            operand_stack_slot ev_args[] = { fp[ev_instr.lhs], fp[ev_instr.rhs] };                                \
+            fp[ev_instr.dst]             = apply(eosio::vm::EOS_VM_OPCODE_T(NAME){}, ev_args, memory);            \
+         }                                                                                                        \
+      }                                                                                                           \
+      REGISTER_DISPATCH();
+#define REGISTER_COMPARE_BRANCH_LABEL(NAME, CODE)                                                                 \
+      ev_label_##NAME : {                                                                                         \
+         register_ops::compare_branch_t ev_instr;                                                                 \
+         pc = ev_instr.unpack(pc + 1);                                                                            \
+         if (compare<CODE>(fp[ev_instr.lhs], fp[ev_instr.rhs]))                                                   \
+            pc = code_base + ev_instr.target;                                                                     \
+      }                                                                                                           \
+      REGISTER_DISPATCH();
+
+      // fp_index is the index in the operand stack of the function's first
+      // register.  The function's enter instruction sets up the rest.
+      void run(uint32_t fp_index, const uint8_t* pc) {
+         static void* dispatch_table[] = {
+            EOS_VM_REGISTER_CONTROL_OPS(REGISTER_TABLE_ENTRY)
+            EOS_VM_REGISTER_VARIABLE_OPS(REGISTER_TABLE_ENTRY)
+            EOS_VM_REGISTER_PADDING_OPS(REGISTER_INVALID_ENTRY)
+            EOS_VM_MEMORY_OPS(REGISTER_TABLE_ENTRY)
+            EOS_VM_I32_CONSTANT_OPS(REGISTER_TABLE_ENTRY)
+            EOS_VM_I64_CONSTANT_OPS(REGISTER_TABLE_ENTRY)
+            EOS_VM_F32_CONSTANT_OPS(REGISTER_TABLE_ENTRY)
+            EOS_VM_F64_CONSTANT_OPS(REGISTER_TABLE_ENTRY)
+            EOS_VM_COMPARISON_OPS(REGISTER_TABLE_ENTRY)
+            EOS_VM_NUMERIC_OPS(REGISTER_TABLE_ENTRY)
+            EOS_VM_CONVERSION_OPS(REGISTER_TABLE_ENTRY)
+            EOS_VM_EXIT_OP(REGISTER_TABLE_ENTRY)
+            EOS_VM_REGISTER_COMPARE_BRANCH_OPS(REGISTER_TABLE_ENTRY)
+            EOS_VM_REGISTER_TEST_BRANCH_OPS(REGISTER_TABLE_ENTRY)
+            EOS_VM_REGISTER_EMPTY_OPS(REGISTER_INVALID_ENTRY)
+            EOS_VM_ERROR_OPS(REGISTER_INVALID_ENTRY)
+         };
+         static_assert(sizeof(dispatch_table) / sizeof(dispatch_table[0]) == 256, "missing register opcodes");
+
+         const uint8_t*      code_base = _mod.code[0].code;
+         operand_stack_slot* fp        = _os.data() + fp_index;
+         char*               memory    = _linear_memory;
+
+         // The operands of do_call, which is shared by call and call_indirect
+         uint32_t callee, call_base;
+
+         REGISTER_DISPATCH();
+
+      ev_label_unreachable:
+         throw wasm_interpreter_exception{ "unreachable" };
+      ev_label_enter: {
+         register_ops::enter_t ev_instr;
+         pc = ev_instr.unpack(pc + 1);
+         _os.eat(fp_index);
+         _os.reserve(ev_instr.frame_size);
+         _os.eat(fp_index + ev_instr.frame_size);
+         fp = _os.data() + fp_index;
+         std::memset(fp + ev_instr.first_local, 0, ev_instr.num_locals * sizeof(operand_stack_slot));
+      }
+      REGISTER_DISPATCH();
+      ev_label_br: {
+         register_ops::branch_t ev_instr;
+         ev_instr.unpack(pc + 1);
+         pc = code_base + ev_instr.target;
+      }
+      REGISTER_DISPATCH();
+      ev_label_br_if: {
+         register_ops::cond_branch_t ev_instr;
+         pc = ev_instr.unpack(pc + 1);
+         if (fp[ev_instr.cond].to_ui32())
+            pc = code_base + ev_instr.target;
+      }
+      REGISTER_DISPATCH();
+      ev_label_br_unless: {
+         register_ops::cond_branch_t ev_instr;
+         pc = ev_instr.unpack(pc + 1);
+         if (!fp[ev_instr.cond].to_ui32())
+            pc = code_base + ev_instr.target;
+      }
+      REGISTER_DISPATCH();
+      ev_label_br_table: {
+         register_ops::br_table_t ev_instr;
+         const uint8_t* elems = ev_instr.unpack(pc + 1);
+         uint32_t i = std::min(fp[ev_instr.index].to_ui32(), ev_instr.size);
+         register_ops::br_table_t::elem_t elem;
+         std::memcpy(&elem, elems + i * sizeof(elem), sizeof(elem));
+         fp[elem.dst] = fp[ev_instr.src];
+         pc = code_base + elem.target;
+      }
+      REGISTER_DISPATCH();
+      ev_label_return_:
+         goto do_return;
+      ev_label_return_value: {
+         register_ops::return_value_t ev_instr;
+         ev_instr.unpack(pc + 1);
+         fp[0] = fp[ev_instr.src];
+      }
+      goto do_return;
+      ev_label_call: {
+         register_ops::call_t ev_instr;
+         pc        = ev_instr.unpack(pc + 1);
+         callee    = ev_instr.funcnum;
+         call_base = ev_instr.base;
+      }
+      goto do_call;
+      ev_label_call_indirect: {
+         register_ops::call_indirect_t ev_instr;
+         pc = ev_instr.unpack(pc + 1);
+         uint32_t fn = table_elem(fp[ev_instr.elem].to_ui32());
+         EOS_VM_ASSERT(_mod.function_frames[fn].type_id == _mod.type_aliases[ev_instr.type_index],
+                       wasm_interpreter_exception, "bad call_indirect type");
+         callee    = fn;
+         call_base = ev_instr.base;
+      }
+      goto do_call;
+      ev_label_copy: {
+         register_ops::unary_t ev_instr;
+         pc = ev_instr.unpack(pc + 1);
+         fp[ev_instr.dst] = fp[ev_instr.src];
+      }
+      REGISTER_DISPATCH();
+      ev_label_select: {
+         register_ops::select_t ev_instr;
+         pc = ev_instr.unpack(pc + 1);
+         fp[ev_instr.dst] = fp[ev_instr.cond].to_ui32() ? fp[ev_instr.lhs] : fp[ev_instr.rhs];
+      }
+      REGISTER_DISPATCH();
+      ev_label_get_global: {
+         register_ops::get_global_t ev_instr;
+         pc = ev_instr.unpack(pc + 1);
+         fp[ev_instr.dst] = this->get_global(ev_instr.index);
+      }
+      REGISTER_DISPATCH();
+      ev_label_set_global: {
+         register_ops::set_global_t ev_instr;
+         pc = ev_instr.unpack(pc + 1);
+         this->set_global(ev_instr.index, fp[ev_instr.src]);
+      }
+      REGISTER_DISPATCH();
+      ev_label_i32_add_imm: {
+         register_ops::binary_imm_t ev_instr;
+         pc = ev_instr.unpack(pc + 1);
+         fp[ev_instr.dst] = i32_const_t{ fp[ev_instr.lhs].to_ui32() + ev_instr.imm };
+      }
+      REGISTER_DISPATCH();
+      EOS_VM_MEMORY_OPS(REGISTER_MEMORY_LABEL)
+      ev_label_i32_const: {
+         register_ops::const_t<uint32_t> ev_instr;
+         pc = ev_instr.unpack(pc + 1);
+         fp[ev_instr.dst] = i32_const_t{ ev_instr.value };
+      }
+      REGISTER_DISPATCH();
+      ev_label_i64_const: {
+         register_ops::const_t<uint64_t> ev_instr;
+         pc = ev_instr.unpack(pc + 1);
+         fp[ev_instr.dst] = i64_const_t{ ev_instr.value };
+      }
+      REGISTER_DISPATCH();
+      ev_label_f32_const: {
+         register_ops::const_t<uint32_t> ev_instr;
+         pc = ev_instr.unpack(pc + 1);
+         fp[ev_instr.dst] = f32_const_t{ ev_instr.value };
+      }
+      REGISTER_DISPATCH();
+      ev_label_f64_const: {
+         register_ops::const_t<uint64_t> ev_instr;
+         pc = ev_instr.unpack(pc + 1);
+         fp[ev_instr.dst] = f64_const_t{ ev_instr.value };
+      }
+      REGISTER_DISPATCH();
+      EOS_VM_COMPARISON_OPS(REGISTER_NUMERIC_LABEL)
+      EOS_VM_NUMERIC_OPS(REGISTER_NUMERIC_LABEL)
+      EOS_VM_CONVERSION_OPS(REGISTER_NUMERIC_LABEL)
+      ev_label_exit:
+         return;
+      EOS_VM_REGISTER_COMPARE_BRANCH_OPS(REGISTER_COMPARE_BRANCH_LABEL)
+      ev_label_br_if_i64_eqz: {
+         register_ops::cond_branch_t ev_instr;
+         pc = ev_instr.unpack(pc + 1);
+         if (fp[ev_instr.cond].to_ui64() == 0)
+            pc = code_base + ev_instr.target;
+      }
+      REGISTER_DISPATCH();
+      ev_label_br_unless_i64_eqz: {
+         register_ops::cond_branch_t ev_instr;
+         pc = ev_instr.unpack(pc + 1);
+         if (fp[ev_instr.cond].to_ui64() != 0)
+            pc = code_base + ev_instr.target;
+      }
+      REGISTER_DISPATCH();
+      do_call:
+         if (const uint8_t* callee_pc = _mod.function_frames[callee].pc) {
+            _frames.push(frame{ pc, fp_index });
+            fp_index += call_base;
+            pc = callee_pc;
+         } else {
+            call_host_function(callee, fp_index + call_base);
+            fp     = _os.data() + fp_index;
+            memory = _linear_memory;
+         }
+         REGISTER_DISPATCH();
+      do_return: {
+         frame f  = _frames.pop();
+         pc       = f.pc;
+         fp_index = f.fp;
+         fp       = _os.data() + fp_index;
+         memory   = _linear_memory;
+      }
+      REGISTER_DISPATCH();
+      ev_invalid:
+         throw wasm_interpreter_exception{ "invalid opcode" };
+      }
+
+#undef REGISTER_COMPARE_BRANCH_LABEL
+#undef REGISTER_NUMERIC_LABEL
+#undef REGISTER_MEMORY_LABEL
+#undef REGISTER_DISPATCH
+#undef REGISTER_INVALID_ENTRY
+#undef REGISTER_TABLE_ENTRY
+
+      Host* _host = nullptr;
+      bounded_allocator _base_allocator = {
+         (constants::max_call_depth + 1) * sizeof(frame)
+      };
+      stack<frame, constants::max_call_depth + 1, bounded_allocator> _frames = { _base_allocator };
+      operand_stack _os;
+      uint8_t       _halt = register_ops::exit;
+   };
+
+}} // namespace eosio::vm
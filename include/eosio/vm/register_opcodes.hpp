@@ -0,0 +1,295 @@
+#pragma once
+
+#include <eosio/vm/opcodes.hpp>
+
+#include <cstdint>
+
+// The register bitcode run by register_execution_context.  Every operand is a
+// register: a slot in the current function's frame, counted from its first
+// parameter.  The locals come first, followed by one register for each
+// position of the wasm operand stack.
+//
+// The loads, stores, constants and numeric instructions keep their wasm
+// opcodes, with registers in place of the operand stack.  Only the control
+// flow and variable access instructions are different.
+
+/* clang-format off */
+#define EOS_VM_REGISTER_CONTROL_OPS(opcode_macro) \
+   opcode_macro(unreachable, 0x00)                \
+   opcode_macro(enter, 0x01)                      \
+   opcode_macro(br, 0x02)                         \
+   opcode_macro(br_if, 0x03)                      \
+   opcode_macro(br_unless, 0x04)                  \
+   opcode_macro(br_table, 0x05)                   \
+   opcode_macro(return_, 0x06)                    \
+   opcode_macro(return_value, 0x07)               \
+   opcode_macro(call, 0x08)                       \
+   opcode_macro(call_indirect, 0x09)
+#define EOS_VM_REGISTER_VARIABLE_OPS(opcode_macro) \
+   opcode_macro(copy, 0x0A)                        \
+   opcode_macro(select, 0x0B)                      \
+   opcode_macro(get_global, 0x0C)                  \
+   opcode_macro(set_global, 0x0D)                  \
+   opcode_macro(i32_add_imm, 0x0E)
+#define EOS_VM_REGISTER_PADDING_OPS(opcode_macro) \
+   opcode_macro(padding_reg_0, 0x0F)              \
+   opcode_macro(padding_reg_1, 0x10)              \
+   opcode_macro(padding_reg_2, 0x11)              \
+   opcode_macro(padding_reg_3, 0x12)              \
+   opcode_macro(padding_reg_4, 0x13)              \
+   opcode_macro(padding_reg_5, 0x14)              \
+   opcode_macro(padding_reg_6, 0x15)              \
+   opcode_macro(padding_reg_7, 0x16)              \
+   opcode_macro(padding_reg_8, 0x17)              \
+   opcode_macro(padding_reg_9, 0x18)              \
+   opcode_macro(padding_reg_10, 0x19)             \
+   opcode_macro(padding_reg_11, 0x1A)             \
+   opcode_macro(padding_reg_12, 0x1B)             \
+   opcode_macro(padding_reg_13, 0x1C)             \
+   opcode_macro(padding_reg_14, 0x1D)             \
+   opcode_macro(padding_reg_15, 0x1E)             \
+   opcode_macro(padding_reg_16, 0x1F)             \
+   opcode_macro(padding_reg_17, 0x20)             \
+   opcode_macro(padding_reg_18, 0x21)             \
+   opcode_macro(padding_reg_19, 0x22)             \
+   opcode_macro(padding_reg_20, 0x23)             \
+   opcode_macro(padding_reg_21, 0x24)             \
+   opcode_macro(padding_reg_22, 0x25)             \
+   opcode_macro(padding_reg_23, 0x26)             \
+   opcode_macro(padding_reg_24, 0x27)
+// An integer comparison followed by br_if.  br_unless is written as the
+// opposite comparison.
+#define EOS_VM_REGISTER_COMPARE_BRANCH_OPS(opcode_macro) \
+   opcode_macro(br_if_i32_eq, 0xC1)                      \
+   opcode_macro(br_if_i32_ne, 0xC2)                      \
+   opcode_macro(br_if_i32_lt_s, 0xC3)                    \
+   opcode_macro(br_if_i32_lt_u, 0xC4)                    \
+   opcode_macro(br_if_i32_gt_s, 0xC5)                    \
+   opcode_macro(br_if_i32_gt_u, 0xC6)                    \
+   opcode_macro(br_if_i32_le_s, 0xC7)                    \
+   opcode_macro(br_if_i32_le_u, 0xC8)                    \
+   opcode_macro(br_if_i32_ge_s, 0xC9)                    \
+   opcode_macro(br_if_i32_ge_u, 0xCA)                    \
+   opcode_macro(br_if_i64_eq, 0xCB)                      \
+   opcode_macro(br_if_i64_ne, 0xCC)                      \
+   opcode_macro(br_if_i64_lt_s, 0xCD)                    \
+   opcode_macro(br_if_i64_lt_u, 0xCE)                    \
+   opcode_macro(br_if_i64_gt_s, 0xCF)                    \
+   opcode_macro(br_if_i64_gt_u, 0xD0)                    \
+   opcode_macro(br_if_i64_le_s, 0xD1)                    \
+   opcode_macro(br_if_i64_le_u, 0xD2)                    \
+   opcode_macro(br_if_i64_ge_s, 0xD3)                    \
+   opcode_macro(br_if_i64_ge_u, 0xD4)
+#define EOS_VM_REGISTER_TEST_BRANCH_OPS(opcode_macro) \
+   opcode_macro(br_if_i64_eqz, 0xD5)                  \
+   opcode_macro(br_unless_i64_eqz, 0xD6)
+#define EOS_VM_REGISTER_EMPTY_OPS(opcode_macro) \
+   opcode_macro(empty_reg_0xD7, 0xD7)           \
+   opcode_macro(empty_reg_0xD8, 0xD8)           \
+   opcode_macro(empty_reg_0xD9, 0xD9)           \
+   opcode_macro(empty_reg_0xDA, 0xDA)           \
+   opcode_macro(empty_reg_0xDB, 0xDB)           \
+   opcode_macro(empty_reg_0xDC, 0xDC)           \
+   opcode_macro(empty_reg_0xDD, 0xDD)           \
+   opcode_macro(empty_reg_0xDE, 0xDE)           \
+   opcode_macro(empty_reg_0xDF, 0xDF)           \
+   opcode_macro(empty_reg_0xE0, 0xE0)           \
+   opcode_macro(empty_reg_0xE1, 0xE1)           \
+   opcode_macro(empty_reg_0xE2, 0xE2)           \
+   opcode_macro(empty_reg_0xE3, 0xE3)           \
+   opcode_macro(empty_reg_0xE4, 0xE4)           \
+   opcode_macro(empty_reg_0xE5, 0xE5)           \
+   opcode_macro(empty_reg_0xE6, 0xE6)           \
+   opcode_macro(empty_reg_0xE7, 0xE7)           \
+   opcode_macro(empty_reg_0xE8, 0xE8)           \
+   opcode_macro(empty_reg_0xE9, 0xE9)           \
+   opcode_macro(empty_reg_0xEA, 0xEA)           \
+   opcode_macro(empty_reg_0xEB, 0xEB)           \
+   opcode_macro(empty_reg_0xEC, 0xEC)           \
+   opcode_macro(empty_reg_0xED, 0xED)           \
+   opcode_macro(empty_reg_0xEE, 0xEE)           \
+   opcode_macro(empty_reg_0xEF, 0xEF)           \
+   opcode_macro(empty_reg_0xF0, 0xF0)           \
+   opcode_macro(empty_reg_0xF1, 0xF1)           \
+   opcode_macro(empty_reg_0xF2, 0xF2)           \
+   opcode_macro(empty_reg_0xF3, 0xF3)           \
+   opcode_macro(empty_reg_0xF4, 0xF4)           \
+   opcode_macro(empty_reg_0xF5, 0xF5)           \
+   opcode_macro(empty_reg_0xF6, 0xF6)           \
+   opcode_macro(empty_reg_0xF7, 0xF7)           \
+   opcode_macro(empty_reg_0xF8, 0xF8)           \
+   opcode_macro(empty_reg_0xF9, 0xF9)           \
+   opcode_macro(empty_reg_0xFA, 0xFA)           \
+   opcode_macro(empty_reg_0xFB, 0xFB)           \
+   opcode_macro(empty_reg_0xFC, 0xFC)           \
+   opcode_macro(empty_reg_0xFD, 0xFD)           \
+   opcode_macro(empty_reg_0xFE, 0xFE)
+/* clang-format on */
+
+namespace eosio { namespace vm { namespace register_ops {
+
+   enum opcodes {
+      EOS_VM_REGISTER_CONTROL_OPS(EOS_VM_CREATE_ENUM)
+      EOS_VM_REGISTER_VARIABLE_OPS(EOS_VM_CREATE_ENUM)
+      EOS_VM_REGISTER_PADDING_OPS(EOS_VM_CREATE_ENUM)
+      EOS_VM_REGISTER_COMPARE_BRANCH_OPS(EOS_VM_CREATE_ENUM)
+      EOS_VM_REGISTER_TEST_BRANCH_OPS(EOS_VM_CREATE_ENUM)
+      EOS_VM_REGISTER_EMPTY_OPS(EOS_VM_CREATE_ENUM)
+      exit  = vm::opcodes::exit,
+      error = vm::opcodes::error,
+   };
+
+   namespace detail {
+      template <typename... T>
+      inline const uint8_t* unpack_immediates(const uint8_t* p, T&... values) {
+         ((p = vm::detail::unpack_immediate(p, values)), ...);
+         return p;
+      }
+      template <typename... T>
+      inline uint8_t* pack_immediates(uint8_t* p, const T&... values) {
+         ((p = vm::detail::pack_immediate(p, values)), ...);
+         return p;
+      }
+   } // namespace detail
+
+#define EOS_VM_REGISTER_IMMEDIATES(...)                                                                               \
+   const uint8_t* unpack(const uint8_t* p) { return detail::unpack_immediates(p, __VA_ARGS__); }                      \
+   uint8_t*       pack(uint8_t* p) const { return detail::pack_immediates(p, __VA_ARGS__); }
+
+   // The instructions' immediates.  Several opcodes share each layout.
+   struct none_t {
+      const uint8_t* unpack(const uint8_t* p) { return p; }
+      uint8_t*       pack(uint8_t* p) const { return p; }
+   };
+   struct enter_t {
+      uint32_t first_local; // the number of parameters
+      uint32_t num_locals;
+      uint32_t frame_size;  // all registers, including the parameters
+      EOS_VM_REGISTER_IMMEDIATES(first_local, num_locals, frame_size)
+   };
+   // Branch targets are byte offsets from the start of the first function
+   struct branch_t {
+      uint32_t target;
+      EOS_VM_REGISTER_IMMEDIATES(target)
+   };
+   struct cond_branch_t {
+      uint32_t cond;
+      uint32_t target;
+      EOS_VM_REGISTER_IMMEDIATES(cond, target)
+   };
+   struct compare_branch_t {
+      uint32_t lhs;
+      uint32_t rhs;
+      uint32_t target;
+      EOS_VM_REGISTER_IMMEDIATES(lhs, rhs, target)
+   };
+   // Followed by size + 1 elements.  The last one is the default.  src is
+   // copied to the element's dst, which is src itself when the label has no
+   // result.
+   struct br_table_t {
+      uint32_t index;
+      uint32_t src;
+      uint32_t size;
+      EOS_VM_REGISTER_IMMEDIATES(index, src, size)
+      struct elem_t {
+         uint32_t target;
+         uint32_t dst;
+      };
+   };
+   struct return_value_t {
+      uint32_t src;
+      EOS_VM_REGISTER_IMMEDIATES(src)
+   };
+   // The arguments are in consecutive registers starting from base.  They
+   // become the callee's first registers, and the result is left in base.
+   struct call_t {
+      uint32_t funcnum;
+      uint32_t base;
+      EOS_VM_REGISTER_IMMEDIATES(funcnum, base)
+   };
+   struct call_indirect_t {
+      uint32_t type_index;
+      uint32_t elem;
+      uint32_t base;
+      EOS_VM_REGISTER_IMMEDIATES(type_index, elem, base)
+   };
+   struct select_t {
+      uint32_t dst;
+      uint32_t lhs;
+      uint32_t rhs;
+      uint32_t cond;
+      EOS_VM_REGISTER_IMMEDIATES(dst, lhs, rhs, cond)
+   };
+   struct get_global_t {
+      uint32_t dst;
+      uint32_t index;
+      EOS_VM_REGISTER_IMMEDIATES(dst, index)
+   };
+   struct set_global_t {
+      uint32_t index;
+      uint32_t src;
+      EOS_VM_REGISTER_IMMEDIATES(index, src)
+   };
+   struct nullary_t {
+      uint32_t dst;
+      EOS_VM_REGISTER_IMMEDIATES(dst)
+   };
+   struct unary_t {
+      uint32_t dst;
+      uint32_t src;
+      EOS_VM_REGISTER_IMMEDIATES(dst, src)
+   };
+   struct binary_t {
+      uint32_t dst;
+      uint32_t lhs;
+      uint32_t rhs;
+      EOS_VM_REGISTER_IMMEDIATES(dst, lhs, rhs)
+   };
+   struct binary_imm_t {
+      uint32_t dst;
+      uint32_t lhs;
+      uint32_t imm;
+      EOS_VM_REGISTER_IMMEDIATES(dst, lhs, imm)
+   };
+   struct load_t {
+      uint32_t dst;
+      uint32_t addr;
+      uint32_t flags_align;
+      uint32_t offset;
+      EOS_VM_REGISTER_IMMEDIATES(dst, addr, flags_align, offset)
+   };
+   struct store_t {
+      uint32_t addr;
+      uint32_t src;
+      uint32_t flags_align;
+      uint32_t offset;
+      EOS_VM_REGISTER_IMMEDIATES(addr, src, flags_align, offset)
+   };
+   template <typename T>
+   struct const_t {
+      uint32_t dst;
+      T        value;
+      EOS_VM_REGISTER_IMMEDIATES(dst, value)
+   };
+
+#undef EOS_VM_REGISTER_IMMEDIATES
+
+   // The numeric instructions with one operand.  The others have two.
+   constexpr bool is_unary(uint8_t opcode) {
+      switch (opcode) {
+         case vm::opcodes::i32_eqz:
+         case vm::opcodes::i64_eqz:
+         case vm::opcodes::i32_clz:
+         case vm::opcodes::i32_ctz:
+         case vm::opcodes::i32_popcnt:
+         case vm::opcodes::i64_clz:
+         case vm::opcodes::i64_ctz:
+         case vm::opcodes::i64_popcnt: return true;
+         default:
+            return (opcode >= vm::opcodes::f32_abs && opcode <= vm::opcodes::f32_sqrt) ||
+                   (opcode >= vm::opcodes::f64_abs && opcode <= vm::opcodes::f64_sqrt) ||
+                   opcode >= vm::opcodes::i32_wrap_i64;
+      }
+   }
+
+}}} // namespace eosio::vm::register_ops
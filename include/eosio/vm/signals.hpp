@@ -93,6 +93,20 @@ namespace eosio { namespace vm {
       static_assert(std::atomic<sigjmp_buf*>::is_always_lock_free, "Atomic pointers must be lock-free to be async signal safe.");
    }
 
+   // SIGSEGV, SIGBUS, and SIGFPE are raised synchronously by the faulting
+   // instruction, so blocking them only turns a trap into process termination.
+   // The caller may have blocked them again since the last call, so they
+   // are unblocked every time.  Restoring the mask afterwards is skipped,
+   // which saves a second syscall.
+   inline void unblock_trap_signals() {
+      sigset_t unblock_mask;
+      sigemptyset(&unblock_mask);
+      sigaddset(&unblock_mask, SIGSEGV);
+      sigaddset(&unblock_mask, SIGBUS);
+      sigaddset(&unblock_mask, SIGFPE);
+      pthread_sigmask(SIG_UNBLOCK, &unblock_mask, nullptr);
+   }
+
    /// Call a function with a signal handler installed.  If this thread is
    /// signalled during the execution of f, the function e will be called with
    /// the signal number as an argument.  If f creates any automatic variables
@@ -101,6 +115,12 @@ namespace eosio { namespace vm {
    ///
    /// signals handled: SIGSEGV, SIGBUS, SIGFPE
    ///
+   /// These signals are unblocked on every call, and the caller's signal
+   /// mask is not restored afterwards: they stay unblocked until the caller
+   /// blocks them again.  The handler does not change the signal mask
+   /// (SA_NODEFER with an empty sa_mask), so the jump buffer does not need
+   /// to save or restore it.
+   ///
    // Make this noinline to prevent possible corruption of the caller's local variables.
    // It's unlikely, but I'm not sure that it can definitely be ruled out if both
    // this and f are inlined and f modifies locals from the caller.
@@ -110,27 +130,19 @@ namespace eosio { namespace vm {
       sigjmp_buf dest;
       sigjmp_buf* volatile old_signal_handler = nullptr;
       int sig;
-      if((sig = sigsetjmp(dest, 1)) == 0) {
+      if((sig = sigsetjmp(dest, 0)) == 0) {
          // Note: Cannot use RAII, as non-trivial destructors w/ longjmp
          // have undefined behavior. [csetjmp.syn]
          //
-         // Warning: The order of operations is critical here.
-         // We also have to register signal_dest before unblocking
-         // signals to make sure that only our signal handler is executed
-         // if the caller has previously blocked signals.
+         // signal_dest is registered before unblocking signals to make
+         // sure that only our signal handler is executed if the caller
+         // has previously blocked signals.
          old_signal_handler = std::atomic_exchange(&signal_dest, &dest);
-         sigset_t unblock_mask, old_sigmask; // Might not be preserved across longjmp
-         sigemptyset(&unblock_mask);
-         sigaddset(&unblock_mask, SIGSEGV);
-         sigaddset(&unblock_mask, SIGBUS);
-         sigaddset(&unblock_mask, SIGFPE);
-         pthread_sigmask(SIG_UNBLOCK, &unblock_mask, &old_sigmask);
+         unblock_trap_signals();
          try {
             f();
-            pthread_sigmask(SIG_SETMASK, &old_sigmask, nullptr);
             std::atomic_store(&signal_dest, old_signal_handler);
          } catch(...) {
-            pthread_sigmask(SIG_SETMASK, &old_sigmask, nullptr);
             std::atomic_store(&signal_dest, old_signal_handler);
             throw;
          }
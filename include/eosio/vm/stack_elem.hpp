@@ -1,6 +1,8 @@
 #pragma once
 
+#include <eosio/vm/exceptions.hpp>
 #include <eosio/vm/opcodes.hpp>
+#include <eosio/vm/types.hpp>
 #include <eosio/vm/variant.hpp>
 
 #include <cstdint>
@@ -31,4 +33,59 @@ namespace eosio { namespace vm {
          inline uint64_t to_fui64() const & { return get<f64_const_t>().data.ui; }
 
    };
+
+   // An element of the interpreter's operand stack.  Unlike operand_stack_elem,
+   // it does not record its type.  Validation has already proven the type of
+   // every operand, so each opcode reads the type that it expects.  Types are
+   // only needed where values cross into or out of the interpreter.
+   class operand_stack_slot {
+      public:
+         operand_stack_slot() = default;
+         operand_stack_slot(const i32_const_t& v) { _value.ui32 = v.data.ui; }
+         operand_stack_slot(const i64_const_t& v) { _value.ui64 = v.data.ui; }
+         operand_stack_slot(const f32_const_t& v) { _value.fui32 = v.data.ui; }
+         operand_stack_slot(const f64_const_t& v) { _value.fui64 = v.data.ui; }
+
+         inline int32_t&  to_i32() & { return _value.i32; }
+         inline uint32_t& to_ui32() & { return _value.ui32; }
+         inline float&    to_f32() & { return _value.f32; }
+         inline uint32_t& to_fui32() & { return _value.fui32; }
+
+         inline int64_t&  to_i64() & { return _value.i64; }
+         inline uint64_t& to_ui64() & { return _value.ui64; }
+         inline double&   to_f64() & { return _value.f64; }
+         inline uint64_t& to_fui64() & { return _value.fui64; }
+
+         inline int32_t  to_i32() const & { return _value.i32; }
+         inline uint32_t to_ui32() const & { return _value.ui32; }
+         inline float    to_f32() const & { return _value.f32; }
+         inline uint32_t to_fui32() const & { return _value.fui32; }
+
+         inline int64_t  to_i64() const & { return _value.i64; }
+         inline uint64_t to_ui64() const & { return _value.ui64; }
+         inline double   to_f64() const & { return _value.f64; }
+         inline uint64_t to_fui64() const & { return _value.fui64; }
+
+         operand_stack_elem to_operand_stack_elem(value_type type) const {
+            switch (type) {
+               case types::i32: return i32_const_t{ _value.ui32 };
+               case types::i64: return i64_const_t{ _value.ui64 };
+               case types::f32: return f32_const_t{ _value.fui32 };
+               case types::f64: return f64_const_t{ _value.fui64 };
+               default: throw wasm_interpreter_exception{ "invalid operand type" };
+            }
+         }
+
+      private:
+         union {
+            int32_t  i32;
+            uint32_t ui32;
+            float    f32;
+            uint32_t fui32;
+            int64_t  i64;
+            uint64_t ui64;
+            double   f64;
+            uint64_t fui64;
+         } _value;
+   };
 }} // nameo::vm
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <eosio/vm/opcodes.hpp>
+
+#include <algorithm>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace eosio { namespace vm {
+
+   struct superinstruction_pattern {
+      uint8_t opcode;      // the superinstruction
+      uint8_t size;        // the number of wasm instructions that it replaces
+      uint8_t sequence[4]; // the wasm instructions that it replaces
+   };
+
+   // i32_add_const and local_i32_add_const also replace i32.sub, with the
+   // constant negated.
+   inline constexpr superinstruction_pattern superinstruction_patterns[] = {
+      { opcodes::get_local_get_local, 2, { opcodes::get_local, opcodes::get_local } },
+      { opcodes::set_local_get_local, 2, { opcodes::set_local, opcodes::get_local } },
+      { opcodes::get_local_i32_const, 2, { opcodes::get_local, opcodes::i32_const } },
+      { opcodes::local_i32_add_const, 3, { opcodes::get_local, opcodes::i32_const, opcodes::i32_add } },
+      { opcodes::i32_add_const, 2, { opcodes::i32_const, opcodes::i32_add } },
+      { opcodes::i32_and_const, 2, { opcodes::i32_const, opcodes::i32_and } },
+      { opcodes::local_i32_load, 2, { opcodes::get_local, opcodes::i32_load } },
+      { opcodes::local_i64_load, 2, { opcodes::get_local, opcodes::i64_load } },
+      { opcodes::local_i32_store, 2, { opcodes::get_local, opcodes::i32_store } },
+      { opcodes::local_i64_store, 2, { opcodes::get_local, opcodes::i64_store } },
+      { opcodes::i32_const_call, 2, { opcodes::i32_const, opcodes::call } },
+      { opcodes::i32_eqz_br_if, 2, { opcodes::i32_eqz, opcodes::br_if } },
+      { opcodes::i32_eq_br_if, 2, { opcodes::i32_eq, opcodes::br_if } },
+      { opcodes::i32_ne_br_if, 2, { opcodes::i32_ne, opcodes::br_if } },
+      { opcodes::i32_lt_s_br_if, 2, { opcodes::i32_lt_s, opcodes::br_if } },
+      { opcodes::i32_lt_u_br_if, 2, { opcodes::i32_lt_u, opcodes::br_if } },
+      { opcodes::i32_gt_u_br_if, 2, { opcodes::i32_gt_u, opcodes::br_if } },
+      { opcodes::i32_ge_u_br_if, 2, { opcodes::i32_ge_u, opcodes::br_if } },
+      { opcodes::i64_eq_br_if, 2, { opcodes::i64_eq, opcodes::br_if } },
+      { opcodes::i64_ne_br_if, 2, { opcodes::i64_ne, opcodes::br_if } },
+      { opcodes::local_local_i32_lt_u_br_if, 4, { opcodes::get_local, opcodes::get_local, opcodes::i32_lt_u, opcodes::br_if } },
+   };
+
+   // The superinstructions that bitcode_writer may use
+   class superinstruction_set {
+    public:
+      static superinstruction_set all() {
+         superinstruction_set result;
+         for (const auto& pattern : superinstruction_patterns)
+            result.insert(pattern.opcode);
+         return result;
+      }
+      static superinstruction_set none() { return {}; }
+
+      superinstruction_set& insert(uint8_t opcode) {
+         _opcodes.set(opcode);
+         return *this;
+      }
+      superinstruction_set& erase(uint8_t opcode) {
+         _opcodes.reset(opcode);
+         return *this;
+      }
+      bool        contains(uint8_t opcode) const { return _opcodes.test(opcode); }
+      std::size_t size() const { return _opcodes.count(); }
+
+    private:
+      std::bitset<256> _opcodes;
+   };
+
+   // Counts how often each instruction is directly followed by each other
+   // instruction.  Profiles used to choose superinstructions should be
+   // gathered from code compiled with superinstruction_set::none().
+   class opcode_pair_profile {
+    public:
+      void     add(uint8_t first, uint8_t second, uint64_t n = 1) { _counts[first * 256 + second] += n; }
+      uint64_t count(uint8_t first, uint8_t second) const { return _counts[first * 256 + second]; }
+
+      // Adds every pair in a function's bitcode.  This counts each
+      // instruction once, however often it runs, and also counts pairs
+      // that span a block boundary, which cannot be fused.
+      void add_code(const uint8_t* code, std::size_t size) {
+         const uint8_t* end = code + size;
+         for (const uint8_t* pos = code; pos < end;) {
+            const uint8_t* next = visit_instruction([](const auto&) {}, pos);
+            if (next < end)
+               add(*pos, *next);
+            pos = next;
+         }
+      }
+
+      // An upper bound on how often pattern occurs
+      uint64_t count(const superinstruction_pattern& pattern) const {
+         uint64_t result = count(pattern.sequence[0], pattern.sequence[1]);
+         for (uint8_t i = 2; i < pattern.size; ++i)
+            result = std::min(result, count(pattern.sequence[i - 1], pattern.sequence[i]));
+         return result;
+      }
+
+    private:
+      std::vector<uint64_t> _counts = std::vector<uint64_t>(256 * 256);
+   };
+
+   // Chooses up to max_size superinstructions that save the most dispatches
+   // in profile.  Superinstructions that never occur are not chosen.
+   inline superinstruction_set select_superinstructions(const opcode_pair_profile& profile, std::size_t max_size) {
+      std::vector<std::pair<uint64_t, uint8_t>> saved;
+      for (const auto& pattern : superinstruction_patterns) {
+         if (uint64_t n = profile.count(pattern))
+            saved.emplace_back(n * (pattern.size - 1), pattern.opcode);
+      }
+      std::stable_sort(saved.begin(), saved.end(), [](const auto& lhs, const auto& rhs) { return lhs.first > rhs.first; });
+      superinstruction_set result;
+      for (std::size_t i = 0; i < saved.size() && i < max_size; ++i)
+         result.insert(saved[i].second);
+      return result;
+   }
+}} // namespace eosio::vm
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <eosio/vm/execution_context.hpp>
+#include <eosio/vm/interpret_visitor.hpp>
+#include <eosio/vm/parser.hpp>
+#include <eosio/vm/types.hpp>
+#include <eosio/vm/utils.hpp>
+#include <eosio/vm/x86_64.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <system_error>
+#include <thread>
+
+namespace eosio { namespace vm {
+
+   // Starts executing a module in the interpreter.  When any function has
+   // been called or has looped hot_threshold times, the whole module is
+   // compiled by the jit on a background thread, and every call made after
+   // the jit is ready runs native code.
+   //
+   // The two tiers share the linear memory.  Globals live in the interpreter's
+   // module and are copied into the jit's module around calls that run native code.
+   //
+   // The visitor passed to execute only applies to calls that run in the
+   // interpreter.  Native code has no instructions to visit.
+   template <typename Host>
+   class tiered_execution_context {
+      struct jit_tier {
+         jit_tier(wasm_code& code, const compile_options& options)
+            : ctx(binary_parser<machine_code_writer<jit_execution_context<Host>>>{ mod.allocator, options }.parse_module(code, mod)) {}
+         module                        mod;
+         jit_execution_context<Host>   ctx;
+      };
+
+    public:
+      static constexpr uint32_t default_hot_threshold = 1000;
+
+      tiered_execution_context(module& m) : _interp(m) { set_hot_threshold(default_hot_threshold); }
+      ~tiered_execution_context() {
+         if (_compile_thread.joinable())
+            _compile_thread.join();
+      }
+
+      // The jit tier is compiled from these bytes with the same options as
+      // the interpreter tier, so they must be provided before execution starts.
+      void set_source(const uint8_t* code, std::size_t size, const compile_options& options) {
+         _source.assign(code, code + size);
+         _options = options;
+      }
+
+      // Only has an effect before the background compile has started.
+      void set_hot_threshold(uint32_t threshold) {
+         _interp.enable_profiling(threshold, [this]() { start_jit(); });
+      }
+
+      // True once calls are run by the jit
+      bool is_jit_ready() { return get_jit_tier() != nullptr; }
+
+      // Blocks until the background compile, if it was started, has finished.
+      void wait_for_jit() {
+         if (_compile_thread.joinable())
+            _compile_thread.join();
+      }
+
+      inline module&         get_module() { return _interp.get_module(); }
+      inline auto&           get_interpreter() { return _interp; }
+      inline auto            get_wasm_allocator() { return _interp.get_wasm_allocator(); }
+      inline void            set_wasm_allocator(wasm_allocator* alloc) { _interp.set_wasm_allocator(alloc); }
+      inline char*           linear_memory() { return _interp.linear_memory(); }
+      inline int32_t         current_linear_memory() const { return _interp.current_linear_memory(); }
+
+      inline void exit(std::error_code err = std::error_code()) {
+         if (_jit_depth)
+            _jit_tier->ctx.exit(err);
+         else
+            _interp.exit(err);
+      }
+
+      inline std::error_code get_error_code() const {
+         return _jit_depth ? _jit_tier->ctx.get_error_code() : _interp.get_error_code();
+      }
+
+      inline void reset() { _interp.reset(); }
+
+      // Called by the watchdog, possibly while the jit tier is being
+      // compiled.  A tier that becomes ready afterwards is not used until
+      // the code is enabled again, so calls keep running in the interpreter,
+      // whose code the watchdog has disabled.
+      void disable_jit_code() {
+         _code_disabled = true;
+         if (_jit_ready)
+            _jit_tier->mod.allocator.disable_code();
+      }
+      void enable_jit_code() {
+         if (_jit_ready)
+            _jit_tier->mod.allocator.enable_code(true);
+         _code_disabled = false;
+      }
+
+      template <typename Visitor, typename... Args>
+      inline std::optional<operand_stack_elem> execute_func_table(Host* host, Visitor&& visitor, uint32_t table_index,
+                                                                  Args... args) {
+         return execute(host, std::forward<Visitor>(visitor), _interp.table_elem(table_index), std::forward<Args>(args)...);
+      }
+
+      template <typename Visitor, typename... Args>
+      inline std::optional<operand_stack_elem> execute(Host* host, Visitor&& visitor, const std::string_view func,
+                                                       Args... args) {
+         uint32_t func_index = get_module().get_exported_function(func);
+         return execute(host, std::forward<Visitor>(visitor), func_index, std::forward<Args>(args)...);
+      }
+
+      template <typename Visitor>
+      inline void execute_start(Host* host, Visitor&& visitor) {
+         if (get_module().start != std::numeric_limits<uint32_t>::max())
+            execute(host, std::forward<Visitor>(visitor), get_module().start);
+      }
+
+      template <typename Visitor, typename... Args>
+      inline std::optional<operand_stack_elem> execute(Host* host, Visitor&& visitor, uint32_t func_index, Args... args) {
+         if (jit_tier* tier = get_jit_tier())
+            return execute_jit(*tier, host, func_index, args...);
+         return _interp.execute(host, rebind_visitor(visitor), func_index, args...);
+      }
+
+    private:
+      void start_jit() {
+         if (_compile_thread.joinable() || _source.empty())
+            return;
+         _compile_thread = std::thread([this]() {
+            try {
+               auto tier = std::make_unique<jit_tier>(_source, _options);
+               tier->mod.finalize();
+               const module& m = get_module();
+               for (uint32_t i = 0; i < m.import_functions.size(); ++i)
+                  tier->mod.import_functions[i] = m.import_functions[i];
+               _jit_tier = std::move(tier);
+               _jit_ready = true;
+            } catch (...) {
+               // Anything the jit rejects keeps running in the interpreter
+            }
+         });
+      }
+
+      // Both flags are sequentially consistent, so a tier that is published
+      // after disable_jit_code checked _jit_ready is seen here as disabled.
+      jit_tier* get_jit_tier() {
+         if (!_jit_ready || _code_disabled)
+            return nullptr;
+         if (_compile_thread.joinable())
+            _compile_thread.join();
+         return _jit_tier.get();
+      }
+
+      // Visitors such as interpret_visitor and debug_visitor are built on
+      // this context by the backend.  The interpreter tier needs the same
+      // kind of visitor built on its own context.
+      template <template <typename> class Visitor>
+      Visitor<execution_context<Host>> rebind_visitor(const Visitor<tiered_execution_context>&) {
+         return Visitor<execution_context<Host>>(_interp);
+      }
+
+      static void copy_globals(module& from, module& to) {
+         for (uint32_t i = 0; i < from.globals.size(); ++i)
+            to.globals[i].current = from.globals[i].current;
+      }
+
+      template <typename... Args>
+      std::optional<operand_stack_elem> execute_jit(jit_tier& tier, Host* host, uint32_t func_index, Args... args) {
+         tier.ctx.set_wasm_allocator(_interp.get_wasm_allocator());
+         tier.ctx.set_linear_memory(_interp.linear_memory());
+         // Nested calls from host functions find the globals already in the jit's module
+         if (!_jit_depth)
+            copy_globals(get_module(), tier.mod);
+         ++_jit_depth;
+         auto g = scope_guard([&]() {
+            if (!--_jit_depth)
+               copy_globals(tier.mod, get_module());
+         });
+         return tier.ctx.execute(host, jit_visitor(nullptr), func_index, args...);
+      }
+
+      execution_context<Host>   _interp;
+      wasm_code                 _source;
+      compile_options           _options;
+      std::thread               _compile_thread;
+      std::unique_ptr<jit_tier> _jit_tier;
+      std::atomic<bool>         _jit_ready     = false;
+      std::atomic<bool>         _code_disabled = false;
+      // Read by the watchdog in exit and get_error_code
+      std::atomic<uint32_t>     _jit_depth = 0;
+   };
+}} // namespace eosio::vm
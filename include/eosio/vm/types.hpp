@@ -13,6 +13,7 @@
 #include <cstdint>
 #include <cstring>
 #include <limits>
+#include <memory>
 #include <string_view>
 #include <vector>
 
@@ -29,7 +30,7 @@ namespace eosio { namespace vm {
    using guarded_vector = managed_vector<T, growable_allocator>;
 
    struct activation_frame {
-      opcode* pc;
+      const uint8_t* pc;
       uint16_t last_op_index;
    };
 
@@ -51,7 +52,7 @@ namespace eosio { namespace vm {
         lhs.param_types.size() == rhs.param_types.size() &&
         std::equal(lhs.param_types.raw(), lhs.param_types.raw() + lhs.param_types.size(), rhs.param_types.raw()) &&
         lhs.return_count == rhs.return_count &&
-        (lhs.return_count || lhs.return_type == rhs.return_type);
+        (!lhs.return_count || lhs.return_type == rhs.return_type);
    }
 
    union expr_value {
@@ -134,10 +135,21 @@ namespace eosio { namespace vm {
    struct function_body {
       uint32_t                    size;
       guarded_vector<local_entry> locals;
-      opcode*                     code;
+      uint8_t*                    code;
       std::size_t                 jit_code_offset;
    };
 
+   // Everything the interpreter needs to call a function, computed once
+   // when the module is finalized.  Operands are untagged, so every local
+   // starts as zero bits whatever its type.
+   struct function_frame {
+      const uint8_t* pc;         // nullptr for imported functions
+      uint32_t       type_id;    // functions with equal types have the same id
+      uint32_t       num_params;
+      uint32_t       num_locals; // not counting the parameters
+      uint32_t       code_index; // index in code, or the import index
+   };
+
    struct data_segment {
       uint32_t                index;
       init_expr               offset;
@@ -165,12 +177,21 @@ namespace eosio { namespace vm {
       guarded_vector<uint32_t> import_functions = { allocator, 0 };
       guarded_vector<uint32_t> type_aliases     = { allocator, 0 };
       guarded_vector<uint32_t> fast_functions   = { allocator, 0 };
+      guarded_vector<function_frame> function_frames = { allocator, 0 };
       uint64_t                 maximum_stack = 0;
+      // State used by the jit to compile functions on their first call.
+      // Only set when the module was parsed with compile_options::lazy.
+      std::shared_ptr<void>    lazy_compiler;
+      // The wasm that data segments refer to, when the module was parsed
+      // with compile_options::reference_source.
+      std::shared_ptr<const void> source;
 
       void finalize() {
          import_functions.resize(get_imported_functions_size());
+         build_function_frames();
          allocator.finalize();
       }
+
       uint32_t get_imported_functions_size() const {
          uint32_t number_of_imports = 0;
          for (uint32_t i = 0; i < imports.size(); i++) {
@@ -181,15 +202,11 @@ namespace eosio { namespace vm {
       }
       inline uint32_t get_functions_size() const { return functions.size(); }
       inline uint32_t get_functions_total() const { return get_imported_functions_size() + get_functions_size(); }
-      inline opcode* get_function_pc( uint32_t fidx ) const {
+      inline uint8_t* get_function_pc( uint32_t fidx ) const {
          EOS_VM_ASSERT( fidx >= get_imported_functions_size(), wasm_interpreter_exception, "trying to get the PC of an imported function" );
          return code[fidx-get_imported_functions_size()].code;
       }
 
-      inline auto& get_opcode(uint32_t pc) const {
-         return ((opcode*)&code[0].code[0])[pc];
-      }
-      
       inline uint32_t get_function_locals_size(uint32_t index) const {
          EOS_VM_ASSERT(index >= get_imported_functions_size(), wasm_interpreter_exception, "imported functions do not have locals");
          return code[index - get_imported_functions_size()].locals.size();
@@ -235,5 +252,28 @@ namespace eosio { namespace vm {
             fast_functions[i + imported_functions_size] = type_aliases[functions[i]];
          }
       }
+
+      void build_function_frames() {
+         uint32_t imported_functions_size = get_imported_functions_size();
+         // Modules without a function section never normalized their types
+         if (fast_functions.size() != imported_functions_size + functions.size())
+            normalize_types();
+         function_frames.resize(imported_functions_size + functions.size());
+         for (uint32_t i = 0; i < function_frames.size(); ++i) {
+            function_frame& frame = function_frames[i];
+            frame.type_id         = fast_functions[i];
+            frame.num_params      = get_function_type(i).param_types.size();
+            frame.num_locals      = 0;
+            if (i < imported_functions_size) {
+               frame.pc         = nullptr;
+               frame.code_index = i;
+            } else {
+               frame.code_index = i - imported_functions_size;
+               frame.pc         = code[frame.code_index].code;
+               for (uint32_t j = 0; j < code[frame.code_index].locals.size(); ++j)
+                  frame.num_locals += code[frame.code_index].locals[j].count;
+            }
+         }
+      }
    };
 }} // namespace eosio::vm
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace eosio { namespace vm {
+
+   namespace detail {
+      using utf8_validator = bool (*)(const uint8_t*, std::size_t);
+
+      // Accepts the same strings as binary_parser::validate_utf8_code_point:
+      // shortest-form encodings of code points up to 0x10FFFF, excluding
+      // the surrogates.
+      inline bool validate_utf8_scalar(const uint8_t* data, std::size_t size) {
+         std::size_t i = 0;
+         while (i < size) {
+            if (size - i >= 8) {
+               uint64_t word;
+               std::memcpy(&word, data + i, sizeof(word));
+               if ((word & 0x8080808080808080ull) == 0) {
+                  i += 8;
+                  continue;
+               }
+            }
+            uint8_t ch = data[i];
+            if (ch < 0x80) {
+               ++i;
+               continue;
+            }
+            std::size_t len;
+            uint32_t    code_point, min_code_point;
+            if ((ch & 0xE0) == 0xC0) {
+               len = 2, code_point = ch & 0x1F, min_code_point = 0x80;
+            } else if ((ch & 0xF0) == 0xE0) {
+               len = 3, code_point = ch & 0x0F, min_code_point = 0x800;
+            } else if ((ch & 0xF8) == 0xF0) {
+               len = 4, code_point = ch & 0x07, min_code_point = 0x10000;
+            } else {
+               return false;
+            }
+            if (size - i < len)
+               return false;
+            for (std::size_t j = 1; j < len; ++j) {
+               uint8_t b = data[i + j];
+               if ((b & 0xC0) != 0x80)
+                  return false;
+               code_point = (code_point << 6) | (b & 0x3F);
+            }
+            if (code_point < min_code_point || code_point >= 0x110000 ||
+                (0xD800 <= code_point && code_point < 0xE000))
+               return false;
+            i += len;
+         }
+         return true;
+      }
+
+#if defined(__x86_64__)
+      // The vector validators classify each pair of adjacent bytes by
+      // three table lookups: the high and low nibbles of the first byte and
+      // the high nibble of the second.  A bit that is set in all three is an
+      // error, except for two continuation bytes in a row, which must be
+      // exactly where the third or fourth byte of a sequence is expected.
+      // (Keiser and Lemire, "Validating UTF-8 In Less Than One Instruction
+      // Per Byte")
+      namespace utf8_tables {
+         constexpr uint8_t too_short   = 1 << 0; // 11______ 0_______, 11______ 11______
+         constexpr uint8_t too_long    = 1 << 1; // 0_______ 10______
+         constexpr uint8_t overlong_3  = 1 << 2; // 11100000 100_____
+         constexpr uint8_t too_large   = 1 << 3; // 11110100 1001____, 11110101+ 10______
+         constexpr uint8_t surrogate   = 1 << 4; // 11101101 101_____
+         constexpr uint8_t overlong_2  = 1 << 5; // 1100000_ 10______
+         constexpr uint8_t too_large_1000 = 1 << 6; // 11110101+ 1000____
+         constexpr uint8_t overlong_4  = 1 << 6; // 11110000 1000____
+         constexpr uint8_t two_conts   = 1 << 7; // 10______ 10______
+         constexpr uint8_t carry       = too_short | too_long | two_conts;
+
+         alignas(16) inline constexpr uint8_t byte_1_high[16] = {
+            too_long, too_long, too_long, too_long, too_long, too_long, too_long, too_long,
+            two_conts, two_conts, two_conts, two_conts,
+            too_short | overlong_2,
+            too_short,
+            too_short | overlong_3 | surrogate,
+            too_short | too_large | too_large_1000 | overlong_4
+         };
+         alignas(16) inline constexpr uint8_t byte_1_low[16] = {
+            carry | overlong_3 | overlong_2 | overlong_4,
+            carry | overlong_2,
+            carry,
+            carry,
+            carry | too_large,
+            carry | too_large | too_large_1000,
+            carry | too_large | too_large_1000,
+            carry | too_large | too_large_1000,
+            carry | too_large | too_large_1000,
+            carry | too_large | too_large_1000,
+            carry | too_large | too_large_1000,
+            carry | too_large | too_large_1000,
+            carry | too_large | too_large_1000,
+            carry | too_large | too_large_1000 | surrogate,
+            carry | too_large | too_large_1000,
+            carry | too_large | too_large_1000
+         };
+         alignas(16) inline constexpr uint8_t byte_2_high[16] = {
+            too_short, too_short, too_short, too_short, too_short, too_short, too_short, too_short,
+            too_long | overlong_2 | two_conts | overlong_3 | too_large_1000 | overlong_4,
+            too_long | overlong_2 | two_conts | overlong_3 | too_large,
+            too_long | overlong_2 | two_conts | surrogate | too_large,
+            too_long | overlong_2 | two_conts | surrogate | too_large,
+            too_short, too_short, too_short, too_short
+         };
+         // A block is incomplete if it ends with the lead byte of a sequence
+         // that continues past it
+         alignas(16) inline constexpr uint8_t incomplete_max[16] = {
+            0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+            0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1
+         };
+      } // namespace utf8_tables
+
+      __attribute__((target("sse4.1")))
+      inline __m128i check_utf8_block(__m128i input, __m128i prev_input) {
+         using namespace utf8_tables;
+         const __m128i nibble = _mm_set1_epi8(0x0F);
+         __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+         __m128i prev2 = _mm_alignr_epi8(input, prev_input, 14);
+         __m128i prev3 = _mm_alignr_epi8(input, prev_input, 13);
+         __m128i special_cases = _mm_and_si128(
+               _mm_and_si128(
+                     _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(byte_1_high)),
+                                      _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+                     _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(byte_1_low)),
+                                      _mm_and_si128(prev1, nibble))),
+               _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(byte_2_high)),
+                                _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+         __m128i third_or_fourth = _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8(static_cast<char>(0xE0 - 1))),
+                                                _mm_subs_epu8(prev3, _mm_set1_epi8(static_cast<char>(0xF0 - 1))));
+         __m128i must_be_continuation = _mm_andnot_si128(_mm_cmpeq_epi8(third_or_fourth, _mm_setzero_si128()),
+                                                         _mm_set1_epi8(static_cast<char>(0x80)));
+         return _mm_xor_si128(must_be_continuation, special_cases);
+      }
+
+      __attribute__((target("sse4.1")))
+      inline void validate_utf8_step(__m128i input, __m128i& error, __m128i& prev_input, __m128i& prev_incomplete) {
+         if (_mm_movemask_epi8(input) == 0) {
+            // ASCII only needs the previous block to be complete
+            error = _mm_or_si128(error, prev_incomplete);
+         } else {
+            error = _mm_or_si128(error, check_utf8_block(input, prev_input));
+            prev_incomplete = _mm_subs_epu8(input, _mm_load_si128(reinterpret_cast<const __m128i*>(utf8_tables::incomplete_max)));
+         }
+         prev_input = input;
+      }
+
+      __attribute__((target("sse4.1")))
+      inline bool validate_utf8_sse41(const uint8_t* data, std::size_t size) {
+         __m128i error = _mm_setzero_si128();
+         __m128i prev_input = _mm_setzero_si128();
+         __m128i prev_incomplete = _mm_setzero_si128();
+         std::size_t i = 0;
+         for (; size - i >= 16; i += 16)
+            validate_utf8_step(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), error, prev_input, prev_incomplete);
+         // The zero padding ends any sequence that is still open
+         alignas(16) uint8_t tail[16] = {};
+         if (size != i)
+            std::memcpy(tail, data + i, size - i);
+         validate_utf8_step(_mm_load_si128(reinterpret_cast<const __m128i*>(tail)), error, prev_input, prev_incomplete);
+         error = _mm_or_si128(error, prev_incomplete);
+         return _mm_testz_si128(error, error);
+      }
+
+      __attribute__((target("avx2")))
+      inline __m256i check_utf8_block(__m256i input, __m256i prev_input) {
+         using namespace utf8_tables;
+         const __m256i nibble = _mm256_set1_epi8(0x0F);
+         // Lines up the end of prev_input with the start of each lane
+         __m256i shifted = _mm256_permute2x128_si256(prev_input, input, 0x21);
+         __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+         __m256i prev2 = _mm256_alignr_epi8(input, shifted, 14);
+         __m256i prev3 = _mm256_alignr_epi8(input, shifted, 13);
+         __m256i special_cases = _mm256_and_si256(
+               _mm256_and_si256(
+                     _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(byte_1_high))),
+                                         _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+                     _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(byte_1_low))),
+                                         _mm256_and_si256(prev1, nibble))),
+               _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(byte_2_high))),
+                                   _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+         __m256i third_or_fourth = _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8(static_cast<char>(0xE0 - 1))),
+                                                   _mm256_subs_epu8(prev3, _mm256_set1_epi8(static_cast<char>(0xF0 - 1))));
+         __m256i must_be_continuation = _mm256_andnot_si256(_mm256_cmpeq_epi8(third_or_fourth, _mm256_setzero_si256()),
+                                                            _mm256_set1_epi8(static_cast<char>(0x80)));
+         return _mm256_xor_si256(must_be_continuation, special_cases);
+      }
+
+      __attribute__((target("avx2")))
+      inline void validate_utf8_step(__m256i input, __m256i& error, __m256i& prev_input, __m256i& prev_incomplete) {
+         if (_mm256_movemask_epi8(input) == 0) {
+            error = _mm256_or_si256(error, prev_incomplete);
+         } else {
+            error = _mm256_or_si256(error, check_utf8_block(input, prev_input));
+            // incomplete_max applies to the end of the upper lane
+            __m256i incomplete_max = _mm256_inserti128_si256(
+                  _mm256_set1_epi8(static_cast<char>(0xFF)),
+                  _mm_load_si128(reinterpret_cast<const __m128i*>(utf8_tables::incomplete_max)), 1);
+            prev_incomplete = _mm256_subs_epu8(input, incomplete_max);
+         }
+         prev_input = input;
+      }
+
+      __attribute__((target("avx2")))
+      inline bool validate_utf8_avx2(const uint8_t* data, std::size_t size) {
+         __m256i error = _mm256_setzero_si256();
+         __m256i prev_input = _mm256_setzero_si256();
+         __m256i prev_incomplete = _mm256_setzero_si256();
+         std::size_t i = 0;
+         for (; size - i >= 32; i += 32)
+            validate_utf8_step(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), error, prev_input, prev_incomplete);
+         alignas(32) uint8_t tail[32] = {};
+         if (size != i)
+            std::memcpy(tail, data + i, size - i);
+         validate_utf8_step(_mm256_load_si256(reinterpret_cast<const __m256i*>(tail)), error, prev_input, prev_incomplete);
+         error = _mm256_or_si256(error, prev_incomplete);
+         return _mm256_testz_si256(error, error);
+      }
+
+      inline utf8_validator select_utf8_validator() {
+         __builtin_cpu_init();
+         if (__builtin_cpu_supports("avx2"))
+            return &validate_utf8_avx2;
+         if (__builtin_cpu_supports("sse4.1"))
+            return &validate_utf8_sse41;
+         return &validate_utf8_scalar;
+      }
+#endif
+   } // namespace detail
+
+   // Checks that data[0, size) is valid UTF-8, using the widest vector
+   // instructions that the CPU supports.
+   inline bool is_valid_utf8(const uint8_t* data, std::size_t size) {
+#if defined(__x86_64__)
+      static const detail::utf8_validator validate = detail::select_utf8_validator();
+      return validate(data, size);
+#else
+      return detail::validate_utf8_scalar(data, size);
+#endif
+   }
+
+}} // namespace eosio::vm
@@ -11,6 +11,9 @@
 #include <eosio/vm/types.hpp>
 #include <eosio/vm/vector.hpp>
 
+#include <algorithm>
+#include <type_traits>
+
 namespace eosio { namespace vm {
    template <typename ElemT, size_t ElemSz, typename Allocator = nullptr_t >
    class stack {
@@ -42,6 +45,15 @@ namespace eosio { namespace vm {
          _store[index] = el;
       }
       void  eat(uint32_t index) { _index = index; }
+      // Makes room for n more elements, so that pointers into the stack stay
+      // valid while they are pushed.
+      void reserve(size_t n) {
+         if constexpr (std::is_same_v<Allocator, nullptr_t>) {
+            if (_index + n > _store.size())
+               _store.resize(std::max(_store.size() * 2, _index + n));
+         }
+      }
+      ElemT*       data() { return &_store[0]; }
       // compact the last element to the element pointed to by index
       void compact(uint32_t index) { 
          _store[index] = _store[_index-1];
@@ -62,7 +74,7 @@ namespace eosio { namespace vm {
       size_t            _index = 0;
    };
 
-   using operand_stack = stack<operand_stack_elem, constants::max_stack_size>;
+   using operand_stack = stack<operand_stack_slot, constants::max_stack_size>;
    using call_stack    = stack<activation_frame,   constants::max_call_depth + 1, bounded_allocator>;
 
 }} // namespace eosio::vm
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <eosio/vm/allocator.hpp>
+#include <eosio/vm/code_cache.hpp>
 #include <eosio/vm/exceptions.hpp>
 #include <eosio/vm/signals.hpp>
 #include <eosio/vm/softfloat.hpp>
@@ -11,6 +12,9 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <functional>
+#include <memory>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -23,8 +27,9 @@ namespace eosio { namespace vm {
    // - branch instructions return the address that will need to be updated
    // - label instructions return the address of the target
    // - fix_branch will be called when the branch target is resolved
-   // - It would make everything more efficient to make RAX always represent the top of
-   //   the stack.
+   // - The top of the wasm operand stack may be held in RAX instead of being
+   //   pushed (see _top_in_rax).  The rest of the operand stack is on the native
+   //   stack.  The stack is always fully in memory at labels and calls.
    //
    // - The base of memory is stored in rsi
    //
@@ -34,7 +39,16 @@ namespace eosio { namespace vm {
     public:
       machine_code_writer(growable_allocator& alloc, std::size_t source_bytes, module& mod) :
          _mod(mod), _code_segment_base(alloc.start_code()) {
-         const std::size_t code_size = 4 * 16; // 4 error handlers, each is 16 bytes.
+         // The function table used by call_indirect is data, not code.  It
+         // comes first and gets its own pages, which will be made read-only
+         // instead of executable.
+         call_indirect_table = static_cast<unsigned char*>(_code_segment_base);
+         if (_mod.tables.size() > 0) {
+            _table_data_size = growable_allocator::align_to_page(8 * _mod.tables[0].table.size());
+            call_indirect_table = _mod.allocator.alloc<unsigned char>(_table_data_size);
+         }
+
+         const std::size_t code_size = 4 * 16 + 14; // 4 error handlers, each is 16 bytes, and the type check failure.
          _code_start = _mod.allocator.alloc<unsigned char>(code_size);
          _code_end = _code_start + code_size;
          code = _code_start;
@@ -45,11 +59,23 @@ namespace eosio { namespace vm {
          type_error_handler = emit_error_handler(&on_type_error);
          stack_overflow_handler = emit_error_handler(&on_stack_overflow);
 
+         // Jumped to by call_indirect with the table entry in %rdx when the type
+         // does not match.  Out-of-range functions have a type of -1.
+         call_indirect_type_handler = code;
+         // cmpl $-1, (%rdx)
+         emit_bytes(0x83, 0x3a, 0xff);
+         // je call_indirect_handler
+         emit_bytes(0x0f, 0x84);
+         fix_branch(emit_branch_target32(), call_indirect_handler);
+         // jmp type_error_handler
+         emit_bytes(0xe9);
+         fix_branch(emit_branch_target32(), type_error_handler);
+
          assert(code == _code_end); // verify that the manual instruction count is correct
 
          // emit host functions
          const uint32_t num_imported = mod.get_imported_functions_size();
-         const std::size_t host_functions_size = 40 * num_imported;
+         const std::size_t host_functions_size = 53 * num_imported;
          _code_start = _mod.allocator.alloc<unsigned char>(host_functions_size);
          _code_end = _code_start + host_functions_size;
          // code already set
@@ -59,55 +85,150 @@ namespace eosio { namespace vm {
          }
          assert(code == _code_end);
 
-         jmp_table = code;
          if (_mod.tables.size() > 0) {
-            // Each function table entry consumes exactly 17 bytes (counted
-            // manually).  The size must be constant, so that call_indirect
-            // can use random access
-            _table_element_size = 17;
-            const std::size_t table_size = _table_element_size*_mod.tables[0].table.size();
-            _code_start = _mod.allocator.alloc<unsigned char>(table_size);
-            _code_end = _code_start + table_size;
-            // code already set
+            // Each function table entry is 8 bytes: the type id followed by
+            // the address of the function, relative to the end of the entry.
             for(uint32_t i = 0; i < _mod.tables[0].table.size(); ++i) {
                uint32_t fn_idx = _mod.tables[0].table[i];
+               unsigned char* entry = call_indirect_table + 8 * i;
                if (fn_idx < _mod.fast_functions.size()) {
-                  // cmp _mod.fast_functions[fn_idx], %edx
-                  emit_bytes(0x81, 0xfa);
-                  emit_operand32(_mod.fast_functions[fn_idx]);
-                  // je fn
-                  emit_bytes(0x0f, 0x84);
-                  register_call(emit_branch_target32(), fn_idx);
-                  // jmp ERROR
-                  emit_bytes(0xe9);
-                  fix_branch(emit_branch_target32(), type_error_handler);
+                  uint32_t type_id = _mod.fast_functions[fn_idx];
+                  memcpy(entry, &type_id, sizeof(type_id));
+                  register_call(entry + 4, fn_idx);
                } else {
-                  // jmp ERROR
-                  emit_bytes(0xe9);
                   // default for out-of-range functions
-                  fix_branch(emit_branch_target32(), call_indirect_handler);
-                  // padding
-                  emit_bytes(0xcc, 0xcc, 0xcc, 0xcc);
-                  emit_bytes(0xcc, 0xcc, 0xcc, 0xcc);
-                  emit_bytes(0xcc, 0xcc, 0xcc, 0xcc);
+                  uint32_t type_id = 0xFFFFFFFFu;
+                  memcpy(entry, &type_id, sizeof(type_id));
+                  fix_branch(entry + 4, call_indirect_handler);
                }
             }
-            assert(code == _code_end);
          }
       }
-      ~machine_code_writer() { _mod.allocator.end_code<true>(_code_segment_base); }
+      ~machine_code_writer() {
+         if (!_is_worker)
+            _mod.allocator.end_code<true>(_code_segment_base, _table_data_size, _lazy_reserved_size);
+      }
+
+      // Parallel compilation: a worker compiles one function at a time into
+      // private memory.  The result is position independent except for the
+      // rel32 operands that refer to other functions or to the shared
+      // handlers, which are listed here by offset and resolved by link_function.
+      struct compiled_function {
+         std::vector<unsigned char> code;
+         std::vector<std::pair<uint32_t, void*>> external_targets;
+         std::vector<std::pair<uint32_t, uint32_t>> calls;
+         std::vector<code_cache::relocation> relocations;
+      };
+      machine_code_writer make_worker() const { return machine_code_writer(*this, worker_tag{}); }
+      // Called on a worker after emit_epilogue instead of finalize.
+      compiled_function release_function() {
+         _compiled.code.assign(_code_start, code);
+         return std::move(_compiled);
+      }
+      // Copies a function compiled by a worker into the code segment.
+      // Functions must be linked in order.
+      void link_function(compiled_function& func, function_body& body, uint32_t funcnum) {
+         _code_start = _mod.allocator.alloc<unsigned char>(func.code.size());
+         std::memcpy(_code_start, func.code.data(), func.code.size());
+         start_function(_code_start, funcnum + _mod.get_imported_functions_size());
+         for (auto [offset, target] : func.external_targets)
+            fix_branch(_code_start + offset, target);
+         for (auto [offset, callee] : func.calls)
+            register_call(_code_start + offset, callee);
+         body.jit_code_offset = _code_start - (unsigned char*)_code_segment_base;
+         for (code_cache::relocation r : func.relocations) {
+            r.offset += body.jit_code_offset;
+            _relocations.push_back(r);
+         }
+      }
+
+      // Code cache support: the code segment can be saved once every
+      // function has been finalized, and loaded again by applying the
+      // relocations to it.  Lazy compilation is not supported.
+      static constexpr bool supports_code_cache = true;
+      // Superinstructions only exist in the interpreter's bitcode
+      static constexpr bool supports_superinstructions = false;
+      static constexpr bool tracks_operand_depth = false;
+      static const void* code_cache_anchor() { return reinterpret_cast<const void*>(&call_host_function); }
+      std::vector<unsigned char> get_code_segment() const {
+         auto* begin = static_cast<const unsigned char*>(_code_segment_base);
+         auto* end = reinterpret_cast<const unsigned char*>(_mod.allocator._base + growable_allocator::align_to_page(_mod.allocator._offset));
+         return { begin, end };
+      }
+      std::size_t get_data_size() const { return _table_data_size; }
+      const std::vector<code_cache::relocation>& get_relocations() const { return _relocations; }
+
+      // Lazy compilation: instead of compiling the functions up front,
+      // emit_lazy_functions gives each function a stub that compiles it on
+      // the first call.  compile_body must emit the function with the given
+      // index using the writer that it is passed.  The compiled code goes
+      // into space reserved after the stubs, and the stub and any direct
+      // calls to it are then redirected to the new code.
+      static constexpr bool supports_lazy_compile = true;
+      using lazy_compile_fn = std::function<void(machine_code_writer&, uint32_t)>;
+      void emit_lazy_functions(lazy_compile_fn compile_body) {
+         const uint32_t num_imported = _mod.get_imported_functions_size();
+         const uint32_t count = _mod.code.size();
+         auto* segment_base = static_cast<unsigned char*>(_code_segment_base);
+         _lazy = std::make_shared<lazy_state>(*this, std::move(compile_body));
+         _lazy->offsets.resize(num_imported + count);
+         _lazy->compiled.resize(num_imported + count);
+         _lazy->callers.resize(num_imported + count);
+         for (uint32_t i = 0; i < num_imported; ++i) {
+            _lazy->offsets[i] = static_cast<unsigned char*>(std::get<void*>(_function_relocations[i])) - segment_base;
+            _lazy->compiled[i] = true;
+         }
+
+         const std::size_t code_size = lazy_entry_size + lazy_stub_size * count;
+         _code_start = _mod.allocator.alloc<unsigned char>(code_size);
+         _code_end = _code_start + code_size;
+         code = _code_start;
+         void* entry = emit_lazy_entry(_lazy.get());
+         for (uint32_t i = 0; i < count; ++i) {
+            _lazy->offsets[num_imported + i] = code - segment_base;
+            _mod.code[i].jit_code_offset = code - segment_base;
+            start_function(code, num_imported + i);
+            // mov $i, %edx
+            emit_bytes(0xba);
+            emit_operand32(i);
+            // jmp entry
+            emit_bytes(0xe9);
+            fix_branch(emit_branch_target32(), entry);
+         }
+         assert(code == _code_end);
+
+         // end_code puts the reserved space after the last page of code
+         _lazy->next_offset = growable_allocator::align_to_page(code - segment_base);
+         for (uint32_t i = 0; i < count; ++i) {
+            _lazy_reserved_size += max_function_size(i);
+         }
+         _mod.lazy_compiler = _lazy;
+      }
 
       static constexpr std::size_t max_prologue_size = 21;
       static constexpr std::size_t max_epilogue_size = 10;
+      std::size_t max_function_size(uint32_t funcnum) const {
+         // FIXME: This is not a tight upper bound
+         const std::size_t instruction_size_ratio_upper_bound = 79;
+         return max_prologue_size + _mod.code[funcnum].size * instruction_size_ratio_upper_bound + max_epilogue_size;
+      }
       void emit_prologue(const func_type& /*ft*/, const guarded_vector<local_entry>& locals, uint32_t funcnum) {
          _ft = &_mod.types[_mod.functions[funcnum]];
-         // FIXME: This is not a tight upper bound
-         const std::size_t instruction_size_ratio_upper_bound = use_softfloat?49:79;
-         std::size_t code_size = max_prologue_size + _mod.code[funcnum].size * instruction_size_ratio_upper_bound + max_epilogue_size;
-         _code_start = _mod.allocator.alloc<unsigned char>(code_size);
+         std::size_t code_size = max_function_size(funcnum);
+         if (_is_worker) {
+            // Only the pages that are written are touched, so the
+            // oversized reservation costs nothing and is reused for
+            // every function.
+            _worker_code->reset();
+            _code_start = _worker_code->alloc<unsigned char>(code_size);
+            _compiled = {};
+         } else {
+            _code_start = _mod.allocator.alloc<unsigned char>(code_size);
+         }
          _code_end = _code_start + code_size;
          code = _code_start;
-         start_function(code, funcnum + _mod.get_imported_functions_size());
+         if (!_is_worker)
+            start_function(code, funcnum + _mod.get_imported_functions_size());
          // pushq RBP
          emit_bytes(0x55);
          // movq RSP, RBP
@@ -119,6 +240,8 @@ namespace eosio { namespace vm {
             count += locals[i].count;
          }
          _local_count = count;
+         _top_in_rax = false;
+         _top_source = {};
          if (_local_count > 0) {
             // xor %rax, %rax
             emit_bytes(0x48, 0x31, 0xc0);
@@ -150,7 +273,7 @@ namespace eosio { namespace vm {
 #endif
          if(ft.return_count != 0) {
             // pop RAX
-            emit_bytes(0x58);
+            emit_pop_top();
          }
          if (_local_count & 0xF0000000u) unimplemented();
          emit_multipop(_local_count);
@@ -164,27 +287,42 @@ namespace eosio { namespace vm {
       void emit_unreachable() {
          auto icount = fixed_size_instr(16);
          emit_error_handler(&on_unreachable);
+         _top_in_rax = false;
       }
       void emit_nop() {}
-      void* emit_end() { return code; }
+      void* emit_end() {
+         emit_flush_top();
+         // This is a branch target, so nothing is known about %rax
+         _top_source = {};
+         return code;
+      }
       void* emit_return(uint32_t depth_change) {
          // Return is defined as equivalent to branching to the outermost label
          return emit_br(depth_change);
       }
-      void emit_block() {}
-      void* emit_loop() { return code; }
+      void emit_block() { emit_flush_top(); }
+      void* emit_loop() {
+         emit_flush_top();
+         _top_source = {};
+         return code;
+      }
       void* emit_if() {
-         auto icount = fixed_size_instr(9);
-         // pop RAX
-         emit_bytes(0x58);
-         // test EAX, EAX
-         emit_bytes(0x85, 0xC0);
-         // jz DEST
-         emit_bytes(0x0F, 0x84);
+         uint8_t condition = pop_top_condition();
+         auto icount = variable_size_instr(6, 9);
+         if (!condition) {
+            // pop RAX
+            emit_pop_top();
+            // test EAX, EAX
+            emit_bytes(0x85, 0xC0);
+            condition = 0x95;
+         }
+         // jNcc DEST
+         emit_bytes(0x0F, jcc_opcode(invert_condition(condition)));
          return emit_branch_target32();
       }
       void* emit_else(void* if_loc) {
-         auto icount = fixed_size_instr(5);
+         auto icount = variable_size_instr(5, 6);
+         // The result of the if branch, if any, must be in memory at the end
          void* result = emit_br(0);
          fix_branch(if_loc, code);
          return result;
@@ -198,19 +336,23 @@ namespace eosio { namespace vm {
          return emit_branch_target32();
       }
       void* emit_br_if(uint32_t depth_change) {
-         auto icount = variable_size_instr(9, 26);
-         // pop RAX
-         emit_bytes(0x58);
-         // test EAX, EAX
-         emit_bytes(0x85, 0xC0);
+         uint8_t condition = pop_top_condition();
+         auto icount = variable_size_instr(6, 26);
+         if (!condition) {
+            // pop RAX
+            emit_pop_top();
+            // test EAX, EAX
+            emit_bytes(0x85, 0xC0);
+            condition = 0x95;
+         }
 
          if(depth_change == 0u || depth_change == 0x80000001u) {
-            // jnz DEST
-            emit_bytes(0x0F, 0x85);
+            // jcc DEST
+            emit_bytes(0x0F, jcc_opcode(condition));
             return emit_branch_target32();
          } else {
-            // jz SKIP
-            emit_bytes(0x0f, 0x84);
+            // jNcc SKIP
+            emit_bytes(0x0f, jcc_opcode(invert_condition(condition)));
             void* skip = emit_branch_target32();
             // add depth_change*8, %rsp
             emit_multipop(depth_change);
@@ -223,9 +365,23 @@ namespace eosio { namespace vm {
          }
       }
 
-      // Generate a binary search.
+      // Generate a jump table or, for small tables, a binary search.
       struct br_table_generator {
          void* emit_case(uint32_t depth_change) {
+            if (_table) {
+               // The table entry is a jmp, which can be returned
+               // directly if no stack adjustment is needed.
+               void* entry = _table + 5 * _i++ + 1;
+               if (depth_change == 0u || depth_change == 0x80000001u) {
+                  return entry;
+               }
+               _this->fix_branch(entry, _this->code);
+               // add depth_change*8, %rsp
+               _this->emit_multipop(depth_change);
+               // jmp TARGET
+               _this->emit_bytes(0xe9);
+               return _this->emit_branch_target32();
+            }
             while(true) {
                assert(!stack.empty() && "The parser is supposed to handle the number of elements in br_table.");
                auto [min, max, label] = stack.back();
@@ -282,17 +438,55 @@ namespace eosio { namespace vm {
          // the ranges are strictly contiguous and non-ovelapping, with
          // the lower values at the back.
          std::vector<stack_item> stack;
+         // The jump table, if one is used instead of a binary search.
+         unsigned char* _table = nullptr;
       };
+      // Smaller tables use a binary search, which needs at most
+      // two comparisons.
+      static constexpr uint32_t min_br_table_jump_table_size = 4;
       br_table_generator emit_br_table(uint32_t table_size) {
          // pop %rax
-         emit_bytes(0x58);
-         // Increase the size by one to account for the default.
-         // The current algorithm handles this correctly, without
-         // any special cases.
-         return { this, 0, { {0, table_size+1, nullptr} } };
+         emit_pop_top();
+         if (table_size < min_br_table_jump_table_size) {
+            // Increase the size by one to account for the default.
+            // The current algorithm handles this correctly, without
+            // any special cases.
+            return { this, 0, { {0, table_size+1, nullptr} } };
+         }
+         // Clamp the index to the default
+         // mov $table_size, %ecx
+         emit_bytes(0xb9);
+         emit_operand32(table_size);
+         // cmp %ecx, %eax
+         emit_bytes(0x39, 0xc8);
+         // cmovae %ecx, %eax
+         emit_bytes(0x0f, 0x43, 0xc1);
+         // lea (%rax,%rax,4), %rax
+         emit_bytes(0x48, 0x8d, 0x04, 0x80);
+         // lea TABLE(%rip), %rcx
+         emit_bytes(0x48, 0x8d, 0x0d);
+         void* table_ref = emit_branch_target32();
+         // add %rax, %rcx
+         emit_bytes(0x48, 0x01, 0xc1);
+         // jmp *%rcx
+         emit_bytes(0xff, 0xe1);
+         // TABLE: one jmp per case and one for the default.  The code
+         // segment is execute-only, so the table cannot hold plain addresses.
+         fix_branch(table_ref, code);
+         unsigned char* table = code;
+         for (uint32_t i = 0; i <= table_size; ++i) {
+            // jmp TARGET
+            emit_bytes(0xe9);
+            emit_branch_target32();
+         }
+         return { this, 0, {}, table };
       }
 
       void register_call(void* ptr, uint32_t funcnum) {
+         if (_is_worker) {
+            _compiled.calls.emplace_back(static_cast<unsigned char*>(ptr) - _code_start, funcnum);
+            return;
+         }
          auto& vec = _function_relocations;
          if(funcnum >= vec.size()) vec.resize(funcnum + 1);
          if(void** addr = std::get_if<void*>(&vec[funcnum])) {
@@ -311,73 +505,93 @@ namespace eosio { namespace vm {
       }
 
       void emit_call(const func_type& ft, uint32_t funcnum) {
-         auto icount = variable_size_instr(15, 23);
+         emit_flush_top();
+         auto icount = variable_size_instr(15, 22);
          emit_check_call_depth();
          // callq TARGET
          emit_bytes(0xe8);
          void * branch = emit_branch_target32();
          emit_multipop(ft.param_types.size());
          register_call(branch, funcnum);
-         if(ft.return_count != 0)
-            // pushq %rax
-            emit_bytes(0x50);
+         // The result is returned in %rax
+         _top_in_rax = (ft.return_count != 0);
          emit_check_call_depth_end();
       }
 
       void emit_call_indirect(const func_type& ft, uint32_t functypeidx) {
-         auto icount = variable_size_instr(43, 51);
+         auto icount = variable_size_instr(56, 64);
          emit_check_call_depth();
          auto& table = _mod.tables[0].table;
          functypeidx = _mod.type_aliases[functypeidx];
          // pop %rax
-         emit_bytes(0x58);
+         emit_pop_top();
          // cmp $size, %rax
          emit_bytes(0x48, 0x3d);
          emit_operand32(table.size());
          // jae ERROR
          emit_bytes(0x0f, 0x83);
-         fix_branch(emit_branch_target32(), call_indirect_handler);
+         emit_external_target32(call_indirect_handler);
          // leaq table(%rip), %rdx
          emit_bytes(0x48, 0x8d, 0x15);
-         fix_branch(emit_branch_target32(), jmp_table);
-         // imul $17, %eax, %eax
-         assert(_table_element_size <= 127); // must fit in 8-bit signed value for imul
-         emit_bytes(0x6b, 0xc0, _table_element_size);
-         // addq %rdx, %rax
-         emit_bytes(0x48, 0x01, 0xd0);
-         // mov $funtypeidx, %edx
-         emit_bytes(0xba);
+         emit_external_target32(call_indirect_table);
+         // leaq (%rdx,%rax,8), %rdx
+         emit_bytes(0x48, 0x8d, 0x14, 0xc2);
+         // cmpl $funtypeidx, (%rdx)
+         emit_bytes(0x81, 0x3a);
          emit_operand32(functypeidx);
+         // jne ERROR
+         emit_bytes(0x0f, 0x85);
+         emit_external_target32(call_indirect_type_handler);
+         // movslq 4(%rdx), %rax
+         emit_bytes(0x48, 0x63, 0x42, 0x04);
+         // leaq 8(%rdx,%rax), %rax
+         emit_bytes(0x48, 0x8d, 0x44, 0x02, 0x08);
          // callq *%rax
          emit_bytes(0xff, 0xd0);
          emit_multipop(ft.param_types.size());
-         if(ft.return_count != 0)
-            // pushq %rax
-            emit_bytes(0x50);
+         // The result is returned in %rax
+         _top_in_rax = (ft.return_count != 0);
          emit_check_call_depth_end();
       }
 
       void emit_drop() {
          // pop RAX
-         emit_bytes(0x58);
+         emit_pop_top();
       }
 
       void emit_select() {
-         auto icount = fixed_size_instr(13);
+         uint8_t condition = pop_top_condition();
+         auto icount = variable_size_instr(6, 9);
+         if (!condition) {
+            // popq RAX
+            emit_pop_top();
+            // test EAX, EAX
+            emit_bytes(0x85, 0xc0);
+            condition = 0x95;
+         }
          // popq RAX
          emit_bytes(0x58);
          // popq RCX
          emit_bytes(0x59);
-         // test EAX, EAX
-         emit_bytes(0x85, 0xc0);
-         // cmovnzq RCX, (RSP)
-         emit_bytes(0x48, 0x0f, 0x45, 0x0c, 0x24);
-         // movq (RSP), RCX
-         emit_bytes(0x48, 0x89, 0x0c, 0x24);
+         // cmovccq RCX, RAX
+         emit_bytes(0x48, 0x0f, cmov_opcode(condition), 0xc1);
+         _top_in_rax = true;
       }
 
       void emit_get_local(uint32_t local_idx) {
-         auto icount = fixed_size_instr(8);
+         const int32_t offset = local_offset(local_idx);
+         // %rax may still hold the local after set_local, tee_local or get_local
+         if ((_top_source.kind == top_source::local || _top_source.kind == top_source::local_copy) &&
+             _top_source.value == offset && code == _top_source.end) {
+            emit_flush_top();
+            _top_in_rax = true;
+            set_top_source(top_source::local_copy, code, false, offset);
+            return;
+         }
+         unsigned char* start = code;
+         bool flushed = _top_in_rax;
+         emit_flush_top();
+         auto icount = variable_size_instr(4, 7);
          // stack layout:
          //   param0    <----- %rbp + 8*(nparams + 1)
          //   param1
@@ -390,239 +604,208 @@ namespace eosio { namespace vm {
          //   local1
          //   ...
          //   localN
-         if (local_idx < _ft->param_types.size()) {
-            // mov 8*(local_idx)(%RBP), RAX
-            emit_bytes(0x48, 0x8b, 0x85);
-            emit_operand32(8 * (_ft->param_types.size() - local_idx + 1));
-            // push RAX
-            emit_bytes(0x50);
-         } else {
-            // mov -8*(local_idx+1)(%RBP), RAX
-            emit_bytes(0x48, 0x8b, 0x85);
-            emit_operand32(-8 * (local_idx - _ft->param_types.size() + 1));
-            // push RAX
-            emit_bytes(0x50);
-         }
+         // mov offset(%RBP), RAX
+         emit_bytes(0x48, 0x8b);
+         emit_rbp_operand(0, offset);
+         _top_in_rax = true;
+         set_top_source(top_source::local, start, flushed, offset);
       }
 
       void emit_set_local(uint32_t local_idx) {
-         auto icount = fixed_size_instr(8);
-         if (local_idx < _ft->param_types.size()) {
-            // pop RAX
-            emit_bytes(0x58);
-            // mov RAX, -8*local_idx(EBP)
-            emit_bytes(0x48, 0x89, 0x85);
-            emit_operand32(8 * (_ft->param_types.size() - local_idx + 1));
-         } else {
-            // pop RAX
-            emit_bytes(0x58);
-            // mov RAX, -8*local_idx(EBP)
-            emit_bytes(0x48, 0x89, 0x85);
-            emit_operand32(-8 * (local_idx - _ft->param_types.size() + 1));
-         }
+         const int32_t offset = local_offset(local_idx);
+         auto icount = variable_size_instr(4, 8);
+         // pop RAX
+         emit_pop_top();
+         // mov RAX, offset(EBP)
+         emit_bytes(0x48, 0x89);
+         emit_rbp_operand(0, offset);
+         set_top_source(top_source::local_copy, code, false, offset);
       }
 
       void emit_tee_local(uint32_t local_idx) {
-         auto icount = fixed_size_instr(9);
-         if (local_idx < _ft->param_types.size()) {
-            // pop RAX
-            emit_bytes(0x58);
-            // push RAX
-            emit_bytes(0x50);
-            // mov RAX, -8*local_idx(EBP)
-            emit_bytes(0x48, 0x89, 0x85);
-            emit_operand32(8 * (_ft->param_types.size() - local_idx + 1));
-         } else {
-            // pop RAX
-            emit_bytes(0x58);
-            // push RAX
-            emit_bytes(0x50);
-            // mov RAX, -8*local_idx(EBP)
-            emit_bytes(0x48, 0x89, 0x85);
-            emit_operand32(-8 * (local_idx - _ft->param_types.size() + 1));
-         }
+         const int32_t offset = local_offset(local_idx);
+         auto icount = variable_size_instr(4, 8);
+         // pop RAX
+         emit_pop_top();
+         // mov RAX, offset(EBP)
+         emit_bytes(0x48, 0x89);
+         emit_rbp_operand(0, offset);
+         _top_in_rax = true;
+         set_top_source(top_source::local_copy, code, false, offset);
       }
 
       void emit_get_global(uint32_t globalidx) {
-         auto icount = variable_size_instr(13, 14);
          auto& gl = _mod.globals[globalidx];
-         void *ptr = &gl.current.value;
+         // An immutable global always holds its initializer, which is a constant
+         if (!gl.type.mutability) {
+            switch(gl.type.content_type) {
+             case types::i32: emit_i32_const(gl.init.value.i32); return;
+             case types::i64: emit_i64_const(gl.init.value.i64); return;
+             case types::f32: {
+               float value;
+               memcpy(&value, &gl.init.value.f32, sizeof(value));
+               emit_f32_const(value);
+               return;
+             }
+             case types::f64: {
+               double value;
+               memcpy(&value, &gl.init.value.f64, sizeof(value));
+               emit_f64_const(value);
+               return;
+             }
+            }
+         }
+         emit_flush_top();
+         auto icount = variable_size_instr(12, 13);
          switch(gl.type.content_type) {
           case types::i32:
           case types::f32:
             // movabsq $ptr, %rax
             emit_bytes(0x48, 0xb8);
-            emit_operand_ptr(ptr);
+            emit_global_ptr(globalidx);
             // movl (%rax), eax
             emit_bytes(0x8b, 0x00);
-            // push %rax
-            emit_bytes(0x50);
             break;
           case types::i64:
           case types::f64:
             // movabsq $ptr, %rax
             emit_bytes(0x48, 0xb8);
-            emit_operand_ptr(ptr);
+            emit_global_ptr(globalidx);
             // movl (%rax), %rax
             emit_bytes(0x48, 0x8b, 0x00);
-            // push %rax
-            emit_bytes(0x50);
             break;
          }
+         _top_in_rax = true;
       }
       void emit_set_global(uint32_t globalidx) {
-         auto icount = fixed_size_instr(14);
-         auto& gl = _mod.globals[globalidx];
-         void *ptr = &gl.current.value;
-         // popq %rcx
-         emit_bytes(0x59);
-         // movabsq $ptr, %rax
-         emit_bytes(0x48, 0xb8);
-         emit_operand_ptr(ptr);
-         // movq %rcx, (%rax)
-         emit_bytes(0x48, 0x89, 0x08);
+         auto icount = variable_size_instr(13, 14);
+         // popq %rax
+         emit_pop_top();
+         // movabsq $ptr, %rcx
+         emit_bytes(0x48, 0xb9);
+         emit_global_ptr(globalidx);
+         // movq %rax, (%rcx)
+         emit_bytes(0x48, 0x89, 0x01);
       }
 
       void emit_i32_load(uint32_t /*alignment*/, uint32_t offset) {
-         auto icount = variable_size_instr(7, 15);
          // movl (RAX), EAX
          emit_load_impl(offset, 0x8b, 0x00);
       }
 
       void emit_i64_load(uint32_t /*alignment*/, uint32_t offset) {
-         auto icount = variable_size_instr(8, 16);
          // movq (RAX), RAX
          emit_load_impl(offset, 0x48, 0x8b, 0x00);
       }
 
       void emit_f32_load(uint32_t /*alignment*/, uint32_t offset) {
-         auto icount = variable_size_instr(7, 15);
          // movl (RAX), EAX
          emit_load_impl(offset, 0x8b, 0x00);
       }
 
       void emit_f64_load(uint32_t /*alignment*/, uint32_t offset) {
-         auto icount = variable_size_instr(8, 16);
          // movq (RAX), RAX
          emit_load_impl(offset, 0x48, 0x8b, 0x00);
       }
 
       void emit_i32_load8_s(uint32_t /*alignment*/, uint32_t offset) {
-         auto icount = variable_size_instr(8, 16);
          // movsbl (RAX), EAX; 
          emit_load_impl(offset, 0x0F, 0xbe, 0x00);
       }
 
       void emit_i32_load16_s(uint32_t /*alignment*/, uint32_t offset) {
-         auto icount = variable_size_instr(8, 16);
          // movswl (RAX), EAX; 
          emit_load_impl(offset, 0x0F, 0xbf, 0x00);
       }
 
       void emit_i32_load8_u(uint32_t /*alignment*/, uint32_t offset) {
-         auto icount = variable_size_instr(8, 16);
          // movzbl (RAX), EAX; 
          emit_load_impl(offset, 0x0f, 0xb6, 0x00);
       }
 
       void emit_i32_load16_u(uint32_t /*alignment*/, uint32_t offset) {
-         auto icount = variable_size_instr(8, 16);
          // movzwl (RAX), EAX; 
          emit_load_impl(offset, 0x0f, 0xb7, 0x00);
       }
 
       void emit_i64_load8_s(uint32_t /*alignment*/, uint32_t offset) {
-         auto icount = variable_size_instr(9, 17);
          // movsbq (RAX), RAX; 
          emit_load_impl(offset, 0x48, 0x0F, 0xbe, 0x00);
       }
 
       void emit_i64_load16_s(uint32_t /*alignment*/, uint32_t offset) {
-         auto icount = variable_size_instr(9, 17);
          // movswq (RAX), RAX; 
          emit_load_impl(offset, 0x48, 0x0F, 0xbf, 0x00);
       }
 
       void emit_i64_load32_s(uint32_t /*alignment*/, uint32_t offset) {
-         auto icount = variable_size_instr(8, 16);
          // movslq (RAX), RAX
          emit_load_impl(offset, 0x48, 0x63, 0x00);
       }
 
       void emit_i64_load8_u(uint32_t /*alignment*/, uint32_t offset) {
-         auto icount = variable_size_instr(8, 16);
          // movzbl (RAX), EAX; 
          emit_load_impl(offset, 0x0f, 0xb6, 0x00);
       }
 
       void emit_i64_load16_u(uint32_t /*alignment*/, uint32_t offset) {
-         auto icount = variable_size_instr(8, 16);
          // movzwl (RAX), EAX; 
          emit_load_impl(offset, 0x0f, 0xb7, 0x00);
       }
 
      void emit_i64_load32_u(uint32_t /*alignment*/, uint32_t offset) {
-         auto icount = variable_size_instr(7, 15);
          // movl (RAX), EAX
          emit_load_impl(offset, 0x8b, 0x00);
       }
 
       void emit_i32_store(uint32_t /*alignment*/, uint32_t offset) {
-         auto icount = variable_size_instr(7, 15);
-         // movl ECX, (RAX)
-         emit_store_impl(offset, 0x89, 0x08);
+         // movl EAX, (RCX)
+         emit_store_impl(offset, 0x89, 0x01);
       }
 
       void emit_i64_store(uint32_t /*alignment*/, uint32_t offset) {
-         auto icount = variable_size_instr(8, 16);
-         // movl ECX, (RAX)
-         emit_store_impl(offset, 0x48, 0x89, 0x08);
+         // movq RAX, (RCX)
+         emit_store_impl(offset, 0x48, 0x89, 0x01);
       }
 
       void emit_f32_store(uint32_t /*alignment*/, uint32_t offset) {
-         auto icount = variable_size_instr(7, 15);
-         // movl ECX, (RAX)
-         emit_store_impl(offset, 0x89, 0x08);
+         // movl EAX, (RCX)
+         emit_store_impl(offset, 0x89, 0x01);
       }
 
       void emit_f64_store(uint32_t /*alignment*/, uint32_t offset) {
-         auto icount = variable_size_instr(8, 16);
-         // movl ECX, (RAX)
-         emit_store_impl(offset, 0x48, 0x89, 0x08);
+         // movq RAX, (RCX)
+         emit_store_impl(offset, 0x48, 0x89, 0x01);
       }
 
       void emit_i32_store8(uint32_t /*alignment*/, uint32_t offset) {
-         auto icount = variable_size_instr(7, 15);
-         // movb CL, (RAX)
-         emit_store_impl(offset, 0x88, 0x08);
+         // movb AL, (RCX)
+         emit_store_impl(offset, 0x88, 0x01);
       }
 
       void emit_i32_store16(uint32_t /*alignment*/, uint32_t offset) {
-         auto icount = variable_size_instr(8, 16);
-         // movb CX, (RAX)
-         emit_store_impl(offset, 0x66, 0x89, 0x08);
+         // movw AX, (RCX)
+         emit_store_impl(offset, 0x66, 0x89, 0x01);
       }
 
       void emit_i64_store8(uint32_t /*alignment*/, uint32_t offset) {
-         auto icount = variable_size_instr(7, 15);
-         // movb CL, (RAX)
-         emit_store_impl(offset, 0x88, 0x08);
+         // movb AL, (RCX)
+         emit_store_impl(offset, 0x88, 0x01);
       }
 
       void emit_i64_store16(uint32_t /*alignment*/, uint32_t offset) {
-         auto icount = variable_size_instr(8, 16);
-         // movb CX, (RAX)
-         emit_store_impl(offset, 0x66, 0x89, 0x08);
+         // movw AX, (RCX)
+         emit_store_impl(offset, 0x66, 0x89, 0x01);
       }
 
       void emit_i64_store32(uint32_t /*alignment*/, uint32_t offset) {
-         auto icount = variable_size_instr(7, 15);
-         // movl ECX, (RAX)
-         emit_store_impl(offset, 0x89, 0x08);
+         // movl EAX, (RCX)
+         emit_store_impl(offset, 0x89, 0x01);
       }
 
       void emit_current_memory() {
-         auto icount = fixed_size_instr(17);
+         emit_flush_top();
+         auto icount = fixed_size_instr(16);
          // pushq %rdi
          emit_bytes(0x57);
          // pushq %rsi
@@ -636,13 +819,12 @@ namespace eosio { namespace vm {
          emit_bytes(0x5e);
          // pop %rdi
          emit_bytes(0x5f);
-         // push %rax
-         emit_bytes(0x50);
+         _top_in_rax = true;
       }
       void emit_grow_memory() {
-         auto icount = fixed_size_instr(21);
+         auto icount = variable_size_instr(19, 20);
          // popq %rax
-         emit_bytes(0x58);
+         emit_pop_top();
          // pushq %rdi
          emit_bytes(0x57);
          // pushq %rsi
@@ -658,190 +840,183 @@ namespace eosio { namespace vm {
          emit_bytes(0x5e);
          // pop %rdi
          emit_bytes(0x5f);
-         // push %rax
-         emit_bytes(0x50);
+         _top_in_rax = true;
       }
 
       void emit_i32_const(uint32_t value) {
-         auto icount = fixed_size_instr(6);
+         unsigned char* start = code;
+         bool flushed = _top_in_rax;
+         emit_flush_top();
+         auto icount = fixed_size_instr(5);
          // mov $value, %eax
          emit_bytes(0xb8);
          emit_operand32(value);
-         // push %rax
-         emit_bytes(0x50);
+         _top_in_rax = true;
+         set_top_source(top_source::constant, start, flushed, static_cast<int64_t>(value));
       }
 
       void emit_i64_const(uint64_t value) {
-         auto icount = fixed_size_instr(11);
+         unsigned char* start = code;
+         bool flushed = _top_in_rax;
+         emit_flush_top();
+         auto icount = fixed_size_instr(10);
          // movabsq $value, %rax
          emit_bytes(0x48, 0xb8);
          emit_operand64(value);
-         // push %rax
-         emit_bytes(0x50);
+         _top_in_rax = true;
+         set_top_source(top_source::constant, start, flushed, static_cast<int64_t>(value));
       }
 
       void emit_f32_const(float value) {
-         auto icount = fixed_size_instr(6);
+         unsigned char* start = code;
+         bool flushed = _top_in_rax;
+         emit_flush_top();
+         auto icount = fixed_size_instr(5);
          // mov $value, %eax
          emit_bytes(0xb8);
          emit_operandf32(value);
-         // push %rax
-         emit_bytes(0x50);
+         _top_in_rax = true;
+         uint32_t bits;
+         memcpy(&bits, &value, sizeof(bits));
+         set_top_source(top_source::constant, start, flushed, bits);
       }
       void emit_f64_const(double value) {
-         auto icount = fixed_size_instr(11);
+         unsigned char* start = code;
+         bool flushed = _top_in_rax;
+         emit_flush_top();
+         auto icount = fixed_size_instr(10);
          // movabsq $value, %rax
          emit_bytes(0x48, 0xb8);
          emit_operandf64(value);
-         // push %rax
-         emit_bytes(0x50);
+         _top_in_rax = true;
+         int64_t bits;
+         memcpy(&bits, &value, sizeof(bits));
+         set_top_source(top_source::constant, start, flushed, bits);
       }
 
       void emit_i32_eqz() {
-         auto icount = fixed_size_instr(10);
+         uint8_t condition = pop_top_condition();
+         auto icount = variable_size_instr(6, 9);
+         if (condition) {
+            // The operand is a comparison; negate it instead
+            emit_condition_result(invert_condition(condition));
+            return;
+         }
          // pop %rax
-         emit_bytes(0x58);
-         // xor %rcx, %rcx
-         emit_bytes(0x48, 0x31, 0xc9);
+         emit_pop_top();
          // test %eax, %eax
          emit_bytes(0x85, 0xc0);
-         // setz %cl
-         emit_bytes(0x0f, 0x94, 0xc1);
-         // push %rcx
-         emit_bytes(0x51);
+         // setz %al; movzbl %al, %eax
+         emit_condition_result(0x94);
       }
 
       // i32 relops
       void emit_i32_eq() {
-         auto icount = fixed_size_instr(11);
          // sete %dl
          emit_i32_relop(0x94);
       }
 
       void emit_i32_ne() {
-         auto icount = fixed_size_instr(11);
          // sete %dl
          emit_i32_relop(0x95);
       }
 
       void emit_i32_lt_s() {
-         auto icount = fixed_size_instr(11);
          // setl %dl
          emit_i32_relop(0x9c);
       }
 
       void emit_i32_lt_u() {
-         auto icount = fixed_size_instr(11);
          // setl %dl
          emit_i32_relop(0x92);
       }
 
       void emit_i32_gt_s() {
-         auto icount = fixed_size_instr(11);
          // setg %dl
          emit_i32_relop(0x9f);
       }
 
       void emit_i32_gt_u() {
-         auto icount = fixed_size_instr(11);
          // seta %dl
          emit_i32_relop(0x97);
       }
 
       void emit_i32_le_s() {
-         auto icount = fixed_size_instr(11);
          // setle %dl
          emit_i32_relop(0x9e);
       }
 
       void emit_i32_le_u() {
-         auto icount = fixed_size_instr(11);
          // setbe %dl
          emit_i32_relop(0x96);
       }
 
       void emit_i32_ge_s() {
-         auto icount = fixed_size_instr(11);
          // setge %dl
          emit_i32_relop(0x9d);
       }
 
       void emit_i32_ge_u() {
-         auto icount = fixed_size_instr(11);
          // setae %dl
          emit_i32_relop(0x93);
       }
 
       void emit_i64_eqz() {
-         auto icount = fixed_size_instr(11);
+         auto icount = variable_size_instr(9, 10);
          // pop %rax
-         emit_bytes(0x58);
-         // xor %rcx, %rcx
-         emit_bytes(0x48, 0x31, 0xc9);
+         emit_pop_top();
          // test %rax, %rax
          emit_bytes(0x48, 0x85, 0xc0);
-         // setz %cl
-         emit_bytes(0x0f, 0x94, 0xc1);
-         // push %rcx
-         emit_bytes(0x51);
+         // setz %al; movzbl %al, %eax
+         emit_condition_result(0x94);
       }
       // i64 relops
       void emit_i64_eq() {
-         auto icount = fixed_size_instr(12);
          // sete %dl
          emit_i64_relop(0x94);
       }
 
       void emit_i64_ne() {
-         auto icount = fixed_size_instr(12);
          // sete %dl
          emit_i64_relop(0x95);
       }
 
       void emit_i64_lt_s() {
-         auto icount = fixed_size_instr(12);
          // setl %dl
          emit_i64_relop(0x9c);
       }
 
       void emit_i64_lt_u() {
-         auto icount = fixed_size_instr(12);
          // setl %dl
          emit_i64_relop(0x92);
       }
 
       void emit_i64_gt_s() {
-         auto icount = fixed_size_instr(12);
          // setg %dl
          emit_i64_relop(0x9f);
       }
 
       void emit_i64_gt_u() {
-         auto icount = fixed_size_instr(12);
          // seta %dl
          emit_i64_relop(0x97);
       }
 
       void emit_i64_le_s() {
-         auto icount = fixed_size_instr(12);
          // setle %dl
          emit_i64_relop(0x9e);
       }
 
       void emit_i64_le_u() {
-         auto icount = fixed_size_instr(12);
          // setbe %dl
          emit_i64_relop(0x96);
       }
 
       void emit_i64_ge_s() {
-         auto icount = fixed_size_instr(12);
          // setge %dl
          emit_i64_relop(0x9d);
       }
 
       void emit_i64_ge_u() {
-         auto icount = fixed_size_instr(12);
          // setae %dl
          emit_i64_relop(0x93);
       }
@@ -973,62 +1148,74 @@ namespace eosio { namespace vm {
 
       // --------------- f32 relops ----------------------
       void emit_f32_eq() {
+         emit_flush_top();
          auto icount = softfloat_instr(25,45);
          emit_f32_relop(0x00, CHOOSE_FN(_eosio_f32_eq), false, false);
       }
 
       void emit_f32_ne() {
+         emit_flush_top();
          auto icount = softfloat_instr(24,47);
          emit_f32_relop(0x00, CHOOSE_FN(_eosio_f32_eq), false, true);
       }
 
       void emit_f32_lt() {
+         emit_flush_top();
          auto icount = softfloat_instr(25,45);
          emit_f32_relop(0x01, CHOOSE_FN(_eosio_f32_lt), false, false);
       }
 
       void emit_f32_gt() {
+         emit_flush_top();
          auto icount = softfloat_instr(25,45);
          emit_f32_relop(0x01, CHOOSE_FN(_eosio_f32_lt), true, false);
       }
 
       void emit_f32_le() {
+         emit_flush_top();
          auto icount = softfloat_instr(25,45);
          emit_f32_relop(0x02, CHOOSE_FN(_eosio_f32_le), false, false);
       }
 
       void emit_f32_ge() {
+         emit_flush_top();
          auto icount = softfloat_instr(25,45);
          emit_f32_relop(0x02, CHOOSE_FN(_eosio_f32_le), true, false);
       }
 
       // --------------- f64 relops ----------------------
       void emit_f64_eq() {
+         emit_flush_top();
          auto icount = softfloat_instr(25,47);
          emit_f64_relop(0x00, CHOOSE_FN(_eosio_f64_eq), false, false);
       }
 
       void emit_f64_ne() {
+         emit_flush_top();
          auto icount = softfloat_instr(24,49);
          emit_f64_relop(0x00, CHOOSE_FN(_eosio_f64_eq), false, true);
       }
 
       void emit_f64_lt() {
+         emit_flush_top();
          auto icount = softfloat_instr(25,47);
          emit_f64_relop(0x01, CHOOSE_FN(_eosio_f64_lt), false, false);
       }
 
       void emit_f64_gt() {
+         emit_flush_top();
          auto icount = softfloat_instr(25,47);
          emit_f64_relop(0x01, CHOOSE_FN(_eosio_f64_lt), true, false);
       }
 
       void emit_f64_le() {
+         emit_flush_top();
          auto icount = softfloat_instr(25,47);
          emit_f64_relop(0x02, CHOOSE_FN(_eosio_f64_le), false, false);
       }
 
       void emit_f64_ge() {
+         emit_flush_top();
          auto icount = softfloat_instr(25,47);
          emit_f64_relop(0x02, CHOOSE_FN(_eosio_f64_le), true, false);
       }
@@ -1037,65 +1224,62 @@ namespace eosio { namespace vm {
 
       // FIXME: detect whether lzcnt/tzcnt are supported
       void emit_i32_clz() {
-         auto icount = fixed_size_instr(6);
+         auto icount = variable_size_instr(4, 5);
          // popq %rax
-         emit_bytes(0x58);
+         emit_pop_top();
          // lzcntl %eax, %eax
          emit_bytes(0xf3, 0x0f, 0xbd, 0xc0);
-         // pushq %rax
-         emit_bytes(0x50);
+         _top_in_rax = true;
       }
 
       void emit_i32_ctz() {
-         auto icount = fixed_size_instr(6);
+         auto icount = variable_size_instr(4, 5);
          // popq %rax
-         emit_bytes(0x58);
+         emit_pop_top();
          // tzcntl %eax, %eax
          emit_bytes(0xf3, 0x0f, 0xbc, 0xc0);
-         // pushq %rax
-         emit_bytes(0x50);
+         _top_in_rax = true;
       }
 
       void emit_i32_popcnt() {
-         auto icount = fixed_size_instr(6);
+         auto icount = variable_size_instr(4, 5);
          // popq %rax
-         emit_bytes(0x58);
+         emit_pop_top();
          // popcntl %eax, %eax
          emit_bytes(0xf3, 0x0f, 0xb8, 0xc0);
-         // pushq %rax
-         emit_bytes(0x50);
+         _top_in_rax = true;
       }
 
       // --------------- i32 binops ----------------------
 
       void emit_i32_add() {
-         auto icount = fixed_size_instr(5);
-         emit_i32_binop(0x01, 0xc8, 0x50);
+         if (emit_folded_alu(false, 0)) return;
+         auto icount = variable_size_instr(3, 4);
+         emit_i32_commutative_binop(0x01, 0xc8);
       }
       void emit_i32_sub() {
-         auto icount = fixed_size_instr(5);
-         emit_i32_binop(0x29, 0xc8, 0x50);
+         if (emit_folded_alu(false, 5)) return;
+         auto icount = variable_size_instr(4, 6);
+         emit_i32_binop(0x29, 0xc8);
       }
       void emit_i32_mul() {
-         auto icount = fixed_size_instr(6);
-         emit_i32_binop(0x0f, 0xaf, 0xc1, 0x50);
+         if (emit_folded_mul(false)) return;
+         auto icount = variable_size_instr(4, 5);
+         emit_i32_commutative_binop(0x0f, 0xaf, 0xc1);
       }
-      // cdq; idiv %ecx; pushq %rax
+      // cdq; idiv %ecx
       void emit_i32_div_s() {
-         auto icount = fixed_size_instr(6);
-         emit_i32_binop(0x99, 0xf7, 0xf9, 0x50);
+         auto icount = variable_size_instr(5, 7);
+         emit_i32_binop(0x99, 0xf7, 0xf9);
       }
       void emit_i32_div_u() {
-         auto icount = fixed_size_instr(7);
-         emit_i32_binop(0x31, 0xd2, 0xf7, 0xf1, 0x50);
+         auto icount = variable_size_instr(6, 8);
+         emit_i32_binop(0x31, 0xd2, 0xf7, 0xf1);
       }
       void emit_i32_rem_s() {
-         auto icount = fixed_size_instr(22);
-         // pop %rcx
-         emit_bytes(0x59);
-         // pop %rax
-         emit_bytes(0x58);
-         // cmp $-1, %edx
+         auto icount = variable_size_instr(23, 25);
+         emit_binop_operands(false);
+         // cmp $-1, %ecx
          emit_bytes(0x83, 0xf9, 0xff);
          // je MINUS1
          emit_bytes(0x0f, 0x84);
@@ -1104,117 +1288,124 @@ namespace eosio { namespace vm {
          emit_bytes(0x99);
          // idiv %ecx
          emit_bytes(0xf7, 0xf9);
+         // mov %edx, %eax
+         emit_bytes(0x89, 0xd0);
          // jmp END
          emit_bytes(0xe9);
          void* end = emit_branch_target32();
          // MINUS1:
          fix_branch(minus1, code);
-         // xor %edx, %edx
-         emit_bytes(0x31, 0xd2);
+         // xor %eax, %eax
+         emit_bytes(0x31, 0xc0);
          // END:
          fix_branch(end, code);
-         // push %rdx
-         emit_bytes(0x52);
+         _top_in_rax = true;
       }
       void emit_i32_rem_u() {
-         auto icount = fixed_size_instr(7);
-         emit_i32_binop(0x31, 0xd2, 0xf7, 0xf1, 0x52);
+         auto icount = variable_size_instr(8, 10);
+         // xor %edx, %edx; div %ecx; mov %edx, %eax
+         emit_i32_binop(0x31, 0xd2, 0xf7, 0xf1, 0x89, 0xd0);
       }
       void emit_i32_and() {
-         auto icount = fixed_size_instr(5);
-         emit_i32_binop(0x21, 0xc8, 0x50);
+         if (emit_folded_alu(false, 4)) return;
+         auto icount = variable_size_instr(3, 4);
+         emit_i32_commutative_binop(0x21, 0xc8);
       }
       void emit_i32_or() {
-         auto icount = fixed_size_instr(5);
-         emit_i32_binop(0x09, 0xc8, 0x50);
+         if (emit_folded_alu(false, 1)) return;
+         auto icount = variable_size_instr(3, 4);
+         emit_i32_commutative_binop(0x09, 0xc8);
       }
       void emit_i32_xor() {
-         auto icount = fixed_size_instr(5);
-         emit_i32_binop(0x31, 0xc8, 0x50);
+         if (emit_folded_alu(false, 6)) return;
+         auto icount = variable_size_instr(3, 4);
+         emit_i32_commutative_binop(0x31, 0xc8);
       }
       void emit_i32_shl() {
-         auto icount = fixed_size_instr(5);
-         emit_i32_binop(0xd3, 0xe0, 0x50);
+         if (emit_folded_shift(false, 4)) return;
+         auto icount = variable_size_instr(4, 6);
+         emit_i32_binop(0xd3, 0xe0);
       }
       void emit_i32_shr_s() {
-         auto icount = fixed_size_instr(5);
-         emit_i32_binop(0xd3, 0xf8, 0x50);
+         if (emit_folded_shift(false, 7)) return;
+         auto icount = variable_size_instr(4, 6);
+         emit_i32_binop(0xd3, 0xf8);
       }
       void emit_i32_shr_u() {
-         auto icount = fixed_size_instr(5);
-         emit_i32_binop(0xd3, 0xe8, 0x50);
+         if (emit_folded_shift(false, 5)) return;
+         auto icount = variable_size_instr(4, 6);
+         emit_i32_binop(0xd3, 0xe8);
       }
       void emit_i32_rotl() {
-         auto icount = fixed_size_instr(5);
-         emit_i32_binop(0xd3, 0xc0, 0x50);
+         if (emit_folded_shift(false, 0)) return;
+         auto icount = variable_size_instr(4, 6);
+         emit_i32_binop(0xd3, 0xc0);
       }
       void emit_i32_rotr() {
-         auto icount = fixed_size_instr(5);
-         emit_i32_binop(0xd3, 0xc8, 0x50);
+         if (emit_folded_shift(false, 1)) return;
+         auto icount = variable_size_instr(4, 6);
+         emit_i32_binop(0xd3, 0xc8);
       }
 
       // --------------- i64 unops ----------------------
 
       // FIXME: detect whether lzcnt/tzcnt are supported
       void emit_i64_clz() {
-         auto icount = fixed_size_instr(7);
+         auto icount = variable_size_instr(5, 6);
          // popq %rax
-         emit_bytes(0x58);
+         emit_pop_top();
          // lzcntq %eax, %eax
          emit_bytes(0xf3, 0x48, 0x0f, 0xbd, 0xc0);
-         // pushq %rax
-         emit_bytes(0x50);
+         _top_in_rax = true;
       }
 
       void emit_i64_ctz() {
-         auto icount = fixed_size_instr(7);
+         auto icount = variable_size_instr(5, 6);
          // popq %rax
-         emit_bytes(0x58);
+         emit_pop_top();
          // tzcntq %eax, %eax
          emit_bytes(0xf3, 0x48, 0x0f, 0xbc, 0xc0);
-         // pushq %rax
-         emit_bytes(0x50);
+         _top_in_rax = true;
       }
 
       void emit_i64_popcnt() {
-         auto icount = fixed_size_instr(7);
+         auto icount = variable_size_instr(5, 6);
          // popq %rax
-         emit_bytes(0x58);
+         emit_pop_top();
          // popcntq %rax, %rax
          emit_bytes(0xf3, 0x48, 0x0f, 0xb8, 0xc0);
-         // pushq %rax
-         emit_bytes(0x50);
+         _top_in_rax = true;
       }
 
       // --------------- i64 binops ----------------------
 
       void emit_i64_add() {
-         auto icount = fixed_size_instr(6);
-         emit_i64_binop(0x48, 0x01, 0xc8, 0x50);
+         if (emit_folded_alu(true, 0)) return;
+         auto icount = variable_size_instr(4, 5);
+         emit_i64_commutative_binop(0x48, 0x01, 0xc8);
       }
       void emit_i64_sub() {
-         auto icount = fixed_size_instr(6);
-         emit_i64_binop(0x48, 0x29, 0xc8, 0x50);
+         if (emit_folded_alu(true, 5)) return;
+         auto icount = variable_size_instr(5, 7);
+         emit_i64_binop(0x48, 0x29, 0xc8);
       }
       void emit_i64_mul() {
-         auto icount = fixed_size_instr(7);
-         emit_i64_binop(0x48, 0x0f, 0xaf, 0xc1, 0x50);
+         if (emit_folded_mul(true)) return;
+         auto icount = variable_size_instr(5, 6);
+         emit_i64_commutative_binop(0x48, 0x0f, 0xaf, 0xc1);
       }
-      // cdq; idiv %rcx; pushq %rax
+      // cqo; idiv %rcx
       void emit_i64_div_s() {
-         auto icount = fixed_size_instr(8);
-         emit_i64_binop(0x48, 0x99, 0x48, 0xf7, 0xf9, 0x50);
+         auto icount = variable_size_instr(7, 9);
+         emit_i64_binop(0x48, 0x99, 0x48, 0xf7, 0xf9);
       }
       void emit_i64_div_u() {
-         auto icount = fixed_size_instr(9);
-         emit_i64_binop(0x48, 0x31, 0xd2, 0x48, 0xf7, 0xf1, 0x50);
+         auto icount = variable_size_instr(8, 10);
+         emit_i64_binop(0x48, 0x31, 0xd2, 0x48, 0xf7, 0xf1);
       }
       void emit_i64_rem_s() {
-         auto icount = fixed_size_instr(25);
-         // pop %rcx
-         emit_bytes(0x59);
-         // pop %rax
-         emit_bytes(0x58);
+         auto icount = variable_size_instr(27, 29);
+         emit_binop_operands(false);
          // cmp $-1, %rcx
          emit_bytes(0x48, 0x83, 0xf9, 0xff);
          // je MINUS1
@@ -1224,80 +1415,89 @@ namespace eosio { namespace vm {
          emit_bytes(0x48, 0x99);
          // idiv %rcx
          emit_bytes(0x48, 0xf7, 0xf9);
+         // mov %rdx, %rax
+         emit_bytes(0x48, 0x89, 0xd0);
          // jmp END
          emit_bytes(0xe9);
          void* end = emit_branch_target32();
          // MINUS1:
          fix_branch(minus1, code);
-         // xor %edx, %edx
-         emit_bytes(0x31, 0xd2);
+         // xor %eax, %eax
+         emit_bytes(0x31, 0xc0);
          // END:
          fix_branch(end, code);
-         // push %rdx
-         emit_bytes(0x52);
+         _top_in_rax = true;
       }
       void emit_i64_rem_u() {
-         auto icount = fixed_size_instr(9);
-         emit_i64_binop(0x48, 0x31, 0xd2, 0x48, 0xf7, 0xf1, 0x52);
+         auto icount = variable_size_instr(11, 13);
+         // xor %edx, %edx; div %rcx; mov %rdx, %rax
+         emit_i64_binop(0x48, 0x31, 0xd2, 0x48, 0xf7, 0xf1, 0x48, 0x89, 0xd0);
       }
       void emit_i64_and() {
-         auto icount = fixed_size_instr(6);
-         emit_i64_binop(0x48, 0x21, 0xc8, 0x50);
+         if (emit_folded_alu(true, 4)) return;
+         auto icount = variable_size_instr(4, 5);
+         emit_i64_commutative_binop(0x48, 0x21, 0xc8);
       }
       void emit_i64_or() {
-         auto icount = fixed_size_instr(6);
-         emit_i64_binop(0x48, 0x09, 0xc8, 0x50);
+         if (emit_folded_alu(true, 1)) return;
+         auto icount = variable_size_instr(4, 5);
+         emit_i64_commutative_binop(0x48, 0x09, 0xc8);
       }
       void emit_i64_xor() {
-         auto icount = fixed_size_instr(6);
-         emit_i64_binop(0x48, 0x31, 0xc8, 0x50);
+         if (emit_folded_alu(true, 6)) return;
+         auto icount = variable_size_instr(4, 5);
+         emit_i64_commutative_binop(0x48, 0x31, 0xc8);
       }
       void emit_i64_shl() {
-         auto icount = fixed_size_instr(6);
-         emit_i64_binop(0x48, 0xd3, 0xe0, 0x50);
+         if (emit_folded_shift(true, 4)) return;
+         auto icount = variable_size_instr(5, 7);
+         emit_i64_binop(0x48, 0xd3, 0xe0);
       }
       void emit_i64_shr_s() {
-         auto icount = fixed_size_instr(6);
-         emit_i64_binop(0x48, 0xd3, 0xf8, 0x50);
+         if (emit_folded_shift(true, 7)) return;
+         auto icount = variable_size_instr(5, 7);
+         emit_i64_binop(0x48, 0xd3, 0xf8);
       }
       void emit_i64_shr_u() {
-         auto icount = fixed_size_instr(6);
-         emit_i64_binop(0x48, 0xd3, 0xe8, 0x50);
+         if (emit_folded_shift(true, 5)) return;
+         auto icount = variable_size_instr(5, 7);
+         emit_i64_binop(0x48, 0xd3, 0xe8);
       }
       void emit_i64_rotl() {
-         auto icount = fixed_size_instr(6);
-         emit_i64_binop(0x48, 0xd3, 0xc0, 0x50);
+         if (emit_folded_shift(true, 0)) return;
+         auto icount = variable_size_instr(5, 7);
+         emit_i64_binop(0x48, 0xd3, 0xc0);
       }
       void emit_i64_rotr() {
-         auto icount = fixed_size_instr(6);
-         emit_i64_binop(0x48, 0xd3, 0xc8, 0x50);
+         if (emit_folded_shift(true, 1)) return;
+         auto icount = variable_size_instr(5, 7);
+         emit_i64_binop(0x48, 0xd3, 0xc8);
       }
 
       // --------------- f32 unops ----------------------
 
       void emit_f32_abs() {
-         auto icount = fixed_size_instr(7);
+         auto icount = variable_size_instr(5, 6);
          // popq %rax; 
-         emit_bytes(0x58);
+         emit_pop_top();
          // andl 0x7fffffff, %eax
          emit_bytes(0x25);
          emit_operand32(0x7fffffff);
-         // pushq %rax
-         emit_bytes(0x50);
+         _top_in_rax = true;
       }
 
       void emit_f32_neg() {
-         auto icount = fixed_size_instr(7);
+         auto icount = variable_size_instr(5, 6);
          // popq %rax
-         emit_bytes(0x58);
+         emit_pop_top();
          // xorl 0x80000000, %eax
          emit_bytes(0x35);
          emit_operand32(0x80000000);
-         // pushq %rax
-         emit_bytes(0x50);
+         _top_in_rax = true;
       }
 
       void emit_f32_ceil() {
+         emit_flush_top();
          auto icount = softfloat_instr(12, 36);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(_eosio_f32_ceil));
@@ -1309,6 +1509,7 @@ namespace eosio { namespace vm {
       }
 
       void emit_f32_floor() {
+         emit_flush_top();
          auto icount = softfloat_instr(12, 36);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(_eosio_f32_floor));
@@ -1320,6 +1521,7 @@ namespace eosio { namespace vm {
       }
 
       void emit_f32_trunc() {
+         emit_flush_top();
          auto icount = softfloat_instr(12, 36);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(_eosio_f32_trunc));
@@ -1331,6 +1533,7 @@ namespace eosio { namespace vm {
       }
 
       void emit_f32_nearest() {
+         emit_flush_top();
          auto icount = softfloat_instr(12, 36);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(_eosio_f32_nearest));
@@ -1342,35 +1545,48 @@ namespace eosio { namespace vm {
       }
 
       void emit_f32_sqrt() {
-         auto icount = softfloat_instr(10, 36);
-         if constexpr (use_softfloat) {
-            return emit_softfloat_unop(CHOOSE_FN(_eosio_f32_sqrt));
-         }
+         emit_flush_top();
+         auto icount = softfloat_instr(10, 53);
          // sqrtss (%rsp), %xmm0
          emit_bytes(0xf3, 0x0f, 0x51, 0x04, 0x24);
+         if constexpr (use_softfloat) {
+            // ucomiss %xmm0, %xmm0
+            emit_bytes(0x0f, 0x2e, 0xc0);
+         }
+         void* is_nan = emit_softfloat_nan_check();
          // movss %xmm0, (%rsp)
          emit_bytes(0xf3, 0x0f, 0x11, 0x04, 0x24);
+         if constexpr (use_softfloat) {
+            void* done = emit_softfloat_fallback_jump(is_nan);
+            emit_softfloat_unop(CHOOSE_FN(_eosio_f32_sqrt));
+            fix_branch8(done, code);
+         }
       }
 
       // --------------- f32 binops ----------------------
 
       void emit_f32_add() {
-         auto icount = softfloat_instr(21, 44);
+         emit_flush_top();
+         auto icount = softfloat_instr(21, 72);
          emit_f32_binop(0x58, CHOOSE_FN(_eosio_f32_add));
       }
       void emit_f32_sub() {
-         auto icount = softfloat_instr(21, 44);
+         emit_flush_top();
+         auto icount = softfloat_instr(21, 72);
          emit_f32_binop(0x5c, CHOOSE_FN(_eosio_f32_sub));
       }
       void emit_f32_mul() {
-         auto icount = softfloat_instr(21, 44);
+         emit_flush_top();
+         auto icount = softfloat_instr(21, 72);
          emit_f32_binop(0x59, CHOOSE_FN(_eosio_f32_mul));
       }
       void emit_f32_div() {
-         auto icount = softfloat_instr(21, 44);
+         emit_flush_top();
+         auto icount = softfloat_instr(21, 72);
          emit_f32_binop(0x5e, CHOOSE_FN(_eosio_f32_div));
       }
       void emit_f32_min() {
+         emit_flush_top();
          auto icount = softfloat_instr(47, 44);
         if constexpr(use_softfloat) {
            emit_f32_binop_softfloat(CHOOSE_FN(_eosio_f32_min));
@@ -1404,6 +1620,7 @@ namespace eosio { namespace vm {
         emit_bytes(0xf3, 0x0f, 0x11, 0x04, 0x24);
       }
       void emit_f32_max() {
+         emit_flush_top();
          auto icount = softfloat_instr(47, 44);
         if(use_softfloat) {
            emit_f32_binop_softfloat(CHOOSE_FN(_eosio_f32_max));
@@ -1438,9 +1655,9 @@ namespace eosio { namespace vm {
       }
 
       void emit_f32_copysign() {
-         auto icount = fixed_size_instr(16);
+         auto icount = variable_size_instr(14, 15);
          // popq %rax; 
-         emit_bytes(0x58);
+         emit_pop_top();
          // andl 0x80000000, %eax
          emit_bytes(0x25);
          emit_operand32(0x80000000);
@@ -1451,39 +1668,31 @@ namespace eosio { namespace vm {
          emit_operand32(0x7fffffff);
          // orl %ecx, %eax
          emit_bytes(0x09, 0xc8);
-         // pushq %rax
-         emit_bytes(0x50);
+         _top_in_rax = true;
       }
       
       // --------------- f64 unops ----------------------
 
       void emit_f64_abs() {
-         auto icount = fixed_size_instr(15);
-         // popq %rcx; 
-         emit_bytes(0x59);
-         // movabsq $0x7fffffffffffffff, %rax
-         emit_bytes(0x48, 0xb8);
-         emit_operand64(0x7fffffffffffffffull);
-         // andq %rcx, %rax
-         emit_bytes(0x48, 0x21, 0xc8);
-         // pushq %rax
-         emit_bytes(0x50);
+         auto icount = variable_size_instr(5, 6);
+         // popq %rax
+         emit_pop_top();
+         // btrq $63, %rax
+         emit_bytes(0x48, 0x0f, 0xba, 0xf0, 0x3f);
+         _top_in_rax = true;
       }
 
       void emit_f64_neg() {
-         auto icount = fixed_size_instr(15);
-         // popq %rcx; 
-         emit_bytes(0x59);
-         // movabsq $0x8000000000000000, %rax
-         emit_bytes(0x48, 0xb8);
-         emit_operand64(0x8000000000000000ull);
-         // xorq %rcx, %rax
-         emit_bytes(0x48, 0x31, 0xc8);
-         // pushq %rax
-         emit_bytes(0x50);
+         auto icount = variable_size_instr(5, 6);
+         // popq %rax
+         emit_pop_top();
+         // btcq $63, %rax
+         emit_bytes(0x48, 0x0f, 0xba, 0xf8, 0x3f);
+         _top_in_rax = true;
       }
 
       void emit_f64_ceil() {
+         emit_flush_top();
          auto icount = softfloat_instr(12, 38);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(_eosio_f64_ceil));
@@ -1495,6 +1704,7 @@ namespace eosio { namespace vm {
       }
 
       void emit_f64_floor() {
+         emit_flush_top();
          auto icount = softfloat_instr(12, 38);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(_eosio_f64_floor));
@@ -1506,6 +1716,7 @@ namespace eosio { namespace vm {
       }
 
       void emit_f64_trunc() {
+         emit_flush_top();
          auto icount = softfloat_instr(12, 38);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(_eosio_f64_trunc));
@@ -1517,6 +1728,7 @@ namespace eosio { namespace vm {
       }
 
       void emit_f64_nearest() {
+         emit_flush_top();
          auto icount = softfloat_instr(12, 38);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(_eosio_f64_nearest));
@@ -1528,35 +1740,48 @@ namespace eosio { namespace vm {
       }
 
       void emit_f64_sqrt() {
-         auto icount = softfloat_instr(10, 38);
+         emit_flush_top();
+         auto icount = softfloat_instr(10, 56);
+         // sqrtsd (%rsp), %xmm0
+         emit_bytes(0xf2, 0x0f, 0x51, 0x04, 0x24);
          if constexpr (use_softfloat) {
-            return emit_softfloat_unop(CHOOSE_FN(_eosio_f64_sqrt));
+            // ucomisd %xmm0, %xmm0
+            emit_bytes(0x66, 0x0f, 0x2e, 0xc0);
          }
-         // sqrtss (%rsp), %xmm0
-         emit_bytes(0xf2, 0x0f, 0x51, 0x04, 0x24);
-         // movss %xmm0, (%rsp)
+         void* is_nan = emit_softfloat_nan_check();
+         // movsd %xmm0, (%rsp)
          emit_bytes(0xf2, 0x0f, 0x11, 0x04, 0x24);
+         if constexpr (use_softfloat) {
+            void* done = emit_softfloat_fallback_jump(is_nan);
+            emit_softfloat_unop(CHOOSE_FN(_eosio_f64_sqrt));
+            fix_branch8(done, code);
+         }
       }
 
       // --------------- f64 binops ----------------------
 
       void emit_f64_add() {
-         auto icount = softfloat_instr(21, 47);
+         emit_flush_top();
+         auto icount = softfloat_instr(21, 76);
          emit_f64_binop(0x58, CHOOSE_FN(_eosio_f64_add));
       }
       void emit_f64_sub() {
-         auto icount = softfloat_instr(21, 47);
+         emit_flush_top();
+         auto icount = softfloat_instr(21, 76);
          emit_f64_binop(0x5c, CHOOSE_FN(_eosio_f64_sub));
       }
       void emit_f64_mul() {
-         auto icount = softfloat_instr(21, 47);
+         emit_flush_top();
+         auto icount = softfloat_instr(21, 76);
          emit_f64_binop(0x59, CHOOSE_FN(_eosio_f64_mul));
       }
       void emit_f64_div() {
-         auto icount = softfloat_instr(21, 47);
+         emit_flush_top();
+         auto icount = softfloat_instr(21, 76);
          emit_f64_binop(0x5e, CHOOSE_FN(_eosio_f64_div));
       }
       void emit_f64_min() {
+         emit_flush_top();
          auto icount = softfloat_instr(49, 47);
          if(use_softfloat) {
             emit_f64_binop_softfloat(CHOOSE_FN(_eosio_f64_min));
@@ -1590,6 +1815,7 @@ namespace eosio { namespace vm {
          emit_bytes(0xf2, 0x0f, 0x11, 0x04, 0x24);
       }
       void emit_f64_max() {
+         emit_flush_top();
          auto icount = softfloat_instr(49, 47);
          if(use_softfloat) {
             emit_f64_binop_softfloat(CHOOSE_FN(_eosio_f64_max));
@@ -1624,39 +1850,37 @@ namespace eosio { namespace vm {
       }
 
       void emit_f64_copysign() {
-         auto icount = fixed_size_instr(25);
-         // popq %rcx; 
+         auto icount = variable_size_instr(17, 18);
+         // popq %rax
+         emit_pop_top();
+         // shrq $63, %rax
+         emit_bytes(0x48, 0xc1, 0xe8, 0x3f);
+         // shlq $63, %rax
+         emit_bytes(0x48, 0xc1, 0xe0, 0x3f);
+         // popq %rcx
          emit_bytes(0x59);
-         // movabsq 0x8000000000000000, %rax
-         emit_bytes(0x48, 0xb8);
-         emit_operand64(0x8000000000000000ull);
-         // andq %rax, %rcx
-         emit_bytes(0x48, 0x21, 0xc1);
-         // popq %rdx
-         emit_bytes(0x5a);
-         // notq %rax
-         emit_bytes(0x48, 0xf7, 0xd0);
-         // andq %rdx, %rax
-         emit_bytes(0x48, 0x21, 0xd0);
+         // btrq $63, %rcx
+         emit_bytes(0x48, 0x0f, 0xba, 0xf1, 0x3f);
          // orq %rcx, %rax
          emit_bytes(0x48, 0x09, 0xc8);
-         // pushq %rax
-         emit_bytes(0x50);
+         _top_in_rax = true;
       }
 
       // --------------- conversions --------------------
 
 
       void emit_i32_wrap_i64() {
-         auto icount = fixed_size_instr(6);
+         auto icount = variable_size_instr(2, 3);
+         // popq %rax
+         emit_pop_top();
          // Zero out the high 4 bytes
-         // xor %eax, %eax
-         emit_bytes(0x31, 0xc0);
-         // mov %eax, 4(%rsp)
-         emit_bytes(0x89, 0x44, 0x24, 0x04);
+         // mov %eax, %eax
+         emit_bytes(0x89, 0xc0);
+         _top_in_rax = true;
       }
 
       void emit_i32_trunc_s_f32() {
+         emit_flush_top();
          auto icount = softfloat_instr(33, 36);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(softfloat_trap<&_eosio_f32_trunc_i32s>()));
@@ -1668,6 +1892,7 @@ namespace eosio { namespace vm {
       }
 
       void emit_i32_trunc_u_f32() {
+         emit_flush_top();
          auto icount = softfloat_instr(46, 36);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(softfloat_trap<&_eosio_f32_trunc_i32u>()));
@@ -1682,9 +1907,10 @@ namespace eosio { namespace vm {
          emit_bytes(0x85, 0xc0);
          // jnz FP_ERROR_HANDLER
          emit_bytes(0x0f, 0x85);
-         fix_branch(emit_branch_target32(), fpe_handler);
+         emit_external_target32(fpe_handler);
       }
       void emit_i32_trunc_s_f64() {
+         emit_flush_top();
          auto icount = softfloat_instr(34, 38);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(softfloat_trap<&_eosio_f64_trunc_i32s>()));
@@ -1696,6 +1922,7 @@ namespace eosio { namespace vm {
       }
 
       void emit_i32_trunc_u_f64() {
+         emit_flush_top();
          auto icount = softfloat_instr(47, 38);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(softfloat_trap<&_eosio_f64_trunc_i32u>()));
@@ -1710,20 +1937,25 @@ namespace eosio { namespace vm {
          emit_bytes(0x85, 0xc0);
          // jnz FP_ERROR_HANDLER
          emit_bytes(0x0f, 0x85);
-         fix_branch(emit_branch_target32(), fpe_handler);
+         emit_external_target32(fpe_handler);
       }
 
       void emit_i64_extend_s_i32() {
-         auto icount = fixed_size_instr(8);
-         // movslq (%rsp), %rax
-         emit_bytes(0x48, 0x63, 0x04, 0x24);
-         // mov %rax, (%rsp)
-         emit_bytes(0x48, 0x89, 0x04, 0x24);
+         auto icount = variable_size_instr(3, 4);
+         // popq %rax
+         emit_pop_top();
+         // movslq %eax, %rax
+         emit_bytes(0x48, 0x63, 0xc0);
+         _top_in_rax = true;
       }
 
-      void emit_i64_extend_u_i32() { /* Nothing to do */ }
+      void emit_i64_extend_u_i32() {
+         // The upper half of the local's stack slot is not known to be zero
+         if (_top_source.kind != top_source::constant) _top_source = {};
+      }
       
       void emit_i64_trunc_s_f32() {
+         emit_flush_top();
          auto icount = softfloat_instr(35, 37);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(softfloat_trap<&_eosio_f32_trunc_i64s>()));
@@ -1734,6 +1966,7 @@ namespace eosio { namespace vm {
          emit_bytes(0x48, 0x89, 0x04 ,0x24);
       }
       void emit_i64_trunc_u_f32() {
+         emit_flush_top();
          auto icount = softfloat_instr(101, 37);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(softfloat_trap<&_eosio_f32_trunc_i64u>()));
@@ -1774,9 +2007,10 @@ namespace eosio { namespace vm {
          emit_bytes(0x48, 0x0f, 0xba, 0xe2, 0x3f);
          // jc FP_ERROR_HANDLER
          emit_bytes(0x0f, 0x82);
-         fix_branch(emit_branch_target32(), fpe_handler);
+         emit_external_target32(fpe_handler);
       }
       void emit_i64_trunc_s_f64() {
+         emit_flush_top();
          auto icount = softfloat_instr(35, 38);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(softfloat_trap<&_eosio_f64_trunc_i64s>()));
@@ -1787,6 +2021,7 @@ namespace eosio { namespace vm {
          emit_bytes(0x48, 0x89, 0x04 ,0x24);
       }
       void emit_i64_trunc_u_f64() {
+         emit_flush_top();
          auto icount = softfloat_instr(109, 38);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(softfloat_trap<&_eosio_f64_trunc_i64u>()));
@@ -1827,10 +2062,11 @@ namespace eosio { namespace vm {
          emit_bytes(0x48, 0x0f, 0xba, 0xe2, 0x3f);
          // jc FP_ERROR_HANDLER
          emit_bytes(0x0f, 0x82);
-         fix_branch(emit_branch_target32(), fpe_handler);
+         emit_external_target32(fpe_handler);
       }
 
       void emit_f32_convert_s_i32() {
+         emit_flush_top();
          auto icount = softfloat_instr(10, 36);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(_eosio_i32_to_f32));
@@ -1841,6 +2077,7 @@ namespace eosio { namespace vm {
          emit_bytes(0xf3, 0x0f, 0x11, 0x04, 0x24);
       }
       void emit_f32_convert_u_i32() {
+         emit_flush_top();
          auto icount = softfloat_instr(11, 36);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(_eosio_ui32_to_f32));
@@ -1852,6 +2089,7 @@ namespace eosio { namespace vm {
          emit_bytes(0xf3, 0x0f, 0x11, 0x04, 0x24);
       }
       void emit_f32_convert_s_i64() {
+         emit_flush_top();
          auto icount = softfloat_instr(11, 38);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(_eosio_i64_to_f32));
@@ -1862,6 +2100,7 @@ namespace eosio { namespace vm {
          emit_bytes(0xf3, 0x0f, 0x11, 0x04, 0x24);
       }
       void emit_f32_convert_u_i64() {
+         emit_flush_top();
          auto icount = softfloat_instr(55, 38);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(_eosio_ui64_to_f32));
@@ -1902,6 +2141,7 @@ namespace eosio { namespace vm {
         emit_bytes(0xf3, 0x0f, 0x11, 0x04, 0x24);
       }
       void emit_f32_demote_f64() {
+         emit_flush_top();
          auto icount = softfloat_instr(10, 38);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(_eosio_f64_demote));
@@ -1912,6 +2152,7 @@ namespace eosio { namespace vm {
          emit_bytes(0xf3, 0x0f, 0x11, 0x04, 0x24);
       }
       void emit_f64_convert_s_i32() {
+         emit_flush_top();
          auto icount = softfloat_instr(10, 37);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(_eosio_i32_to_f64));
@@ -1922,6 +2163,7 @@ namespace eosio { namespace vm {
          emit_bytes(0xf2, 0x0f, 0x11, 0x04, 0x24);
       }
       void emit_f64_convert_u_i32() {
+         emit_flush_top();
          auto icount = softfloat_instr(11, 37);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(_eosio_ui32_to_f64));
@@ -1932,6 +2174,7 @@ namespace eosio { namespace vm {
          emit_bytes(0xf2, 0x0f, 0x11, 0x04, 0x24);
       }
       void emit_f64_convert_s_i64() {
+         emit_flush_top();
          auto icount = softfloat_instr(11, 38);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(_eosio_i64_to_f64));
@@ -1942,6 +2185,7 @@ namespace eosio { namespace vm {
          emit_bytes(0xf2, 0x0f, 0x11, 0x04, 0x24);
       }
       void emit_f64_convert_u_i64() {
+         emit_flush_top();
          auto icount = softfloat_instr(49, 38);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(_eosio_ui64_to_f64));
@@ -1978,6 +2222,7 @@ namespace eosio { namespace vm {
         emit_bytes(0xf2, 0x0f, 0x11, 0x04, 0x24);
       }
       void emit_f64_promote_f32() {
+         emit_flush_top();
          auto icount = softfloat_instr(10, 37);
          if constexpr (use_softfloat) {
             return emit_softfloat_unop(CHOOSE_FN(_eosio_f32_promote));
@@ -2021,6 +2266,16 @@ namespace eosio { namespace vm {
 
     private:
 
+      struct lazy_state;
+      struct worker_tag {};
+      machine_code_writer(const machine_code_writer& parent, worker_tag) :
+         _mod(parent._mod), _code_segment_base(parent._code_segment_base),
+         fpe_handler(parent.fpe_handler), call_indirect_handler(parent.call_indirect_handler),
+         type_error_handler(parent.type_error_handler), stack_overflow_handler(parent.stack_overflow_handler),
+         call_indirect_type_handler(parent.call_indirect_type_handler),
+         call_indirect_table(parent.call_indirect_table), _is_worker(true),
+         _worker_code(std::make_unique<growable_allocator>(0)) {}
+
       auto fixed_size_instr(std::size_t expected_bytes) {
          return scope_guard{[this, expected_code=code+expected_bytes](){
 #ifdef EOS_VM_VALIDATE_JIT_SIZE
@@ -2052,9 +2307,41 @@ namespace eosio { namespace vm {
       void* call_indirect_handler;
       void* type_error_handler;
       void* stack_overflow_handler;
-      void* jmp_table;
+      void* call_indirect_type_handler;
+      unsigned char* call_indirect_table;
       uint32_t _local_count;
-      uint32_t _table_element_size;
+      std::size_t _table_data_size = 0;
+      // Set for writers created by make_worker
+      bool _is_worker = false;
+      std::shared_ptr<lazy_state> _lazy;
+      std::size_t _lazy_reserved_size = 0;
+      // Scratch space for the function being compiled by a worker
+      std::unique_ptr<growable_allocator> _worker_code;
+      compiled_function _compiled;
+      std::vector<code_cache::relocation> _relocations;
+      // When set, the top of the wasm operand stack is in %rax
+      // and has not been pushed.
+      bool _top_in_rax = false;
+      // Describes the code that produced the value in %rax.  It is only
+      // meaningful while code == end, i.e. nothing has been emitted since,
+      // which lets the next instruction remove that code and fold the value
+      // into its own encoding.
+      struct top_source {
+         enum kind_t : uint8_t {
+            none,
+            condition,  // SETcc/movzbl, the flags are still live.  value is the SETcc opcode.
+            constant,   // mov $value, %rax
+            local,      // mov value(%rbp), %rax
+            local_copy  // %rax holds the local at value(%rbp), but there is nothing to remove
+         };
+         kind_t kind = none;
+         // The code begins by pushing the previous top of the stack
+         bool flushed = false;
+         unsigned char* start = nullptr;
+         unsigned char* end = nullptr;
+         int64_t value = 0;
+      };
+      top_source _top_source;
 
       void emit_byte(uint8_t val) { *code++ = val; }
       void emit_bytes() {}
@@ -2067,21 +2354,48 @@ namespace eosio { namespace vm {
       void emit_operand64(uint64_t val) { memcpy(code, &val, sizeof(val)); code += sizeof(val); }
       void emit_operandf32(float val) { memcpy(code, &val, sizeof(val)); code += sizeof(val); }
       void emit_operandf64(double val) { memcpy(code, &val, sizeof(val)); code += sizeof(val); }
+      // Absolute addresses are recorded for the code cache
       template<class T>
-      void emit_operand_ptr(T* val) { memcpy(code, &val, sizeof(val)); code += sizeof(val); }
+      void emit_operand_ptr(T* val) {
+         record_relocation(code_cache::relocation::function, reinterpret_cast<uint64_t>(val));
+         memcpy(code, &val, sizeof(val));
+         code += sizeof(val);
+      }
+      void emit_global_ptr(uint32_t globalidx) {
+         void* ptr = &_mod.globals[globalidx].current.value;
+         record_relocation(code_cache::relocation::global,
+                           static_cast<char*>(ptr) - reinterpret_cast<char*>(_mod.globals.raw()));
+         memcpy(code, &ptr, sizeof(ptr));
+         code += sizeof(ptr);
+      }
+      void record_relocation(code_cache::relocation::kind_t kind, uint64_t value) {
+         if (_is_worker)
+            _compiled.relocations.push_back({ static_cast<uint32_t>(code - _code_start), kind, value });
+         else
+            _relocations.push_back({ static_cast<uint32_t>(code - static_cast<unsigned char*>(_code_segment_base)), kind, value });
+      }
 
      void* emit_branch_target32() {
         void * result = code;
         emit_operand32(3735928555u - static_cast<uint32_t>(reinterpret_cast<uintptr_t>(code)));
         return result;
      }
+      // Emits a rel32 operand that refers to code or data outside the
+      // current function.  Workers defer it to link_function.
+      void emit_external_target32(void* target) {
+         void* branch = emit_branch_target32();
+         if (_is_worker)
+            _compiled.external_targets.emplace_back(static_cast<unsigned char*>(branch) - _code_start, target);
+         else
+            fix_branch(branch, target);
+      }
 
       void emit_check_call_depth() {
          // decl %ebx
          emit_bytes(0xff, 0xcb);
          // jz stack_overflow
          emit_bytes(0x0f, 0x84);
-         fix_branch(emit_branch_target32(), stack_overflow_handler);
+         emit_external_target32(stack_overflow_handler);
       }
       void emit_check_call_depth_end() {
          // incl %ebx
@@ -2090,8 +2404,201 @@ namespace eosio { namespace vm {
 
       static void unimplemented() { EOS_VM_ASSERT(false, wasm_parse_exception, "Sorry, not implemented."); }
 
+      // Writes the cached top of the stack to memory
+      void emit_flush_top() {
+         if (_top_in_rax) {
+            // pushq %rax
+            emit_bytes(0x50);
+            _top_in_rax = false;
+         }
+      }
+
+      // Removes the top of the stack and leaves it in %rax
+      void emit_pop_top() {
+         if (_top_in_rax) {
+            _top_in_rax = false;
+         } else {
+            // popq %rax
+            emit_bytes(0x58);
+         }
+      }
+
+      // Stores the flags condition for the given SETcc opcode in %rax as 0 or 1.
+      // A following branch or select can remove this code and use the flags
+      // directly (see pop_top_condition).
+      void emit_condition_result(uint8_t setcc) {
+         unsigned char* start = code;
+         // SETcc %al
+         emit_bytes(0x0f, setcc, 0xc0);
+         // movzbl %al, %eax
+         emit_bytes(0x0f, 0xb6, 0xc0);
+         _top_in_rax = true;
+         set_top_source(top_source::condition, start, false, setcc);
+      }
+
+      // If the top of the stack was produced by the immediately preceding
+      // emit_condition_result, removes the top of the stack and the
+      // SETcc/movzbl and returns the SETcc opcode.  Otherwise returns 0
+      // and leaves the stack unchanged.
+      uint8_t pop_top_condition() {
+         if (top_source_is(top_source::condition)) {
+            return static_cast<uint8_t>(pop_top_source().value);
+         }
+         return 0;
+      }
+
+      void set_top_source(typename top_source::kind_t kind, unsigned char* start, bool flushed, int64_t value) {
+         _top_source = { kind, flushed, start, code, value };
+      }
+
+      // Whether the top of the stack is in %rax and was produced by
+      // the immediately preceding code of the given kind.
+      bool top_source_is(typename top_source::kind_t kind) const {
+         return _top_in_rax && _top_source.kind == kind && code == _top_source.end;
+      }
+
+      // Removes the code that produced the top of the stack, which must
+      // be removable, and returns its description.  The previous element
+      // becomes the top of the stack again.
+      top_source pop_top_source() {
+         top_source result = _top_source;
+         code = result.start;
+         _top_in_rax = result.flushed;
+         _top_source = {};
+         return result;
+      }
+
+      static bool fits_int8(int64_t value) { return value >= -128 && value <= 127; }
+      static bool fits_int32(int64_t value) { return value >= INT32_MIN && value <= INT32_MAX; }
+
+      int32_t local_offset(uint32_t local_idx) const {
+         if (local_idx < _ft->param_types.size()) {
+            return 8 * (_ft->param_types.size() - local_idx + 1);
+         } else {
+            return -8 * (local_idx - _ft->param_types.size() + 1);
+         }
+      }
+
+      // ModRM byte and displacement for offset(%rbp)
+      void emit_rbp_operand(uint8_t reg, int32_t offset) {
+         if (fits_int8(offset)) {
+            emit_bytes(0x45 | (reg << 3), static_cast<uint8_t>(offset));
+         } else {
+            emit_bytes(0x85 | (reg << 3));
+            emit_operand32(offset);
+         }
+      }
+
+      // Emits a group 1 ALU instruction (add, or, and, sub, xor, cmp) whose
+      // right operand is a constant or local that was just loaded, using
+      // an immediate or memory operand instead.  ext is the opcode extension.
+      // Returns false if the right operand cannot be folded.
+      bool emit_folded_alu(bool is64, uint8_t ext) {
+         if (!(top_source_is(top_source::local) ||
+               (top_source_is(top_source::constant) && (!is64 || fits_int32(_top_source.value))))) {
+            return false;
+         }
+         top_source rhs = pop_top_source();
+         auto icount = variable_size_instr(3, 8);
+         // pop %rax
+         emit_pop_top();
+         if (is64) {
+            // REX.W
+            emit_bytes(0x48);
+         }
+         if (rhs.kind == top_source::constant) {
+            int32_t imm = static_cast<int32_t>(rhs.value);
+            if (fits_int8(imm)) {
+               // OP $imm8, %eax
+               emit_bytes(0x83, 0xc0 | (ext << 3), static_cast<uint8_t>(imm));
+            } else {
+               // OP $imm32, %eax
+               emit_bytes(0x81, 0xc0 | (ext << 3));
+               emit_operand32(imm);
+            }
+         } else {
+            // OP local(%rbp), %eax
+            emit_bytes((ext << 3) | 0x03);
+            emit_rbp_operand(0, rhs.value);
+         }
+         _top_in_rax = true;
+         return true;
+      }
+
+      // Shift or rotate by a constant.  ext is the opcode extension.
+      bool emit_folded_shift(bool is64, uint8_t ext) {
+         if (!top_source_is(top_source::constant)) {
+            return false;
+         }
+         top_source rhs = pop_top_source();
+         auto icount = variable_size_instr(3, 5);
+         // pop %rax
+         emit_pop_top();
+         if (is64) {
+            // REX.W
+            emit_bytes(0x48);
+         }
+         // OP $imm8, %eax
+         emit_bytes(0xc1, 0xc0 | (ext << 3), static_cast<uint8_t>(rhs.value & (is64 ? 63 : 31)));
+         _top_in_rax = true;
+         return true;
+      }
+
+      // Multiplication by a constant or local.
+      bool emit_folded_mul(bool is64) {
+         if (!(top_source_is(top_source::local) ||
+               (top_source_is(top_source::constant) && (!is64 || fits_int32(_top_source.value))))) {
+            return false;
+         }
+         top_source rhs = pop_top_source();
+         auto icount = variable_size_instr(3, 9);
+         // pop %rax
+         emit_pop_top();
+         if (is64) {
+            // REX.W
+            emit_bytes(0x48);
+         }
+         if (rhs.kind == top_source::constant) {
+            int32_t imm = static_cast<int32_t>(rhs.value);
+            if (fits_int8(imm)) {
+               // imul $imm8, %eax, %eax
+               emit_bytes(0x6b, 0xc0, static_cast<uint8_t>(imm));
+            } else {
+               // imul $imm32, %eax, %eax
+               emit_bytes(0x69, 0xc0);
+               emit_operand32(imm);
+            }
+         } else {
+            // imul local(%rbp), %eax
+            emit_bytes(0x0f, 0xaf);
+            emit_rbp_operand(0, rhs.value);
+         }
+         _top_in_rax = true;
+         return true;
+      }
+
+      static uint8_t invert_condition(uint8_t setcc) { return setcc ^ 1; }
+      static uint8_t jcc_opcode(uint8_t setcc) { return setcc - 0x10; }
+      static uint8_t cmov_opcode(uint8_t setcc) { return setcc - 0x50; }
+
       // clobbers %rax if the high bit of count is set.
       void emit_multipop(uint32_t count) {
+         if (_top_in_rax) {
+            // The top of the stack is already in %rax, so only
+            // the elements below it need to be dropped.
+            uint32_t in_memory = (count & 0x7FFFFFFF) == 0 ? 0 : (count & 0x7FFFFFFF) - 1;
+            if (in_memory != 0) {
+               // add depth_change*8, %rsp
+               emit_bytes(0x48, 0x81, 0xc4);
+               emit_operand32(in_memory * 8);
+            }
+            if ((count & 0x80000000) || (count & 0x7FFFFFFF) == 0) {
+               // push %rax
+               emit_bytes(0x50);
+            }
+            _top_in_rax = false;
+            return;
+         }
          if(count > 0 && count != 0x80000001) {
             if (count & 0x80000000) {
                // mov (%rsp), %rax
@@ -2112,81 +2619,139 @@ namespace eosio { namespace vm {
          }
       }
 
+      // Emits the ModRM byte, SIB byte, and displacement for offset(%rsi,index).
+      // offset must be less than 2^31.
+      void emit_memory_operand(uint8_t modrm, uint8_t index, uint32_t offset) {
+         uint8_t sib = (index << 3) | 0x06;
+         if (offset == 0) {
+            emit_bytes(modrm | 0x04, sib);
+         } else if (offset < 0x80) {
+            emit_bytes(modrm | 0x44, sib, static_cast<uint8_t>(offset));
+         } else {
+            emit_bytes(modrm | 0x84, sib);
+            emit_operand32(offset);
+         }
+      }
+
+      // loadop is a load from (%rax).  Its last byte is the ModRM byte.
       template<class... T>
       void emit_load_impl(uint32_t offset, T... loadop) {
+         const uint8_t op[] = { static_cast<uint8_t>(loadop)... };
+         constexpr std::size_t n = sizeof...(T);
+         const uint64_t address = static_cast<uint64_t>(_top_source.value) + offset;
+         if (top_source_is(top_source::constant) && address < 0x80000000u) {
+            pop_top_source();
+            auto icount = variable_size_instr(n + 4, n + 5);
+            // The value below the address stays on the stack
+            emit_flush_top();
+            // OP address(%rsi), %eax
+            for (std::size_t i = 0; i < n - 1; ++i) emit_byte(op[i]);
+            emit_bytes(op[n - 1] | 0x86);
+            emit_operand32(address);
+            _top_in_rax = true;
+            return;
+         }
+         auto icount = variable_size_instr(n + 1, n + 12);
          // pop %rax
-         emit_bytes(0x58);
+         emit_pop_top();
          if (offset & 0x80000000) {
             // mov $offset, %ecx
             emit_bytes(0xb9);
             emit_operand32(offset);
             // add %rcx, %rax
             emit_bytes(0x48, 0x01, 0xc8);
-         } else if (offset != 0) {
-            // add offset, %rax
-            emit_bytes(0x48, 0x05);
-            emit_operand32(offset);
+            // add %rsi, %rax
+            emit_bytes(0x48, 0x01, 0xf0);
+            // from the caller
+            emit_bytes(static_cast<uint8_t>(loadop)...);
+         } else {
+            // OP offset(%rsi,%rax), %eax
+            for (std::size_t i = 0; i < n - 1; ++i) emit_byte(op[i]);
+            emit_memory_operand(op[n - 1], 0, offset);
          }
-         // add %rsi, %rax
-         emit_bytes(0x48, 0x01, 0xf0);
-         // from the caller
-         emit_bytes(static_cast<uint8_t>(loadop)...);
-         // push RAX
-         emit_bytes(0x50);
+         _top_in_rax = true;
       }
 
+      // storeop is a store of %rax to (%rcx).  Its last byte is the ModRM byte.
       template<class... T>
       void emit_store_impl(uint32_t offset, T... storeop) {
+         const uint8_t op[] = { static_cast<uint8_t>(storeop)... };
+         constexpr std::size_t n = sizeof...(T);
+         // The opcode is movb (0x88), movw (0x66 0x89), movl (0x89), or movq (0x48 0x89)
+         const bool is64 = op[0] == 0x48;
+         const std::size_t imm_size = op[0] == 0x88 ? 1 : op[0] == 0x66 ? 2 : 4;
+         if (top_source_is(top_source::constant) && !(offset & 0x80000000) &&
+             (!is64 || fits_int32(_top_source.value))) {
+            const uint32_t imm = static_cast<uint32_t>(pop_top_source().value);
+            auto icount = variable_size_instr(n + 2, n + 10);
+            // pop %rax
+            emit_pop_top();
+            // mov $imm, offset(%rsi,%rax)
+            for (std::size_t i = 0; i < n - 2; ++i) emit_byte(op[i]);
+            emit_byte(op[n - 2] == 0x88 ? 0xc6 : 0xc7);
+            emit_memory_operand(0, 0, offset);
+            for (std::size_t i = 0; i < imm_size; ++i) emit_byte(static_cast<uint8_t>(imm >> (8 * i)));
+            return;
+         }
+         auto icount = variable_size_instr(n + 2, n + 13);
+         // pop RAX
+         emit_pop_top();
          // pop RCX
          emit_bytes(0x59);
-         // pop RAX
-         emit_bytes(0x58);
          if (offset & 0x80000000) {
-            // mov $offset, %ecx
-            emit_bytes(0xb9);
-            emit_operand32(offset);
-            // add %rcx, %rax
-            emit_bytes(0x48, 0x01, 0xc8);
-         } else if (offset != 0) {
-            // add offset, %rax
-            emit_bytes(0x48, 0x05);
+            // mov $offset, %edx
+            emit_bytes(0xba);
             emit_operand32(offset);
+            // add %rdx, %rcx
+            emit_bytes(0x48, 0x01, 0xd1);
+            // add %rsi, %rcx
+            emit_bytes(0x48, 0x01, 0xf1);
+            // from the caller
+            emit_bytes(static_cast<uint8_t>(storeop)...);
+         } else {
+            // OP %eax, offset(%rsi,%rcx)
+            for (std::size_t i = 0; i < n - 1; ++i) emit_byte(op[i]);
+            emit_memory_operand(op[n - 1] & 0x38, 1, offset);
          }
-         // add %rsi, %rax
-         emit_bytes(0x48, 0x01, 0xf0);
-         // from the caller
-         emit_bytes(static_cast<uint8_t>(storeop)...);;
       }
 
       void emit_i32_relop(uint8_t opcode) {
+         // cmpl $imm, %eax or cmpl local(%rbp), %eax
+         if (emit_folded_alu(false, 7)) {
+            auto icount = fixed_size_instr(6);
+            // SETcc %al; movzbl %al, %eax
+            emit_condition_result(opcode);
+            return;
+         }
+         auto icount = variable_size_instr(9, 10);
          // popq %rax
-         emit_bytes(0x58);
+         emit_pop_top();
          // popq %rcx
          emit_bytes(0x59);
-         // xorq %rdx, %rdx
-         emit_bytes(0x48, 0x31, 0xd2);
          // cmpl %eax, %ecx
          emit_bytes(0x39, 0xc1);
-         // SETcc %dl
-         emit_bytes(0x0f, opcode, 0xc2);
-         // pushq %rdx
-         emit_bytes(0x52);
+         // SETcc %al; movzbl %al, %eax
+         emit_condition_result(opcode);
       }
 
       template<class... T>
       void emit_i64_relop(uint8_t opcode) {
+         // cmpq $imm, %rax or cmpq local(%rbp), %rax
+         if (emit_folded_alu(true, 7)) {
+            auto icount = fixed_size_instr(6);
+            // SETcc %al; movzbl %al, %eax
+            emit_condition_result(opcode);
+            return;
+         }
+         auto icount = variable_size_instr(10, 11);
          // popq %rax
-         emit_bytes(0x58);
+         emit_pop_top();
          // popq %rcx
          emit_bytes(0x59);
-         // xorq %rdx, %rdx
-         emit_bytes(0x48, 0x31, 0xd2);
          // cmpq %rax, %rcx
          emit_bytes(0x48, 0x39, 0xc1);
-         // SETcc %dl
-         emit_bytes(0x0f, opcode, 0xc2);
-         // pushq %rdx
-         emit_bytes(0x52);
+         // SETcc %al; movzbl %al, %eax
+         emit_condition_result(opcode);
       }
 
       template<typename T, typename U>
@@ -2405,54 +2970,139 @@ namespace eosio { namespace vm {
          }
       }
 
+      // Leaves the lhs in %rax and the rhs in %rcx.  A commutative
+      // operation may get them the other way around, which saves
+      // a move when the rhs is already in %rax.
+      void emit_binop_operands(bool commutative) {
+         if (!_top_in_rax) {
+            // popq %rcx
+            emit_bytes(0x59);
+            // popq %rax
+            emit_bytes(0x58);
+         } else if (commutative) {
+            // popq %rcx
+            emit_bytes(0x59);
+         } else {
+            // movq %rax, %rcx
+            emit_bytes(0x48, 0x89, 0xc1);
+            // popq %rax
+            emit_bytes(0x58);
+         }
+         _top_in_rax = false;
+      }
+
       template<class... T>
       void emit_i32_binop(T... op) {
-         // popq %rcx
-         emit_bytes(0x59);
-         // popq %rax
-         emit_bytes(0x58);
-         // OP %eax, %ecx
+         emit_binop_operands(false);
+         // OP %ecx, %eax
+         emit_bytes(static_cast<uint8_t>(op)...);
+         _top_in_rax = true;
+      }
+
+      template<class... T>
+      void emit_i32_commutative_binop(T... op) {
+         emit_binop_operands(true);
+         // OP %ecx, %eax
          emit_bytes(static_cast<uint8_t>(op)...);
-         // pushq %rax
-         // emit_bytes(0x50);
+         _top_in_rax = true;
       }
 
       template<class... T>
       void emit_i64_binop(T... op) {
-         // popq %rcx
-         emit_bytes(0x59);
-         // popq %rax
-         emit_bytes(0x58);
-         // OP %eax, %ecx
+         emit_binop_operands(false);
+         // OP %rcx, %rax
          emit_bytes(static_cast<uint8_t>(op)...);
+         _top_in_rax = true;
       }
 
+      template<class... T>
+      void emit_i64_commutative_binop(T... op) {
+         emit_binop_operands(true);
+         // OP %rcx, %rax
+         emit_bytes(static_cast<uint8_t>(op)...);
+         _top_in_rax = true;
+      }
+
+      // add, sub, mul, div and sqrt are exactly rounded, so SSE gives the
+      // same result as softfloat except possibly for the payload of a NaN.
+      // With softfloat, they run in hardware and a NaN result is computed
+      // again by softfloat.  The jit always runs with the default MXCSR:
+      // it is loaded on entry and again whenever native code returns to
+      // the jit (see emit_restore_mxcsr).
       void emit_f32_binop(uint8_t op, float32_t (*softfloatfun)(float32_t, float32_t)) {
-         if constexpr (use_softfloat) {
-            return emit_f32_binop_softfloat(softfloatfun);
-         }
          // movss 8(%rsp), %xmm0
          emit_bytes(0xf3, 0x0f, 0x10, 0x44, 0x24, 0x08);
          // OPss (%rsp), %xmm0
          emit_bytes(0xf3, 0x0f, op, 0x04, 0x24);
+         if constexpr (use_softfloat) {
+            // ucomiss %xmm0, %xmm0
+            emit_bytes(0x0f, 0x2e, 0xc0);
+         }
+         void* is_nan = emit_softfloat_nan_check();
          // leaq 8(%rsp), %rsp
          emit_bytes(0x48, 0x8d, 0x64, 0x24, 0x08);
          // movss %xmm0, (%rsp)
          emit_bytes(0xf3, 0x0f, 0x11, 0x04, 0x24);
+         if constexpr (use_softfloat) {
+            void* done = emit_softfloat_fallback_jump(is_nan);
+            emit_f32_binop_softfloat(softfloatfun);
+            fix_branch8(done, code);
+         }
       }
 
       void emit_f64_binop(uint8_t op, float64_t (*softfloatfun)(float64_t, float64_t)) {
-         if constexpr (use_softfloat) {
-            return emit_f64_binop_softfloat(softfloatfun);
-         }
          // movsd 8(%rsp), %xmm0
          emit_bytes(0xf2, 0x0f, 0x10, 0x44, 0x24, 0x08);
          // OPsd (%rsp), %xmm0
          emit_bytes(0xf2, 0x0f, op, 0x04, 0x24);
+         if constexpr (use_softfloat) {
+            // ucomisd %xmm0, %xmm0
+            emit_bytes(0x66, 0x0f, 0x2e, 0xc0);
+         }
+         void* is_nan = emit_softfloat_nan_check();
          // leaq 8(%rsp), %rsp
          emit_bytes(0x48, 0x8d, 0x64, 0x24, 0x08);
          // movsd %xmm0, (%rsp)
          emit_bytes(0xf2, 0x0f, 0x11, 0x04, 0x24);
+         if constexpr (use_softfloat) {
+            void* done = emit_softfloat_fallback_jump(is_nan);
+            emit_f64_binop_softfloat(softfloatfun);
+            fix_branch8(done, code);
+         }
+      }
+
+      // With softfloat, jumps over the hardware result if the preceding
+      // ucomis sets PF, i.e. if the result is a NaN.
+      void* emit_softfloat_nan_check() {
+         if constexpr (use_softfloat) {
+            // jp SOFTFLOAT
+            emit_bytes(0x7a);
+            return emit_branch_target8();
+         } else {
+            return nullptr;
+         }
+      }
+      // Ends the hardware path and starts the softfloat path.  Returns
+      // the branch to the end of the softfloat path.
+      void* emit_softfloat_fallback_jump(void* is_nan) {
+         // jmp DONE
+         emit_bytes(0xeb);
+         void* done = emit_branch_target8();
+         // SOFTFLOAT:
+         fix_branch8(is_nan, code);
+         return done;
+      }
+
+      // rel8 branches are only used within the code of one instruction
+      void* emit_branch_target8() {
+         void* result = code;
+         emit_byte(0);
+         return result;
+      }
+      static void fix_branch8(void* branch, void* target) {
+         auto rel = static_cast<unsigned char*>(target) - (static_cast<unsigned char*>(branch) + 1);
+         assert(rel >= -128 && rel <= 127);
+         *static_cast<int8_t*>(branch) = static_cast<int8_t>(rel);
       }
 
       // Beware: This pushes and pops mxcsr around the user op.  Remember to adjust access to %rsp in the caller.
@@ -2475,7 +3125,7 @@ namespace eosio { namespace vm {
          emit_bytes(0xf6, 0xc1, 0x01);
          // jnz FP_ERROR_HANDLER
          emit_bytes(0x0f, 0x85);
-         fix_branch(emit_branch_target32(), fpe_handler);
+         emit_external_target32(fpe_handler);
       }
 
       void* emit_error_handler(void (*handler)()) {
@@ -2503,6 +3153,17 @@ namespace eosio { namespace vm {
          emit_bytes(0x48, 0x8b, 0x24, 0x24);
       }
 
+      // Host functions and the compiler are arbitrary native code that may
+      // change the rounding mode or FTZ/DAZ.  Called after they return,
+      // between emit_align_stack and emit_restore_stack, whose second copy
+      // of the old %rsp is free.  Preserves all registers.
+      void emit_restore_mxcsr() {
+         // movl $0x1f80, 8(%rsp) // round-to-even/all exceptions masked/no exceptions set
+         emit_bytes(0xc7, 0x44, 0x24, 0x08, 0x80, 0x1f, 0x00, 0x00);
+         // ldmxcsr 8(%rsp)
+         emit_bytes(0x0f, 0xae, 0x54, 0x24, 0x08);
+      }
+
       void emit_host_call(uint32_t funcnum) {
          // mov $funcnum, %edx
          emit_bytes(0xba);
@@ -2519,6 +3180,7 @@ namespace eosio { namespace vm {
          emit_operand_ptr(&call_host_function);
          // callq *%rax
          emit_bytes(0xff, 0xd0);
+         emit_restore_mxcsr();
          emit_restore_stack();
          // popq %rsi
          emit_bytes(0x5e);
@@ -2528,6 +3190,39 @@ namespace eosio { namespace vm {
          emit_bytes(0xc3);
       }
 
+      static constexpr std::size_t lazy_entry_size = 56;
+      static constexpr std::size_t lazy_stub_size = 10;
+      // Shared by the stubs of functions that have not been compiled yet.
+      // The function index is in %edx.  The arguments are still on the
+      // stack, so the compiled function is entered with a jump.
+      void* emit_lazy_entry(lazy_state* state) {
+         void* result = code;
+         // pushq %rdi
+         emit_bytes(0x57);
+         // pushq %rsi
+         emit_bytes(0x56);
+         // mov %edx, %esi
+         emit_bytes(0x89, 0xd6);
+         // movabsq $state, %rdi
+         emit_bytes(0x48, 0xbf);
+         emit_operand_ptr(state);
+         emit_align_stack();
+         // movabsq $lazy_compile, %rax
+         emit_bytes(0x48, 0xb8);
+         emit_operand_ptr(&lazy_compile);
+         // callq *%rax
+         emit_bytes(0xff, 0xd0);
+         emit_restore_mxcsr();
+         emit_restore_stack();
+         // popq %rsi
+         emit_bytes(0x5e);
+         // popq %rdi
+         emit_bytes(0x5f);
+         // jmp *%rax
+         emit_bytes(0xff, 0xe0);
+         return result;
+      }
+
       bool is_host_function(uint32_t funcnum) { return funcnum < _mod.get_imported_functions_size(); }
 
       static native_value call_host_function(Context* context /*rdi*/, native_value* stack /*rsi*/, uint32_t idx /*edx*/) {
@@ -2540,6 +3235,14 @@ namespace eosio { namespace vm {
          return result;
       }
 
+      static void* lazy_compile(lazy_state* state /*rdi*/, uint32_t idx /*esi*/) {
+         void* result;
+         vm::longjmp_on_exception([&]() {
+            result = state->compile(idx);
+         });
+         return result;
+      }
+
       static int32_t current_memory(Context* context /*rdi*/) {
          return context->current_linear_memory();
       }
@@ -2554,5 +3257,59 @@ namespace eosio { namespace vm {
       static void on_type_error() { vm::throw_<wasm_interpreter_exception>( "call_indirect incorrect function type" ); }
       static void on_stack_overflow() { vm::throw_<wasm_interpreter_exception>( "stack overflow" ); }
    };
+
+   template<typename Context>
+   struct machine_code_writer<Context>::lazy_state {
+      lazy_state(const machine_code_writer& parent, lazy_compile_fn compile_body) :
+         worker(parent, worker_tag{}), compile_body(std::move(compile_body)),
+         segment_base(static_cast<unsigned char*>(parent._code_segment_base)) {}
+
+      // Compiles the function and links it into the reserved code space.
+      // Returns the address of the new code.
+      void* compile(uint32_t idx) {
+         module& mod = worker._mod;
+         const uint32_t funcnum = idx + mod.get_imported_functions_size();
+         compile_body(worker, idx);
+         compiled_function func = worker.release_function();
+
+         // Addresses that were recorded while the module was being
+         // compiled are relative to segment_base.
+         auto* base = reinterpret_cast<unsigned char*>(mod.allocator._code_base);
+         const std::size_t offset = next_offset;
+         EOS_VM_ASSERT(offset + func.code.size() <= mod.allocator._code_size, wasm_bad_alloc, "lazy jit code space exhausted");
+         unsigned char* dest = base + offset;
+         mod.allocator.update_code([&]() {
+            std::memcpy(dest, func.code.data(), func.code.size());
+            for (auto [o, target] : func.external_targets)
+               fix_branch(dest + o, base + (static_cast<unsigned char*>(target) - segment_base));
+            for (auto [o, callee] : func.calls) {
+               fix_branch(dest + o, base + offsets[callee]);
+               if (!compiled[callee])
+                  callers[callee].push_back(offset + o);
+            }
+            // Replace the stub with a jump to the new code
+            unsigned char* stub = base + offsets[funcnum];
+            stub[0] = 0xe9; // jmp
+            fix_branch(stub + 1, dest);
+            for (std::size_t site : callers[funcnum])
+               fix_branch(base + site, dest);
+         });
+         callers[funcnum] = {};
+         offsets[funcnum] = offset;
+         compiled[funcnum] = true;
+         next_offset += func.code.size();
+         mod.code[idx].jit_code_offset = offset;
+         return dest;
+      }
+
+      machine_code_writer worker;
+      lazy_compile_fn compile_body;
+      unsigned char* segment_base;
+      // Indexed by function number, including imports.
+      std::vector<std::size_t> offsets; // The stub until the function is compiled
+      std::vector<bool> compiled;
+      std::vector<std::vector<std::size_t>> callers; // Direct calls to the stub
+      std::size_t next_offset = 0;
+   };
    
 }}
@@ -2,6 +2,8 @@
 
 #include <catch2/catch.hpp>
 
+#include <algorithm>
+
 using namespace eosio;
 using namespace eosio::vm;
 
@@ -97,3 +99,92 @@ TEST_CASE("Testing reclaim", "[growable_allocator]") {
    int * ptr2 = alloc.alloc<int>(10);
    CHECK(ptr2 == ptr1 + 2);
 }
+
+namespace {
+   bool is_zero(const char* ptr, std::size_t size) {
+      return std::all_of(ptr, ptr + size, [](char c) { return c == 0; });
+   }
+} // namespace
+
+TEST_CASE("Testing wasm_allocator reset policies", "[wasm_allocator]") {
+   for (auto policy : { wasm_allocator::zero_all, wasm_allocator::zero_resident, wasm_allocator::decommit }) {
+      wasm_allocator alloc(policy);
+      CHECK(alloc.get_reset_policy() == policy);
+      alloc.reset(4);
+      alloc.alloc<char>(4);
+      char* base = alloc.get_base_ptr<char>();
+      base[0] = 1;
+      base[page_size + 100] = 2;
+      base[4 * page_size - 1] = 3;
+
+      // Shrinking clears the pages that are released
+      alloc.free<char>(1);
+      alloc.alloc<char>(1);
+      CHECK(is_zero(base + 3 * page_size, page_size));
+      base[3 * page_size] = 4;
+
+      alloc.reset(4);
+      alloc.alloc<char>(4);
+      CHECK(is_zero(base, 4 * page_size));
+
+      // Growing past the previous size
+      base[2 * page_size] = 5;
+      alloc.reset();
+      alloc.reset(2);
+      alloc.alloc<char>(6);
+      CHECK(is_zero(base, 6 * page_size));
+      alloc.free();
+   }
+}
+
+#ifdef __linux__
+namespace {
+   std::size_t resident_bytes(char* base, std::size_t size) {
+      std::size_t syspagesize = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+      std::vector<unsigned char> residency(size / syspagesize);
+      CHECK(mincore(base, size, residency.data()) == 0);
+      return std::count_if(residency.begin(), residency.end(), [](unsigned char r) { return r & 1; }) * syspagesize;
+   }
+} // namespace
+
+TEST_CASE("Testing wasm_allocator reset cost does not carry over", "[wasm_allocator]") {
+   for (auto policy : { wasm_allocator::decommit, wasm_allocator::zero_resident }) {
+      wasm_allocator alloc(policy);
+      alloc.reset(32);
+      alloc.alloc<char>(32);
+      char* base = alloc.get_base_ptr<char>();
+      const std::size_t size = 32 * page_size;
+
+      // A large instance touches all of its memory
+      memset(base, 1, size);
+      alloc.reset(32);
+      alloc.alloc<char>(32);
+      CHECK(resident_bytes(base, size) == 0);
+
+      // Later small instances only keep their own pages
+      for (int i = 0; i < 3; ++i) {
+         base[i * page_size] = 1;
+         alloc.reset(32);
+         alloc.alloc<char>(32);
+         CHECK(resident_bytes(base, size) <= (policy == wasm_allocator::decommit ? 0 : wasm_allocator::zero_resident_limit));
+      }
+      CHECK(is_zero(base, size));
+      alloc.free();
+   }
+}
+
+TEST_CASE("Testing wasm_allocator decommit releases pages", "[wasm_allocator]") {
+   wasm_allocator alloc(wasm_allocator::decommit);
+   alloc.reset(1);
+   alloc.alloc<char>(1);
+   char* base = alloc.get_base_ptr<char>();
+   base[0] = 1;
+   alloc.reset(1);
+   alloc.alloc<char>(1);
+   unsigned char resident = 1;
+   CHECK(mincore(base, 1, &resident) == 0);
+   CHECK((resident & 1) == 0);
+   CHECK(base[0] == 0);
+   alloc.free();
+}
+#endif
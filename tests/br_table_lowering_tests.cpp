@@ -0,0 +1,122 @@
+#include <eosio/vm/backend.hpp>
+
+#include "utils.hpp"
+#include <catch2/catch.hpp>
+
+#include <vector>
+
+using namespace eosio;
+using namespace eosio::vm;
+
+extern wasm_allocator wa;
+
+namespace {
+   struct br_table_shape {
+      const char*           name_suffix;
+      std::vector<uint32_t> targets; // the label of each case, 0 being the outermost
+      uint32_t              default_target;
+   };
+   // Three tables: just below the JIT's jump table threshold, at it and
+   // well above it with repeated targets.
+   const std::vector<br_table_shape> br_table_shapes = {
+      { "3", { 0, 3, 1 }, 2 },
+      { "4", { 3, 0, 2, 1 }, 3 },
+      { "9", { 4, 4, 0, 1, 2, 3, 0, 2, 4 }, 1 }
+   };
+
+   // For each table and each of void, i32 and i64 labels, a function
+   // (param i32) (result i32) nests one block per label.  Each block holds
+   // a value below the next, so every case pops a different number of
+   // values.  For example, "i32_3" is
+   //   (block $0 (result i32)
+   //     (i32.const 2)
+   //     (block $1 (result i32)
+   //       (i32.const 4)
+   //       (block $2 (result i32)
+   //         (i32.const 8)
+   //         (block $3 (result i32)
+   //           (i64.const 7) (i32.const 1000)
+   //           (br_table $0 $3 $1 $2 (local.get 0)))
+   //         (i32.add))
+   //       (i32.add))
+   //     (i32.add))
+   //   (i32.add (i32.const 1))
+   // so that leaving label t returns 1000 + 2^(t+1) - 1.  The void
+   // functions add the same values to a local instead, and the i64
+   // functions wrap their result.
+   std::vector<uint8_t> br_table_wasm = {
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x06, 0x01, 0x60,
+      0x01, 0x7f, 0x01, 0x7f, 0x03, 0x0a, 0x09, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x07, 0x4c, 0x09, 0x06, 0x76, 0x6f, 0x69, 0x64,
+      0x5f, 0x33, 0x00, 0x00, 0x06, 0x76, 0x6f, 0x69, 0x64, 0x5f, 0x34, 0x00,
+      0x01, 0x06, 0x76, 0x6f, 0x69, 0x64, 0x5f, 0x39, 0x00, 0x02, 0x05, 0x69,
+      0x33, 0x32, 0x5f, 0x33, 0x00, 0x03, 0x05, 0x69, 0x33, 0x32, 0x5f, 0x34,
+      0x00, 0x04, 0x05, 0x69, 0x33, 0x32, 0x5f, 0x39, 0x00, 0x05, 0x05, 0x69,
+      0x36, 0x34, 0x5f, 0x33, 0x00, 0x06, 0x05, 0x69, 0x36, 0x34, 0x5f, 0x34,
+      0x00, 0x07, 0x05, 0x69, 0x36, 0x34, 0x5f, 0x39, 0x00, 0x08, 0x0a, 0xe2,
+      0x03, 0x09, 0x3f, 0x01, 0x01, 0x7f, 0x02, 0x40, 0x41, 0x05, 0x02, 0x40,
+      0x41, 0x05, 0x02, 0x40, 0x41, 0x05, 0x02, 0x40, 0x42, 0x07, 0x41, 0x03,
+      0x20, 0x00, 0x0e, 0x03, 0x03, 0x00, 0x02, 0x01, 0x0b, 0x1a, 0x20, 0x01,
+      0x41, 0x08, 0x6a, 0x21, 0x01, 0x0b, 0x1a, 0x20, 0x01, 0x41, 0x04, 0x6a,
+      0x21, 0x01, 0x0b, 0x1a, 0x20, 0x01, 0x41, 0x02, 0x6a, 0x21, 0x01, 0x0b,
+      0x20, 0x01, 0x41, 0x01, 0x6a, 0x0b, 0x40, 0x01, 0x01, 0x7f, 0x02, 0x40,
+      0x41, 0x05, 0x02, 0x40, 0x41, 0x05, 0x02, 0x40, 0x41, 0x05, 0x02, 0x40,
+      0x42, 0x07, 0x41, 0x03, 0x20, 0x00, 0x0e, 0x04, 0x00, 0x03, 0x01, 0x02,
+      0x00, 0x0b, 0x1a, 0x20, 0x01, 0x41, 0x08, 0x6a, 0x21, 0x01, 0x0b, 0x1a,
+      0x20, 0x01, 0x41, 0x04, 0x6a, 0x21, 0x01, 0x0b, 0x1a, 0x20, 0x01, 0x41,
+      0x02, 0x6a, 0x21, 0x01, 0x0b, 0x20, 0x01, 0x41, 0x01, 0x6a, 0x0b, 0x52,
+      0x01, 0x01, 0x7f, 0x02, 0x40, 0x41, 0x05, 0x02, 0x40, 0x41, 0x05, 0x02,
+      0x40, 0x41, 0x05, 0x02, 0x40, 0x41, 0x05, 0x02, 0x40, 0x42, 0x07, 0x41,
+      0x03, 0x20, 0x00, 0x0e, 0x09, 0x00, 0x00, 0x04, 0x03, 0x02, 0x01, 0x04,
+      0x02, 0x00, 0x03, 0x0b, 0x1a, 0x20, 0x01, 0x41, 0x10, 0x6a, 0x21, 0x01,
+      0x0b, 0x1a, 0x20, 0x01, 0x41, 0x08, 0x6a, 0x21, 0x01, 0x0b, 0x1a, 0x20,
+      0x01, 0x41, 0x04, 0x6a, 0x21, 0x01, 0x0b, 0x1a, 0x20, 0x01, 0x41, 0x02,
+      0x6a, 0x21, 0x01, 0x0b, 0x20, 0x01, 0x41, 0x01, 0x6a, 0x0b, 0x27, 0x00,
+      0x02, 0x7f, 0x41, 0x02, 0x02, 0x7f, 0x41, 0x04, 0x02, 0x7f, 0x41, 0x08,
+      0x02, 0x7f, 0x42, 0x07, 0x41, 0xe8, 0x07, 0x20, 0x00, 0x0e, 0x03, 0x03,
+      0x00, 0x02, 0x01, 0x0b, 0x6a, 0x0b, 0x6a, 0x0b, 0x6a, 0x0b, 0x41, 0x01,
+      0x6a, 0x0b, 0x28, 0x00, 0x02, 0x7f, 0x41, 0x02, 0x02, 0x7f, 0x41, 0x04,
+      0x02, 0x7f, 0x41, 0x08, 0x02, 0x7f, 0x42, 0x07, 0x41, 0xe8, 0x07, 0x20,
+      0x00, 0x0e, 0x04, 0x00, 0x03, 0x01, 0x02, 0x00, 0x0b, 0x6a, 0x0b, 0x6a,
+      0x0b, 0x6a, 0x0b, 0x41, 0x01, 0x6a, 0x0b, 0x33, 0x00, 0x02, 0x7f, 0x41,
+      0x02, 0x02, 0x7f, 0x41, 0x04, 0x02, 0x7f, 0x41, 0x08, 0x02, 0x7f, 0x41,
+      0x10, 0x02, 0x7f, 0x42, 0x07, 0x41, 0xe8, 0x07, 0x20, 0x00, 0x0e, 0x09,
+      0x00, 0x00, 0x04, 0x03, 0x02, 0x01, 0x04, 0x02, 0x00, 0x03, 0x0b, 0x6a,
+      0x0b, 0x6a, 0x0b, 0x6a, 0x0b, 0x6a, 0x0b, 0x41, 0x01, 0x6a, 0x0b, 0x28,
+      0x00, 0x02, 0x7e, 0x42, 0x02, 0x02, 0x7e, 0x42, 0x04, 0x02, 0x7e, 0x42,
+      0x08, 0x02, 0x7e, 0x42, 0x07, 0x42, 0xe8, 0x07, 0x20, 0x00, 0x0e, 0x03,
+      0x03, 0x00, 0x02, 0x01, 0x0b, 0x7c, 0x0b, 0x7c, 0x0b, 0x7c, 0x0b, 0x42,
+      0x01, 0x7c, 0xa7, 0x0b, 0x29, 0x00, 0x02, 0x7e, 0x42, 0x02, 0x02, 0x7e,
+      0x42, 0x04, 0x02, 0x7e, 0x42, 0x08, 0x02, 0x7e, 0x42, 0x07, 0x42, 0xe8,
+      0x07, 0x20, 0x00, 0x0e, 0x04, 0x00, 0x03, 0x01, 0x02, 0x00, 0x0b, 0x7c,
+      0x0b, 0x7c, 0x0b, 0x7c, 0x0b, 0x42, 0x01, 0x7c, 0xa7, 0x0b, 0x34, 0x00,
+      0x02, 0x7e, 0x42, 0x02, 0x02, 0x7e, 0x42, 0x04, 0x02, 0x7e, 0x42, 0x08,
+      0x02, 0x7e, 0x42, 0x10, 0x02, 0x7e, 0x42, 0x07, 0x42, 0xe8, 0x07, 0x20,
+      0x00, 0x0e, 0x09, 0x00, 0x00, 0x04, 0x03, 0x02, 0x01, 0x04, 0x02, 0x00,
+      0x03, 0x0b, 0x7c, 0x0b, 0x7c, 0x0b, 0x7c, 0x0b, 0x7c, 0x0b, 0x42, 0x01,
+      0x7c, 0xa7, 0x0b
+   };
+
+   uint32_t expected_result(const std::string& kind, uint32_t target) {
+      uint32_t result = (2u << target) - 1;
+      return kind == "void" ? result : result + 1000;
+   }
+} // namespace
+
+BACKEND_TEST_CASE("Testing br_table cases and defaults", "[br_table_lowering_tests]") {
+   backend<std::nullptr_t, TestType> bkend(br_table_wasm);
+   bkend.set_wasm_allocator(&wa);
+   bkend.initialize(nullptr);
+
+   for (std::string kind : { "void", "i32", "i64" }) {
+      for (const auto& shape : br_table_shapes) {
+         std::string func = kind + "_" + shape.name_suffix;
+         for (uint32_t i = 0; i < shape.targets.size(); ++i)
+            CHECK(bkend.call_with_return(nullptr, "env", func, i)->to_ui32() == expected_result(kind, shape.targets[i]));
+         // Out of range indices go to the default
+         for (uint32_t i : { static_cast<uint32_t>(shape.targets.size()), static_cast<uint32_t>(shape.targets.size() + 1),
+                             UINT32_C(0x80000000), UINT32_C(0xFFFFFFFF) })
+            CHECK(bkend.call_with_return(nullptr, "env", func, i)->to_ui32() == expected_result(kind, shape.default_target));
+      }
+   }
+}
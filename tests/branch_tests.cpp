@@ -0,0 +1,100 @@
+#include <eosio/vm/backend.hpp>
+
+#include "utils.hpp"
+#include <catch2/catch.hpp>
+
+using namespace eosio;
+using namespace eosio::vm;
+
+extern wasm_allocator wa;
+
+namespace {
+   // Branches that leave dead values on the stack, from the spec's br, if and
+   // unwind tests.  Every function is (param i32 i32) (result i32).
+   // (func (export "as-br_if-value-cond")
+   //   (block (result i32) (drop (br_if 0 (i32.const 6) (br 0 (i32.const 9)))) (i32.const 7)))
+   // (func (export "as-br_table-value-index")
+   //   (block (result i32) (br_table 0 0 (i32.const 6) (br 0 (i32.const 11))) (i32.const 7)))
+   // (func (export "as-if-else")
+   //   (block (result i32) (if (result i32) (local.get 0) (then (local.get 1)) (else (br 1 (i32.const 4))))))
+   // (func (export "as-select-second")
+   //   (block (result i32) (select (i32.const 5) (br 0 (i32.const 6)) (local.get 0))))
+   // (func (export "break-value")
+   //   (if (result i32) (local.get 0)
+   //     (then (br 0 (i32.const 18)) (i32.const 19))
+   //     (else (br 0 (i32.const 21)) (i32.const 20))))
+   // (func (export "unwind-by-br-value")
+   //   (block (result i32) (i32.const 3) (i64.const 1) (br 0 (i32.const 9))))
+   // (func (export "unwind-by-br_table-value")
+   //   (block (result i32) (i32.const 3) (i64.const 1) (br_table 0 (i32.const 9) (i32.const 0))))
+   // (func (export "unwind-local")
+   //   (block (result i32) (local.get 1) (br 0 (i32.const 9))))
+   // (func (export "br_if-nested")
+   //   (block (result i32) (block (result i32) (local.get 1) (drop (br_if 1 (i32.const 9) (local.get 0))))))
+   // (func (export "br_table-nested")
+   //   (block (result i32)
+   //     (i32.add (block (result i32) (local.get 1) (br_table 0 1 0 (i32.const 10) (local.get 0)))
+   //              (i32.const 100))))
+   std::vector<uint8_t> branch_wasm = {
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x07, 0x01, 0x60,
+      0x02, 0x7f, 0x7f, 0x01, 0x7f, 0x03, 0x0b, 0x0a, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x07, 0xbf, 0x01, 0x0a, 0x13, 0x61,
+      0x73, 0x2d, 0x62, 0x72, 0x5f, 0x69, 0x66, 0x2d, 0x76, 0x61, 0x6c, 0x75,
+      0x65, 0x2d, 0x63, 0x6f, 0x6e, 0x64, 0x00, 0x00, 0x17, 0x61, 0x73, 0x2d,
+      0x62, 0x72, 0x5f, 0x74, 0x61, 0x62, 0x6c, 0x65, 0x2d, 0x76, 0x61, 0x6c,
+      0x75, 0x65, 0x2d, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x00, 0x01, 0x0a, 0x61,
+      0x73, 0x2d, 0x69, 0x66, 0x2d, 0x65, 0x6c, 0x73, 0x65, 0x00, 0x02, 0x10,
+      0x61, 0x73, 0x2d, 0x73, 0x65, 0x6c, 0x65, 0x63, 0x74, 0x2d, 0x73, 0x65,
+      0x63, 0x6f, 0x6e, 0x64, 0x00, 0x03, 0x0b, 0x62, 0x72, 0x65, 0x61, 0x6b,
+      0x2d, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x00, 0x04, 0x12, 0x75, 0x6e, 0x77,
+      0x69, 0x6e, 0x64, 0x2d, 0x62, 0x79, 0x2d, 0x62, 0x72, 0x2d, 0x76, 0x61,
+      0x6c, 0x75, 0x65, 0x00, 0x05, 0x18, 0x75, 0x6e, 0x77, 0x69, 0x6e, 0x64,
+      0x2d, 0x62, 0x79, 0x2d, 0x62, 0x72, 0x5f, 0x74, 0x61, 0x62, 0x6c, 0x65,
+      0x2d, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x00, 0x06, 0x0c, 0x75, 0x6e, 0x77,
+      0x69, 0x6e, 0x64, 0x2d, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x00, 0x07, 0x0c,
+      0x62, 0x72, 0x5f, 0x69, 0x66, 0x2d, 0x6e, 0x65, 0x73, 0x74, 0x65, 0x64,
+      0x00, 0x08, 0x0f, 0x62, 0x72, 0x5f, 0x74, 0x61, 0x62, 0x6c, 0x65, 0x2d,
+      0x6e, 0x65, 0x73, 0x74, 0x65, 0x64, 0x00, 0x09, 0x0a, 0xaf, 0x01, 0x0a,
+      0x10, 0x00, 0x02, 0x7f, 0x41, 0x06, 0x41, 0x09, 0x0c, 0x00, 0x0d, 0x00,
+      0x1a, 0x41, 0x07, 0x0b, 0x0b, 0x11, 0x00, 0x02, 0x7f, 0x41, 0x06, 0x41,
+      0x0b, 0x0c, 0x00, 0x0e, 0x01, 0x00, 0x00, 0x41, 0x07, 0x0b, 0x0b, 0x11,
+      0x00, 0x02, 0x7f, 0x20, 0x00, 0x04, 0x7f, 0x20, 0x01, 0x05, 0x41, 0x04,
+      0x0c, 0x01, 0x0b, 0x0b, 0x0b, 0x0e, 0x00, 0x02, 0x7f, 0x41, 0x05, 0x41,
+      0x06, 0x0c, 0x00, 0x20, 0x00, 0x1b, 0x0b, 0x0b, 0x14, 0x00, 0x20, 0x00,
+      0x04, 0x7f, 0x41, 0x12, 0x0c, 0x00, 0x41, 0x13, 0x05, 0x41, 0x15, 0x0c,
+      0x00, 0x41, 0x14, 0x0b, 0x0b, 0x0d, 0x00, 0x02, 0x7f, 0x41, 0x03, 0x42,
+      0x01, 0x41, 0x09, 0x0c, 0x00, 0x0b, 0x0b, 0x10, 0x00, 0x02, 0x7f, 0x41,
+      0x03, 0x42, 0x01, 0x41, 0x09, 0x41, 0x00, 0x0e, 0x00, 0x00, 0x0b, 0x0b,
+      0x0b, 0x00, 0x02, 0x7f, 0x20, 0x01, 0x41, 0x09, 0x0c, 0x00, 0x0b, 0x0b,
+      0x11, 0x00, 0x02, 0x7f, 0x02, 0x7f, 0x20, 0x01, 0x41, 0x09, 0x20, 0x00,
+      0x0d, 0x01, 0x1a, 0x0b, 0x0b, 0x0b, 0x17, 0x00, 0x02, 0x7f, 0x02, 0x7f,
+      0x20, 0x01, 0x41, 0x0a, 0x20, 0x00, 0x0e, 0x02, 0x00, 0x01, 0x00, 0x0b,
+      0x41, 0xe4, 0x00, 0x6a, 0x0b, 0x0b
+   };
+} // namespace
+
+BACKEND_TEST_CASE("Testing branches that leave values on the stack", "[branch_tests]") {
+   backend<std::nullptr_t, TestType> bkend(branch_wasm);
+   bkend.set_wasm_allocator(&wa);
+   bkend.initialize(nullptr);
+
+   auto call = [&](const char* func, uint32_t a, uint32_t b) {
+      return bkend.call_with_return(nullptr, "env", func, a, b)->to_ui32();
+   };
+   CHECK(call("as-br_if-value-cond", 0, 0) == 9);
+   CHECK(call("as-br_table-value-index", 0, 0) == 11);
+   CHECK(call("as-if-else", 0, 6) == 4);
+   CHECK(call("as-if-else", 1, 6) == 6);
+   CHECK(call("as-select-second", 0, 0) == 6);
+   CHECK(call("as-select-second", 1, 0) == 6);
+   CHECK(call("break-value", 1, 0) == 18);
+   CHECK(call("break-value", 0, 0) == 21);
+   CHECK(call("unwind-by-br-value", 0, 0) == 9);
+   CHECK(call("unwind-by-br_table-value", 0, 0) == 9);
+   CHECK(call("unwind-local", 0, 6) == 9);
+   CHECK(call("br_if-nested", 0, 6) == 6);
+   CHECK(call("br_if-nested", 1, 6) == 9);
+   CHECK(call("br_table-nested", 0, 6) == 110);
+   CHECK(call("br_table-nested", 1, 6) == 10);
+   CHECK(call("br_table-nested", 2, 6) == 110);
+}
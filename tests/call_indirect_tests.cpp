@@ -0,0 +1,69 @@
+#include <eosio/vm/backend.hpp>
+
+#include "utils.hpp"
+#include <catch2/catch.hpp>
+
+using namespace eosio;
+using namespace eosio::vm;
+
+extern wasm_allocator wa;
+
+namespace {
+   // (type $i32 (func (result i32)))
+   // (type $i64 (func (result i64)))
+   // (table 6 anyfunc)
+   // (elem (i32.const 2) $eleven $thirty_three $twenty_two)
+   // (func (export "call_i32") (param i32) (result i32)
+   //   (call_indirect (type $i32) (local.get 0)))
+   // (func (export "call_i64") (param i32) (result i32)
+   //   (i32.wrap_i64 (call_indirect (type $i64) (local.get 0))))
+   // (func $eleven (result i32) (i32.const 11))
+   // (func $twenty_two (result i32) (i32.const 22))
+   // (func $thirty_three (result i64) (i64.const 33))
+   std::vector<uint8_t> call_indirect_wasm = {
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x0e, 0x03, 0x60,
+      0x01, 0x7f, 0x01, 0x7f, 0x60, 0x00, 0x01, 0x7f, 0x60, 0x00, 0x01, 0x7e,
+      0x03, 0x06, 0x05, 0x00, 0x00, 0x01, 0x01, 0x02, 0x04, 0x04, 0x01, 0x70,
+      0x00, 0x06, 0x07, 0x17, 0x02, 0x08, 0x63, 0x61, 0x6c, 0x6c, 0x5f, 0x69,
+      0x33, 0x32, 0x00, 0x00, 0x08, 0x63, 0x61, 0x6c, 0x6c, 0x5f, 0x69, 0x36,
+      0x34, 0x00, 0x01, 0x09, 0x09, 0x01, 0x00, 0x41, 0x02, 0x0b, 0x03, 0x02,
+      0x04, 0x03, 0x0a, 0x21, 0x05, 0x07, 0x00, 0x20, 0x00, 0x11, 0x01, 0x00,
+      0x0b, 0x08, 0x00, 0x20, 0x00, 0x11, 0x02, 0x00, 0xa7, 0x0b, 0x04, 0x00,
+      0x41, 0x0b, 0x0b, 0x04, 0x00, 0x41, 0x16, 0x0b, 0x04, 0x00, 0x42, 0x21,
+      0x0b
+   };
+} // namespace
+
+BACKEND_TEST_CASE("Testing call_indirect through an elem segment", "[call_indirect_tests]") {
+   backend<std::nullptr_t, TestType> bkend(call_indirect_wasm);
+   bkend.set_wasm_allocator(&wa);
+   bkend.initialize(nullptr);
+
+   CHECK(bkend.call_with_return(nullptr, "env", "call_i32", UINT32_C(2))->to_ui32() == 11);
+   CHECK(bkend.call_with_return(nullptr, "env", "call_i32", UINT32_C(4))->to_ui32() == 22);
+   CHECK(bkend.call_with_return(nullptr, "env", "call_i64", UINT32_C(3))->to_ui32() == 33);
+}
+
+BACKEND_TEST_CASE("Testing call_indirect traps", "[call_indirect_tests]") {
+   backend<std::nullptr_t, TestType> bkend(call_indirect_wasm);
+   bkend.set_wasm_allocator(&wa);
+   bkend.initialize(nullptr);
+
+   // Signature mismatch
+   CHECK_THROWS_AS(bkend.call(nullptr, "env", "call_i32", UINT32_C(3)), std::exception);
+   CHECK_THROWS_AS(bkend.call(nullptr, "env", "call_i64", UINT32_C(2)), std::exception);
+   CHECK_THROWS_AS(bkend.call(nullptr, "env", "call_i64", UINT32_C(4)), std::exception);
+   // Elements that no segment initializes
+   for (uint32_t i : { 0, 1, 5 }) {
+      CHECK_THROWS_AS(bkend.call(nullptr, "env", "call_i32", i), std::exception);
+      CHECK_THROWS_AS(bkend.call(nullptr, "env", "call_i64", i), std::exception);
+   }
+   // Out of range
+   for (uint32_t i : { UINT32_C(6), UINT32_C(7), UINT32_C(0x80000000), UINT32_C(0xFFFFFFFF) }) {
+      CHECK_THROWS_AS(bkend.call(nullptr, "env", "call_i32", i), std::exception);
+      CHECK_THROWS_AS(bkend.call(nullptr, "env", "call_i64", i), std::exception);
+   }
+
+   // The table still works after the traps
+   CHECK(bkend.call_with_return(nullptr, "env", "call_i32", UINT32_C(2))->to_ui32() == 11);
+}
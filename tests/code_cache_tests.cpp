@@ -0,0 +1,144 @@
+#include <eosio/vm/backend.hpp>
+
+#include "sum_loop.wasm.hpp"
+#include "utils.hpp"
+#include <catch2/catch.hpp>
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace eosio;
+using namespace eosio::vm;
+
+extern wasm_allocator wa;
+
+namespace {
+   struct temp_dir {
+      temp_dir() {
+         char name[] = "/tmp/eos-vm-code-cache-XXXXXX";
+         REQUIRE(mkdtemp(name));
+         path = name;
+      }
+      ~temp_dir() {
+         for (const std::string& f : files())
+            ::unlink(f.c_str());
+         ::rmdir(path.c_str());
+      }
+      std::vector<std::string> files() const {
+         std::vector<std::string> result;
+         if (DIR* d = ::opendir(path.c_str())) {
+            while (dirent* e = ::readdir(d))
+               if (e->d_name[0] != '.')
+                  result.push_back(path + "/" + e->d_name);
+            ::closedir(d);
+         }
+         return result;
+      }
+      std::string path;
+   };
+
+   ino_t inode(const std::string& path) {
+      struct stat st;
+      REQUIRE(::stat(path.c_str(), &st) == 0);
+      return st.st_ino;
+   }
+
+   void check_module(backend<std::nullptr_t, jit>& bkend) {
+      bkend.set_wasm_allocator(&wa);
+      bkend.initialize(nullptr);
+      for (uint32_t i = 1; i <= 3; ++i) {
+         CHECK(bkend.call_with_return(nullptr, "env", "sum", UINT32_C(4))->to_ui32() == 10);
+         CHECK(bkend.call_with_return(nullptr, "env", "g")->to_ui32() == i * 4);
+         CHECK(bkend.call_with_return(nullptr, "env", "load")->to_ui32() == i * 10);
+      }
+   }
+}
+
+TEST_CASE("Testing the jit code cache", "[code_cache_tests]") {
+   temp_dir dir;
+   compile_options options;
+   options.code_cache_dir = dir.path;
+
+   {
+      backend<std::nullptr_t, jit> bkend(sum_loop_wasm, nullptr, options);
+      check_module(bkend);
+   }
+   REQUIRE(dir.files().size() == 1);
+   const std::string entry = dir.files()[0];
+   const ino_t       saved = inode(entry);
+
+   // A cache hit does not write the entry again
+   {
+      backend<std::nullptr_t, jit> bkend(sum_loop_wasm, nullptr, options);
+      check_module(bkend);
+   }
+   CHECK(inode(entry) == saved);
+
+   // A damaged entry is ignored and replaced
+   REQUIRE(::truncate(entry.c_str(), 100) == 0);
+   {
+      backend<std::nullptr_t, jit> bkend(sum_loop_wasm, nullptr, options);
+      check_module(bkend);
+   }
+   CHECK(inode(entry) != saved);
+   {
+      backend<std::nullptr_t, jit> bkend(sum_loop_wasm, nullptr, options);
+      check_module(bkend);
+   }
+
+   // So is one whose code was changed without changing its size
+   const ino_t rewritten = inode(entry);
+   {
+      std::FILE* f = std::fopen(entry.c_str(), "r+b");
+      REQUIRE(f);
+      REQUIRE(std::fseek(f, -1, SEEK_END) == 0);
+      int last = std::fgetc(f);
+      REQUIRE(std::fseek(f, -1, SEEK_END) == 0);
+      std::fputc(last ^ 0xFF, f);
+      REQUIRE(std::fclose(f) == 0);
+   }
+   {
+      backend<std::nullptr_t, jit> bkend(sum_loop_wasm, nullptr, options);
+      check_module(bkend);
+   }
+   CHECK(inode(entry) != rewritten);
+}
+
+TEST_CASE("Testing concurrent stores to the jit code cache", "[code_cache_tests]") {
+   temp_dir dir;
+   compile_options options;
+   options.code_cache_dir = dir.path;
+
+   std::vector<std::thread> threads;
+   for (int i = 0; i < 8; ++i)
+      threads.emplace_back([&] {
+         for (int j = 0; j < 4; ++j)
+            backend<std::nullptr_t, jit>(sum_loop_wasm, nullptr, options);
+      });
+   for (std::thread& t : threads)
+      t.join();
+
+   // Every temporary file was either renamed or removed
+   CHECK(dir.files().size() == 1);
+   backend<std::nullptr_t, jit> bkend(sum_loop_wasm, nullptr, options);
+   check_module(bkend);
+}
+
+TEST_CASE("Testing that invalid modules are not cached", "[code_cache_tests]") {
+   temp_dir dir;
+   compile_options options;
+   options.code_cache_dir = dir.path;
+
+   auto code = sum_loop_wasm;
+   // (global.get $g) becomes (global.get 1)
+   code[code.size() - 10] = 0x01;
+   CHECK_THROWS(backend<std::nullptr_t, jit>(code, nullptr, options));
+   CHECK(dir.files().empty());
+}
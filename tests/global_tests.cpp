@@ -0,0 +1,76 @@
+#include <eosio/vm/backend.hpp>
+
+#include "utils.hpp"
+#include <catch2/catch.hpp>
+
+using namespace eosio;
+using namespace eosio::vm;
+
+extern wasm_allocator wa;
+
+namespace {
+   // (global $mi32 (mut i32) (i32.const 5))       (global $ci32 i32 (i32.const 7))
+   // (global $mi64 (mut i64) (i64.const -3))      (global $ci64 i64 (i64.const 0x100000000))
+   // (global $mf32 (mut f32) (f32.const 1.5))     (global $cf32 f32 (f32.const 2.5))
+   // (global $mf64 (mut f64) (f64.const 3.25))    (global $cf64 f64 (f64.const -0.5))
+   // for each type T in i32, i64, f32, f64:
+   // (func (export "T") (param T) (result T)
+   //   (global.set $mT (T.add (global.get $mT) (local.get 0)))
+   //   (T.add (global.get $mT) (global.get $cT)))
+   std::vector<uint8_t> global_wasm = {
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x15, 0x04, 0x60,
+      0x01, 0x7f, 0x01, 0x7f, 0x60, 0x01, 0x7e, 0x01, 0x7e, 0x60, 0x01, 0x7d,
+      0x01, 0x7d, 0x60, 0x01, 0x7c, 0x01, 0x7c, 0x03, 0x05, 0x04, 0x00, 0x01,
+      0x02, 0x03, 0x06, 0x41, 0x08, 0x7f, 0x01, 0x41, 0x05, 0x0b, 0x7f, 0x00,
+      0x41, 0x07, 0x0b, 0x7e, 0x01, 0x42, 0x7d, 0x0b, 0x7e, 0x00, 0x42, 0x80,
+      0x80, 0x80, 0x80, 0x10, 0x0b, 0x7d, 0x01, 0x43, 0x00, 0x00, 0xc0, 0x3f,
+      0x0b, 0x7d, 0x00, 0x43, 0x00, 0x00, 0x20, 0x40, 0x0b, 0x7c, 0x01, 0x44,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0a, 0x40, 0x0b, 0x7c, 0x00, 0x44,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xe0, 0xbf, 0x0b, 0x07, 0x19, 0x04,
+      0x03, 0x69, 0x33, 0x32, 0x00, 0x00, 0x03, 0x69, 0x36, 0x34, 0x00, 0x01,
+      0x03, 0x66, 0x33, 0x32, 0x00, 0x02, 0x03, 0x66, 0x36, 0x34, 0x00, 0x03,
+      0x0a, 0x3d, 0x04, 0x0e, 0x00, 0x23, 0x00, 0x20, 0x00, 0x6a, 0x24, 0x00,
+      0x23, 0x00, 0x23, 0x01, 0x6a, 0x0b, 0x0e, 0x00, 0x23, 0x02, 0x20, 0x00,
+      0x7c, 0x24, 0x02, 0x23, 0x02, 0x23, 0x03, 0x7c, 0x0b, 0x0e, 0x00, 0x23,
+      0x04, 0x20, 0x00, 0x92, 0x24, 0x04, 0x23, 0x04, 0x23, 0x05, 0x92, 0x0b,
+      0x0e, 0x00, 0x23, 0x06, 0x20, 0x00, 0xa0, 0x24, 0x06, 0x23, 0x06, 0x23,
+      0x07, 0xa0, 0x0b
+   };
+} // namespace
+
+BACKEND_TEST_CASE("Testing global variables", "[global_tests]") {
+   backend<std::nullptr_t, TestType> bkend(global_wasm);
+   bkend.set_wasm_allocator(&wa);
+   bkend.initialize(nullptr);
+
+   for (int i = 0; i < 2; ++i) {
+      CHECK(bkend.call_with_return(nullptr, "env", "i32", UINT32_C(1))->to_ui32() == 13);
+      CHECK(bkend.call_with_return(nullptr, "env", "i32", UINT32_C(1))->to_ui32() == 14);
+      CHECK(bkend.call_with_return(nullptr, "env", "i64", INT64_C(1))->to_i64() == INT64_C(0xFFFFFFFE));
+      CHECK(bkend.call_with_return(nullptr, "env", "i64", INT64_C(-1))->to_i64() == INT64_C(0xFFFFFFFD));
+      CHECK(bkend.call_with_return(nullptr, "env", "f32", 1.0f)->to_f32() == 5.0f);
+      CHECK(bkend.call_with_return(nullptr, "env", "f32", 1.0f)->to_f32() == 6.0f);
+      CHECK(bkend.call_with_return(nullptr, "env", "f64", 1.0)->to_f64() == 3.75);
+      CHECK(bkend.call_with_return(nullptr, "env", "f64", 1.0)->to_f64() == 4.75);
+
+      const module& mod = bkend.get_module();
+      CHECK(mod.globals[0].current.value.i32 == 7);
+      CHECK(mod.globals[1].current.value.i32 == 7);
+      CHECK(mod.globals[2].current.value.i64 == -3);
+
+      // Mutable globals return to their initial values
+      bkend.initialize(nullptr);
+   }
+}
+
+TEST_CASE("Testing interpreter global accesses are resolved when parsing", "[global_tests]") {
+   backend<std::nullptr_t, interpreter> bkend(global_wasm);
+   module& mod = bkend.get_module();
+   for (uint32_t i = 0; i < mod.code.size(); ++i) {
+      const uint8_t* end = mod.code[i].code + mod.code[i].size;
+      for (const uint8_t* pos = mod.code[i].code; pos < end; pos = visit_instruction([](const auto&) {}, pos)) {
+         CHECK(*pos != opcodes::get_global);
+         CHECK(*pos != opcodes::set_global);
+      }
+   }
+}
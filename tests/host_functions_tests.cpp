@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cfenv>
 #include <vector>
 #include <iterator>
 #include <cstdlib>
@@ -560,3 +561,62 @@ BACKEND_TEST_CASE( "Testing exiting host functions", "[host_functions_exit_test]
    bkend.initialize();
    CHECK(!bkend.call_with_return(&host, "env", "test", UINT32_C(2)));
 }
+
+TEST_CASE( "Testing interpreter argument checks", "[interpreter_argument_check]" ) {
+   // (func (export "id") (param i32) (result i32) (local.get 0))
+   wasm_code code = {
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x06, 0x01, 0x60, 0x01, 0x7f, 0x01, 0x7f,
+      0x03, 0x02, 0x01, 0x00, 0x07, 0x06, 0x01, 0x02, 0x69, 0x64, 0x00, 0x00, 0x0a, 0x06, 0x01, 0x04,
+      0x00, 0x20, 0x00, 0x0b
+   };
+   backend<std::nullptr_t, interpreter> bkend( code );
+   bkend.set_wasm_allocator( &wa );
+   bkend.initialize(nullptr);
+
+   auto result = bkend.call_with_return(nullptr, "env", "id", UINT32_C(42));
+   REQUIRE(result);
+   CHECK(result->is_a<i32_const_t>());
+   CHECK(result->to_ui32() == 42);
+   CHECK_THROWS_AS(bkend.call(nullptr, "env", "id", UINT64_C(42)), wasm_interpreter_exception);
+   CHECK_THROWS_AS(bkend.call(nullptr, "env", "id", 42.0f), wasm_interpreter_exception);
+   CHECK_THROWS_AS(bkend.call(nullptr, "env", "id"), wasm_interpreter_exception);
+   CHECK_THROWS_AS(bkend.call(nullptr, "env", "id", UINT32_C(1), UINT32_C(2)), wasm_interpreter_exception);
+   CHECK(bkend.call_with_return(nullptr, "env", "id", UINT32_C(7))->to_ui32() == 7);
+}
+
+struct rounding_host_functions {
+   static void set_round_up() { std::fesetround(FE_UPWARD); }
+};
+
+// The interpreters only give consensus results with softfloat, so this is
+// only checked for the jit, which restores the rounding mode itself.
+TEST_CASE( "Testing that host functions cannot change jit rounding", "[host_functions_rounding]" ) {
+   // (import "env" "set_round_up" (func $set_round_up))
+   // (func (export "add") (param f64 f64) (result f64)
+   //   (call $set_round_up)
+   //   (f64.add (local.get 0) (local.get 1)))
+   wasm_code code = {
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x0a, 0x02, 0x60, 0x00, 0x00, 0x60, 0x02,
+      0x7c, 0x7c, 0x01, 0x7c, 0x02, 0x14, 0x01, 0x03, 0x65, 0x6e, 0x76, 0x0c, 0x73, 0x65, 0x74, 0x5f,
+      0x72, 0x6f, 0x75, 0x6e, 0x64, 0x5f, 0x75, 0x70, 0x00, 0x00, 0x03, 0x02, 0x01, 0x01, 0x07, 0x07,
+      0x01, 0x03, 0x61, 0x64, 0x64, 0x00, 0x01, 0x0a, 0x0b, 0x01, 0x09, 0x00, 0x10, 0x00, 0x20, 0x00,
+      0x20, 0x01, 0xa0, 0x0b
+   };
+   registered_function<rounding_host_functions, std::nullptr_t, &rounding_host_functions::set_round_up>("env", "set_round_up");
+
+   for (bool lazy : { false, true }) {
+      using backend_t = backend<rounding_host_functions, jit>;
+      compile_options options;
+      options.lazy = lazy;
+      backend_t bkend( code, nullptr, options );
+      bkend.set_wasm_allocator( &wa );
+      registered_host_functions<rounding_host_functions>::resolve(bkend.get_module());
+      bkend.initialize();
+
+      // 1 + 2^-60 is inexact and rounds up to the next double under FE_UPWARD
+      auto result = bkend.call_with_return(nullptr, "env", "add", 1.0, std::ldexp(1.0, -60));
+      std::fesetround(FE_TONEAREST);
+      REQUIRE(result);
+      CHECK(result->to_f64() == 1.0);
+   }
+}
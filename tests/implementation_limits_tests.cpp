@@ -44,3 +44,27 @@ BACKEND_TEST_CASE( "Test call depth", "[call_depth]") {
    CHECK(!bkend.call_with_return(nullptr, "env", "call.indirect.host", (uint32_t)249));
    CHECK_THROWS_AS(bkend.call(nullptr, "env", "call.indirect.host", (uint32_t)250), std::exception);
 }
+
+BACKEND_TEST_CASE( "Test deep operand stack", "[call_depth]") {
+   // (func (export "f") (param i32) (result i32) (local i64 x 200)
+   //   (if (result i32) (i32.eqz (local.get 0))
+   //     (then (i32.const 0))
+   //     (else (i32.add (call 0 (i32.sub (local.get 0) (i32.const 1))) (i32.const 1)))))
+   wasm_code code = {
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x06, 0x01, 0x60, 0x01, 0x7f, 0x01, 0x7f,
+      0x03, 0x02, 0x01, 0x00, 0x07, 0x05, 0x01, 0x01, 0x66, 0x00, 0x00, 0x0a, 0x1a, 0x01, 0x18, 0x01,
+      0xc8, 0x01, 0x7e, 0x20, 0x00, 0x45, 0x04, 0x7f, 0x41, 0x00, 0x05, 0x20, 0x00, 0x41, 0x01, 0x6b,
+      0x10, 0x00, 0x41, 0x01, 0x6a, 0x0b, 0x0b
+   };
+   wasm_allocator wa;
+   using backend_t = eosio::vm::backend<nullptr_t, TestType>;
+
+   backend_t bkend(code);
+   bkend.set_wasm_allocator(&wa);
+   bkend.initialize(nullptr);
+
+   // The frames need far more than the operand stack's initial size
+   CHECK(bkend.call_with_return(nullptr, "env", "f", (uint32_t)250)->to_ui32() == 250);
+   CHECK_THROWS_AS(bkend.call(nullptr, "env", "f", (uint32_t)251), std::exception);
+   CHECK(bkend.call_with_return(nullptr, "env", "f", (uint32_t)10)->to_ui32() == 10);
+}
@@ -0,0 +1,128 @@
+#include <eosio/vm/backend.hpp>
+
+#include "utils.hpp"
+#include <catch2/catch.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace eosio;
+using namespace eosio::vm;
+
+extern wasm_allocator wa;
+
+namespace {
+   // (table 2 anyfunc) (memory 1)
+   // (global $g (mut i32) (i32.const 100))
+   // (func $fib (export "fib") (param i32) (result i32) ...)
+   // (func (export "indirect") (param i32) (result i32) (call_indirect (type 0) (i32.const 10) (local.get 0)))
+   // (func $double (export "double") (param i32) (result i32) (i32.mul (local.get 0) (i32.const 2)))
+   // (func (export "load") (result i32) (i32.add (i32.load (i32.const 0)) (global.get $g)))
+   // (elem (i32.const 0) $fib $double)
+   // (data (i32.const 0) "\2a\00\00\00")
+   std::vector<uint8_t> mapped_wasm = {
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x00, 0x0a, 0x06, 0x63,
+      0x75, 0x73, 0x74, 0x6f, 0x6d, 0x01, 0x02, 0x03, 0x01, 0x0a, 0x02, 0x60,
+      0x01, 0x7f, 0x01, 0x7f, 0x60, 0x00, 0x01, 0x7f, 0x03, 0x05, 0x04, 0x00,
+      0x00, 0x00, 0x01, 0x04, 0x04, 0x01, 0x70, 0x00, 0x02, 0x05, 0x03, 0x01,
+      0x00, 0x01, 0x06, 0x07, 0x01, 0x7f, 0x01, 0x41, 0xe4, 0x00, 0x0b, 0x07,
+      0x22, 0x04, 0x03, 0x66, 0x69, 0x62, 0x00, 0x00, 0x08, 0x69, 0x6e, 0x64,
+      0x69, 0x72, 0x65, 0x63, 0x74, 0x00, 0x01, 0x06, 0x64, 0x6f, 0x75, 0x62,
+      0x6c, 0x65, 0x00, 0x02, 0x04, 0x6c, 0x6f, 0x61, 0x64, 0x00, 0x03, 0x09,
+      0x08, 0x01, 0x00, 0x41, 0x00, 0x0b, 0x02, 0x00, 0x02, 0x0a, 0x45, 0x04,
+      0x1c, 0x00, 0x20, 0x00, 0x41, 0x02, 0x49, 0x04, 0x7f, 0x20, 0x00, 0x05,
+      0x20, 0x00, 0x41, 0x01, 0x6b, 0x10, 0x00, 0x20, 0x00, 0x41, 0x02, 0x6b,
+      0x10, 0x00, 0x6a, 0x0b, 0x0b, 0x09, 0x00, 0x41, 0x0a, 0x20, 0x00, 0x11,
+      0x00, 0x00, 0x0b, 0x0b, 0x02, 0x01, 0x7e, 0x02, 0x7c, 0x20, 0x00, 0x41,
+      0x02, 0x6c, 0x0b, 0x10, 0x01, 0x01, 0x7f, 0x41, 0x00, 0x28, 0x02, 0x00,
+      0x21, 0x00, 0x20, 0x00, 0x23, 0x00, 0x6a, 0x0b, 0x0b, 0x0a, 0x01, 0x00,
+      0x41, 0x00, 0x0b, 0x04, 0x2a, 0x00, 0x00, 0x00
+   };
+
+   struct temp_file {
+      explicit temp_file(const std::vector<uint8_t>& contents) {
+         char name[] = "/tmp/eos-vm-mapped-file-XXXXXX";
+         int fd = mkstemp(name);
+         REQUIRE(fd >= 0);
+         path = name;
+         REQUIRE(::write(fd, contents.data(), contents.size()) == static_cast<ssize_t>(contents.size()));
+         ::close(fd);
+      }
+      ~temp_file() { ::unlink(path.c_str()); }
+      std::string path;
+   };
+
+   bool in_file(const mapped_file& file, const guarded_vector<uint8_t>& v) {
+      return v.raw() >= file.data() && v.raw() + v.size() <= file.data() + file.size();
+   }
+} // namespace
+
+BACKEND_TEST_CASE("Testing loading a mapped file", "[mapped_file_tests]") {
+   std::shared_ptr<const mapped_file> file;
+   {
+      temp_file wasm_file(mapped_wasm);
+      file = backend<std::nullptr_t, TestType>::map_wasm(wasm_file.path);
+   }
+   REQUIRE(file->size() == mapped_wasm.size());
+   backend<std::nullptr_t, TestType> bkend(file);
+
+   // The data refers to the mapping, but names are copied, so calls do
+   // not read it
+   const module& mod = bkend.get_module();
+   REQUIRE(mod.exports.size() == 4);
+   for (uint32_t i = 0; i < mod.exports.size(); ++i)
+      CHECK(!in_file(*file, mod.exports[i].field_str));
+   REQUIRE(mod.data.size() == 1);
+   CHECK(in_file(*file, mod.data[0].data));
+
+   // Parallel compilation copies the function bodies for its workers
+   {
+      compile_options options;
+      options.threads = 4;
+      backend<std::nullptr_t, TestType> parallel(file, nullptr, options);
+      parallel.set_wasm_allocator(&wa);
+      parallel.initialize(nullptr);
+      CHECK(parallel.call_with_return(nullptr, "env", "fib", UINT32_C(10))->to_ui32() == 55);
+   }
+
+   // The module keeps the mapping alive
+   file.reset();
+   bkend.set_wasm_allocator(&wa);
+   bkend.initialize(nullptr);
+   CHECK(bkend.call_with_return(nullptr, "env", "fib", UINT32_C(10))->to_ui32() == 55);
+   CHECK(bkend.call_with_return(nullptr, "env", "indirect", UINT32_C(1))->to_ui32() == 20);
+   CHECK(bkend.call_with_return(nullptr, "env", "load")->to_ui32() == 142);
+}
+
+BACKEND_TEST_CASE("Testing a mapped file that is truncated", "[mapped_file_tests]") {
+   using backend_t = backend<std::nullptr_t, TestType>;
+   temp_file wasm_file(mapped_wasm);
+   {
+      auto file = backend_t::map_wasm(wasm_file.path);
+      REQUIRE(::truncate(wasm_file.path.c_str(), 0) == 0);
+      CHECK_THROWS_AS(backend_t(file), wasm_parse_exception);
+   }
+
+   {
+      std::ofstream(wasm_file.path, std::ios::binary)
+            .write(reinterpret_cast<const char*>(mapped_wasm.data()), mapped_wasm.size());
+      backend_t bkend(backend_t::map_wasm(wasm_file.path));
+      bkend.set_wasm_allocator(&wa);
+      bkend.initialize(nullptr);
+      CHECK(bkend.call_with_return(nullptr, "env", "load")->to_ui32() == 142);
+
+      // Resetting reads the data segment from the file again
+      REQUIRE(::truncate(wasm_file.path.c_str(), 0) == 0);
+      CHECK_THROWS_AS(bkend.initialize(nullptr), wasm_parse_exception);
+      // Exports are still found
+      CHECK(bkend.call_with_return(nullptr, "env", "fib", UINT32_C(10))->to_ui32() == 55);
+   }
+}
+
+TEST_CASE("Testing mapping a missing file", "[mapped_file_tests]") {
+   CHECK_THROWS_AS(backend<std::nullptr_t>::map_wasm("/nonexistent/eos-vm.wasm"), std::runtime_error);
+}
@@ -0,0 +1,107 @@
+#include <eosio/vm/backend.hpp>
+
+#include "utils.hpp"
+#include <catch2/catch.hpp>
+
+using namespace eosio;
+using namespace eosio::vm;
+
+extern wasm_allocator wa;
+
+namespace {
+   // (func $fact (param i32) (result i32) ...)  recursive call
+   // (func $twice (param i32) (result i32) ...) calls $inc twice
+   // (func $inc (param i32) (result i32) ...)
+   // (func $indirect (param i32) (result i32) (call_indirect (i32.const 5) (local.get 0)))
+   // (func $switch (param i32) (result i32) ...) br_table over 4 blocks
+   // (table funcref (elem $inc $fact))
+   std::vector<uint8_t> parallel_compile_wasm = {
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x06, 0x01, 0x60,
+      0x01, 0x7f, 0x01, 0x7f, 0x03, 0x06, 0x05, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x04, 0x04, 0x01, 0x70, 0x00, 0x02, 0x07, 0x24, 0x04, 0x04, 0x66, 0x61,
+      0x63, 0x74, 0x00, 0x00, 0x05, 0x74, 0x77, 0x69, 0x63, 0x65, 0x00, 0x01,
+      0x08, 0x69, 0x6e, 0x64, 0x69, 0x72, 0x65, 0x63, 0x74, 0x00, 0x03, 0x06,
+      0x73, 0x77, 0x69, 0x74, 0x63, 0x68, 0x00, 0x04, 0x09, 0x08, 0x01, 0x00,
+      0x41, 0x00, 0x0b, 0x02, 0x02, 0x00, 0x0a, 0x5a, 0x05, 0x17, 0x00, 0x20,
+      0x00, 0x41, 0x02, 0x48, 0x04, 0x7f, 0x41, 0x01, 0x05, 0x20, 0x00, 0x20,
+      0x00, 0x41, 0x01, 0x6b, 0x10, 0x00, 0x6c, 0x0b, 0x0b, 0x0b, 0x00, 0x20,
+      0x00, 0x10, 0x02, 0x20, 0x00, 0x10, 0x02, 0x6a, 0x0b, 0x07, 0x00, 0x20,
+      0x00, 0x41, 0x01, 0x6a, 0x0b, 0x09, 0x00, 0x41, 0x05, 0x20, 0x00, 0x11,
+      0x00, 0x00, 0x0b, 0x22, 0x00, 0x02, 0x40, 0x02, 0x40, 0x02, 0x40, 0x02,
+      0x40, 0x20, 0x00, 0x0e, 0x04, 0x00, 0x01, 0x02, 0x03, 0x03, 0x0b, 0x41,
+      0x0a, 0x0f, 0x0b, 0x41, 0x14, 0x0f, 0x0b, 0x41, 0x1e, 0x0f, 0x0b, 0x41,
+      0x28, 0x0b
+   };
+   // The same module with an invalid $indirect
+   std::vector<uint8_t> parallel_compile_invalid_wasm = {
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x06, 0x01, 0x60,
+      0x01, 0x7f, 0x01, 0x7f, 0x03, 0x06, 0x05, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x04, 0x04, 0x01, 0x70, 0x00, 0x02, 0x07, 0x24, 0x04, 0x04, 0x66, 0x61,
+      0x63, 0x74, 0x00, 0x00, 0x05, 0x74, 0x77, 0x69, 0x63, 0x65, 0x00, 0x01,
+      0x08, 0x69, 0x6e, 0x64, 0x69, 0x72, 0x65, 0x63, 0x74, 0x00, 0x03, 0x06,
+      0x73, 0x77, 0x69, 0x74, 0x63, 0x68, 0x00, 0x04, 0x09, 0x08, 0x01, 0x00,
+      0x41, 0x00, 0x0b, 0x02, 0x02, 0x00, 0x0a, 0x55, 0x05, 0x17, 0x00, 0x20,
+      0x00, 0x41, 0x02, 0x48, 0x04, 0x7f, 0x41, 0x01, 0x05, 0x20, 0x00, 0x20,
+      0x00, 0x41, 0x01, 0x6b, 0x10, 0x00, 0x6c, 0x0b, 0x0b, 0x0b, 0x00, 0x20,
+      0x00, 0x10, 0x02, 0x20, 0x00, 0x10, 0x02, 0x6a, 0x0b, 0x07, 0x00, 0x20,
+      0x00, 0x41, 0x01, 0x6a, 0x0b, 0x04, 0x00, 0x42, 0x05, 0x0b, 0x22, 0x00,
+      0x02, 0x40, 0x02, 0x40, 0x02, 0x40, 0x02, 0x40, 0x20, 0x00, 0x0e, 0x04,
+      0x00, 0x01, 0x02, 0x03, 0x03, 0x0b, 0x41, 0x0a, 0x0f, 0x0b, 0x41, 0x14,
+      0x0f, 0x0b, 0x41, 0x1e, 0x0f, 0x0b, 0x41, 0x28, 0x0b
+   };
+}
+
+BACKEND_TEST_CASE("Test parallel compilation", "[parallel_compile_test]") {
+   using backend_t = backend<std::nullptr_t, TestType>;
+   for (uint32_t threads : { 1, 2, 4, 8 }) {
+      backend_t bkend(parallel_compile_wasm, nullptr, compile_options{ threads });
+      bkend.set_wasm_allocator(&wa);
+      bkend.initialize(nullptr);
+
+      CHECK(bkend.call_with_return(nullptr, "env", "fact", (uint32_t)5)->to_ui32() == 120);
+      CHECK(bkend.call_with_return(nullptr, "env", "twice", (uint32_t)5)->to_ui32() == 12);
+      CHECK(bkend.call_with_return(nullptr, "env", "indirect", (uint32_t)0)->to_ui32() == 6);
+      CHECK(bkend.call_with_return(nullptr, "env", "indirect", (uint32_t)1)->to_ui32() == 120);
+      CHECK_THROWS_AS(bkend.call_with_return(nullptr, "env", "indirect", (uint32_t)2), std::exception);
+      for (uint32_t i = 0; i < 6; ++i) {
+         CHECK(bkend.call_with_return(nullptr, "env", "switch", i)->to_ui32() == 10 * std::min(i + 1, 4u));
+      }
+   }
+}
+
+BACKEND_TEST_CASE("Test parallel compilation of an invalid module", "[parallel_compile_test]") {
+   using backend_t = backend<std::nullptr_t, TestType>;
+   for (uint32_t threads : { 1, 4 }) {
+      CHECK_THROWS_AS(backend_t(parallel_compile_invalid_wasm, nullptr, compile_options{ threads }), wasm_parse_exception);
+   }
+}
+
+BACKEND_TEST_CASE("Test lazy compilation", "[lazy_compile_test]") {
+   using backend_t = backend<std::nullptr_t, TestType>;
+   backend_t bkend(parallel_compile_wasm, nullptr, compile_options{ 1, true });
+   bkend.set_wasm_allocator(&wa);
+   bkend.initialize(nullptr);
+
+   // call_indirect reaches $fact before it is called directly
+   CHECK(bkend.call_with_return(nullptr, "env", "indirect", (uint32_t)1)->to_ui32() == 120);
+   CHECK(bkend.call_with_return(nullptr, "env", "fact", (uint32_t)6)->to_ui32() == 720);
+   CHECK(bkend.call_with_return(nullptr, "env", "indirect", (uint32_t)0)->to_ui32() == 6);
+   CHECK(bkend.call_with_return(nullptr, "env", "twice", (uint32_t)5)->to_ui32() == 12);
+   CHECK_THROWS_AS(bkend.call_with_return(nullptr, "env", "indirect", (uint32_t)2), std::exception);
+   for (uint32_t i = 0; i < 6; ++i) {
+      CHECK(bkend.call_with_return(nullptr, "env", "switch", i)->to_ui32() == 10 * std::min(i + 1, 4u));
+   }
+}
+
+TEST_CASE("Test lazy compilation of an invalid module", "[lazy_compile_test]") {
+   using backend_t = backend<std::nullptr_t, jit>;
+   // Validation is deferred along with compilation
+   backend_t bkend(parallel_compile_invalid_wasm, nullptr, compile_options{ 1, true });
+   bkend.set_wasm_allocator(&wa);
+   bkend.initialize(nullptr);
+
+   CHECK(bkend.call_with_return(nullptr, "env", "fact", (uint32_t)5)->to_ui32() == 120);
+   CHECK_THROWS_AS(bkend.call_with_return(nullptr, "env", "indirect", (uint32_t)0), wasm_parse_exception);
+   CHECK_THROWS_AS(bkend.call_with_return(nullptr, "env", "indirect", (uint32_t)0), wasm_parse_exception);
+   CHECK(bkend.call_with_return(nullptr, "env", "twice", (uint32_t)5)->to_ui32() == 12);
+}
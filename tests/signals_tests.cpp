@@ -22,6 +22,28 @@ TEST_CASE("Testing signals", "[invoke_with_signal_handler]") {
    CHECK(okay);
 }
 
+TEST_CASE("Testing signals on a thread that blocked them", "[invoke_with_signal_handler]") {
+   int caught = 0;
+   std::thread t([&]() {
+      sigset_t mask;
+      sigemptyset(&mask);
+      sigaddset(&mask, SIGSEGV);
+      for (int i = 0; i < 3; ++i) {
+         // Blocked again before every call, as a thread pool that resets
+         // the mask of its workers would
+         pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+         eosio::vm::invoke_with_signal_handler([]() {
+            std::raise(SIGSEGV);
+         }, [&](int sig) {
+            if (sig == SIGSEGV)
+               ++caught;
+         });
+      }
+   });
+   t.join();
+   CHECK(caught == 3);
+}
+
 TEST_CASE("Testing throw", "[signal_handler_throw]") {
    CHECK_THROWS_AS(eosio::vm::invoke_with_signal_handler([](){
       eosio::vm::throw_<eosio::vm::wasm_exit_exception>( "Exiting" );
@@ -0,0 +1,141 @@
+#include <eosio/vm/backend.hpp>
+
+#include "utils.hpp"
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+
+using namespace eosio;
+using namespace eosio::vm;
+
+extern wasm_allocator wa;
+
+namespace {
+   // (custom "custom" "\01\02\03")
+   // (table 2 anyfunc) (memory 1)
+   // (global $g (mut i32) (i32.const 100))
+   // (func $fib (export "fib") (param i32) (result i32)
+   //   (if (result i32) (i32.lt_u (local.get 0) (i32.const 2)) (local.get 0)
+   //     (i32.add (call $fib (i32.sub (local.get 0) (i32.const 1))) (call $fib (i32.sub (local.get 0) (i32.const 2))))))
+   // (func (export "indirect") (param i32) (result i32) (call_indirect (type 0) (i32.const 10) (local.get 0)))
+   // (func $double (export "double") (param i32) (result i32) (local i64) (local f64 f64) (i32.mul (local.get 0) (i32.const 2)))
+   // (func (export "load") (result i32) (local i32)
+   //   (local.set 0 (i32.load (i32.const 0))) (i32.add (local.get 0) (global.get $g)))
+   // (elem (i32.const 0) $fib $double)
+   // (data (i32.const 0) "\2a\00\00\00")
+   std::vector<uint8_t> stream_wasm = {
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x00, 0x0a, 0x06, 0x63,
+      0x75, 0x73, 0x74, 0x6f, 0x6d, 0x01, 0x02, 0x03, 0x01, 0x0a, 0x02, 0x60,
+      0x01, 0x7f, 0x01, 0x7f, 0x60, 0x00, 0x01, 0x7f, 0x03, 0x05, 0x04, 0x00,
+      0x00, 0x00, 0x01, 0x04, 0x04, 0x01, 0x70, 0x00, 0x02, 0x05, 0x03, 0x01,
+      0x00, 0x01, 0x06, 0x07, 0x01, 0x7f, 0x01, 0x41, 0xe4, 0x00, 0x0b, 0x07,
+      0x22, 0x04, 0x03, 0x66, 0x69, 0x62, 0x00, 0x00, 0x08, 0x69, 0x6e, 0x64,
+      0x69, 0x72, 0x65, 0x63, 0x74, 0x00, 0x01, 0x06, 0x64, 0x6f, 0x75, 0x62,
+      0x6c, 0x65, 0x00, 0x02, 0x04, 0x6c, 0x6f, 0x61, 0x64, 0x00, 0x03, 0x09,
+      0x08, 0x01, 0x00, 0x41, 0x00, 0x0b, 0x02, 0x00, 0x02, 0x0a, 0x45, 0x04,
+      0x1c, 0x00, 0x20, 0x00, 0x41, 0x02, 0x49, 0x04, 0x7f, 0x20, 0x00, 0x05,
+      0x20, 0x00, 0x41, 0x01, 0x6b, 0x10, 0x00, 0x20, 0x00, 0x41, 0x02, 0x6b,
+      0x10, 0x00, 0x6a, 0x0b, 0x0b, 0x09, 0x00, 0x41, 0x0a, 0x20, 0x00, 0x11,
+      0x00, 0x00, 0x0b, 0x0b, 0x02, 0x01, 0x7e, 0x02, 0x7c, 0x20, 0x00, 0x41,
+      0x02, 0x6c, 0x0b, 0x10, 0x01, 0x01, 0x7f, 0x41, 0x00, 0x28, 0x02, 0x00,
+      0x21, 0x00, 0x20, 0x00, 0x23, 0x00, 0x6a, 0x0b, 0x0b, 0x0a, 0x01, 0x00,
+      0x41, 0x00, 0x0b, 0x04, 0x2a, 0x00, 0x00, 0x00
+   };
+
+   // Returns a function that reads code at most chunk bytes at a time
+   auto reader(const std::vector<uint8_t>& code, std::size_t chunk) {
+      return [&code, chunk, pos = std::size_t{ 0 }](uint8_t* buffer, std::size_t size) mutable {
+         std::size_t n = std::min({ size, chunk, code.size() - pos });
+         std::copy_n(code.data() + pos, n, buffer);
+         pos += n;
+         return n;
+      };
+   }
+
+   template <typename Backend>
+   void check_results(Backend& bkend) {
+      bkend.set_wasm_allocator(&wa);
+      bkend.initialize(nullptr);
+      CHECK(bkend.call_with_return(nullptr, "env", "fib", UINT32_C(10))->to_ui32() == 55);
+      CHECK(bkend.call_with_return(nullptr, "env", "indirect", UINT32_C(0))->to_ui32() == 55);
+      CHECK(bkend.call_with_return(nullptr, "env", "indirect", UINT32_C(1))->to_ui32() == 20);
+      CHECK(bkend.call_with_return(nullptr, "env", "double", UINT32_C(21))->to_ui32() == 42);
+      CHECK(bkend.call_with_return(nullptr, "env", "load")->to_ui32() == 142);
+   }
+} // namespace
+
+BACKEND_TEST_CASE("Testing streamed modules", "[streaming_tests]") {
+   for (std::size_t chunk : { std::size_t{ 1 }, std::size_t{ 7 }, stream_wasm.size() }) {
+      backend<std::nullptr_t, TestType> bkend(reader(stream_wasm, chunk));
+      check_results(bkend);
+   }
+}
+
+TEST_CASE("Testing streamed modules match loaded modules", "[streaming_tests]") {
+   backend<std::nullptr_t, interpreter> loaded(stream_wasm);
+   backend<std::nullptr_t, interpreter> streamed(reader(stream_wasm, 5));
+   module& expected = loaded.get_module();
+   module& mod = streamed.get_module();
+   CHECK(mod.maximum_stack == expected.maximum_stack);
+   REQUIRE(mod.code.size() == expected.code.size());
+   for (uint32_t i = 0; i < mod.code.size(); ++i) {
+      CHECK(mod.code[i].size == expected.code[i].size);
+      REQUIRE(mod.code[i].locals.size() == expected.code[i].locals.size());
+      for (uint32_t j = 0; j < mod.code[i].locals.size(); ++j) {
+         CHECK(mod.code[i].locals[j].count == expected.code[i].locals[j].count);
+         CHECK(mod.code[i].locals[j].type == expected.code[i].locals[j].type);
+      }
+   }
+}
+
+TEST_CASE("Testing streamed modules with lazy and parallel compilation", "[streaming_tests]") {
+   compile_options lazy;
+   lazy.lazy = true;
+   backend<std::nullptr_t, jit> lazy_bkend(reader(stream_wasm, 3), nullptr, lazy);
+   check_results(lazy_bkend);
+
+   compile_options parallel;
+   parallel.threads = 2;
+   backend<std::nullptr_t, interpreter> parallel_bkend(reader(stream_wasm, 3), nullptr, parallel);
+   check_results(parallel_bkend);
+}
+
+TEST_CASE("Testing invalid streamed modules", "[streaming_tests]") {
+   std::vector<uint8_t> truncated(stream_wasm.begin(), stream_wasm.end() - 1);
+   CHECK_THROWS_AS((backend<std::nullptr_t, interpreter>(reader(truncated, 4))), wasm_parse_exception);
+
+   // The stream ends in the middle of the code section
+   std::vector<uint8_t> short_body(stream_wasm.begin(), stream_wasm.end() - 14);
+   CHECK_THROWS((backend<std::nullptr_t, interpreter>(reader(short_body, 4))));
+
+   // A section length is checked before the section is buffered.  The
+   // stream never ends, so buffering it would not either.
+   std::vector<uint8_t> huge_section = { 0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0xff, 0xff, 0xff, 0xff, 0x0f };
+   auto endless = [&, pos = std::size_t{ 0 }](uint8_t* buffer, std::size_t size) mutable {
+      for (std::size_t i = 0; i < size; ++i, ++pos)
+         buffer[i] = pos < huge_section.size() ? huge_section[pos] : 0;
+      return size;
+   };
+   CHECK_THROWS_AS((backend<std::nullptr_t, interpreter>(endless)), wasm_section_length_exception);
+
+   std::vector<uint8_t> wrong_type = stream_wasm;
+   auto add = std::find(wrong_type.rbegin(), wrong_type.rend(), opcodes::i32_add);
+   *add = opcodes::i64_add;
+   CHECK_THROWS_AS((backend<std::nullptr_t, interpreter>(reader(wrong_type, 4))), wasm_parse_exception);
+}
+
+TEST_CASE("Testing the maximum section size", "[streaming_tests]") {
+   // The code section is the largest, at 69 bytes
+   compile_options options;
+   options.max_section_size = 69;
+   backend<std::nullptr_t, interpreter> streamed(reader(stream_wasm, 5), nullptr, options);
+   check_results(streamed);
+   backend<std::nullptr_t, interpreter> loaded(stream_wasm, nullptr, options);
+   check_results(loaded);
+
+   options.max_section_size = 68;
+   CHECK_THROWS_AS((backend<std::nullptr_t, interpreter>(reader(stream_wasm, 5), nullptr, options)),
+                   wasm_section_length_exception);
+   CHECK_THROWS_AS((backend<std::nullptr_t, interpreter>(stream_wasm, nullptr, options)),
+                   wasm_section_length_exception);
+}
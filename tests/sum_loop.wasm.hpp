@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// (memory 1)
+// (global $g (mut i32) (i32.const 0))
+// (func $sum (export "sum") (param $n i32) (result i32) (local $total i32)
+//   loop while $n != 0: $g += 1; mem[0] += $n; $total += $n; $n -= 1
+//   (local.get $total))
+// (func (export "g") (result i32) (global.get $g))
+// (func (export "load") (result i32) (i32.load (i32.const 0)))
+inline std::vector<uint8_t> sum_loop_wasm = {
+  0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x0a, 0x02, 0x60,
+  0x01, 0x7f, 0x01, 0x7f, 0x60, 0x00, 0x01, 0x7f, 0x03, 0x04, 0x03, 0x00,
+  0x01, 0x01, 0x05, 0x03, 0x01, 0x00, 0x01, 0x06, 0x06, 0x01, 0x7f, 0x01,
+  0x41, 0x00, 0x0b, 0x07, 0x12, 0x03, 0x03, 0x73, 0x75, 0x6d, 0x00, 0x00,
+  0x01, 0x67, 0x00, 0x01, 0x04, 0x6c, 0x6f, 0x61, 0x64, 0x00, 0x02, 0x0a,
+  0x44, 0x03, 0x35, 0x01, 0x01, 0x7f, 0x02, 0x40, 0x03, 0x40, 0x20, 0x00,
+  0x45, 0x0d, 0x01, 0x23, 0x00, 0x41, 0x01, 0x6a, 0x24, 0x00, 0x41, 0x00,
+  0x41, 0x00, 0x28, 0x02, 0x00, 0x20, 0x00, 0x6a, 0x36, 0x02, 0x00, 0x20,
+  0x01, 0x20, 0x00, 0x6a, 0x21, 0x01, 0x20, 0x00, 0x41, 0x01, 0x6b, 0x21,
+  0x00, 0x0c, 0x00, 0x0b, 0x0b, 0x20, 0x01, 0x0b, 0x04, 0x00, 0x23, 0x00,
+  0x0b, 0x07, 0x00, 0x41, 0x00, 0x28, 0x02, 0x00, 0x0b
+};
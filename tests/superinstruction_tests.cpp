@@ -0,0 +1,172 @@
+#include <eosio/vm/backend.hpp>
+#include <eosio/vm/debug_visitor.hpp>
+#include <eosio/vm/superinstructions.hpp>
+
+#include "utils.hpp"
+#include <catch2/catch.hpp>
+
+#include <set>
+
+using namespace eosio;
+using namespace eosio::vm;
+
+extern wasm_allocator wa;
+
+namespace {
+   // (memory 1)
+   // (data (i32.const 0) "\01\00\00\00\02\00\00\00\03\00\00\00\04\00\00\00")
+   // (func $sum (export "sum") (param $n i32) (result i32) (local $i i32) (local $s i32)
+   //   (loop $l
+   //     (local.set $s (i32.add (local.get $s) (local.get $i)))
+   //     (block (local.set $i (i32.add (local.get $i) (i32.const 1))))
+   //     (br_if $l (i32.lt_u (local.get $i) (local.get $n))))
+   //   (local.get $s))
+   // (func $inc (export "inc") (param i32) (result i32) (i32.add (local.get 0) (i32.const 1)))
+   // (func (export "misc") (param $p i32) (result i32) (local $q i32)
+   //   (i32.store (i32.const 16) (local.get $p))
+   //   (local.set $q (call $inc (i32.const 7)))
+   //   (i32.and (i32.add (local.get $q) (local.get $p)) (i32.const 255))
+   //   (i32.add (i32.sub (local.get $p) (i32.const 3)))
+   //   (i32.add (i32.load (i32.const 16)))
+   //   (i32.add (i32.mul (local.get $p) (i32.const 2)))
+   //   (i32.add (i32.const 100)))
+   // (func (export "load") (param $a i32) (result i64)
+   //   (i64.add (i64.load (local.get $a)) (i64.extend_i32_u (i32.load offset=4 (local.get $a)))))
+   // (func (export "branches") (param $a i32) (param $b i32) (result i32) (local $r i32)
+   //   for each condition c in i32.eqz $a, i32.eq, i32.ne, i32.lt_s, i32.lt_u, i32.gt_u, i32.ge_u, i64.eq, i64.ne
+   //   of $a and $b, and (i32.lt_u (i32.sub (local.get $b) (local.get $a)) (i32.const 7)):
+   //     (block (br_if 0 c) (local.set $r (i32.or (local.get $r) (i32.const bit))))
+   //   (local.get $r))
+   // (func (export "store64") (param $x i64) (result i64)
+   //   (i64.store (i32.const 32) (local.get $x)) (i64.load (i32.const 32)))
+   std::vector<uint8_t> superinstruction_wasm = {
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x16, 0x04, 0x60,
+      0x01, 0x7f, 0x01, 0x7f, 0x60, 0x01, 0x7f, 0x01, 0x7e, 0x60, 0x02, 0x7f,
+      0x7f, 0x01, 0x7f, 0x60, 0x01, 0x7e, 0x01, 0x7e, 0x03, 0x07, 0x06, 0x00,
+      0x00, 0x00, 0x01, 0x02, 0x03, 0x05, 0x03, 0x01, 0x00, 0x01, 0x07, 0x30,
+      0x06, 0x03, 0x73, 0x75, 0x6d, 0x00, 0x00, 0x03, 0x69, 0x6e, 0x63, 0x00,
+      0x01, 0x04, 0x6d, 0x69, 0x73, 0x63, 0x00, 0x02, 0x04, 0x6c, 0x6f, 0x61,
+      0x64, 0x00, 0x03, 0x08, 0x62, 0x72, 0x61, 0x6e, 0x63, 0x68, 0x65, 0x73,
+      0x00, 0x04, 0x07, 0x73, 0x74, 0x6f, 0x72, 0x65, 0x36, 0x34, 0x00, 0x05,
+      0x0a, 0xb5, 0x02, 0x06, 0x21, 0x01, 0x02, 0x7f, 0x03, 0x40, 0x20, 0x02,
+      0x20, 0x01, 0x6a, 0x21, 0x02, 0x02, 0x40, 0x20, 0x01, 0x41, 0x01, 0x6a,
+      0x21, 0x01, 0x0b, 0x20, 0x01, 0x20, 0x00, 0x49, 0x0d, 0x00, 0x0b, 0x20,
+      0x02, 0x0b, 0x07, 0x00, 0x20, 0x00, 0x41, 0x01, 0x6a, 0x0b, 0x30, 0x01,
+      0x01, 0x7f, 0x41, 0x10, 0x20, 0x00, 0x36, 0x02, 0x00, 0x41, 0x07, 0x10,
+      0x01, 0x21, 0x01, 0x20, 0x01, 0x20, 0x00, 0x6a, 0x41, 0xff, 0x01, 0x71,
+      0x20, 0x00, 0x41, 0x03, 0x6b, 0x6a, 0x41, 0x10, 0x28, 0x02, 0x00, 0x6a,
+      0x20, 0x00, 0x41, 0x02, 0x6c, 0x6a, 0x41, 0xe4, 0x00, 0x6a, 0x0b, 0x0e,
+      0x00, 0x20, 0x00, 0x29, 0x03, 0x00, 0x20, 0x00, 0x28, 0x02, 0x04, 0xad,
+      0x7c, 0x0b, 0xb9, 0x01, 0x01, 0x01, 0x7f, 0x02, 0x40, 0x20, 0x00, 0x45,
+      0x0d, 0x00, 0x20, 0x02, 0x41, 0x01, 0x72, 0x21, 0x02, 0x0b, 0x02, 0x40,
+      0x20, 0x00, 0x20, 0x01, 0x46, 0x0d, 0x00, 0x20, 0x02, 0x41, 0x02, 0x72,
+      0x21, 0x02, 0x0b, 0x02, 0x40, 0x20, 0x00, 0x20, 0x01, 0x47, 0x0d, 0x00,
+      0x20, 0x02, 0x41, 0x04, 0x72, 0x21, 0x02, 0x0b, 0x02, 0x40, 0x20, 0x00,
+      0x20, 0x01, 0x48, 0x0d, 0x00, 0x20, 0x02, 0x41, 0x08, 0x72, 0x21, 0x02,
+      0x0b, 0x02, 0x40, 0x20, 0x00, 0x20, 0x01, 0x49, 0x0d, 0x00, 0x20, 0x02,
+      0x41, 0x10, 0x72, 0x21, 0x02, 0x0b, 0x02, 0x40, 0x20, 0x00, 0x20, 0x01,
+      0x4b, 0x0d, 0x00, 0x20, 0x02, 0x41, 0x20, 0x72, 0x21, 0x02, 0x0b, 0x02,
+      0x40, 0x20, 0x00, 0x20, 0x01, 0x4f, 0x0d, 0x00, 0x20, 0x02, 0x41, 0xc0,
+      0x00, 0x72, 0x21, 0x02, 0x0b, 0x02, 0x40, 0x20, 0x00, 0xac, 0x20, 0x01,
+      0xac, 0x51, 0x0d, 0x00, 0x20, 0x02, 0x41, 0x80, 0x01, 0x72, 0x21, 0x02,
+      0x0b, 0x02, 0x40, 0x20, 0x00, 0xac, 0x20, 0x01, 0xac, 0x52, 0x0d, 0x00,
+      0x20, 0x02, 0x41, 0x80, 0x02, 0x72, 0x21, 0x02, 0x0b, 0x02, 0x40, 0x20,
+      0x01, 0x20, 0x00, 0x6b, 0x41, 0x07, 0x49, 0x0d, 0x00, 0x20, 0x02, 0x41,
+      0x80, 0x04, 0x72, 0x21, 0x02, 0x0b, 0x20, 0x02, 0x0b, 0x0e, 0x00, 0x41,
+      0x20, 0x20, 0x00, 0x37, 0x03, 0x00, 0x41, 0x20, 0x29, 0x03, 0x00, 0x0b,
+      0x0b, 0x16, 0x01, 0x00, 0x41, 0x00, 0x0b, 0x10, 0x01, 0x00, 0x00, 0x00,
+      0x02, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00
+   };
+
+   using backend_t = backend<std::nullptr_t, interpreter>;
+
+   std::set<uint8_t> bitcode_opcodes(module& mod) {
+      std::set<uint8_t> result;
+      for (uint32_t i = 0; i < mod.code.size(); ++i) {
+         const uint8_t* end = mod.code[i].code + mod.code[i].size;
+         for (const uint8_t* pos = mod.code[i].code; pos < end; pos = visit_instruction([](const auto&) {}, pos))
+            result.insert(*pos);
+      }
+      return result;
+   }
+
+   uint32_t expected_branches(uint32_t a, uint32_t b) {
+      bool taken[] = { a == 0, a == b, a != b, int32_t(a) < int32_t(b), a < b, a > b, a >= b,
+                       int64_t(int32_t(a)) == int64_t(int32_t(b)), int64_t(int32_t(a)) != int64_t(int32_t(b)),
+                       b - a < 7 };
+      uint32_t result = 0;
+      for (int i = 0; i < 10; ++i)
+         if (!taken[i])
+            result |= 1u << i;
+      return result;
+   }
+
+   void check_results(backend_t& bkend) {
+      bkend.set_wasm_allocator(&wa);
+      bkend.initialize(nullptr);
+      CHECK(bkend.call_with_return(nullptr, "env", "sum", UINT32_C(0))->to_ui32() == 0);
+      CHECK(bkend.call_with_return(nullptr, "env", "sum", UINT32_C(10))->to_ui32() == 45);
+      CHECK(bkend.call_with_return(nullptr, "env", "sum", UINT32_C(100))->to_ui32() == 4950);
+      for (uint32_t p : { 0u, 1u, 3u, 200u, 0xFFFFFFFFu }) {
+         uint32_t expected = ((8 + p) & 255) + (p - 3) + p + p * 2 + 100;
+         CHECK(bkend.call_with_return(nullptr, "env", "misc", p)->to_ui32() == expected);
+      }
+      CHECK(bkend.call_with_return(nullptr, "env", "load", UINT32_C(0))->to_ui64() == UINT64_C(0x200000003));
+      CHECK(bkend.call_with_return(nullptr, "env", "load", UINT32_C(4))->to_ui64() == UINT64_C(0x300000005));
+      const uint32_t values[] = { 0, 1, 5, 0x7FFFFFFF, 0x80000000, 0xFFFFFFFF };
+      for (uint32_t a : values)
+         for (uint32_t b : values)
+            CHECK(bkend.call_with_return(nullptr, "env", "branches", a, b)->to_ui32() == expected_branches(a, b));
+      CHECK(bkend.call_with_return(nullptr, "env", "store64", UINT64_C(0x123456789ABCDEF0))->to_ui64() ==
+            UINT64_C(0x123456789ABCDEF0));
+   }
+} // namespace
+
+TEST_CASE("Testing superinstructions", "[superinstruction_tests]") {
+   backend_t bkend(superinstruction_wasm);
+   std::set<uint8_t> opcodes = bitcode_opcodes(bkend.get_module());
+   for (const auto& pattern : superinstruction_patterns)
+      CHECK(opcodes.count(pattern.opcode) == 1);
+   check_results(bkend);
+}
+
+TEST_CASE("Testing disabled superinstructions", "[superinstruction_tests]") {
+   compile_options options;
+   options.superinstructions = superinstruction_set::none();
+   backend_t bkend(superinstruction_wasm, nullptr, options);
+   std::set<uint8_t> opcodes = bitcode_opcodes(bkend.get_module());
+   for (const auto& pattern : superinstruction_patterns)
+      CHECK(opcodes.count(pattern.opcode) == 0);
+   check_results(bkend);
+}
+
+TEST_CASE("Testing superinstructions chosen from a profile", "[superinstruction_tests]") {
+   opcode_pair_profile profile;
+   {
+      compile_options options;
+      options.superinstructions = superinstruction_set::none();
+      backend_t bkend(superinstruction_wasm, nullptr, options);
+      bkend.set_wasm_allocator(&wa);
+      bkend.initialize(nullptr);
+      auto& ctx = bkend.get_context();
+      CHECK(ctx.execute(nullptr, profile_visitor(ctx, profile), "sum", UINT32_C(100))->to_ui32() == 4950);
+   }
+   // $sum runs two pairs of local.get per iteration
+   CHECK(profile.count(opcodes::get_local, opcodes::get_local) == 200);
+   CHECK(profile.count(opcodes::i32_lt_u, opcodes::br_if) == 100);
+   CHECK(profile.count(opcodes::i32_const, opcodes::call) == 0);
+
+   // Replaces four dispatches with one in every iteration
+   superinstruction_set selected = select_superinstructions(profile, 1);
+   CHECK(selected.size() == 1);
+   CHECK(selected.contains(opcodes::local_local_i32_lt_u_br_if));
+   CHECK(select_superinstructions(profile, 100).size() < std::size(superinstruction_patterns));
+
+   compile_options options;
+   options.superinstructions = selected;
+   backend_t bkend(superinstruction_wasm, nullptr, options);
+   std::set<uint8_t> opcodes = bitcode_opcodes(bkend.get_module());
+   for (const auto& pattern : superinstruction_patterns)
+      CHECK(opcodes.count(pattern.opcode) == selected.contains(pattern.opcode));
+   check_results(bkend);
+}
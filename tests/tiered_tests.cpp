@@ -0,0 +1,138 @@
+#include <eosio/vm/backend.hpp>
+
+#include "sum_loop.wasm.hpp"
+#include "utils.hpp"
+#include <catch2/catch.hpp>
+
+using namespace eosio;
+using namespace eosio::vm;
+
+extern wasm_allocator wa;
+
+namespace {
+   // sum_loop_wasm with $sum also reachable through a host function
+   // (import "env" "reenter" (func $reenter (param i32) (result i32)))
+   // ...
+   // (func (export "call_host") (param i32) (result i32) (call $reenter (local.get 0)))
+   std::vector<uint8_t> reenter_wasm = {
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x0a, 0x02, 0x60,
+      0x01, 0x7f, 0x01, 0x7f, 0x60, 0x00, 0x01, 0x7f, 0x02, 0x0f, 0x01, 0x03,
+      0x65, 0x6e, 0x76, 0x07, 0x72, 0x65, 0x65, 0x6e, 0x74, 0x65, 0x72, 0x00,
+      0x00, 0x03, 0x04, 0x03, 0x00, 0x01, 0x00, 0x05, 0x03, 0x01, 0x00, 0x01,
+      0x06, 0x06, 0x01, 0x7f, 0x01, 0x41, 0x00, 0x0b, 0x07, 0x17, 0x03, 0x03,
+      0x73, 0x75, 0x6d, 0x00, 0x01, 0x01, 0x67, 0x00, 0x02, 0x09, 0x63, 0x61,
+      0x6c, 0x6c, 0x5f, 0x68, 0x6f, 0x73, 0x74, 0x00, 0x03, 0x0a, 0x43, 0x03,
+      0x35, 0x01, 0x01, 0x7f, 0x02, 0x40, 0x03, 0x40, 0x20, 0x00, 0x45, 0x0d,
+      0x01, 0x23, 0x00, 0x41, 0x01, 0x6a, 0x24, 0x00, 0x41, 0x00, 0x41, 0x00,
+      0x28, 0x02, 0x00, 0x20, 0x00, 0x6a, 0x36, 0x02, 0x00, 0x20, 0x01, 0x20,
+      0x00, 0x6a, 0x21, 0x01, 0x20, 0x00, 0x41, 0x01, 0x6b, 0x21, 0x00, 0x0c,
+      0x00, 0x0b, 0x0b, 0x20, 0x01, 0x0b, 0x04, 0x00, 0x23, 0x00, 0x0b, 0x06,
+      0x00, 0x20, 0x00, 0x10, 0x00, 0x0b
+   };
+
+   // Host functions are called on a copy of the host
+   struct reenter_host {
+      int32_t reenter(int32_t n) {
+         ++calls;
+         return bkend.call_with_return(this, "env", "sum", n)->to_i32();
+      }
+      backend<reenter_host, tiered>& bkend;
+      uint32_t&                      calls;
+   };
+
+   // Fires as soon as it is started
+   struct expired_watchdog {
+      template <typename F>
+      expired_watchdog scoped_run(F&& callback) {
+         callback();
+         return *this;
+      }
+   };
+}
+
+TEST_CASE("Testing tiered execution switches to the jit", "[tiered_tests]") {
+   backend<std::nullptr_t, tiered> bkend(sum_loop_wasm);
+   bkend.get_context().set_hot_threshold(10);
+   bkend.set_wasm_allocator(&wa);
+   bkend.initialize(nullptr);
+
+   uint32_t calls = 0;
+   auto     check = [&]() {
+      CHECK(bkend.call_with_return(nullptr, "env", "sum", UINT32_C(4))->to_ui32() == 10);
+      ++calls;
+      CHECK(bkend.call_with_return(nullptr, "env", "g")->to_ui32() == calls * 4);
+      CHECK(bkend.call_with_return(nullptr, "env", "load")->to_ui32() == calls * 10);
+      CHECK(bkend.get_module().globals[0].current.value.i32 == calls * 4);
+   };
+
+   check();
+   CHECK(!bkend.get_context().is_jit_ready());
+   // The loop in $sum reaches the threshold during the second call
+   check();
+   check();
+   bkend.get_context().wait_for_jit();
+   CHECK(bkend.get_context().is_jit_ready());
+   for (int i = 0; i < 5; ++i)
+      check();
+
+   // Both tiers see the state left by reset
+   bkend.initialize(nullptr);
+   calls = 0;
+   check();
+}
+
+TEST_CASE("Testing tiered execution without reaching the threshold", "[tiered_tests]") {
+   backend<std::nullptr_t, tiered> bkend(sum_loop_wasm);
+   bkend.set_wasm_allocator(&wa);
+   bkend.initialize(nullptr);
+
+   CHECK(bkend.call_with_return(nullptr, "env", "sum", UINT32_C(100))->to_ui32() == 5050);
+   bkend.get_context().wait_for_jit();
+   CHECK(!bkend.get_context().is_jit_ready());
+   CHECK(bkend.call_with_return(nullptr, "env", "load")->to_ui32() == 5050);
+}
+
+TEST_CASE("Testing tiered execution with host functions that call back into wasm", "[tiered_tests]") {
+   registered_function<reenter_host, reenter_host, &reenter_host::reenter>("env", "reenter");
+   using backend_t = backend<reenter_host, tiered>;
+   backend_t bkend(reenter_wasm);
+   registered_host_functions<reenter_host>::resolve(bkend.get_module());
+   bkend.get_context().set_hot_threshold(10);
+   bkend.set_wasm_allocator(&wa);
+   uint32_t     calls = 0;
+   reenter_host host{ bkend, calls };
+   bkend.initialize(&host);
+
+   // Each call runs $sum inside a host function called from wasm, in
+   // the interpreter, then while the jit is compiled, and then in the jit
+   for (uint32_t i = 1; i <= 8; ++i) {
+      CHECK(bkend.call_with_return(&host, "env", "call_host", UINT32_C(4))->to_ui32() == 10);
+      CHECK(calls == i);
+      CHECK(bkend.call_with_return(&host, "env", "g")->to_ui32() == i * 4);
+      CHECK(bkend.get_module().globals[0].current.value.i32 == i * 4);
+      if (i == 4) {
+         bkend.get_context().wait_for_jit();
+         CHECK(bkend.get_context().is_jit_ready());
+      }
+   }
+}
+
+TEST_CASE("Testing that a timeout applies to a jit tier compiled after it", "[tiered_tests]") {
+   backend<std::nullptr_t, tiered> bkend(sum_loop_wasm);
+   bkend.get_context().set_hot_threshold(10);
+   bkend.set_wasm_allocator(&wa);
+   bkend.initialize(nullptr);
+
+   // Starts the background compile
+   CHECK(bkend.call_with_return(nullptr, "env", "sum", UINT32_C(20))->to_ui32() == 210);
+   CHECK_THROWS_AS(bkend.timed_run(expired_watchdog{}, [&]() {
+                      bkend.get_context().wait_for_jit();
+                      CHECK(!bkend.get_context().is_jit_ready());
+                      bkend.call(nullptr, "env", "sum", UINT32_C(4));
+                   }),
+                   timeout_exception);
+
+   // The timeout only lasts for the timed run
+   CHECK(bkend.get_context().is_jit_ready());
+   CHECK(bkend.call_with_return(nullptr, "env", "sum", UINT32_C(4))->to_ui32() == 10);
+}
@@ -0,0 +1,102 @@
+#include <eosio/vm/null_writer.hpp>
+#include <eosio/vm/parser.hpp>
+#include <eosio/vm/utf8.hpp>
+
+#include <catch2/catch.hpp>
+
+#include <cstdlib>
+#include <vector>
+
+using namespace eosio;
+using namespace eosio::vm;
+
+namespace {
+   // The result of walking the string one code point at a time
+   bool reference_validate(std::vector<uint8_t>& str) {
+      static growable_allocator         alloc(1024);
+      static binary_parser<null_writer> parser(alloc);
+      wasm_code_ptr code(str.data(), str.size());
+      uint32_t      bytes = str.size();
+      try {
+         while (bytes != 0)
+            bytes -= parser.validate_utf8_code_point(code);
+         return true;
+      } catch (...) { return false; }
+   }
+
+   std::vector<detail::utf8_validator> validators() {
+      std::vector<detail::utf8_validator> result = { &detail::validate_utf8_scalar, &is_valid_utf8 };
+#if defined(__x86_64__)
+      if (__builtin_cpu_supports("sse4.1"))
+         result.push_back(&detail::validate_utf8_sse41);
+      if (__builtin_cpu_supports("avx2"))
+         result.push_back(&detail::validate_utf8_avx2);
+#endif
+      return result;
+   }
+
+   void check_validators(std::vector<uint8_t> str) {
+      bool expected = reference_validate(str);
+      for (auto validate : validators())
+         CHECK(validate(str.data(), str.size()) == expected);
+   }
+
+   void append_code_point(std::vector<uint8_t>& str, uint32_t code_point) {
+      if (code_point < 0x80) {
+         str.push_back(code_point);
+      } else if (code_point < 0x800) {
+         str.push_back(0xC0 | (code_point >> 6));
+         str.push_back(0x80 | (code_point & 0x3F));
+      } else if (code_point < 0x10000) {
+         str.push_back(0xE0 | (code_point >> 12));
+         str.push_back(0x80 | ((code_point >> 6) & 0x3F));
+         str.push_back(0x80 | (code_point & 0x3F));
+      } else {
+         str.push_back(0xF0 | (code_point >> 18));
+         str.push_back(0x80 | ((code_point >> 12) & 0x3F));
+         str.push_back(0x80 | ((code_point >> 6) & 0x3F));
+         str.push_back(0x80 | (code_point & 0x3F));
+      }
+   }
+} // namespace
+
+TEST_CASE("Testing utf8 validation of every two and three byte prefix", "[utf8_tests]") {
+   // Each position in a block and across the block boundaries
+   for (std::size_t offset : { 0, 13, 14, 15, 29, 30, 31 }) {
+      for (uint32_t b0 = 0x80; b0 < 0x100; ++b0) {
+         for (uint32_t b1 = 0; b1 < 0x100; b1 += 0x10) {
+            std::vector<uint8_t> str(offset, 'a');
+            str.push_back(b0);
+            str.push_back(b1 | (b0 & 0xF));
+            check_validators(str);
+            str.push_back(0x80 | (b1 & 0x3F));
+            check_validators(str);
+            str.push_back(0x80);
+            check_validators(str);
+            str.push_back('a');
+            check_validators(str);
+         }
+      }
+   }
+}
+
+TEST_CASE("Testing utf8 validation of random strings", "[utf8_tests]") {
+   std::srand(0x75746638);
+   for (int i = 0; i < 5000; ++i) {
+      std::vector<uint8_t> str;
+      std::size_t          length = std::rand() % 100;
+      while (str.size() < length) {
+         switch (std::rand() % 4) {
+            case 0: append_code_point(str, std::rand() % 0x80); break;
+            case 1: append_code_point(str, 0x80 + std::rand() % 0x780); break;
+            case 2: append_code_point(str, 0x800 + std::rand() % 0xF800); break;
+            default: append_code_point(str, 0x10000 + std::rand() % 0x100000); break;
+         }
+      }
+      if (std::rand() % 2 && !str.empty())
+         str[std::rand() % str.size()] = std::rand();
+      if (std::rand() % 4 == 0 && !str.empty())
+         str.pop_back();
+      check_validators(str);
+   }
+}
@@ -0,0 +1,51 @@
+#include <eosio/vm/backend.hpp>
+#include <eosio/vm/null_writer.hpp>
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+
+using namespace eosio;
+using namespace eosio::vm;
+
+namespace {
+   // (global $g (mut i32) (i32.const 5))
+   // (func (export "f") (param i32) (result i32)
+   //   (global.set $g (i32.add (global.get $g) (local.get 0)))
+   //   (global.get $g))
+   std::vector<uint8_t> valid_wasm = {
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x06, 0x01, 0x60,
+      0x01, 0x7f, 0x01, 0x7f, 0x03, 0x02, 0x01, 0x00, 0x06, 0x06, 0x01, 0x7f,
+      0x01, 0x41, 0x05, 0x0b, 0x07, 0x05, 0x01, 0x01, 0x66, 0x00, 0x00, 0x0a,
+      0x0d, 0x01, 0x0b, 0x00, 0x23, 0x00, 0x20, 0x00, 0x6a, 0x24, 0x00, 0x23,
+      0x00, 0x0b
+   };
+   // The offset of the i32.add in valid_wasm
+   constexpr std::size_t add_offset = 44;
+} // namespace
+
+TEST_CASE("Testing validation of a valid module", "[validation_tests]") {
+   validate_module(valid_wasm);
+   compile_options options;
+   options.threads = 2;
+   validate_module(valid_wasm.data(), valid_wasm.size(), options);
+}
+
+TEST_CASE("Testing validation of invalid modules", "[validation_tests]") {
+   // i64.add of i32 operands
+   std::vector<uint8_t> wrong_type = valid_wasm;
+   wrong_type[add_offset] = opcodes::i64_add;
+   CHECK_THROWS_AS(validate_module(wrong_type), wasm_parse_exception);
+   CHECK_THROWS_AS(backend<std::nullptr_t>(wrong_type), wasm_parse_exception);
+
+   // set_global of an immutable global
+   std::vector<uint8_t> immutable = valid_wasm;
+   std::vector<uint8_t> mutable_global = { 0x7f, 0x01, 0x41, 0x05, 0x0b };
+   auto pos = std::search(immutable.begin(), immutable.end(), mutable_global.begin(), mutable_global.end());
+   REQUIRE(pos != immutable.end());
+   pos[1] = 0x00;
+   CHECK_THROWS_AS(validate_module(immutable), wasm_parse_exception);
+
+   std::vector<uint8_t> truncated(valid_wasm.begin(), valid_wasm.end() - 1);
+   CHECK_THROWS(validate_module(truncated));
+}
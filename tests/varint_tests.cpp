@@ -164,3 +164,61 @@ TEST_CASE("Testing varint", "[varint_tests]") {
    }
 }
 
+
+namespace {
+   // Decodes data[0, size) with both decoders and checks that they agree on
+   // the value, the bytes consumed and any error
+   template <typename Careful, typename Fast>
+   void check_same_decoding(const uint8_t* data, std::size_t size, Careful&& careful, Fast&& fast) {
+      guarded_ptr<uint8_t> gp0(const_cast<uint8_t*>(data), size);
+      guarded_ptr<uint8_t> gp1(const_cast<uint8_t*>(data), size);
+      int err0 = 0, err1 = 0;
+      int64_t v0 = 0, v1 = 0;
+      try { v0 = careful(gp0); } catch (wasm_parse_exception&) { err0 = 1; } catch (wasm_interpreter_exception&) { err0 = 2; }
+      try { v1 = fast(gp1); } catch (wasm_parse_exception&) { err1 = 1; } catch (wasm_interpreter_exception&) { err1 = 2; }
+      CHECK( err0 == err1 );
+      if (err0 == 0 && err1 == 0) {
+         CHECK( v0 == v1 );
+         CHECK( gp0.offset() == gp1.offset() );
+      }
+   }
+
+   void check_fast_decoders(const std::vector<uint8_t>& tv) {
+      for (std::size_t size = 0; size <= tv.size(); size++) {
+         check_same_decoding(tv.data(), size,
+                             [](auto& gp) { return varuint<32>(gp).to(); },
+                             [](auto& gp) { return read_varuint32(gp); });
+         check_same_decoding(tv.data(), size,
+                             [](auto& gp) { return varint<32>(gp).to(); },
+                             [](auto& gp) { return read_varint32(gp); });
+         check_same_decoding(tv.data(), size,
+                             [](auto& gp) { return varint<64>(gp).to(); },
+                             [](auto& gp) { return read_varint64(gp); });
+      }
+   }
+} // namespace
+
+TEST_CASE("Testing fast leb128 decoding", "[varint_tests]") {
+   // padded and over-long encodings and invalid unused bits
+   check_fast_decoders({ 0x80, 0x80, 0x80, 0x80, 0x00, 0, 0, 0, 0, 0, 0, 0 });
+   check_fast_decoders({ 0xff, 0xff, 0xff, 0xff, 0x0f, 0, 0, 0, 0, 0, 0, 0 });
+   check_fast_decoders({ 0xff, 0xff, 0xff, 0xff, 0x1f, 0, 0, 0, 0, 0, 0, 0 });
+   check_fast_decoders({ 0xff, 0xff, 0xff, 0xff, 0x7f, 0, 0, 0, 0, 0, 0, 0 });
+   check_fast_decoders({ 0xff, 0xff, 0xff, 0xff, 0x77, 0, 0, 0, 0, 0, 0, 0 });
+   check_fast_decoders({ 0x80, 0x80, 0x80, 0x80, 0x78, 0, 0, 0, 0, 0, 0, 0 });
+   check_fast_decoders({ 0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 0, 0, 0, 0, 0, 0 });
+   check_fast_decoders({ 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x7f, 0, 0, 0, 0 });
+   check_fast_decoders({ 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x7f, 0, 0 });
+   check_fast_decoders({ 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x01, 0, 0 });
+   check_fast_decoders({ 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0 });
+
+   std::srand(0x1eb128);
+   for (int i = 0; i < 2000; i++) {
+      std::vector<uint8_t> tv(12);
+      // Favour short encodings by clearing the continuation bit at a random byte
+      std::size_t end = std::rand() % tv.size();
+      for (std::size_t j = 0; j < tv.size(); j++)
+         tv[j] = (std::rand() & 0x7f) | (j < end ? 0x80 : (std::rand() & 0x80));
+      check_fast_decoders(tv);
+   }
+}
@@ -24,8 +24,8 @@ int main(int argc, char** argv) {
    watchdog wd{std::chrono::seconds(3)};
 
    try {
-      // Read the wasm into memory.
-      auto code = backend_t::read_wasm( argv[1] );
+      // Map the wasm into memory.
+      auto code = backend_t::map_wasm( argv[1] );
 
       // Instaniate a new backend using the wasm provided.
       backend_t bkend( code );
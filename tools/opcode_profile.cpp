@@ -0,0 +1,79 @@
+#include <eosio/vm/backend.hpp>
+#include <eosio/vm/debug_visitor.hpp>
+#include <eosio/vm/superinstructions.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <tuple>
+#include <vector>
+
+using namespace eosio;
+using namespace eosio::vm;
+
+/**
+ * Counts pairs of adjacent instructions in the interpreter's bitcode, to
+ * choose superinstructions for compile_options::superinstructions.
+ *
+ * usage: eos-vm-profile <wasm file> [exported function...]
+ *
+ * With only a wasm file, every instruction in the module is counted once.
+ * Otherwise the named functions, which must take no arguments, are run
+ * and each instruction is counted every time it executes.
+ */
+int main(int argc, char** argv) {
+   wasm_allocator wa;
+   using backend_t = eosio::vm::backend<nullptr_t>;
+
+   if (argc < 2) {
+      std::cerr << "Error, no wasm file provided\n";
+      return -1;
+   }
+
+   opcode_pair_profile profile;
+   try {
+      auto code = backend_t::read_wasm(argv[1]);
+
+      // The profile must see the instructions before they are fused.
+      compile_options options;
+      options.superinstructions = superinstruction_set::none();
+      backend_t bkend(code, nullptr, options);
+
+      if (argc == 2) {
+         module& mod = bkend.get_module();
+         for (uint32_t i = 0; i < mod.code.size(); ++i)
+            profile.add_code(mod.code[i].code, mod.code[i].size);
+      } else {
+         bkend.set_wasm_allocator(&wa);
+         bkend.initialize();
+         auto& ctx = bkend.get_context();
+         for (int i = 2; i < argc; ++i)
+            ctx.execute(nullptr, profile_visitor(ctx, profile), argv[i]);
+      }
+   } catch (const eosio::vm::exception& ex) {
+      std::cerr << "eos-vm interpreter error\n";
+      std::cerr << ex.what() << " : " << ex.detail() << "\n";
+      return -1;
+   }
+
+   opcode_utils u;
+   std::vector<std::tuple<uint64_t, uint8_t, uint8_t>> pairs;
+   for (uint32_t first = 0; first < 256; ++first)
+      for (uint32_t second = 0; second < 256; ++second)
+         if (uint64_t n = profile.count(first, second))
+            pairs.emplace_back(n, first, second);
+   std::sort(pairs.begin(), pairs.end(), [](const auto& lhs, const auto& rhs) { return lhs > rhs; });
+   std::cout << "Most frequent instruction pairs:\n";
+   for (std::size_t i = 0; i < pairs.size() && i < 40; ++i) {
+      auto [n, first, second] = pairs[i];
+      std::cout << "   " << n << "\t" << u.opcode_map[first] << " " << u.opcode_map[second] << "\n";
+   }
+
+   std::vector<std::pair<uint64_t, uint8_t>> saved;
+   for (const auto& pattern : superinstruction_patterns)
+      saved.emplace_back(profile.count(pattern) * (pattern.size - 1), pattern.opcode);
+   std::stable_sort(saved.begin(), saved.end(), [](const auto& lhs, const auto& rhs) { return lhs.first > rhs.first; });
+   std::cout << "Estimated dispatches saved by each superinstruction:\n";
+   for (const auto& [n, opcode] : saved)
+      std::cout << "   " << n << "\t" << u.opcode_map[opcode] << "\n";
+   return 0;
+}